@@ -0,0 +1,170 @@
+/**
+ * @file compile_bench.c
+ * @brief End-to-end compiler benchmark harness
+ *
+ * Runs the compiler on each input file in a child process and reports the
+ * best wall time over several runs, lines per second, peak resident memory
+ * of the child and the size of the output.
+ *
+ * Usage: compile_bench [-c compiler] [-n runs] file... [-- compiler options]
+ */
+
+#define _DEFAULT_SOURCE // wait4
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define BENCH_OUTPUT "bench/output/bench.cof"
+#define MAX_COMPILER_ARGS 32
+
+typedef struct {
+  double seconds; // Best wall time
+  long peak_rss;  // Largest child resident set, in KB
+  long output_size;
+  bool ok;
+} RunResult;
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long count_lines(const char* path, long* size) {
+  FILE* file = fopen(path, "rb");
+  if (!file) return -1;
+  
+  char buffer[65536];
+  long lines = 0;
+  size_t n;
+  *size = 0;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    for (size_t i = 0; i < n; i++) {
+      lines += buffer[i] == '\n';
+    }
+    *size += (long)n;
+  }
+  fclose(file);
+  return lines;
+}
+
+// Compile once in a child process; false if it could not run or failed
+static bool run_compiler(char** argv, double* seconds, long* peak_rss) {
+  fflush(stdout); // The child must not inherit buffered report lines
+  double start = now_seconds();
+  pid_t pid = fork();
+  if (pid < 0) return false;
+  
+  if (pid == 0) {
+    // Keep the compiler's own output out of the report
+    if (!freopen("/dev/null", "w", stdout)) _exit(127);
+    execv(argv[0], argv);
+    _exit(127);
+  }
+  
+  int status = 0;
+  struct rusage usage;
+  if (wait4(pid, &status, 0, &usage) < 0) return false;
+  *seconds = now_seconds() - start;
+  *peak_rss = usage.ru_maxrss;
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static RunResult bench_file(const char* compiler, const char* input, char** options,
+                            int option_count, int runs) {
+  char* argv[MAX_COMPILER_ARGS + 5];
+  int argc = 0;
+  argv[argc++] = (char*)compiler;
+  for (int i = 0; i < option_count; i++) {
+    argv[argc++] = options[i];
+  }
+  argv[argc++] = "-o";
+  argv[argc++] = BENCH_OUTPUT;
+  argv[argc++] = (char*)input;
+  argv[argc] = NULL;
+  
+  RunResult result = { 0.0, 0, 0, true };
+  for (int run = 0; run < runs; run++) {
+    double seconds = 0.0;
+    long peak_rss = 0;
+    if (!run_compiler(argv, &seconds, &peak_rss)) {
+      result.ok = false;
+      return result;
+    }
+    if (run == 0 || seconds < result.seconds) result.seconds = seconds;
+    if (peak_rss > result.peak_rss) result.peak_rss = peak_rss;
+  }
+  
+  struct stat st;
+  result.output_size = stat(BENCH_OUTPUT, &st) == 0 ? (long)st.st_size : -1;
+  return result;
+}
+
+int main(int argc, char** argv) {
+  const char* compiler = "bin/colc";
+  int runs = 3;
+  char* options[MAX_COMPILER_ARGS];
+  int option_count = 0;
+  const char** inputs = malloc(sizeof(char*) * argc);
+  int input_count = 0;
+  if (!inputs) return 1;
+  
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+      compiler = argv[++i];
+    } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      runs = atoi(argv[++i]);
+      if (runs < 1) runs = 1;
+    } else if (strcmp(argv[i], "--") == 0) {
+      for (i++; i < argc && option_count < MAX_COMPILER_ARGS; i++) {
+        options[option_count++] = argv[i];
+      }
+    } else {
+      inputs[input_count++] = argv[i];
+    }
+  }
+  
+  if (input_count == 0) {
+    fprintf(stderr, "Usage: compile_bench [-c compiler] [-n runs] file... [-- compiler options]\n");
+    free(inputs);
+    return 1;
+  }
+  
+  printf("%-28s %10s %10s %10s %12s %10s %12s\n", "input", "lines", "size KB", "time ms",
+         "lines/sec", "peak MB", "output KB");
+  
+  bool all_ok = true;
+  for (int i = 0; i < input_count; i++) {
+    long size = 0;
+    long lines = count_lines(inputs[i], &size);
+    const char* name = strrchr(inputs[i], '/') ? strrchr(inputs[i], '/') + 1 : inputs[i];
+    if (lines < 0) {
+      printf("%-28s could not read input\n", name);
+      all_ok = false;
+      continue;
+    }
+    
+    RunResult result = bench_file(compiler, inputs[i], options, option_count, runs);
+    if (!result.ok) {
+      printf("%-28s compilation failed\n", name);
+      all_ok = false;
+      continue;
+    }
+    
+    printf("%-28s %10ld %10.1f %10.2f %12.0f %10.1f %12.1f\n", name, lines, size / 1024.0,
+           result.seconds * 1000.0, lines / result.seconds, result.peak_rss / 1024.0,
+           result.output_size / 1024.0);
+  }
+  
+  free(inputs);
+  return all_ok ? 0 : 1;
+}
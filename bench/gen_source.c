@@ -0,0 +1,219 @@
+/**
+ * @file gen_source.c
+ * @brief Synthetic C source generator for compiler benchmarks
+ *
+ * Writes a translation unit of roughly the requested number of lines to
+ * stdout, using only constructs colc compiles. Each shape stresses one part
+ * of the compiler:
+ *
+ *   functions  many small functions calling each other (symbols, codegen)
+ *   nesting    deeply nested expressions (parser recursion, temporaries)
+ *   blocks     few functions with very long bodies (block lists, labels)
+ *   strings    many string literals, partly repeated (literal pool)
+ *   typedefs   chains of typedefs used throughout (typedef lookup)
+ *   mixed      all of the above in turn
+ *
+ * Usage: gen_source <shape> [lines] [seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NESTING_DEPTH 64       // Operators per nested expression
+#define BLOCK_STATEMENTS 2000  // Statements per function in the blocks shape
+#define STRING_VARIANTS 512    // Distinct literals before the strings shape repeats
+#define TYPEDEF_CHAIN 16       // Typedefs layered on top of each other
+
+static unsigned long rng_state = 1;
+
+// Small deterministic PRNG so the same seed always gives the same file
+static unsigned long next_random(void) {
+  rng_state = rng_state * 6364136223846793005UL + 1442695040888963407UL;
+  return rng_state >> 33;
+}
+
+static int random_below(int limit) {
+  return (int)(next_random() % (unsigned long)limit);
+}
+
+static long emit_helpers(void) {
+  printf("int bench_add(int a, int b) { return a + b; }\n");
+  printf("int bench_pick(int a, int b) { if (a > b) { return a; } return b; }\n");
+  return 2;
+}
+
+static long emit_functions(long lines, int unit) {
+  long written = 0;
+  int index = 0;
+  while (written < lines) {
+    printf("int fn%d_%d(int x, int y) {\n", unit, index);
+    printf("  int t = bench_add(x, y);\n");
+    printf("  if (t > %d) { t = t - y; } else { t = t + %d; }\n", random_below(100), random_below(10));
+    if (index > 0) {
+      printf("  t = t + fn%d_%d(t, x);\n", unit, random_below(index));
+    }
+    printf("  return t * %d;\n", 1 + random_below(7));
+    printf("}\n");
+    written += index > 0 ? 6 : 5;
+    index++;
+  }
+  return written;
+}
+
+static void emit_nested_expression(int depth) {
+  static const char* operators[] = { "+", "-", "*", "&", "|", "^" };
+  for (int i = 0; i < depth; i++) {
+    printf("(a %s ", operators[random_below(6)]);
+  }
+  printf("b");
+  for (int i = 0; i < depth; i++) {
+    printf(" %s %d)", operators[random_below(6)], random_below(1000));
+  }
+}
+
+static long emit_nesting(long lines, int unit) {
+  long written = 0;
+  int index = 0;
+  while (written < lines) {
+    printf("int nest%d_%d(int a, int b) {\n", unit, index);
+    printf("  int r = ");
+    emit_nested_expression(NESTING_DEPTH);
+    printf(";\n");
+    printf("  if (");
+    emit_nested_expression(NESTING_DEPTH / 4);
+    printf(" > 0) { r = r + 1; }\n");
+    printf("  return r;\n}\n");
+    written += 5;
+    index++;
+  }
+  return written;
+}
+
+static long emit_blocks(long lines, int unit) {
+  long written = 0;
+  int index = 0;
+  while (written < lines) {
+    printf("int block%d_%d(int x) {\n", unit, index);
+    printf("  int acc = 0;\n");
+    for (int i = 0; i < BLOCK_STATEMENTS && written < lines; i++) {
+      switch (random_below(4)) {
+        case 0:
+          printf("  int v%d = x + %d;\n", i, i);
+          printf("  acc = acc + v%d;\n", i);
+          written += 2;
+          break;
+        case 1:
+          printf("  if (acc > %d) { acc = acc - %d; }\n", random_below(5000), random_below(50));
+          written++;
+          break;
+        case 2:
+          printf("  { int w = acc * %d; acc = w / %d; }\n", 1 + random_below(5), 1 + random_below(5));
+          written++;
+          break;
+        default:
+          printf("  while (acc > %d) { acc = acc - %d; }\n", 10000 + random_below(1000), 1 + random_below(9));
+          written++;
+          break;
+      }
+    }
+    printf("  return acc;\n}\n");
+    written += 4;
+    index++;
+  }
+  return written;
+}
+
+static long emit_strings(long lines, int unit) {
+  long written = 0;
+  int index = 0;
+  while (written < lines) {
+    printf("int strings%d_%d(int x) {\n", unit, index);
+    for (int i = 0; i < 16; i++) {
+      int variant = random_below(STRING_VARIANTS);
+      printf("  char* s%d = \"benchmark string %d with some padding text\";\n", i, variant);
+    }
+    printf("  char* tail = \"padding text\";\n");
+    printf("  return x;\n}\n");
+    written += 20;
+    index++;
+  }
+  return written;
+}
+
+static long emit_typedefs(long lines, int unit) {
+  printf("typedef int td%d_0;\n", unit);
+  for (int i = 1; i < TYPEDEF_CHAIN; i++) {
+    printf("typedef td%d_%d td%d_%d;\n", unit, i - 1, unit, i);
+  }
+  printf("typedef td%d_%d* tdp%d;\n", unit, TYPEDEF_CHAIN - 1, unit);
+  long written = TYPEDEF_CHAIN + 1;
+  
+  int index = 0;
+  while (written < lines) {
+    int a = random_below(TYPEDEF_CHAIN);
+    int b = random_below(TYPEDEF_CHAIN);
+    printf("td%d_%d tfn%d_%d(td%d_%d p, td%d_%d q) {\n", unit, a, unit, index, unit, a, unit, b);
+    printf("  td%d_%d r = p + q;\n", unit, random_below(TYPEDEF_CHAIN));
+    printf("  tdp%d ptr = &r;\n", unit);
+    printf("  return *ptr;\n}\n");
+    written += 5;
+    index++;
+  }
+  return written;
+}
+
+typedef long (*ShapeFn)(long lines, int unit);
+
+static const struct {
+  const char* name;
+  ShapeFn emit;
+} shapes[] = {
+  { "functions", emit_functions },
+  { "nesting", emit_nesting },
+  { "blocks", emit_blocks },
+  { "strings", emit_strings },
+  { "typedefs", emit_typedefs },
+};
+
+#define SHAPE_COUNT ((int)(sizeof(shapes) / sizeof(shapes[0])))
+
+static void print_usage(void) {
+  fprintf(stderr, "Usage: gen_source <shape> [lines] [seed]\nShapes:");
+  for (int i = 0; i < SHAPE_COUNT; i++) {
+    fprintf(stderr, " %s", shapes[i].name);
+  }
+  fprintf(stderr, " mixed\n");
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    print_usage();
+    return 1;
+  }
+  
+  const char* shape = argv[1];
+  long lines = argc > 2 ? atol(argv[2]) : 100000;
+  rng_state = argc > 3 ? strtoul(argv[3], NULL, 10) : 1;
+  
+  printf("/* Generated by gen_source: shape %s, %ld lines */\n", shape, lines);
+  lines -= emit_helpers();
+  
+  if (strcmp(shape, "mixed") == 0) {
+    long per_shape = lines / (SHAPE_COUNT * 4);
+    for (int unit = 0; lines > 0; unit++) {
+      lines -= shapes[unit % SHAPE_COUNT].emit(per_shape > 0 ? per_shape : 1, unit);
+    }
+    return 0;
+  }
+  
+  for (int i = 0; i < SHAPE_COUNT; i++) {
+    if (strcmp(shape, shapes[i].name) == 0) {
+      shapes[i].emit(lines, 0);
+      return 0;
+    }
+  }
+  
+  print_usage();
+  return 1;
+}
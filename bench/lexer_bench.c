@@ -0,0 +1,105 @@
+/**
+ * @file lexer_bench.c
+ * @brief Lexer throughput micro-benchmark
+ *
+ * Replicates a source file until it reaches the requested size, tokenizes
+ * it and reports tokens per second.
+ *
+ * Usage: lexer_bench [file] [size in MB] [iterations]
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "../include/lexer.h"
+#include "../include/arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static char* read_file(const char* filename, size_t* size) {
+  FILE* file = fopen(filename, "rb");
+  if (!file) return NULL;
+  
+  fseek(file, 0, SEEK_END);
+  long length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  
+  char* buffer = malloc(length + 1);
+  if (!buffer) {
+    fclose(file);
+    return NULL;
+  }
+  
+  *size = fread(buffer, 1, length, file);
+  buffer[*size] = '\0';
+  fclose(file);
+  return buffer;
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv) {
+  const char* filename = argc > 1 ? argv[1] : "test/sample.c";
+  size_t target_size = (size_t)(argc > 2 ? atof(argv[2]) : 4.0) * 1024 * 1024;
+  int iterations = argc > 3 ? atoi(argv[3]) : 5;
+  
+  size_t unit_size;
+  char* unit = read_file(filename, &unit_size);
+  if (!unit || unit_size == 0) {
+    fprintf(stderr, "Error: Failed to read '%s'\n", filename);
+    return 1;
+  }
+  
+  // Scale the input by repeating the file
+  size_t copies = target_size / unit_size + 1;
+  size_t source_size = copies * (unit_size + 1);
+  char* source = malloc(source_size + 1);
+  if (!source) {
+    fprintf(stderr, "Error: Out of memory\n");
+    return 1;
+  }
+  for (size_t i = 0; i < copies; i++) {
+    memcpy(source + i * (unit_size + 1), unit, unit_size);
+    source[i * (unit_size + 1) + unit_size] = '\n';
+  }
+  source[source_size] = '\0';
+  
+  double best = 0.0;
+  size_t tokens = 0;
+  
+  for (int iter = 0; iter < iterations; iter++) {
+    Arena* arena = arena_create(1024 * 1024);
+    
+    double start = now_seconds();
+    Lexer* lexer = lexer_create(source, filename, arena);
+    tokens = 0;
+    for (Token token = lexer_peek_token(lexer); token.type != TOKEN_EOF && !lexer->has_error;
+         token = lexer_next_token(lexer)) {
+      tokens++;
+    }
+    double elapsed = now_seconds() - start;
+    
+    if (lexer->has_error) {
+      fprintf(stderr, "Error: %s\n", lexer_error(lexer));
+      return 1;
+    }
+    
+    if (iter == 0 || elapsed < best) best = elapsed;
+    arena_destroy(arena);
+  }
+  
+  printf("input:  %s x %zu (%.2f MB)\n", filename, copies, source_size / (1024.0 * 1024.0));
+  printf("tokens: %zu\n", tokens);
+  printf("time:   %.3f ms (best of %d)\n", best * 1000.0, iterations);
+  printf("rate:   %.2f Mtokens/sec, %.2f MB/sec\n",
+         tokens / best / 1e6, source_size / best / (1024.0 * 1024.0));
+  
+  free(source);
+  free(unit);
+  return 0;
+}
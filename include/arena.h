@@ -9,16 +9,37 @@
 #include <stddef.h>
 #include <stdbool.h>
 
+#define ARENA_DEFAULT_ALIGNMENT 8
+#define ARENA_MAX_BLOCK_SIZE (64 * 1024 * 1024) // Geometric growth stops here
+#define ARENA_ARRAY_INITIAL_CAPACITY 8
+
+// Flags for arena_create_ex
+#define ARENA_FLAG_MMAP       0x01 // Back blocks with anonymous mmap instead of malloc
+#define ARENA_FLAG_HUGE_PAGES 0x02 // Like ARENA_FLAG_MMAP, and ask for transparent huge pages
+
 /**
  * @brief Memory block in the arena
+ * 
+ * The header and the memory it manages come from a single allocation; the
+ * usable bytes follow the header directly.
  */
 typedef struct ArenaBlock {
-  void* memory;
-  size_t size;
-  size_t used;
   struct ArenaBlock* next;
+  size_t size;    // Usable bytes in data
+  size_t used;
+  bool mapped;    // Allocated with mmap (size of the mapping is header + size)
+  unsigned char data[];
 } ArenaBlock;
 
+/**
+ * @brief Callback run when the arena is reset or destroyed
+ */
+typedef struct ArenaCleanup {
+  void (*fn)(void* data);
+  void* data;
+  struct ArenaCleanup* next;
+} ArenaCleanup;
+
 /**
  * @brief Memory arena for efficient allocations with bulk free
  */
@@ -26,10 +47,27 @@ typedef struct Arena {
   ArenaBlock* first;
   ArenaBlock* current;
   size_t initial_block_size;
+  size_t next_block_size; // Size of the next regular block (doubles each time)
+  size_t alignment;       // Alignment used by arena_alloc
+  unsigned int flags;
   size_t total_allocated;
   size_t total_used;
+  size_t retain_limit;    // Block bytes kept across arena_reset
+  ArenaCleanup* cleanups; // Most recently registered first
+  struct Arena* scratch;  // Lazily created by arena_scratch
 } Arena;
 
+/**
+ * @brief Saved allocation position, see arena_mark and arena_rewind
+ */
+typedef struct {
+  ArenaBlock* block;      // Current block when the mark was taken
+  size_t used;            // Its fill level
+  ArenaBlock* first;      // Chain head (dedicated blocks are pushed in front)
+  size_t total_used;
+  ArenaCleanup* cleanups;
+} ArenaMark;
+
 /**
  * @brief Create a new memory arena with initial capacity
  * @param initial_capacity Initial capacity in bytes
@@ -37,6 +75,15 @@ typedef struct Arena {
  */
 Arena* arena_create(size_t initial_capacity);
 
+/**
+ * @brief Create a new memory arena with explicit alignment and backing
+ * @param initial_capacity Initial capacity in bytes
+ * @param alignment Default alignment for arena_alloc (power of two)
+ * @param flags ARENA_FLAG_* options
+ * @return Newly created arena
+ */
+Arena* arena_create_ex(size_t initial_capacity, size_t alignment, unsigned int flags);
+
 /**
  * @brief Allocate memory from an arena
  * @param arena The arena to allocate from
@@ -45,6 +92,15 @@ Arena* arena_create(size_t initial_capacity);
  */
 void* arena_alloc(Arena* arena, size_t size);
 
+/**
+ * @brief Allocate memory with a specific alignment
+ * @param arena The arena to allocate from
+ * @param size Size in bytes to allocate
+ * @param alignment Required alignment (power of two, e.g. 16 or 64 for SIMD)
+ * @return Pointer to allocated memory
+ */
+void* arena_alloc_aligned(Arena* arena, size_t size, size_t alignment);
+
 /**
  * @brief Allocate zeroed memory from an arena
  * @param arena The arena to allocate from
@@ -53,6 +109,40 @@ void* arena_alloc(Arena* arena, size_t size);
  */
 void* arena_calloc(Arena* arena, size_t size);
 
+/**
+ * @brief Resize an allocation
+ * 
+ * If ptr is the most recent allocation in the current block and the block
+ * has room, the allocation is extended in place; otherwise the contents are
+ * copied to a new allocation. Memory given up by shrinking is not reused.
+ * 
+ * @param arena The arena ptr was allocated from
+ * @param ptr Allocation to resize (NULL allocates)
+ * @param old_size Current size of the allocation in bytes
+ * @param new_size Requested size in bytes
+ * @return Pointer to the resized allocation
+ */
+void* arena_realloc(Arena* arena, void* ptr, size_t old_size, size_t new_size);
+
+/**
+ * @brief Grow an arena-backed array geometrically
+ * 
+ * Doubles *capacity (starting at ARENA_ARRAY_INITIAL_CAPACITY) and returns
+ * the array with its elements preserved, extended in place when possible.
+ * Callers grow when their count reaches *capacity:
+ * 
+ *   if (count == capacity) {
+ *     items = arena_grow_array(arena, items, &capacity, sizeof(*items));
+ *   }
+ * 
+ * @param arena The arena the array lives in
+ * @param items Current array (NULL when *capacity is 0)
+ * @param capacity In: current capacity in elements; out: new capacity
+ * @param item_size Size of one element in bytes
+ * @return The grown array
+ */
+void* arena_grow_array(Arena* arena, void* items, int* capacity, size_t item_size);
+
 /**
  * @brief Allocate and copy a string into the arena
  * @param arena The arena to allocate from
@@ -61,12 +151,68 @@ void* arena_calloc(Arena* arena, size_t size);
  */
 char* arena_strdup(Arena* arena, const char* str);
 
+/**
+ * @brief Register a callback that releases an external resource with the arena
+ * 
+ * Callbacks run in reverse registration order on arena_reset and
+ * arena_destroy, for resources (such as file mappings) whose lifetime
+ * should match the allocations that point into them.
+ * 
+ * @param arena The arena that owns the resource
+ * @param fn Function that releases the resource
+ * @param data Argument passed to fn
+ */
+void arena_add_cleanup(Arena* arena, void (*fn)(void* data), void* data);
+
+/**
+ * @brief Remember the current allocation position
+ * @param arena The arena to mark
+ * @return Mark to pass to arena_rewind
+ */
+ArenaMark arena_mark(Arena* arena);
+
+/**
+ * @brief Free everything allocated since a mark
+ * 
+ * Blocks filled since the mark stay in the arena for reuse, and cleanups
+ * registered since the mark are run. Marks must be rewound in LIFO order
+ * and become invalid when the arena is reset.
+ * 
+ * @param arena The arena the mark was taken from
+ * @param mark Value returned by arena_mark
+ */
+void arena_rewind(Arena* arena, ArenaMark mark);
+
+/**
+ * @brief Get a scratch arena for short-lived allocations
+ * 
+ * The scratch arena is created on first use and belongs to the parent: it is
+ * reset and destroyed along with it. Callers bracket their temporaries with
+ * arena_mark/arena_rewind on the scratch arena and copy out whatever must
+ * outlive them, so growth buffers never pile up in the parent.
+ * 
+ * @param arena The parent arena
+ * @return Scratch arena, or NULL if it could not be created
+ */
+Arena* arena_scratch(Arena* arena);
+
 /**
  * @brief Reset an arena, freeing all allocations at once
+ * 
+ * Blocks are kept for reuse, up to the arena's retain limit; the rest are
+ * returned to the system. Later allocations refill the kept blocks in order.
+ * 
  * @param arena The arena to reset
  */
 void arena_reset(Arena* arena);
 
+/**
+ * @brief Bound the memory an arena keeps warm across resets
+ * @param arena The arena to configure
+ * @param max_bytes Total block size to retain (the first block is always kept)
+ */
+void arena_set_retain_limit(Arena* arena, size_t max_bytes);
+
 /**
  * @brief Destroy an arena, freeing all memory
  * @param arena The arena to destroy
@@ -81,4 +227,4 @@ void arena_destroy(Arena* arena);
  */
 void arena_stats(Arena* arena, size_t* total_allocated, size_t* total_used);
 
-#endif /* ARENA_H */
\ No newline at end of file
+#endif /* ARENA_H */
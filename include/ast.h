@@ -7,22 +7,51 @@
 #define AST_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 // Forward declarations
+struct Arena;
 typedef struct Expr Expr;
 typedef struct Stmt Stmt;
 typedef struct Type Type;
 typedef struct Decl Decl;
 
 /**
- * @brief Source location for error reporting
+ * @brief Reference to an expression or statement: its index in the
+ * program's pool (see AstPool)
+ * 
+ * Index 0 is never handed out, so AST_NONE marks a missing child the way
+ * a NULL pointer does. ast_expr and ast_stmt turn a reference into the node.
  */
+typedef uint32_t ExprRef;
+typedef uint32_t StmtRef;
+
+#define AST_NONE 0
+
+/**
+ * @brief Source location stored in tokens and AST nodes
+ * 
+ * Only the start of the construct is kept; the file name, line and column
+ * are recovered with lexer_resolve_location when a diagnostic needs them.
+ */
+#define SOURCE_FILE_MAIN 0 // File ID of the translation unit being compiled
+
 typedef struct {
-  const char* file;
-  int line;
-  int column;
+  uint32_t file_id; // File of the compilation (SOURCE_FILE_MAIN for the input itself)
+  uint32_t offset;  // Byte offset into the source
 } SourceLocation;
 
+/**
+ * @brief Source location with file name, line and column filled in
+ */
+typedef struct {
+  const char* file;
+  unsigned int offset;
+  int line;   // 1-based
+  int column; // 1-based
+} ResolvedLocation;
+
 /**
  * @brief Token types for C language
  */
@@ -58,6 +87,8 @@ typedef enum {
   TOKEN_AMPERSAND_EQUAL, // &=
   TOKEN_PIPE_EQUAL,  // |=
   TOKEN_CARET_EQUAL, // ^=
+  TOKEN_LESS_LESS_EQUAL, // <<=
+  TOKEN_GREATER_GREATER_EQUAL, // >>=
   TOKEN_EQUAL_EQUAL, // ==
   TOKEN_EXCLAIM_EQUAL, // !=
   TOKEN_LESS_EQUAL,  // <=
@@ -118,6 +149,17 @@ typedef enum {
   TOKEN_WHILE
 } TokenType;
 
+/**
+ * @brief Value carried by literal and identifier tokens
+ */
+typedef union {
+  long long int_value;
+  double float_value;
+  char* string_value;
+  char char_value;
+  const char* identifier; // Interned spelling of identifiers
+} TokenValue;
+
 /**
  * @brief Token structure representing a lexical unit
  */
@@ -128,12 +170,7 @@ typedef struct {
   SourceLocation location;
   
   // Value for literals
-  union {
-    long long int_value;
-    double float_value;
-    char* string_value;
-    char char_value;
-  } value;
+  TokenValue value;
 } Token;
 
 /**
@@ -161,10 +198,10 @@ typedef enum {
  */
 struct Type {
   TypeKind kind;
+  SourceLocation location;
   bool is_const;
   bool is_volatile;
   bool is_signed;
-  SourceLocation location;
   
   union {
     // For pointer types
@@ -195,7 +232,7 @@ struct Type {
     struct {
       Type* return_type;
       Type** param_types;
-      char** param_names;
+      const char** param_names;
       int param_count;
       bool is_variadic;
     } function;
@@ -237,19 +274,18 @@ typedef enum {
  */
 struct Expr {
   ExprType type;
-  Type* result_type;  // Type after semantic analysis
   SourceLocation location;
   
   union {
     struct {
-      Expr* left;
+      ExprRef left;
       TokenType operator;
-      Expr* right;
+      ExprRef right;
     } binary;
     
     struct {
       TokenType operator;
-      Expr* operand;
+      ExprRef operand;
       bool is_postfix;
     } unary;
     
@@ -270,41 +306,41 @@ struct Expr {
     } char_literal;
     
     struct {
-      char* name;
+      const char* name; // Interned
     } identifier;
     
     struct {
-      Expr* function;
-      Expr** arguments;
+      ExprRef* arguments;
+      ExprRef function;
       int arg_count;
     } call;
     
     struct {
-      Expr* array;
-      Expr* index;
+      ExprRef array;
+      ExprRef index;
     } index;
     
     struct {
-      Expr* object;
-      char* field;
+      const char* field; // Interned
+      ExprRef object;
       bool is_arrow; // true for -> operator, false for . operator
     } field;
     
     struct {
-      Expr* target;
+      ExprRef target;
       TokenType operator; // =, +=, -=, etc.
-      Expr* value;
+      ExprRef value;
     } assign;
     
     struct {
-      Expr* condition;
-      Expr* true_expr;
-      Expr* false_expr;
+      ExprRef condition;
+      ExprRef true_expr;
+      ExprRef false_expr;
     } conditional;
     
     struct {
       Type* type;
-      Expr* expr;
+      ExprRef expr;
     } cast;
     
     struct {
@@ -341,42 +377,44 @@ struct Stmt {
   
   union {
     struct {
-      Expr* expr;
+      ExprRef expr;
     } expr;
     
     struct {
-      Stmt** statements;
+      StmtRef* statements;
       int count;
     } block;
     
     struct {
-      Expr* condition;
-      Stmt* then_branch;
-      Stmt* else_branch;
+      ExprRef condition;
+      StmtRef then_branch;
+      StmtRef else_branch;
+      int profile_counter; // First of its two, numbered before folding (see profile.h)
     } if_stmt;
     
     struct {
-      Expr* condition;
-      Stmt** cases;
+      StmtRef* cases;
+      ExprRef condition;
       int case_count;
-      Stmt* default_case; // NULL if no default
+      StmtRef default_case; // AST_NONE if no default
     } switch_stmt;
     
     struct {
-      Expr* condition;
-      Stmt* body;
+      ExprRef condition;
+      StmtRef body;
+      int profile_counter; // Numbered before folding (see profile.h)
     } while_stmt;
     
     struct {
-      Stmt* body;
-      Expr* condition;
+      StmtRef body;
+      ExprRef condition;
     } do_while_stmt;
     
     struct {
-      Stmt* init; // Can be NULL
-      Expr* condition; // Can be NULL
-      Expr* update; // Can be NULL
-      Stmt* body;
+      StmtRef init; // Can be AST_NONE
+      ExprRef condition; // Can be AST_NONE
+      ExprRef update; // Can be AST_NONE
+      StmtRef body;
     } for_stmt;
     
     struct {
@@ -385,11 +423,11 @@ struct Stmt {
     
     struct {
       char* name;
-      Stmt* statement;
+      StmtRef statement;
     } label_stmt;
     
     struct {
-      Expr* value; // Can be NULL for void return
+      ExprRef value; // Can be AST_NONE for void return
     } return_stmt;
     
     struct {
@@ -415,20 +453,21 @@ typedef enum {
  */
 struct Decl {
   DeclType type;
-  char* name;
   SourceLocation location;
   bool is_extern;
   bool is_static;
+  const char* name; // Interned
   Type* declared_type;
   
   union {
     struct {
-      Expr* initializer; // Can be NULL
+      ExprRef initializer; // Can be AST_NONE
     } var;
     
     struct {
-      char** param_names;
-      Stmt* body; // NULL for declarations without body
+      const char** param_names;
+      StmtRef body; // AST_NONE for declarations without body
+      int profile_counters; // Set by profile_number_counters
     } func;
     
     struct {
@@ -449,14 +488,60 @@ struct Decl {
   } as;
 };
 
+/**
+ * @brief Arena-backed pool of one kind of AST node, addressed by index
+ * 
+ * Nodes are handed out in chunks of AST_POOL_CHUNK_SIZE that never move,
+ * so a pointer from ast_expr or ast_stmt stays valid while the tree grows.
+ * Nodes of one kind sit next to each other instead of between the lists,
+ * strings and types the parser allocates, and children are referenced by
+ * 32-bit index instead of 64-bit pointer.
+ */
+#define AST_POOL_CHUNK_BITS 10
+#define AST_POOL_CHUNK_SIZE (1u << AST_POOL_CHUNK_BITS)
+
+typedef struct {
+  void** chunks;
+  int chunk_count;
+  int chunk_capacity;
+  uint32_t count; // Next index to hand out; 0 is reserved for AST_NONE
+} AstPool;
+
 /**
  * @brief Complete AST for a C program
  */
 typedef struct {
   Decl** declarations;
   int count;
+  int capacity;
+  
+  // Token index where each declaration starts, then one past the last
+  // declaration (count + 1 entries; NULL unless parsed from a TokenArray)
+  int* token_starts;
+  
+  // Every expression and statement node of the program
+  AstPool exprs;
+  AstPool stmts;
 } Program;
 
+/**
+ * @brief Node of an expression reference (NULL for AST_NONE)
+ */
+static inline Expr* ast_expr(const Program* program, ExprRef ref) {
+  if (ref == AST_NONE) return NULL;
+  return (Expr*)program->exprs.chunks[ref >> AST_POOL_CHUNK_BITS] +
+         (ref & (AST_POOL_CHUNK_SIZE - 1));
+}
+
+/**
+ * @brief Node of a statement reference (NULL for AST_NONE)
+ */
+static inline Stmt* ast_stmt(const Program* program, StmtRef ref) {
+  if (ref == AST_NONE) return NULL;
+  return (Stmt*)program->stmts.chunks[ref >> AST_POOL_CHUNK_BITS] +
+         (ref & (AST_POOL_CHUNK_SIZE - 1));
+}
+
 /**
  * @brief Create a new program AST node
  * @param arena Memory arena for allocation
@@ -473,22 +558,26 @@ Program* ast_create_program(struct Arena* arena);
 void ast_add_declaration(Program* program, Decl* decl, struct Arena* arena);
 
 /**
- * @brief Create a new expression node
+ * @brief Create a new expression node in a program's pool
+ * @param program The program that owns the node
  * @param type Expression type
  * @param location Source location
- * @param arena Memory arena for allocation
- * @return New expression node
+ * @param arena Memory arena for a new pool chunk
+ * @return Reference to the new node (see ast_expr)
  */
-Expr* ast_create_expr(ExprType type, SourceLocation location, struct Arena* arena);
+ExprRef ast_create_expr(Program* program, ExprType type, SourceLocation location,
+                        struct Arena* arena);
 
 /**
- * @brief Create a new statement node
+ * @brief Create a new statement node in a program's pool
+ * @param program The program that owns the node
  * @param type Statement type
  * @param location Source location
- * @param arena Memory arena for allocation
- * @return New statement node
+ * @param arena Memory arena for a new pool chunk
+ * @return Reference to the new node (see ast_stmt)
  */
-Stmt* ast_create_stmt(StmtType type, SourceLocation location, struct Arena* arena);
+StmtRef ast_create_stmt(Program* program, StmtType type, SourceLocation location,
+                        struct Arena* arena);
 
 /**
  * @brief Create a new type node
@@ -502,7 +591,7 @@ Type* ast_create_type(TypeKind kind, SourceLocation location, struct Arena* aren
 /**
  * @brief Create a new declaration node
  * @param type Declaration type
- * @param name Identifier name
+ * @param name Identifier name (interned, stored without copying)
  * @param location Source location
  * @param arena Memory arena for allocation
  * @return New declaration node
@@ -0,0 +1,94 @@
+/**
+ * @file buffer.h
+ * @brief Growable in-memory byte buffer used as the COIL emission sink
+ */
+
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Forward declaration for Arena
+struct Arena;
+
+/**
+ * @brief Contiguous byte buffer backed by an arena
+ *
+ * The buffer doubles its capacity when full, so emitting n bytes costs O(n)
+ * copying in total. Because the bytes stay in memory until flushed, later
+ * passes can patch already emitted data in place.
+ */
+typedef struct {
+  uint8_t* data;
+  size_t size;
+  size_t capacity;
+  struct Arena* arena;
+  bool has_error;
+} CoilBuffer;
+
+/**
+ * @brief Create a new buffer
+ * @param arena Memory arena for allocations
+ * @param initial_capacity Initial capacity in bytes
+ * @return New buffer, or NULL on allocation failure
+ */
+CoilBuffer* coil_buffer_create(struct Arena* arena, size_t initial_capacity);
+
+/**
+ * @brief Ensure there is room for additional bytes
+ * @param buffer The buffer to grow
+ * @param additional Number of bytes about to be written
+ * @return True if the space is available
+ */
+bool coil_buffer_reserve(CoilBuffer* buffer, size_t additional);
+
+/**
+ * @brief Append bytes to the end of the buffer
+ * @param buffer The buffer to write to
+ * @param data Bytes to append
+ * @param size Number of bytes
+ */
+void coil_buffer_write(CoilBuffer* buffer, const void* data, size_t size);
+
+/**
+ * @brief Append a single byte to the end of the buffer
+ * @param buffer The buffer to write to
+ * @param byte Byte to append
+ */
+void coil_buffer_write_byte(CoilBuffer* buffer, uint8_t byte);
+
+/**
+ * @brief Append an unsigned LEB128 value (7 bits per byte, low bits first)
+ * @param buffer The buffer to write to
+ * @param value Value to encode; values below 128 take one byte
+ */
+void coil_buffer_write_uleb128(CoilBuffer* buffer, uint64_t value);
+
+/**
+ * @brief Append a signed LEB128 value
+ * @param buffer The buffer to write to
+ * @param value Value to encode; values in [-64, 63] take one byte
+ */
+void coil_buffer_write_sleb128(CoilBuffer* buffer, int64_t value);
+
+/**
+ * @brief Overwrite previously emitted bytes
+ * @param buffer The buffer to patch
+ * @param offset Byte offset of the first byte to overwrite
+ * @param data Replacement bytes
+ * @param size Number of bytes; offset + size must not exceed the buffer size
+ */
+void coil_buffer_patch(CoilBuffer* buffer, size_t offset, const void* data, size_t size);
+
+/**
+ * @brief Write the buffer contents to a file in a single call
+ * @param buffer The buffer to flush
+ * @param output Output file
+ * @return True if all bytes were written and no allocation failed
+ */
+bool coil_buffer_flush(CoilBuffer* buffer, FILE* output);
+
+#endif /* BUFFER_H */
@@ -7,21 +7,29 @@
 #define CODEGEN_H
 
 #include "ast.h"
+#include "buffer.h"
+#include "literal.h"
 #include <stdio.h>
 #include <stdint.h>
 
-// Forward declaration for Arena
+// Forward declarations
 struct Arena;
+struct Peephole;
+struct FunctionCache;
+struct CachedFunction;
+struct InlineFrame;
+struct Profile;
 
 /**
  * @brief Symbol information for code generation
  */
 typedef struct {
-  char* name;
+  const char* name; // Interned
   Type* type;
   int scope_level;
   bool is_global;
   int var_id;  // COIL variable ID (for locals)
+  int symbol_index; // Index in the symbol section (for globals)
 } Symbol;
 
 /**
@@ -29,20 +37,66 @@ typedef struct {
  */
 typedef struct SymbolEntry {
   Symbol symbol;
-  struct SymbolEntry* next;
+  unsigned int hash;              // Cached hash of symbol.name
+  struct SymbolEntry* next;       // Next entry in the same bucket (older or outer)
+  struct SymbolEntry* scope_next; // Next entry on the scope stack (older or outer)
 } SymbolEntry;
 
 /**
  * @brief Symbol table for code generation
+ * 
+ * Entries are kept newest first both in their bucket and on the scope
+ * stack, so the innermost declaration of a name is always the first match
+ * in its chain and leaving a scope only pops entries off the chain heads.
  */
-typedef struct {
+typedef struct SymbolTable {
   SymbolEntry** buckets;
-  int bucket_count;
+  int bucket_count;           // Always a power of two
   int size;
   int current_scope;
+  int lookup_floor;           // Lookups skip scopes 1 .. lookup_floor-1 (a caller's, while inlining)
+  SymbolEntry* scope_stack;   // Every live entry, innermost scope first
+  SymbolEntry* free_entries;  // Entries released by scope exit, reused by add
   struct Arena* arena;
 } SymbolTable;
 
+#define CODEGEN_LABEL_UNBOUND UINT32_MAX
+
+// Flags of a symbol section entry
+#define SYMBOL_FLAG_FUNCTION 0x01
+#define SYMBOL_FLAG_DEFINED  0x02 // Defined in this unit (not just declared or extern)
+#define SYMBOL_FLAG_STATIC   0x04 // Internal linkage
+
+#define SYMBOL_NO_CODE UINT32_MAX // Code offset of a symbol without code in this unit
+
+/**
+ * @brief Entry of the symbol section emitted by codegen
+ */
+typedef struct {
+  const char* name; // Interned
+  uint8_t flags;    // SYMBOL_FLAG_*
+  uint8_t type;     // COIL type of the object, or of the return value for functions
+  Decl* inline_decl; // Definition calls are inlined from at -O2 and above, or NULL
+  uint32_t code_offset; // Start of a defined function in the code section, or SYMBOL_NO_CODE
+  int profile_base;     // Symbol index of a function's first profile counter, or -1
+} GlobalSymbol;
+
+/**
+ * @brief Label operand waiting for its target offset
+ */
+typedef struct {
+  size_t offset; // Position of the operand's 32-bit target in the buffer
+  int label;
+} LabelFixup;
+
+/**
+ * @brief Debug section entry: where the code of a statement starts
+ */
+typedef struct {
+  uint32_t code_offset;   // Offset in the code section
+  uint32_t source_offset; // Byte offset of the statement in the source file
+} DebugEntry;
+
 /**
  * @brief COIL instruction opcodes (from ISA.md)
  */
@@ -136,22 +190,109 @@ typedef struct {
   SymbolTable* symbols;
   struct Arena* arena;
   FILE* output;
+  CoilBuffer* buffer; // Emitted code not yet written to output
+  size_t flushed;     // Bytes written to output before the buffer (streamed compilations)
   
   // Code generation state
   int var_counter;
   int label_counter;
+  
+  // Labels of the current function, resolved by backpatching (scratch arena)
+  uint32_t* label_offsets; // Per label ID from label_base: bound byte offset, or CODEGEN_LABEL_UNBOUND
+  int label_capacity;
+  int label_base;          // First label ID of the current function
+  LabelFixup* fixups;
+  int fixup_count;
+  int fixup_capacity;
   int current_scope;
+  Decl* current_function;
   Type* current_function_return_type;
+  int optimization_level;
+  bool emit_debug_info;  // Fill the debug section
+  bool compact_operands; // LEB128 operand data (COF_FLAG_VARINT_OPERANDS)
+  size_t code_start;     // File offset of the code section
+  size_t header_offset;  // File offset of the COF header, filled in by codegen_finish
+  
+  // Temporary recycling (active at -O1 and above)
+  int* free_temps;      // Stack of dead temporaries available for reuse
+  int free_temp_count;
+  int free_temp_capacity;
+  uint8_t* temp_states; // Per var ID from temp_base: whether it is a live or free temporary
+  int temp_state_capacity;
+  int temp_base;        // First var ID of the current function
+  
+  // String literals, emitted as the read-only data section
+  LiteralPool* literals;
+  
+  // Globals referenced by index with OPQUAL_SYM, emitted as the symbol section
+  GlobalSymbol* globals;
+  int global_count;
+  int global_capacity;
   
-  // String table for literals
-  char** string_literals;
-  int string_count;
+  // Statement start offsets, emitted as the debug section
+  DebugEntry* debug_entries;
+  int debug_count;
+  int debug_capacity;
+  
+  // Peephole optimizer, run on each function at -O2 and above (NULL otherwise)
+  struct Peephole* peephole;
+  
+  // Instructions emitted per opcode, for -stats (NULL when not collected)
+  uint32_t* opcode_counts;
+  
+  // Function cache: top-level functions with an unchanged key are copied
+  // from it instead of generated (NULL when disabled)
+  struct FunctionCache* cache;
+  uint64_t* cache_keys;     // Per top-level declaration, 0 if not cacheable
+  uint64_t cache_key;       // Key of the function being generated; nonzero captures it
+  struct CachedFunction* captured; // That function as a relocatable fragment, or NULL
+  int* literal_uses;        // Literal IDs it added, in order (scratch arena)
+  int literal_use_count;
+  int literal_use_capacity;
+  
+  // Threads for function bodies; above 1, codegen_generate fans them out
+  int jobs;
+  
+  // Function bodies being inlined into the current function, innermost first
+  struct InlineFrame* inline_frames;
+  
+  // Loop optimizations (-O2 and above): values the enclosing loops computed
+  // in their preheaders, and the induction steps that update them (scratch arena)
+  struct LoopValue* loop_values;
+  int loop_value_count;
+  int loop_value_capacity;
+  struct LoopStep* loop_steps;
+  int loop_step_count;
+  int loop_step_capacity;
+  int loop_zero;                    // Var ID holding 0 for comparisons against zero, or -1
+  struct LoopNames* loop_addresses; // Address-taken locals of loop_function
+  Decl* loop_function;
+  
+  // Profile-guided optimization: counters added with -fprofile-generate,
+  // or the counts read with -fprofile-use (NULL without either)
+  struct Profile* profile;
+  const uint64_t* profile_counts; // Counts of the current function, or NULL
+  int profile_base;               // Symbol index of its first counter, or -1
   
   // Error handling
   bool has_error;
   char* error_message;
 } CodeGenerator;
 
+/**
+ * @brief Code section offset of a buffer position
+ */
+static inline uint32_t codegen_code_offset(const CodeGenerator* gen, size_t position) {
+  return (uint32_t)(gen->flushed + position - gen->code_start);
+}
+
+/**
+ * @brief Buffer position of a code section offset that has not been flushed yet
+ */
+static inline size_t codegen_buffer_position(const CodeGenerator* gen, uint32_t offset) {
+  return gen->code_start + offset - gen->flushed;
+}
+
 /**
  * @brief Initialize a symbol table
  * @param arena Memory arena for allocations
@@ -167,6 +308,9 @@ void symbol_table_enter_scope(SymbolTable* table);
 
 /**
  * @brief Exit the current scope in the symbol table
+ * 
+ * Every symbol declared in the scope is removed from the table.
+ * 
  * @param table Symbol table
  */
 void symbol_table_exit_scope(SymbolTable* table);
@@ -174,7 +318,7 @@ void symbol_table_exit_scope(SymbolTable* table);
 /**
  * @brief Add a symbol to the symbol table
  * @param table Symbol table
- * @param name Symbol name
+ * @param name Symbol name (interned)
  * @param type Symbol type
  * @param is_global Whether the symbol is global
  * @param var_id COIL variable ID for the symbol (for locals)
@@ -185,7 +329,7 @@ Symbol* symbol_table_add(SymbolTable* table, const char* name, Type* type, bool
 /**
  * @brief Look up a symbol in the symbol table
  * @param table Symbol table
- * @param name Symbol name
+ * @param name Symbol name (interned)
  * @return Found symbol, or NULL if not found
  */
 Symbol* symbol_table_lookup(SymbolTable* table, const char* name);
@@ -200,12 +344,88 @@ Symbol* symbol_table_lookup(SymbolTable* table, const char* name);
 CodeGenerator* codegen_create(Program* program, FILE* output, struct Arena* arena);
 
 /**
- * @brief Generate COIL code for a program
+ * @brief Initialize a code generator with a caller-provided symbol table
+ * @param program The AST to generate code for
+ * @param output Output file for COIL binary
+ * @param symbols Symbol table to fill (normally empty)
+ * @param arena Memory arena for allocations
+ * @return New code generator
+ */
+CodeGenerator* codegen_create_with_symbols(Program* program, FILE* output, SymbolTable* symbols,
+                                           struct Arena* arena);
+
+/**
+ * @brief Generate a COF object for a program
+ * 
+ * Writes the header and section table (see cof.h), the code section, and
+ * the rodata, symbol and debug sections, then flushes it all to the output.
+ * With a profile read by -fprofile-use, function definitions are emitted
+ * from the most to the least entered.
+ * 
  * @param gen Code generator
  * @return true if code generation succeeded
  */
 bool codegen_generate(CodeGenerator* gen);
 
+/**
+ * @brief Start a streamed COF object: reserve its header and section table
+ * 
+ * codegen_generate is codegen_begin, codegen_declaration for each
+ * declaration of gen->program, then codegen_finish. A streamed compilation
+ * instead passes declarations to codegen_stream_declaration one at a time,
+ * as they are parsed, and gen->program can stay empty.
+ * 
+ * @param gen Code generator
+ * @return true if the output buffer is usable
+ */
+bool codegen_begin(CodeGenerator* gen);
+
+/**
+ * @brief Generate one top-level declaration of a streamed compilation
+ * 
+ * Globals are numbered as they are declared rather than up front, so a
+ * name must be declared before its first use (as C requires). Nothing in
+ * decl is referenced afterwards except its name and type. The declaration's
+ * code is written to gen->output before this returns.
+ * 
+ * @param gen Code generator
+ * @param decl Declaration just parsed
+ * @return true if code generation succeeded so far
+ */
+bool codegen_stream_declaration(CodeGenerator* gen, Decl* decl);
+
+/**
+ * @brief Emit the remaining sections and the header, then flush to the output
+ * 
+ * After a streamed compilation the header is written by seeking back to
+ * it, so the output must be a regular file.
+ * @param gen Code generator
+ * @return true if the object was written
+ */
+bool codegen_finish(CodeGenerator* gen);
+
+/**
+ * @brief Give every file-scope function and static or extern variable its symbol index
+ * 
+ * codegen_generate does this first. The numbering depends only on the
+ * program, so a second generator for the same program gets the same indexes.
+ * 
+ * @param gen Code generator
+ */
+void codegen_declare_globals(CodeGenerator* gen);
+
+/**
+ * @brief Check whether calls to a function may be inlined from its definition
+ * 
+ * A streamed compilation keeps the bodies of such functions instead of
+ * releasing them, so later callers can still inline them.
+ * 
+ * @param gen Code generator that has declared decl
+ * @param decl Top-level declaration
+ * @return true if decl is a function definition codegen inlines at -O2 and above
+ */
+bool codegen_inlines(CodeGenerator* gen, Decl* decl);
+
 /**
  * @brief Map C type to COIL type
  * @param type C type
@@ -224,6 +444,12 @@ void codegen_emit_instruction(CodeGenerator* gen, uint8_t opcode, uint8_t qualif
 
 /**
  * @brief Emit a COIL operand
+ * 
+ * With compact_operands set, the data of variable, symbol and string
+ * operands is written as unsigned LEB128 and that of integer immediates as
+ * LEB128 (signed for COIL_TYPE_INT). Other data, and label offsets, which
+ * are patched in place, keep their fixed size.
+ * 
  * @param gen Code generator
  * @param qualifier Operand qualifier
  * @param type Operand type
@@ -240,6 +466,19 @@ void codegen_emit_operand(CodeGenerator* gen, uint8_t qualifier, uint8_t type, c
  */
 int codegen_expression(CodeGenerator* gen, Expr* expr);
 
+/**
+ * @brief Generate COIL code that branches on the truth of an expression
+ * 
+ * Comparisons branch directly on the CMP flags and && / || short-circuit,
+ * so no 0/1 value is materialized for the condition.
+ * 
+ * @param gen Code generator
+ * @param expr Condition expression
+ * @param true_label Label to branch to when the condition holds, or -1 to fall through
+ * @param false_label Label to branch to when the condition fails, or -1 to fall through
+ */
+void codegen_condition(CodeGenerator* gen, Expr* expr, int true_label, int false_label);
+
 /**
  * @brief Generate COIL code for a statement
  * @param gen Code generator
@@ -262,14 +501,58 @@ void codegen_declaration(CodeGenerator* gen, Decl* decl);
 int codegen_new_label(CodeGenerator* gen);
 
 /**
- * @brief Emit a label definition
+ * @brief Allocate a variable for an intermediate result
+ * 
+ * At -O1 and above, temporaries released with codegen_release_temp are
+ * reused within the current function instead of minting a new var ID.
+ * 
+ * @param gen Code generator
+ * @return Variable ID of the temporary
+ */
+int codegen_new_temp(CodeGenerator* gen);
+
+/**
+ * @brief Mark a temporary as dead so it can be reused
+ * @param gen Code generator
+ * @param var_id Variable ID returned by codegen_new_temp (other IDs are ignored)
+ */
+void codegen_release_temp(CodeGenerator* gen, int var_id);
+
+/**
+ * @brief Emit an OPQUAL_SYM operand referring to a global by its symbol index
+ * @param gen Code generator
+ * @param symbol Global symbol
+ */
+void codegen_emit_symbol_operand(CodeGenerator* gen, Symbol* symbol);
+
+/**
+ * @brief Emit an OPQUAL_LBL operand holding the byte offset of a label
+ * 
+ * The label may be bound before or after the branch; forward references
+ * are recorded as fixups and patched in place.
+ * 
+ * @param gen Code generator
+ * @param label_id Label ID from codegen_new_label
+ */
+void codegen_emit_label_operand(CodeGenerator* gen, int label_id);
+
+/**
+ * @brief Bind a label to the current position in the output
+ * 
+ * Nothing is emitted: branches to the label are patched with its byte
+ * offset once the enclosing function is complete.
+ * 
  * @param gen Code generator
- * @param label_id Label ID
+ * @param label_id Label ID from codegen_new_label
  */
 void codegen_emit_label(CodeGenerator* gen, int label_id);
 
 /**
  * @brief Create a unique string identifier for a literal
+ * 
+ * Identical literals share an ID; the ID indexes the offset table of the
+ * read-only data section.
+ * 
  * @param gen Code generator
  * @param str String literal
  * @return String ID
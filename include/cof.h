@@ -0,0 +1,67 @@
+/**
+ * @file cof.h
+ * @brief Layout of COF (COIL Object Format) files written by codegen
+ *
+ * A COF file starts with a CofHeader, followed directly by its section
+ * table. Section contents start on COF_SECTION_ALIGNMENT boundaries, so a
+ * loader can mmap the file and use every section in place. All fields are
+ * in the byte order of the machine that wrote the file.
+ */
+
+#ifndef COF_H
+#define COF_H
+
+#include <stdint.h>
+
+#define COF_MAGIC0 'C'
+#define COF_MAGIC1 'O'
+#define COF_MAGIC2 'F'
+#define COF_MAGIC3 '\0'
+#define COF_VERSION 2
+
+#define COF_SECTION_ALIGNMENT 16
+
+// Header flags
+#define COF_FLAG_VARINT_OPERANDS 0x0001 // Operand data uses LEB128 (see codegen_emit_operand)
+
+/**
+ * @brief Section types, in section table order
+ */
+typedef enum {
+  COF_SECTION_CODE   = 1, // COIL instruction stream; label operands are offsets into it
+  COF_SECTION_RODATA = 2, // String literal pool (see literal_pool_write)
+  COF_SECTION_SYMTAB = 3, // Global symbols referenced by OPQUAL_SYM index
+  COF_SECTION_DEBUG  = 4  // Code offset to source offset pairs (with -g)
+} CofSectionType;
+
+#define COF_SECTION_COUNT 4
+
+// Section flags
+#define COF_SECTION_READ  0x01
+#define COF_SECTION_WRITE 0x02
+#define COF_SECTION_EXEC  0x04
+
+/**
+ * @brief File header at offset 0
+ */
+typedef struct {
+  uint8_t magic[4];              // COF_MAGIC0..3
+  uint16_t version;              // COF_VERSION
+  uint16_t flags;                // COF_FLAG_*
+  uint32_t section_count;
+  uint32_t section_table_offset; // Byte offset of the first CofSection
+} CofHeader;
+
+/**
+ * @brief Section table entry
+ *
+ * Empty sections are still listed, with a size of zero.
+ */
+typedef struct {
+  uint32_t type;   // CofSectionType
+  uint32_t flags;  // COF_SECTION_*
+  uint32_t offset; // Byte offset from the start of the file
+  uint32_t size;   // Size in bytes
+} CofSection;
+
+#endif /* COF_H */
@@ -8,6 +8,15 @@
 
 #include <stdbool.h>
 
+#include <stddef.h>
+
+// Forward declarations
+struct Arena;
+struct InternPool;
+struct SymbolTable;
+
+#define COMPILER_CONTEXT_RETAIN_LIMIT (16 * 1024 * 1024) // Default warm memory per context
+
 /**
  * @brief Compilation options
  */
@@ -19,9 +28,25 @@ typedef struct {
   bool optimize;
   int optimization_level;
   bool emit_debug_info;
+  bool compact_operands; // LEB128 operand encoding in the output
   bool verbose;
+  bool print_stats; // Per-phase timing and memory report on stderr
+  bool stats_json;  // Write that report as JSON
+  int jobs; // Worker threads: one input file each, or the functions of a single file
+  const char* cache_dir; // Function cache directory for incremental rebuilds, or NULL
+  bool stream; // Compile each declaration as it is parsed (no -cache-dir or threads per file)
+  bool profile_generate;   // Add execution counters (see profile.h)
+  const char* profile_use; // Counter dump that guides optimization, or NULL
 } CompilerOptions;
 
+/**
+ * @brief Error report for a single compilation
+ */
+typedef struct {
+  bool has_error;
+  char message[256];
+} CompilerError;
+
 /**
  * @brief Initialize default compiler options
  * @return Default compiler options
@@ -46,8 +71,92 @@ bool compiler_compile_file(CompilerOptions options);
 bool compiler_compile_string(const char* source, const char* source_name, 
                            const char* output_file, CompilerOptions options);
 
+/**
+ * @brief Reentrant version of compiler_compile_file
+ * @param options Compiler options
+ * @param error Receives the error message if compilation fails
+ * @return True if compilation succeeded
+ */
+bool compiler_compile_file_r(CompilerOptions options, CompilerError* error);
+
+/**
+ * @brief Reentrant version of compiler_compile_string
+ * @param source C source code
+ * @param source_name Source name (for error reporting)
+ * @param output_file Output filename for COIL binary
+ * @param options Compiler options
+ * @param error Receives the error message if compilation fails
+ * @return True if compilation succeeded
+ */
+bool compiler_compile_string_r(const char* source, const char* source_name,
+                               const char* output_file, CompilerOptions options,
+                               CompilerError* error);
+
+/**
+ * @brief Reusable state for compiling many sources in one process
+ * 
+ * The context owns one arena. Each compilation allocates its intern pool,
+ * symbol table, tokens and AST from it, and the arena is reset (not freed)
+ * before the next compilation, so a steady stream of similar compiles reuses
+ * the same warm blocks instead of going back to malloc. A context must only
+ * be used by one thread at a time; use one per thread for parallel builds.
+ */
+typedef struct {
+  struct Arena* arena;
+  struct InternPool* strings;  // Identifier pool of the current compilation
+  struct SymbolTable* symbols; // Code generator symbols of the current compilation
+  CompilerError error;         // Error from the last compilation
+  int compilation_count;
+} CompilerContext;
+
+/**
+ * @brief Create a compiler context
+ * @param retain_limit Bytes of arena blocks kept warm between compilations
+ *                     (0 for COMPILER_CONTEXT_RETAIN_LIMIT)
+ * @return New context, or NULL if allocation failed
+ */
+CompilerContext* compiler_context_create(size_t retain_limit);
+
+/**
+ * @brief Destroy a compiler context and all memory it holds
+ * @param context The context to destroy
+ */
+void compiler_context_destroy(CompilerContext* context);
+
+/**
+ * @brief Compile a C source file using a context
+ * @param context The context to compile in
+ * @param options Compiler options
+ * @return True if compilation succeeded
+ */
+bool compiler_context_compile_file(CompilerContext* context, CompilerOptions options);
+
+/**
+ * @brief Compile C source string using a context
+ * @param context The context to compile in
+ * @param source C source code
+ * @param source_name Source name (for error reporting)
+ * @param output_file Output filename for COIL binary
+ * @param options Compiler options
+ * @return True if compilation succeeded
+ */
+bool compiler_context_compile_string(CompilerContext* context, const char* source,
+                                     const char* source_name, const char* output_file,
+                                     CompilerOptions options);
+
+/**
+ * @brief Get the error from the context's last compilation
+ * @param context The context to query
+ * @return Error message or NULL if no error
+ */
+const char* compiler_context_error(CompilerContext* context);
+
 /**
  * @brief Get the last error message if compilation failed
+ * 
+ * Only reports errors from compiler_compile_file and compiler_compile_string,
+ * which share this state and are therefore not thread-safe.
+ * 
  * @return Error message or NULL if no error
  */
 const char* compiler_error();
@@ -0,0 +1,26 @@
+/**
+ * @file driver.h
+ * @brief Parallel multi-file compilation driver
+ */
+
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include "colc.h"
+
+/**
+ * @brief Compile several translation units on a pool of worker threads
+ * 
+ * Each input is compiled to its own output file, named after the input with
+ * the ".c" extension replaced by ".cof". Every worker owns one
+ * CompilerContext, so its arena is reset and reused between files. Errors
+ * are collected per file and printed in input order once all workers finish.
+ * 
+ * @param options Compiler options shared by all files (input/output ignored)
+ * @param input_files Paths of the files to compile
+ * @param input_count Number of files
+ * @return True if every file compiled successfully
+ */
+bool driver_compile_files(CompilerOptions options, const char** input_files, int input_count);
+
+#endif /* DRIVER_H */
@@ -0,0 +1,147 @@
+/**
+ * @file fcache.h
+ * @brief On-disk cache of generated function code for incremental rebuilds
+ */
+
+#ifndef FCACHE_H
+#define FCACHE_H
+
+#include "ast.h"
+#include "lexer.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+// Forward declarations
+struct Arena;
+struct InternPool;
+
+#define FCACHE_VERSION 1
+#define FCACHE_HASH_SEED 0xcbf29ce484222325ULL // FNV-1a 64-bit offset basis
+
+/**
+ * @brief What a relocated operand refers to
+ */
+typedef enum {
+  FCACHE_RELOC_VAR,    // Variable ID, relative to the function's first
+  FCACHE_RELOC_SYMBOL, // Global symbol index, by name
+  FCACHE_RELOC_STRING, // String literal ID, by literal
+  FCACHE_RELOC_LABEL   // Branch target, relative to the function's start
+} FcacheRelocKind;
+
+/**
+ * @brief Operand whose data depends on the rest of the translation unit
+ */
+typedef struct {
+  uint32_t offset; // Position of the operand data, from the start of the function
+  uint32_t value;  // VAR: relative ID; SYMBOL/STRING: index into the name or literal list;
+                   // LABEL: target offset from the start of the function
+  uint8_t kind;    // FcacheRelocKind
+  uint8_t size;    // Encoded data size in the cached code
+} FcacheReloc;
+
+/**
+ * @brief Debug entry of a cached function
+ */
+typedef struct {
+  uint32_t code_offset;  // From the start of the function
+  int32_t source_offset; // From the location of the function's declaration
+} FcacheDebugEntry;
+
+/**
+ * @brief Generated code of one function, independent of its position
+ */
+typedef struct CachedFunction {
+  uint64_t key;
+  uint8_t* code;              // Final (optimized, label-patched) code; read-only
+  uint32_t code_size;
+  FcacheReloc* relocs;        // In offset order
+  int reloc_count;
+  uint32_t* instrs;           // Instruction start offsets, for -stats opcode counts
+  int instr_count;
+  FcacheDebugEntry* debug;
+  int debug_count;
+  const char** literals;      // Distinct literals in the order codegen first added them
+  int literal_count;
+  const char** symbols;       // Interned name of each SYMBOL relocation's global
+  int symbol_count;
+  int var_count;              // Variable IDs the function allocates
+  bool used;                  // Hit or stored by this compilation, so kept on save
+} CachedFunction;
+
+/**
+ * @brief Cached functions of one source file
+ */
+typedef struct FunctionCache {
+  CachedFunction** table;     // Open addressing by key
+  int table_capacity;         // Always a power of two
+  int count;
+  const char* path;           // Cache file
+  struct InternPool* strings; // Symbol names are interned into the compilation's pool
+  struct Arena* arena;
+  int hits;                   // Functions spliced from the cache
+  int stored;                 // Functions generated and added
+} FunctionCache;
+
+/**
+ * @brief Open the cache of a source file, loading it if present
+ *
+ * A missing, stale or corrupt cache file just yields an empty cache.
+ *
+ * @param cache_dir Directory holding cache files (created if missing)
+ * @param source_name Source file the cache belongs to
+ * @param strings Intern pool of the compilation
+ * @param arena Memory arena for allocations
+ * @return New cache
+ */
+FunctionCache* fcache_open(const char* cache_dir, const char* source_name,
+                           struct InternPool* strings, struct Arena* arena);
+
+/**
+ * @brief Find a cached function and mark it as used
+ * @param cache The cache
+ * @param key Key from fcache_program_keys
+ * @return The function, or NULL on a miss
+ */
+CachedFunction* fcache_lookup(FunctionCache* cache, uint64_t key);
+
+/**
+ * @brief Add a freshly generated function
+ * @param cache The cache
+ * @param function Function allocated in the cache's arena
+ */
+void fcache_insert(FunctionCache* cache, CachedFunction* function);
+
+/**
+ * @brief Write the used functions back to the cache file, dropping the rest
+ * @param cache The cache
+ * @return true if the file was written
+ */
+bool fcache_save(FunctionCache* cache);
+
+/**
+ * @brief Continue an FNV-1a hash over some bytes
+ * @param hash Hash so far (FCACHE_HASH_SEED to start)
+ * @param data Bytes to add
+ * @param size Number of bytes
+ * @return Updated hash
+ */
+uint64_t fcache_hash(uint64_t hash, const void* data, size_t size);
+
+/**
+ * @brief Compute the cache key of every top-level function definition
+ *
+ * A key covers the function's own tokens and every token outside function
+ * bodies (prototypes, globals, typedefs), which is everything its code can
+ * depend on, plus the caller's hash of the compiler options.
+ *
+ * @param program Parsed program (needs token_starts)
+ * @param tokens Token array it was parsed from
+ * @param options_hash Hash of the options that affect generated code
+ * @param hash_offsets Include token positions (debug info records them)
+ * @param arena Memory arena for the result
+ * @return Key per declaration (0 for anything but function definitions), or NULL
+ */
+uint64_t* fcache_program_keys(Program* program, const TokenArray* tokens, uint64_t options_hash,
+                              bool hash_offsets, struct Arena* arena);
+
+#endif /* FCACHE_H */
@@ -0,0 +1,45 @@
+/**
+ * @file fold.h
+ * @brief AST-level constant folding and algebraic simplification
+ */
+
+#ifndef FOLD_H
+#define FOLD_H
+
+#include "ast.h"
+
+/**
+ * @brief Fold constants and simplify every declaration in a program
+ * 
+ * Evaluates operators whose operands are literals, removes identity
+ * operations (x*1, x+0, x<<0, ...) and drops if/while branches whose
+ * condition is a known constant. Nodes are rewritten in place.
+ * 
+ * @param program The program to simplify
+ */
+void fold_program(Program* program);
+
+/**
+ * @brief Fold constants in one top-level declaration, as fold_program does
+ * @param program The program whose pools hold the declaration's nodes
+ * @param decl The declaration to simplify (may be NULL)
+ */
+void fold_declaration(Program* program, Decl* decl);
+
+/**
+ * @brief Fold constants in an expression tree
+ * @param program The program whose pools hold the nodes
+ * @param expr Expression to simplify (may be AST_NONE)
+ * @return The simplified expression, which may be a subtree of expr
+ */
+ExprRef fold_expression(Program* program, ExprRef expr);
+
+/**
+ * @brief Fold constants in a statement and remove dead branches
+ * @param program The program whose pools hold the nodes
+ * @param stmt Statement to simplify (may be AST_NONE)
+ * @return The simplified statement, or AST_NONE if it has no effect
+ */
+StmtRef fold_statement(Program* program, StmtRef stmt);
+
+#endif /* FOLD_H */
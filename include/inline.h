@@ -0,0 +1,31 @@
+/**
+ * @file inline.h
+ * @brief Selection of the functions codegen inlines at their call sites
+ */
+
+#ifndef INLINE_H
+#define INLINE_H
+
+#include "ast.h"
+
+#define INLINE_MAX_NODES 24     // Statements and expressions in an inlinable body
+#define INLINE_HOT_MAX_NODES 64 // The same, for a function the profile shows is hot
+#define INLINE_MAX_DEPTH 3      // Inlined bodies nested inside one another
+
+/**
+ * @brief Check whether a function definition is small and simple enough to inline
+ * 
+ * The body must have at most max_nodes statements and expressions,
+ * return only from its last top-level statement, and never call the
+ * function itself. Parameters must never be assigned, incremented or have
+ * their address taken, and a static or extern local would not survive
+ * being copied into every caller.
+ * 
+ * @param program Program whose pools hold the body
+ * @param decl Function declaration
+ * @param max_nodes Size limit, normally INLINE_MAX_NODES
+ * @return true if codegen may inline calls to it
+ */
+bool inline_candidate(Program* program, Decl* decl, int max_nodes);
+
+#endif /* INLINE_H */
@@ -0,0 +1,77 @@
+/**
+ * @file intern.h
+ * @brief String interning pool for identifiers
+ */
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Forward declaration for Arena
+struct Arena;
+
+/**
+ * @brief A unique interned string, stored inline after its header
+ */
+typedef struct InternEntry {
+  struct InternEntry* next;
+  unsigned int hash;
+  unsigned int length;
+  char chars[]; // NUL-terminated spelling
+} InternEntry;
+
+/**
+ * @brief Hash table mapping each distinct spelling to a single copy
+ * 
+ * Strings returned by the pool are unique: two interned strings are equal
+ * exactly when their pointers are equal, and each carries its precomputed
+ * hash and length.
+ */
+typedef struct InternPool {
+  InternEntry** buckets;
+  int bucket_count; // Always a power of two
+  int count;
+  struct Arena* arena;
+} InternPool;
+
+/**
+ * @brief Create a new intern pool
+ * @param arena Memory arena that owns the pool and every interned string
+ * @return New intern pool
+ */
+InternPool* intern_pool_create(struct Arena* arena);
+
+/**
+ * @brief Intern a string
+ * @param pool The pool to intern into
+ * @param str Characters of the string (need not be NUL-terminated)
+ * @param length Number of characters
+ * @return The unique NUL-terminated copy of the string
+ */
+const char* intern_string(InternPool* pool, const char* str, size_t length);
+
+/**
+ * @brief Compute the hash used by the pool for a sequence of characters
+ * @param str Characters to hash
+ * @param length Number of characters
+ * @return Hash value
+ */
+unsigned int intern_hash_bytes(const char* str, size_t length);
+
+/**
+ * @brief Get the precomputed hash of an interned string
+ * @param str A string returned by intern_string
+ * @return Hash value
+ */
+unsigned int intern_hash(const char* str);
+
+/**
+ * @brief Get the length of an interned string without scanning it
+ * @param str A string returned by intern_string
+ * @return Length in characters, excluding the terminator
+ */
+size_t intern_length(const char* str);
+
+#endif /* INTERN_H */
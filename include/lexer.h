@@ -8,9 +8,11 @@
 
 #include "ast.h"
 #include <stdio.h>
+#include <stdint.h>
 
-// Forward declaration for Arena
+// Forward declarations
 struct Arena;
+struct InternPool;
 
 /**
  * @brief Lexer state for tokenizing C source code
@@ -18,11 +20,17 @@ struct Arena;
 typedef struct {
   const char* source;
   const char* filename;
-  size_t source_length;
+  uint32_t file_id;     // Stored in the locations of this lexer's tokens
+  size_t source_length; // source[source_length] is the NUL sentinel
   size_t position;
-  size_t line;
-  size_t column;
+  size_t token_start; // Offset of the token being scanned
+  
+  // Line start offsets, built lazily by lexer_resolve_location
+  size_t* line_offsets;
+  size_t line_count;
+  
   struct Arena* arena;
+  struct InternPool* strings; // Identifier spellings, shared with the parser
   
   // Current token
   Token current;
@@ -32,22 +40,82 @@ typedef struct {
   char* error_message;
 } Lexer;
 
+/**
+ * @brief Whole-file token stream stored as parallel arrays
+ * 
+ * The last token is always TOKEN_EOF, so any index up to count - 1 is valid.
+ */
+typedef struct {
+  uint8_t* types;      // TokenType of each token
+  uint32_t* offsets;   // Byte offset of each token in the source
+  uint32_t* lengths;   // Lexeme length (identifiers and numbers, else 0)
+  TokenValue* values;  // Literal values and interned identifier names
+  int count;
+  int capacity;
+  const char* source;
+  uint32_t file_id;
+} TokenArray;
+
 /**
  * @brief Initialize a lexer for the given source code
- * @param source The C source code to tokenize
+ * @param source The C source code to tokenize (NUL-terminated)
  * @param filename The source filename (for error reporting)
  * @param arena Memory arena for allocations
  * @return New lexer instance
  */
 Lexer* lexer_create(const char* source, const char* filename, struct Arena* arena);
 
+/**
+ * @brief Initialize a lexer for source code of known length
+ * 
+ * Avoids the strlen scan for large or memory-mapped inputs. The byte at
+ * source[length] must still be readable and zero; the lexer uses it as the
+ * end-of-input sentinel.
+ * 
+ * @param source The C source code to tokenize
+ * @param length Number of bytes of source
+ * @param filename The source filename (for error reporting)
+ * @param strings Intern pool for identifiers, or NULL to create one
+ * @param arena Memory arena for allocations
+ * @return New lexer instance
+ */
+Lexer* lexer_create_with_length(const char* source, size_t length, const char* filename,
+                                struct InternPool* strings, struct Arena* arena);
+
 /**
  * @brief Advance to the next token
  * @param lexer The lexer to advance
- * @return The next token
+ * @return The next token (also the new current token)
  */
 Token lexer_next_token(Lexer* lexer);
 
+/**
+ * @brief Look at a token ahead of the current one without consuming anything
+ * @param lexer The lexer to peek at
+ * @param distance How many tokens past the current one (0 = current)
+ * @return The token at that distance (TOKEN_EOF past the end)
+ */
+Token lexer_peek_ahead(Lexer* lexer, int distance);
+
+/**
+ * @brief Lex the rest of the input into a token array
+ * 
+ * Starts at the lexer's current token and stops after TOKEN_EOF (or the
+ * first lexical error, which also ends the array with TOKEN_EOF).
+ * 
+ * @param lexer The lexer to drain
+ * @return Token array allocated in the lexer's arena
+ */
+TokenArray* lexer_tokenize(Lexer* lexer);
+
+/**
+ * @brief Rebuild a full token from a token array entry
+ * @param tokens The token array
+ * @param index Token index (clamped to the final TOKEN_EOF)
+ * @return The token
+ */
+Token token_array_get(const TokenArray* tokens, int index);
+
 /**
  * @brief Peek at the current token
  * @param lexer The lexer to peek at
@@ -82,10 +150,22 @@ bool lexer_consume(Lexer* lexer, TokenType type);
 /**
  * @brief Get the current source location
  * @param lexer The lexer to get the location from
- * @return The current source location
+ * @return The current source location (offset only, see lexer_resolve_location)
  */
 SourceLocation lexer_location(Lexer* lexer);
 
+/**
+ * @brief Find the file, line and column of a location
+ * 
+ * Tokens only record their byte offset; lines and columns are looked up in a
+ * newline index that is built the first time a location is resolved.
+ * 
+ * @param lexer The lexer that produced the location
+ * @param location The location to resolve
+ * @return The location with file name, line and column
+ */
+ResolvedLocation lexer_resolve_location(Lexer* lexer, SourceLocation location);
+
 /**
  * @brief Get a descriptive error message if there was an error
  * @param lexer The lexer with the error
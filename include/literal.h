@@ -0,0 +1,79 @@
+/**
+ * @file literal.h
+ * @brief Pool of string literals emitted as a read-only data section
+ */
+
+#ifndef LITERAL_H
+#define LITERAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "buffer.h"
+
+// Forward declaration for Arena
+struct Arena;
+
+/**
+ * @brief A distinct string literal in the pool
+ */
+typedef struct LiteralEntry {
+  struct LiteralEntry* next; // Next entry in the same bucket
+  const char* chars;         // NUL-terminated, owned by the caller's arena
+  uint32_t length;
+  unsigned int hash;
+  int id;
+  uint32_t offset;           // Byte offset in the section data, set by literal_pool_layout
+} LiteralEntry;
+
+/**
+ * @brief Hash table of string literals, numbered in order of first use
+ * 
+ * Each distinct literal gets a small fixed-size ID that codegen emits as
+ * the operand. When the section is laid out, literals whose bytes are a
+ * suffix of a longer literal ("world" in "hello world") share its storage.
+ */
+typedef struct LiteralPool {
+  LiteralEntry** buckets;
+  int bucket_count;          // Always a power of two
+  LiteralEntry** entries;    // By ID
+  int count;
+  int capacity;
+  uint32_t data_size;        // Size of the merged string data, set by literal_pool_layout
+  struct Arena* arena;
+} LiteralPool;
+
+/**
+ * @brief Create a new literal pool
+ * @param arena Memory arena for allocations
+ * @return New literal pool
+ */
+LiteralPool* literal_pool_create(struct Arena* arena);
+
+/**
+ * @brief Add a literal to the pool, or find the ID of an identical one
+ * @param pool The pool to add to
+ * @param str NUL-terminated literal; must stay valid while the pool is used
+ * @return ID of the literal
+ */
+int literal_pool_add(LiteralPool* pool, const char* str);
+
+/**
+ * @brief Assign each literal its offset in the section data, merging suffixes
+ * @param pool The pool to lay out
+ * @return Size in bytes of the section written by literal_pool_write
+ */
+size_t literal_pool_layout(LiteralPool* pool);
+
+/**
+ * @brief Write the section contents laid out by literal_pool_layout
+ * 
+ * Layout: uint32 count, uint32 offsets[count] into the
+ * string data, uint32 data size, then the NUL-terminated string data.
+ * 
+ * @param pool The pool to write
+ * @param buffer Destination buffer
+ */
+void literal_pool_write(LiteralPool* pool, CoilBuffer* buffer);
+
+#endif /* LITERAL_H */
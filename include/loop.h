@@ -0,0 +1,101 @@
+/**
+ * @file loop.h
+ * @brief Analysis of while loops for the loop optimizations of codegen
+ */
+
+#ifndef LOOP_H
+#define LOOP_H
+
+#include "ast.h"
+
+// Forward declarations
+struct Arena;
+struct LoopName;
+
+#define LOOP_MAX_VALUES 16 // Values one loop keeps in variables from its preheader
+
+/**
+ * @brief What a name in the loop refers to
+ */
+typedef enum {
+  LOOP_NAME_SHARED,  // Global or unknown: calls and stores through pointers may change it
+  LOOP_NAME_LOCAL,   // Local variable or parameter
+  LOOP_NAME_INTEGER  // Local of integer type, so a possible induction variable
+} LoopNameKind;
+
+/**
+ * @brief Resolve a name as seen just before the loop
+ * @param context Caller data
+ * @param name Interned name
+ * @return What it refers to
+ */
+typedef LoopNameKind (*LoopNameFn)(void* context, const char* name);
+
+/**
+ * @brief Interned names, with how often each was seen
+ */
+typedef struct LoopNames {
+  struct LoopName* items;
+  int count;
+  int capacity;
+} LoopNames;
+
+/**
+ * @brief Product of an induction variable and a constant, kept up to date by addition
+ */
+typedef struct {
+  Expr* product;   // i * k or k * i
+  Stmt* step;      // Top-level statement of the body that steps i by a constant
+  long long delta; // Added to the product after the step
+  int first;       // Index of the first reduction of the same product (its own if none)
+} LoopReduction;
+
+/**
+ * @brief What codegen can compute once, before a loop
+ */
+typedef struct {
+  Expr** invariants;         // Largest loop-invariant subexpressions and constants, in source order
+  int* invariant_firsts;     // Index of the first invariant with the same value (its own if none)
+  int invariant_count;
+  LoopReduction* reductions;
+  int reduction_count;
+  bool compares_zero;        // Some condition in the loop tests a value against zero
+} LoopPlan;
+
+/**
+ * @brief Collect the locals whose address a function takes
+ * 
+ * Stores through pointers and calls may change them, so loop_plan never
+ * treats them as invariant. The result serves every loop of the function.
+ * 
+ * @param program Program whose pools hold the function
+ * @param function_body Body of the function
+ * @param arena Memory arena for the names (scratch is fine)
+ * @param names Filled in
+ */
+void loop_address_taken(const Program* program, Stmt* function_body, struct Arena* arena,
+                        LoopNames* names);
+
+/**
+ * @brief Find the invariant values and induction variable products of a while loop
+ * 
+ * A local is invariant if the loop never assigns, steps or declares it and
+ * the function never takes its address; an expression is invariant if it
+ * is built from such locals and constants with operators that cannot trap.
+ * An induction variable is an integer local whose only write in the loop
+ * is a top-level statement of the body adding a constant to it. Repeats of
+ * an invariant or product point back to its first occurrence, so codegen
+ * computes each value once.
+ * 
+ * @param program Program whose pools hold the loop
+ * @param loop While statement
+ * @param address_taken From loop_address_taken on the function the loop is in
+ * @param resolve Name resolution
+ * @param context Passed to resolve
+ * @param arena Memory arena for the plan (scratch is fine)
+ * @param plan Filled in; at most LOOP_MAX_VALUES invariants and reductions in total
+ */
+void loop_plan(const Program* program, Stmt* loop, const LoopNames* address_taken,
+               LoopNameFn resolve, void* context, struct Arena* arena, LoopPlan* plan);
+
+#endif /* LOOP_H */
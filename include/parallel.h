@@ -0,0 +1,28 @@
+/**
+ * @file parallel.h
+ * @brief Code generation of function bodies on worker threads
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "codegen.h"
+#include "fcache.h"
+
+/**
+ * @brief Generate the function definitions of a program on gen->jobs threads
+ *
+ * Each worker has its own code generator, arena and symbol table, with the
+ * globals numbered as in gen, and captures every function it generates as
+ * a relocatable fragment. codegen_generate splices the fragments in
+ * declaration order (or the profile's, see codegen_generate), so the
+ * output does not depend on scheduling.
+ * Functions already in gen's function cache are skipped, and those a worker
+ * could not capture are left NULL for the serial path.
+ *
+ * @param gen Code generator with its globals declared
+ * @return Fragment per top-level declaration (allocated in gen's arena), or NULL
+ */
+CachedFunction** parallel_generate_functions(CodeGenerator* gen);
+
+#endif /* PARALLEL_H */
@@ -8,20 +8,37 @@
 
 #include "ast.h"
 #include "lexer.h"
+#include "arena.h"
 
-// Forward declaration for Arena
-struct Arena;
+#define EXPR_MAX_DEPTH 10000 // Height of an expression tree; folding and codegen recurse over it
 
 /**
  * @brief Parser state for parsing C source code
  */
 typedef struct {
   Lexer* lexer;
-  struct Arena* arena;
+  struct Arena* arena;       // AST nodes
+  struct Arena* table_arena; // Creation arena: the program, pool chunks and tables below
   Program* program;
   
+  // Token source: a pre-lexed array, or the lexer itself when NULL
+  TokenArray* tokens;
+  int position;   // Index of the current token in tokens
+  Token current;
+  Token previous; // Most recently consumed token
+  
   // Symbol table for typedefs
-  struct SymbolTable* typedefs;
+  struct TypedefTable* typedefs;
+  
+  // Operand and operator stacks of the expression parser
+  struct ExprStack* expr_stack;
+  
+  // Nodes of the last function body, for parser_release_body: the node
+  // arena and the pool sizes as they were before the body
+  ArenaMark body_mark;
+  uint32_t body_expr_count;
+  uint32_t body_stmt_count;
+  bool body_releasable;
   
   // Error handling
   bool has_error;
@@ -36,6 +53,15 @@ typedef struct {
  */
 Parser* parser_create(Lexer* lexer, struct Arena* arena);
 
+/**
+ * @brief Initialize a parser that reads from a pre-lexed token array
+ * @param lexer The lexer that produced the tokens (used for locations and errors)
+ * @param tokens Tokens from lexer_tokenize
+ * @param arena Memory arena for allocations
+ * @return New parser instance
+ */
+Parser* parser_create_with_tokens(Lexer* lexer, TokenArray* tokens, struct Arena* arena);
+
 /**
  * @brief Parse a complete C program
  * @param parser The parser to use
@@ -50,19 +76,44 @@ Program* parser_parse_program(Parser* parser);
  */
 Decl* parser_parse_declaration(Parser* parser);
 
+/**
+ * @brief Parse the next top-level declaration of a streamed compilation
+ * 
+ * Unlike parser_parse_program, declarations are not collected into a
+ * Program: each one can be compiled, and its body released with
+ * parser_release_body, before the next is parsed.
+ * 
+ * @param parser The parser to use
+ * @return The declaration, or NULL at the end of the input or after an error
+ */
+Decl* parser_next_declaration(Parser* parser);
+
+/**
+ * @brief Free the body of the function definition just returned by parser_next_declaration
+ * 
+ * Rewinds the node arena to where the body started, so parser->arena must
+ * not be shared with anything that outlives the body. The declaration
+ * itself, its name and its type stay valid, and its body becomes AST_NONE. A
+ * body that declared a typedef is kept.
+ * 
+ * @param parser The parser that returned decl
+ * @param decl The declaration (anything other than a function definition is ignored)
+ */
+void parser_release_body(Parser* parser, Decl* decl);
+
 /**
  * @brief Parse a statement
  * @param parser The parser to use
- * @return The parsed statement AST node
+ * @return Reference to the parsed statement in parser->program
  */
-Stmt* parser_parse_statement(Parser* parser);
+StmtRef parser_parse_statement(Parser* parser);
 
 /**
  * @brief Parse an expression
  * @param parser The parser to use
- * @return The parsed expression AST node
+ * @return Reference to the parsed expression in parser->program
  */
-Expr* parser_parse_expression(Parser* parser);
+ExprRef parser_parse_expression(Parser* parser);
 
 /**
  * @brief Parse a type
@@ -0,0 +1,128 @@
+/**
+ * @file peephole.h
+ * @brief Peephole optimizer over the COIL instructions of a function
+ */
+
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include "codegen.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Rewrites counted by the optimizer
+ */
+typedef enum {
+  PEEPHOLE_VARGET_AFTER_VARSET, // VARSET a, x; VARGET t, a  =>  VARSET a, x; MOV t, x
+  PEEPHOLE_REPEATED_MOVI,       // MOVI t, k when t already holds k
+  PEEPHOLE_BRANCH_TO_NEXT,      // BR/BRC to the instruction that follows
+  PEEPHOLE_EMPTY_SCOPE,         // VARSC immediately followed by VAREND
+  PEEPHOLE_PATTERN_COUNT
+} PeepholePattern;
+
+/**
+ * @brief Decoded operand; its data stays in the code buffer until rewritten
+ */
+typedef struct {
+  uint8_t qualifier;
+  uint8_t type;
+  uint8_t size;         // Encoded data bytes
+  uint32_t data_offset; // Buffer offset of the data
+  int fixup;            // Index into the generator's fixups for label operands, else -1
+} PeepholeOperand;
+
+/**
+ * @brief Decoded instruction
+ */
+typedef struct {
+  uint32_t offset;      // Buffer offset of the instruction
+  uint32_t new_offset;  // Offset after rewriting (of the next kept instruction if deleted)
+  uint8_t opcode;
+  uint8_t qualifier;
+  uint8_t operand_count;
+  bool deleted;
+  bool has_label;       // A label is bound here, so it starts a basic block
+  int first_operand;    // Index into operands
+} PeepholeInstr;
+
+/**
+ * @brief Instructions recorded for the function being generated
+ *
+ * Codegen records every instruction and operand as it emits them. When the
+ * function is complete, peephole_run matches patterns over the decoded list
+ * and re-encodes the function in place, moving labels, fixups and debug
+ * entries along with the code. With optimize off it only records, so the
+ * function cache can read the instruction list.
+ */
+typedef struct Peephole {
+  PeepholeInstr* instrs;
+  int count;
+  int capacity;
+  PeepholeOperand* operands;
+  int operand_count;
+  int operand_capacity;
+  size_t function_start;        // Buffer offset of the function's first instruction
+  bool active;                  // Between peephole_begin and peephole_run
+  bool optimize;                // Rewrite the function, not just record it
+  int hits[PEEPHOLE_PATTERN_COUNT];
+  struct Arena* arena;          // Instruction lists go in its scratch arena
+} Peephole;
+
+/**
+ * @brief Create a peephole optimizer (optimizing) with zeroed hit counters
+ * @param arena Memory arena for allocations (per-function lists use its scratch arena)
+ * @return New optimizer
+ */
+Peephole* peephole_create(struct Arena* arena);
+
+/**
+ * @brief Start recording a new function
+ * @param peephole The optimizer
+ * @param function_start Buffer offset where the function's code begins
+ */
+void peephole_begin(Peephole* peephole, size_t function_start);
+
+/**
+ * @brief Record an instruction header written at offset
+ * @param peephole The optimizer
+ * @param offset Buffer offset of the instruction
+ * @param opcode Instruction opcode
+ * @param qualifier Instruction qualifier
+ * @param operand_count Operand count from the header
+ */
+void peephole_add_instruction(Peephole* peephole, size_t offset, uint8_t opcode, uint8_t qualifier,
+                              uint8_t operand_count);
+
+/**
+ * @brief Record an operand of the most recent instruction
+ * @param peephole The optimizer
+ * @param qualifier Operand qualifier
+ * @param type Operand type
+ * @param data_offset Buffer offset of the encoded data
+ * @param size Encoded data size in bytes
+ * @param fixup Fixup index for label operands, or -1
+ */
+void peephole_add_operand(Peephole* peephole, uint8_t qualifier, uint8_t type, size_t data_offset,
+                          size_t size, int fixup);
+
+/**
+ * @brief Optimize and re-encode the recorded function
+ *
+ * The instruction list stays valid, with new offsets, until the scratch
+ * arena is rewound.
+ *
+ * @param peephole The optimizer
+ * @param gen Code generator whose buffer holds the function
+ */
+void peephole_run(Peephole* peephole, CodeGenerator* gen);
+
+/**
+ * @brief Get a short name for a pattern, for statistics output
+ * @param pattern The pattern
+ * @return Static name string
+ */
+const char* peephole_pattern_name(PeepholePattern pattern);
+
+#endif /* PEEPHOLE_H */
@@ -0,0 +1,136 @@
+/**
+ * @file profile.h
+ * @brief Execution profiles for profile-guided optimization
+ *
+ * With -fprofile-generate, codegen gives every function definition a run
+ * of counters, static globals named __profile.<function>.<index>, and adds
+ * one to a counter each time control reaches it. In source order, counter
+ * 0 is the function's entry, each if statement has two (the then and the
+ * else edge, even without an else branch) and each while loop one (the
+ * start of its body). The numbering is done on the parsed tree, before
+ * folding, so the layout is the same at every -O level; a statement that
+ * folding removes keeps its counters, which then just stay 0. Counters are
+ * never placed in inlined bodies, and inlining is off while instrumenting,
+ * so each call counts as an entry.
+ *
+ * The program's runtime dumps every counter as a text line
+ * "__profile.<function>.<index> <count>". Lines repeating a counter add up,
+ * so dumps of several runs, or of same-named static functions of several
+ * units, can simply be concatenated. -fprofile-use=<file> reads such a
+ * file back.
+ *
+ * With a profile, codegen inlines larger bodies of hot functions, swaps
+ * the branches of if/else statements whose else edge ran more often,
+ * rotates loops that iterated even below -O2, and emits the function
+ * definitions most entered first. A -stream compilation emits each
+ * function as soon as it is parsed, so it skips that last reordering and
+ * its output differs from the whole-file one.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "ast.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+// Forward declarations
+struct Arena;
+struct InternPool;
+
+#define PROFILE_PREFIX "__profile."
+#define PROFILE_HOT_SHARE 16 // Hot: entered at least 1/16 as often as the most entered function
+
+/**
+ * @brief Counters recorded for one function
+ */
+typedef struct ProfileFunction {
+  const char* name;             // Interned
+  uint64_t* counts;             // Per counter index
+  int count;
+  int capacity;
+  const char** names;           // From profile_counter_names, or NULL
+  struct ProfileFunction* next; // Next function in the same bucket
+} ProfileFunction;
+
+/**
+ * @brief Profile being generated, or one read back
+ */
+typedef struct Profile {
+  bool generate;              // Instrumenting: there are no counts
+  ProfileFunction** buckets;
+  int bucket_count;           // Always a power of two
+  uint64_t max_entry;         // Entry count of the most entered function
+  uint64_t hash;              // Of the profile file, for function cache keys
+  struct InternPool* strings;
+  struct Arena* arena;
+} Profile;
+
+/**
+ * @brief Create the profile of an instrumented compilation (-fprofile-generate)
+ * @param strings Intern pool for counter names
+ * @param arena Memory arena for allocations
+ * @return New profile, or NULL on allocation failure
+ */
+Profile* profile_create(struct InternPool* strings, struct Arena* arena);
+
+/**
+ * @brief Read a profile file (-fprofile-use)
+ *
+ * Lines that do not name a counter are ignored.
+ *
+ * @param path Counter dump written by an instrumented program
+ * @param strings Intern pool of the compilation
+ * @param arena Memory arena for allocations
+ * @return The profile, or NULL if the file cannot be read
+ */
+Profile* profile_load(const char* path, struct InternPool* strings, struct Arena* arena);
+
+/**
+ * @brief Number the counters of a function definition's if and while statements
+ *
+ * Must run before the declaration is folded; prototypes are left alone.
+ *
+ * @param program Program whose pools hold the body
+ * @param decl Function declaration
+ */
+void profile_number_counters(Program* program, Decl* decl);
+
+/**
+ * @brief Number of counters a function definition gets
+ * @param decl Function declaration, numbered by profile_number_counters
+ * @return 1 + 2 per if statement + 1 per while loop before folding (0 for a prototype)
+ */
+int profile_counter_count(Decl* decl);
+
+/**
+ * @brief Names of a function's counters, by index
+ *
+ * The names are made on the first call for a function and kept, so once a
+ * thread has asked for every function's names, other threads may share
+ * the profile.
+ *
+ * @param profile The profile
+ * @param decl Function definition
+ * @return profile_counter_count(decl) interned names, or NULL on allocation failure
+ */
+const char** profile_counter_names(Profile* profile, Decl* decl);
+
+/**
+ * @brief Recorded counts of a function definition
+ * @param profile The profile
+ * @param decl Function declaration
+ * @return profile_counter_count(decl) counts, or NULL if the function has
+ *         no counts or they come from a different version of it
+ */
+const uint64_t* profile_counts(Profile* profile, Decl* decl);
+
+/**
+ * @brief Check whether a function is entered often enough to favour
+ * @param profile The profile
+ * @param entry Entry count of the function
+ * @return true for at least 1/PROFILE_HOT_SHARE of the most entered function's count
+ */
+bool profile_is_hot(Profile* profile, uint64_t entry);
+
+#endif /* PROFILE_H */
@@ -0,0 +1,129 @@
+/**
+ * @file stats.h
+ * @brief Per-phase timing and memory statistics for a compilation
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include "ast.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Forward declarations
+struct Arena;
+struct SymbolTable;
+struct InternPool;
+
+#define STATS_CHAIN_BUCKETS 8 // Chain length histogram: 0 .. 6, then 7 or more
+#define STATS_OPCODE_COUNT 256
+
+/**
+ * @brief Compiler phases that are timed separately
+ */
+typedef enum {
+  PHASE_LEX,
+  PHASE_PARSE,
+  PHASE_FOLD,
+  PHASE_CODEGEN,
+  PHASE_COUNT
+} CompilerPhase;
+
+/**
+ * @brief Cost of one phase
+ */
+typedef struct {
+  double wall_seconds;
+  double cpu_seconds;     // CPU time of the compiling thread
+  size_t arena_allocated; // Growth of the arena's block memory during the phase
+  size_t arena_used;      // Bytes handed out by the arena during the phase
+} PhaseStats;
+
+/**
+ * @brief Statistics gathered by compile_source when -stats is given
+ */
+typedef struct {
+  PhaseStats phases[PHASE_COUNT];
+  int token_count;
+  
+  // AST nodes reachable from the program after parsing, per kind
+  int expr_counts[EXPR_CAST + 1];
+  int stmt_counts[STMT_DECL + 1];
+  int type_counts[TYPE_ENUM + 1]; // Type nodes referenced (shared types count per use)
+  int decl_counts[DECL_TYPEDEF + 1];
+  
+  // Hash chain lengths at the end of code generation
+  int symbol_chains[STATS_CHAIN_BUCKETS];
+  int intern_chains[STATS_CHAIN_BUCKETS];
+  
+  uint32_t opcode_counts[STATS_OPCODE_COUNT]; // Emitted instructions per CoilOpcode
+  
+  // State of the phase being measured
+  double wall_start;
+  double cpu_start;
+  size_t allocated_start;
+  size_t used_start;
+} CompilerStats;
+
+/**
+ * @brief Clear all counters
+ * @param stats Statistics to reset
+ */
+void stats_init(CompilerStats* stats);
+
+/**
+ * @brief Start measuring a phase
+ * @param stats Statistics being gathered
+ * @param arena Arena the phase allocates from
+ */
+void stats_phase_begin(CompilerStats* stats, struct Arena* arena);
+
+/**
+ * @brief Finish measuring a phase started with stats_phase_begin
+ * @param stats Statistics being gathered
+ * @param phase The phase that just ran
+ * @param arena Arena the phase allocates from
+ */
+void stats_phase_end(CompilerStats* stats, CompilerPhase phase, struct Arena* arena);
+
+/**
+ * @brief Count the AST nodes of a program by kind
+ * @param stats Statistics being gathered
+ * @param program Parsed program
+ */
+void stats_count_ast(CompilerStats* stats, Program* program);
+
+/**
+ * @brief Count the AST nodes of one declaration, for streamed compilation
+ * @param stats Statistics being gathered
+ * @param program The program whose pools hold the declaration's nodes
+ * @param decl Parsed declaration
+ */
+void stats_count_declaration(CompilerStats* stats, Program* program, Decl* decl);
+
+/**
+ * @brief Record the chain length histograms of the symbol table and intern pool
+ * @param stats Statistics being gathered
+ * @param symbols Code generator symbol table
+ * @param strings Identifier intern pool
+ */
+void stats_count_chains(CompilerStats* stats, struct SymbolTable* symbols, struct InternPool* strings);
+
+/**
+ * @brief Print a human-readable report
+ * @param output Stream to write to
+ * @param stats Gathered statistics
+ * @param source_name Source the statistics belong to
+ */
+void stats_print(FILE* output, const CompilerStats* stats, const char* source_name);
+
+/**
+ * @brief Print the report as a single JSON object
+ * @param output Stream to write to
+ * @param stats Gathered statistics
+ * @param source_name Source the statistics belong to
+ */
+void stats_print_json(FILE* output, const CompilerStats* stats, const char* source_name);
+
+#endif /* STATS_H */
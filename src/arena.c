@@ -3,27 +3,67 @@
  * @brief Implementation of memory arena for efficient allocations
  */
 
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS, madvise
+
 #include "../include/arena.h"
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <stdio.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define ARENA_HAVE_MMAP 1
+#endif
+
+#define ARENA_MIN_BLOCK_SIZE 4096
+#define ARENA_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define ARENA_SCRATCH_SIZE (64 * 1024)
+
+static inline size_t round_up(size_t value, size_t multiple) {
+  return (value + multiple - 1) & ~(multiple - 1); // multiple is a power of two
+}
+
 /**
- * Create a new arena block
+ * Create an arena block: one allocation holding the header and its memory
  */
-static ArenaBlock* arena_block_create(size_t size) {
-  ArenaBlock* block = malloc(sizeof(ArenaBlock));
-  if (!block) return NULL;
+static ArenaBlock* arena_block_create(Arena* arena, size_t size) {
+  size_t total = sizeof(ArenaBlock) + size;
+  ArenaBlock* block = NULL;
   
-  block->memory = malloc(size);
-  if (!block->memory) {
-    free(block);
-    return NULL;
+#ifdef ARENA_HAVE_MMAP
+  if (arena->flags & (ARENA_FLAG_MMAP | ARENA_FLAG_HUGE_PAGES)) {
+    long page_size = sysconf(_SC_PAGESIZE);
+    size_t granule = (arena->flags & ARENA_FLAG_HUGE_PAGES) ? ARENA_HUGE_PAGE_SIZE :
+                     (page_size > 0 ? (size_t)page_size : 4096);
+    size_t mapped_size = round_up(total, granule);
+    
+    void* memory = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory != MAP_FAILED) {
+#ifdef MADV_HUGEPAGE
+      if (arena->flags & ARENA_FLAG_HUGE_PAGES) {
+        madvise(memory, mapped_size, MADV_HUGEPAGE);
+      }
+#endif
+      block = memory;
+      block->size = mapped_size - sizeof(ArenaBlock); // Use the whole mapping
+      block->mapped = true;
+    }
+    // Otherwise fall back to malloc
+  }
+#endif
+  
+  if (!block) {
+    block = malloc(total);
+    if (!block) return NULL;
+    block->size = size;
+    block->mapped = false;
   }
   
-  block->size = size;
   block->used = 0;
   block->next = NULL;
+  arena->total_allocated += block->size;
   
   return block;
 }
@@ -31,58 +71,137 @@ static ArenaBlock* arena_block_create(size_t size) {
 /**
  * Destroy an arena block
  */
-static void arena_block_destroy(ArenaBlock* block) {
-  if (block) {
-    free(block->memory);
-    free(block);
+static void arena_block_destroy(Arena* arena, ArenaBlock* block) {
+  if (!block) return;
+  
+  arena->total_allocated -= block->size;
+  
+#ifdef ARENA_HAVE_MMAP
+  if (block->mapped) {
+    munmap(block, sizeof(ArenaBlock) + block->size);
+    return;
   }
+#endif
+  free(block);
 }
 
 Arena* arena_create(size_t initial_capacity) {
+  return arena_create_ex(initial_capacity, ARENA_DEFAULT_ALIGNMENT, 0);
+}
+
+Arena* arena_create_ex(size_t initial_capacity, size_t alignment, unsigned int flags) {
   Arena* arena = malloc(sizeof(Arena));
   if (!arena) return NULL;
   
-  arena->first = arena_block_create(initial_capacity);
+  if (initial_capacity < ARENA_MIN_BLOCK_SIZE) {
+    initial_capacity = ARENA_MIN_BLOCK_SIZE;
+  }
+  
+  arena->initial_block_size = initial_capacity;
+  arena->next_block_size = initial_capacity * 2;
+  arena->alignment = alignment ? alignment : ARENA_DEFAULT_ALIGNMENT;
+  arena->flags = flags;
+  arena->total_allocated = 0;
+  arena->total_used = 0;
+  arena->retain_limit = (size_t)-1; // Keep everything by default
+  arena->cleanups = NULL;
+  arena->scratch = NULL;
+  
+  arena->first = arena_block_create(arena, initial_capacity);
   if (!arena->first) {
     free(arena);
     return NULL;
   }
-  
   arena->current = arena->first;
-  arena->initial_block_size = initial_capacity;
-  arena->total_allocated = initial_capacity;
-  arena->total_used = 0;
   
   return arena;
 }
 
-void* arena_alloc(Arena* arena, size_t size) {
-  // Align size to 8-byte boundary for better memory access
-  size = (size + 7) & ~7;
-  
-  // Check if there's enough space in the current block
-  if (arena->current->used + size > arena->current->size) {
-    // Need a new block
-    size_t new_block_size = size > arena->initial_block_size ? 
-                           size : arena->initial_block_size;
-    
-    // Double the block size for future allocations
-    new_block_size = new_block_size * 2;
-    
-    ArenaBlock* new_block = arena_block_create(new_block_size);
-    if (!new_block) return NULL;
-    
-    arena->current->next = new_block;
-    arena->current = new_block;
-    arena->total_allocated += new_block_size;
+// Offset in the block at which an allocation with this alignment would start
+static inline size_t arena_aligned_offset(ArenaBlock* block, size_t alignment) {
+  uintptr_t address = (uintptr_t)(block->data + block->used);
+  return block->used + ((alignment - (address & (alignment - 1))) & (alignment - 1));
+}
+
+static inline bool arena_block_fits(ArenaBlock* block, size_t size, size_t alignment) {
+  return arena_aligned_offset(block, alignment) + size <= block->size;
+}
+
+// Put a dedicated block at the head of the chain, out of the way of current
+static void arena_push_front(Arena* arena, ArenaBlock* block) {
+  block->next = arena->first;
+  arena->first = block;
+}
+
+/*
+ * Find room for an allocation that does not fit the current block.
+ *
+ * Blocks after current are always empty (kept by a reset or a rewind), so
+ * they are tried first. Large requests get a block of their own at the head
+ * of the chain rather than becoming current, so the current block's
+ * remaining space is not abandoned because of one big allocation. Regular
+ * blocks grow geometrically up to ARENA_MAX_BLOCK_SIZE.
+ */
+static ArenaBlock* arena_find_block(Arena* arena, size_t size, size_t alignment) {
+  size_t needed = size + alignment - 1; // Room for worst-case padding
+  bool is_large = needed > arena->next_block_size / 2;
+  
+  ArenaBlock* prev = arena->current;
+  for (ArenaBlock* block = prev->next; block; prev = block, block = block->next) {
+    if (arena_block_fits(block, size, alignment)) {
+      if (is_large) {
+        prev->next = block->next;
+        arena_push_front(arena, block);
+      } else {
+        arena->current = block;
+      }
+      return block;
+    }
   }
   
-  // Allocate from the current block
-  void* ptr = (char*)arena->current->memory + arena->current->used;
-  arena->current->used += size;
-  arena->total_used += size;
+  size_t block_size;
+  if (is_large) {
+    block_size = round_up(needed, ARENA_DEFAULT_ALIGNMENT);
+  } else {
+    block_size = arena->next_block_size;
+    if (arena->next_block_size < ARENA_MAX_BLOCK_SIZE) {
+      arena->next_block_size *= 2;
+    }
+  }
   
-  return ptr;
+  ArenaBlock* block = arena_block_create(arena, block_size);
+  if (!block) return NULL;
+  
+  if (is_large) {
+    arena_push_front(arena, block);
+  } else {
+    // Insert after current so retained blocks stay in the chain
+    block->next = arena->current->next;
+    arena->current->next = block;
+    arena->current = block;
+  }
+  
+  return block;
+}
+
+void* arena_alloc_aligned(Arena* arena, size_t size, size_t alignment) {
+  if (alignment == 0) alignment = arena->alignment;
+  
+  ArenaBlock* block = arena->current;
+  if (!arena_block_fits(block, size, alignment)) {
+    block = arena_find_block(arena, size, alignment);
+    if (!block) return NULL;
+  }
+  
+  size_t offset = arena_aligned_offset(block, alignment);
+  arena->total_used += offset + size - block->used;
+  block->used = offset + size;
+  
+  return block->data + offset;
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+  return arena_alloc_aligned(arena, size, arena->alignment);
 }
 
 void* arena_calloc(Arena* arena, size_t size) {
@@ -93,35 +212,162 @@ void* arena_calloc(Arena* arena, size_t size) {
   return ptr;
 }
 
+void* arena_realloc(Arena* arena, void* ptr, size_t old_size, size_t new_size) {
+  if (!ptr) return arena_alloc(arena, new_size);
+  if (new_size <= old_size) return ptr;
+  
+  // Extend in place when ptr is the top of the current block
+  ArenaBlock* block = arena->current;
+  unsigned char* start = ptr;
+  if (start + old_size == block->data + block->used &&
+      (size_t)(start - block->data) + new_size <= block->size) {
+    block->used += new_size - old_size;
+    arena->total_used += new_size - old_size;
+    return ptr;
+  }
+  
+  void* new_ptr = arena_alloc(arena, new_size);
+  if (new_ptr) {
+    memcpy(new_ptr, ptr, old_size);
+  }
+  return new_ptr;
+}
+
+void* arena_grow_array(Arena* arena, void* items, int* capacity, size_t item_size) {
+  int new_capacity = *capacity ? *capacity * 2 : ARENA_ARRAY_INITIAL_CAPACITY;
+  void* new_items = arena_realloc(arena, items, item_size * *capacity, item_size * new_capacity);
+  if (new_items) {
+    *capacity = new_capacity;
+  }
+  return new_items;
+}
+
 char* arena_strdup(Arena* arena, const char* str) {
   if (!str) return NULL;
   
   size_t len = strlen(str) + 1;
-  char* new_str = arena_alloc(arena, len);
+  char* new_str = arena_alloc_aligned(arena, len, 1);
   if (new_str) {
     memcpy(new_str, str, len);
   }
   return new_str;
 }
 
+void arena_add_cleanup(Arena* arena, void (*fn)(void* data), void* data) {
+  ArenaCleanup* cleanup = arena_alloc(arena, sizeof(ArenaCleanup));
+  if (!cleanup) {
+    fn(data); // Cannot track it, release now rather than leak
+    return;
+  }
+  
+  cleanup->fn = fn;
+  cleanup->data = data;
+  cleanup->next = arena->cleanups;
+  arena->cleanups = cleanup;
+}
+
+// Run cleanups registered after stop (NULL runs them all)
+static void arena_run_cleanups(Arena* arena, ArenaCleanup* stop) {
+  ArenaCleanup* cleanup = arena->cleanups;
+  while (cleanup != stop) {
+    cleanup->fn(cleanup->data);
+    cleanup = cleanup->next;
+  }
+  arena->cleanups = stop;
+}
+
+ArenaMark arena_mark(Arena* arena) {
+  ArenaMark mark;
+  mark.block = arena->current;
+  mark.used = arena->current->used;
+  mark.first = arena->first;
+  mark.total_used = arena->total_used;
+  mark.cleanups = arena->cleanups;
+  return mark;
+}
+
+void arena_rewind(Arena* arena, ArenaMark mark) {
+  arena_run_cleanups(arena, mark.cleanups);
+  
+  // Blocks current moved through since the mark (current only moves forward)
+  if (arena->current != mark.block) {
+    for (ArenaBlock* block = mark.block->next; ; block = block->next) {
+      block->used = 0;
+      if (block == arena->current) break;
+    }
+  }
+  
+  // Dedicated blocks created since the mark become free blocks after current
+  while (arena->first != mark.first) {
+    ArenaBlock* block = arena->first;
+    arena->first = block->next;
+    block->used = 0;
+    block->next = mark.block->next;
+    mark.block->next = block;
+  }
+  
+  mark.block->used = mark.used;
+  arena->current = mark.block;
+  arena->total_used = mark.total_used;
+}
+
+Arena* arena_scratch(Arena* arena) {
+  if (!arena->scratch) {
+    arena->scratch = arena_create_ex(ARENA_SCRATCH_SIZE, arena->alignment, arena->flags);
+    if (arena->scratch) {
+      arena_set_retain_limit(arena->scratch, arena->retain_limit);
+    }
+  }
+  return arena->scratch;
+}
+
 void arena_reset(Arena* arena) {
+  arena_run_cleanups(arena, NULL);
+  
+  if (arena->scratch) {
+    arena_reset(arena->scratch);
+  }
+  
+  // Keep blocks up to the retain limit, free the rest
+  size_t retained = 0;
+  ArenaBlock* last_kept = NULL;
   ArenaBlock* block = arena->first;
   while (block) {
-    block->used = 0;
-    block = block->next;
+    ArenaBlock* next = block->next;
+    
+    if (last_kept == NULL || retained + block->size <= arena->retain_limit) {
+      block->used = 0;
+      retained += block->size;
+      last_kept = block;
+    } else {
+      last_kept->next = next;
+      arena_block_destroy(arena, block);
+    }
+    
+    block = next;
   }
   
   arena->current = arena->first;
   arena->total_used = 0;
 }
 
+void arena_set_retain_limit(Arena* arena, size_t max_bytes) {
+  arena->retain_limit = max_bytes;
+  if (arena->scratch) {
+    arena_set_retain_limit(arena->scratch, max_bytes);
+  }
+}
+
 void arena_destroy(Arena* arena) {
   if (!arena) return;
   
+  arena_run_cleanups(arena, NULL);
+  arena_destroy(arena->scratch);
+  
   ArenaBlock* block = arena->first;
   while (block) {
     ArenaBlock* next = block->next;
-    arena_block_destroy(block);
+    arena_block_destroy(arena, block);
     block = next;
   }
   
@@ -131,4 +377,4 @@ void arena_destroy(Arena* arena) {
 void arena_stats(Arena* arena, size_t* total_allocated, size_t* total_used) {
   if (total_allocated) *total_allocated = arena->total_allocated;
   if (total_used) *total_used = arena->total_used;
-}
\ No newline at end of file
+}
@@ -8,40 +8,63 @@
 #include <stdlib.h>
 #include <string.h>
 
+static void pool_init(AstPool* pool) {
+  pool->chunks = NULL;
+  pool->chunk_count = 0;
+  pool->chunk_capacity = 0;
+  pool->count = 1; // Index 0 is AST_NONE
+}
+
+// Hand out the next index of a pool, adding a chunk when the last one is full
+static uint32_t pool_alloc(AstPool* pool, size_t node_size, struct Arena* arena) {
+  uint32_t index = pool->count;
+  if ((int)(index >> AST_POOL_CHUNK_BITS) == pool->chunk_count) {
+    if (pool->chunk_count == pool->chunk_capacity) {
+      pool->chunks = arena_grow_array(arena, pool->chunks, &pool->chunk_capacity, sizeof(void*));
+    }
+    pool->chunks[pool->chunk_count++] = arena_alloc(arena, node_size * AST_POOL_CHUNK_SIZE);
+  }
+  pool->count++;
+  return index;
+}
+
 Program* ast_create_program(struct Arena* arena) {
   Program* program = arena_alloc(arena, sizeof(Program));
   program->declarations = NULL;
   program->count = 0;
+  program->capacity = 0;
+  pool_init(&program->exprs);
+  pool_init(&program->stmts);
+  program->token_starts = NULL;
   return program;
 }
 
 void ast_add_declaration(Program* program, Decl* decl, struct Arena* arena) {
-  // Allocate or resize declarations array
-  if (program->declarations == NULL) {
-    program->declarations = arena_alloc(arena, sizeof(Decl*) * 8);
-  } else if (program->count % 8 == 0) {
-    Decl** new_decls = arena_alloc(arena, sizeof(Decl*) * (program->count + 8));
-    memcpy(new_decls, program->declarations, sizeof(Decl*) * program->count);
-    program->declarations = new_decls;
+  if (program->count == program->capacity) {
+    program->declarations = arena_grow_array(arena, program->declarations, &program->capacity,
+                                             sizeof(Decl*));
   }
   
   // Add declaration
   program->declarations[program->count++] = decl;
 }
 
-Expr* ast_create_expr(ExprType type, SourceLocation location, struct Arena* arena) {
-  Expr* expr = arena_alloc(arena, sizeof(Expr));
+ExprRef ast_create_expr(Program* program, ExprType type, SourceLocation location,
+                        struct Arena* arena) {
+  ExprRef ref = pool_alloc(&program->exprs, sizeof(Expr), arena);
+  Expr* expr = ast_expr(program, ref);
   expr->type = type;
-  expr->result_type = NULL;
   expr->location = location;
-  return expr;
+  return ref;
 }
 
-Stmt* ast_create_stmt(StmtType type, SourceLocation location, struct Arena* arena) {
-  Stmt* stmt = arena_alloc(arena, sizeof(Stmt));
+StmtRef ast_create_stmt(Program* program, StmtType type, SourceLocation location,
+                        struct Arena* arena) {
+  StmtRef ref = pool_alloc(&program->stmts, sizeof(Stmt), arena);
+  Stmt* stmt = ast_stmt(program, ref);
   stmt->type = type;
   stmt->location = location;
-  return stmt;
+  return ref;
 }
 
 Type* ast_create_type(TypeKind kind, SourceLocation location, struct Arena* arena) {
@@ -61,7 +84,7 @@ Type* ast_create_type(TypeKind kind, SourceLocation location, struct Arena* aren
 Decl* ast_create_decl(DeclType type, const char* name, SourceLocation location, struct Arena* arena) {
   Decl* decl = arena_alloc(arena, sizeof(Decl));
   decl->type = type;
-  decl->name = arena_strdup(arena, name);
+  decl->name = name;
   decl->location = location;
   decl->is_extern = false;
   decl->is_static = false;
@@ -0,0 +1,104 @@
+/**
+ * @file buffer.c
+ * @brief Implementation of the growable COIL output buffer
+ */
+
+#include "../include/buffer.h"
+#include "../include/arena.h"
+#include <string.h>
+
+CoilBuffer* coil_buffer_create(struct Arena* arena, size_t initial_capacity) {
+  CoilBuffer* buffer = arena_alloc(arena, sizeof(CoilBuffer));
+  if (!buffer) return NULL;
+  
+  if (initial_capacity == 0) {
+    initial_capacity = 64;
+  }
+  
+  buffer->data = arena_alloc(arena, initial_capacity);
+  buffer->size = 0;
+  buffer->capacity = buffer->data ? initial_capacity : 0;
+  buffer->arena = arena;
+  buffer->has_error = buffer->data == NULL;
+  return buffer;
+}
+
+bool coil_buffer_reserve(CoilBuffer* buffer, size_t additional) {
+  if (buffer->size + additional <= buffer->capacity) {
+    return true;
+  }
+  
+  // Grow geometrically so repeated appends stay amortized O(1)
+  size_t new_capacity = buffer->capacity ? buffer->capacity : 64;
+  while (new_capacity < buffer->size + additional) {
+    new_capacity *= 2;
+  }
+  
+  uint8_t* new_data = arena_alloc(buffer->arena, new_capacity);
+  if (!new_data) {
+    buffer->has_error = true;
+    return false;
+  }
+  
+  if (buffer->size > 0) {
+    memcpy(new_data, buffer->data, buffer->size);
+  }
+  buffer->data = new_data;
+  buffer->capacity = new_capacity;
+  return true;
+}
+
+void coil_buffer_write(CoilBuffer* buffer, const void* data, size_t size) {
+  if (size == 0 || !coil_buffer_reserve(buffer, size)) return;
+  
+  memcpy(buffer->data + buffer->size, data, size);
+  buffer->size += size;
+}
+
+void coil_buffer_write_byte(CoilBuffer* buffer, uint8_t byte) {
+  if (!coil_buffer_reserve(buffer, 1)) return;
+  
+  buffer->data[buffer->size++] = byte;
+}
+
+void coil_buffer_write_uleb128(CoilBuffer* buffer, uint64_t value) {
+  uint8_t bytes[10];
+  size_t count = 0;
+  do {
+    uint8_t byte = value & 0x7F;
+    value >>= 7;
+    bytes[count++] = byte | (value ? 0x80 : 0);
+  } while (value);
+  
+  coil_buffer_write(buffer, bytes, count);
+}
+
+void coil_buffer_write_sleb128(CoilBuffer* buffer, int64_t value) {
+  uint8_t bytes[10];
+  size_t count = 0;
+  bool more = true;
+  while (more) {
+    uint8_t byte = value & 0x7F;
+    value >>= 7; // Arithmetic shift on every supported compiler
+    more = !((value == 0 && !(byte & 0x40)) || (value == -1 && (byte & 0x40)));
+    bytes[count++] = byte | (more ? 0x80 : 0);
+  }
+  
+  coil_buffer_write(buffer, bytes, count);
+}
+
+void coil_buffer_patch(CoilBuffer* buffer, size_t offset, const void* data, size_t size) {
+  if (offset + size > buffer->size) {
+    buffer->has_error = true;
+    return;
+  }
+  
+  memcpy(buffer->data + offset, data, size);
+}
+
+bool coil_buffer_flush(CoilBuffer* buffer, FILE* output) {
+  if (buffer->has_error) return false;
+  if (buffer->size == 0) return true;
+  
+  return fwrite(buffer->data, 1, buffer->size, output) == buffer->size;
+}
@@ -3,23 +3,47 @@
  * @brief COIL C Compiler main implementation
  */
 
+#define _POSIX_C_SOURCE 200809L // mmap, fstat, sysconf
+
 #include "../include/colc.h"
 #include "../include/lexer.h"
 #include "../include/parser.h"
 #include "../include/ast.h"
-#include "../include/semantic.h"
 #include "../include/codegen.h"
+#include "../include/peephole.h"
+#include "../include/fold.h"
 #include "../include/arena.h"
+#include "../include/intern.h"
+#include "../include/stats.h"
+#include "../include/fcache.h"
+#include "../include/profile.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define COLC_HAVE_MMAP 1
+#endif
 
 #define COLC_VERSION "0.1.0"
 #define ARENA_INITIAL_SIZE (1024 * 1024) // 1MB
 
-// Global error message
-static char error_message[256] = {0};
+// Error from the last call to the non-reentrant API
+static CompilerError last_error = {false, {0}};
+
+static void compiler_set_error(CompilerError* error, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  vsnprintf(error->message, sizeof(error->message), format, args);
+  va_end(args);
+  error->has_error = true;
+}
 
 CompilerOptions compiler_default_options() {
   CompilerOptions options;
@@ -30,14 +54,87 @@ CompilerOptions compiler_default_options() {
   options.optimize = true;
   options.optimization_level = 1;
   options.emit_debug_info = false;
+  options.compact_operands = false;
   options.verbose = false;
+  options.print_stats = false;
+  options.stats_json = false;
+  options.jobs = 1;
+  options.cache_dir = NULL;
+  options.stream = false;
+  options.profile_generate = false;
+  options.profile_use = NULL;
   return options;
 }
 
-static char* read_file(const char* path) {
+// Hash of everything besides the source that changes generated code
+static uint64_t compiler_options_hash(CompilerOptions options, const Profile* profile) {
+  uint64_t hash = fcache_hash(FCACHE_HASH_SEED, COLC_VERSION, strlen(COLC_VERSION));
+  uint8_t flags[3] = { options.emit_debug_info, options.compact_operands, options.profile_generate };
+  hash = fcache_hash(hash, &options.optimization_level, sizeof(options.optimization_level));
+  if (profile && !profile->generate) {
+    hash = fcache_hash(hash, &profile->hash, sizeof(profile->hash));
+  }
+  return fcache_hash(hash, flags, sizeof(flags));
+}
+
+#ifdef COLC_HAVE_MMAP
+typedef struct {
+  void* address;
+  size_t size;
+} SourceMapping;
+
+static void unmap_source(void* data) {
+  SourceMapping* mapping = data;
+  munmap(mapping->address, mapping->size);
+}
+
+/*
+ * Map a source file read-only, tied to the arena's lifetime. Only used when
+ * the file does not end on a page boundary, so the zero-filled tail of the
+ * last page provides the NUL sentinel the lexer expects. Returns NULL (with
+ * no error set) whenever the caller should fall back to reading the file.
+ */
+static const char* map_file(const char* path, size_t* length, Arena* arena) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+  
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+    close(fd);
+    return NULL;
+  }
+  
+  size_t size = (size_t)st.st_size;
+  long page_size = sysconf(_SC_PAGESIZE);
+  if (page_size <= 0 || size % (size_t)page_size == 0) {
+    close(fd);
+    return NULL;
+  }
+  
+  void* address = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (address == MAP_FAILED) return NULL;
+  
+  posix_madvise(address, size, POSIX_MADV_SEQUENTIAL);
+  
+  SourceMapping* mapping = arena_alloc(arena, sizeof(SourceMapping));
+  if (!mapping) {
+    munmap(address, size);
+    return NULL;
+  }
+  mapping->address = address;
+  mapping->size = size;
+  arena_add_cleanup(arena, unmap_source, mapping);
+  
+  *length = size;
+  return address;
+}
+#endif
+
+static char* read_file(const char* path, size_t* length, Arena* arena, CompilerError* error) {
   FILE* file = fopen(path, "rb");
   if (!file) {
-    snprintf(error_message, sizeof(error_message), "Could not open file '%s'", path);
+    compiler_set_error(error, "Could not open file '%s'", path);
     return NULL;
   }
   
@@ -47,10 +144,10 @@ static char* read_file(const char* path) {
   fseek(file, 0, SEEK_SET);
   
   // Allocate memory for file content
-  char* buffer = (char*)malloc(size + 1);
+  char* buffer = arena_alloc(arena, size + 1);
   if (!buffer) {
     fclose(file);
-    snprintf(error_message, sizeof(error_message), "Memory allocation failed for file '%s'", path);
+    compiler_set_error(error, "Memory allocation failed for file '%s'", path);
     return NULL;
   }
   
@@ -59,81 +156,325 @@ static char* read_file(const char* path) {
   fclose(file);
   
   if (bytes_read < size) {
-    free(buffer);
-    snprintf(error_message, sizeof(error_message), "Failed to read file '%s'", path);
+    compiler_set_error(error, "Failed to read file '%s'", path);
     return NULL;
   }
   
   // Null-terminate
   buffer[size] = '\0';
   
+  *length = size;
   return buffer;
 }
 
+// Load a source file into memory owned by the arena (mapped when possible)
+static const char* load_source(const char* path, size_t* length, Arena* arena,
+                               CompilerError* error) {
+#ifdef COLC_HAVE_MMAP
+  const char* mapped = map_file(path, length, arena);
+  if (mapped) return mapped;
+#endif
+  return read_file(path, length, arena, error);
+}
+
+// Print one top-level declaration of the AST dump
+static void print_declaration(int index, Decl* decl) {
+  printf("Declaration %d: ", index);
+  
+  if (decl->type == DECL_VAR) {
+    printf("Variable '%s'\n", decl->name);
+  } else if (decl->type == DECL_FUNC) {
+    printf("Function '%s' with %d parameters\n", decl->name, 
+           decl->declared_type->as.function.param_count);
+  } else {
+    printf("Other declaration\n");
+  }
+}
+
 // Print AST for debugging
 static void print_ast(Program* program) {
   printf("AST dump:\n");
   printf("Program with %d declarations\n", program->count);
   
   for (int i = 0; i < program->count; i++) {
-    Decl* decl = program->declarations[i];
-    
-    printf("Declaration %d: ", i);
-    
-    if (decl->type == DECL_VAR) {
-      printf("Variable '%s'\n", decl->name);
-    } else if (decl->type == DECL_FUNC) {
-      printf("Function '%s' with %d parameters\n", decl->name, 
-             decl->declared_type->as.function.param_count);
+    print_declaration(i, program->declarations[i]);
+  }
+}
+
+static void destroy_node_arena(void* data) {
+  arena_destroy(data);
+}
+
+/*
+ * The profile -fprofile-generate fills in or -fprofile-use reads, in
+ * *profile (NULL with neither). Returns false, with the error set, if the
+ * profile file cannot be read.
+ */
+static bool open_profile(CompilerContext* context, CompilerOptions options, Profile** profile) {
+  *profile = NULL;
+  if (options.profile_generate) {
+    *profile = profile_create(context->strings, context->arena);
+    if (!*profile) {
+      compiler_set_error(&context->error, "Memory allocation failed");
+      return false;
+    }
+  } else if (options.profile_use) {
+    *profile = profile_load(options.profile_use, context->strings, context->arena);
+    if (!*profile) {
+      compiler_set_error(&context->error, "Could not read profile file '%s'", options.profile_use);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Code generator writing to output, configured from the options
+static CodeGenerator* create_codegen(CompilerContext* context, Program* program, FILE* output,
+                                     CompilerOptions options, CompilerStats* stats) {
+  CodeGenerator* codegen = codegen_create_with_symbols(program, output, context->symbols,
+                                                       context->arena);
+  if (!codegen) return NULL;
+  
+  codegen->optimization_level = options.optimization_level;
+  codegen->emit_debug_info = options.emit_debug_info;
+  codegen->compact_operands = options.compact_operands;
+  codegen->jobs = options.jobs;
+  if (options.print_stats) {
+    codegen->opcode_counts = stats->opcode_counts;
+  }
+  return codegen;
+}
+
+// Reports and cache update once code generation has succeeded
+static void finish_compilation(CompilerContext* context, CodeGenerator* codegen,
+                               const char* source_name, CompilerOptions options,
+                               CompilerStats* stats) {
+  if (options.print_stats) {
+    stats_count_chains(stats, codegen->symbols, context->strings);
+    if (options.stats_json) {
+      stats_print_json(stderr, stats, source_name);
     } else {
-      printf("Other declaration\n");
+      stats_print(stderr, stats, source_name);
     }
   }
+  
+  // Only a successful compilation updates the cache
+  if (codegen->cache && !fcache_save(codegen->cache) && options.verbose) {
+    printf("Could not write function cache '%s'\n", codegen->cache->path);
+  }
+  
+  if (options.verbose) {
+    if (codegen->cache) {
+      printf("Function cache: %d reused, %d stored\n", codegen->cache->hits,
+             codegen->cache->stored);
+    }
+    if (codegen->peephole && codegen->peephole->optimize) {
+      printf("Peephole rewrites:\n");
+      for (int i = 0; i < PEEPHOLE_PATTERN_COUNT; i++) {
+        printf("  %-20s %d\n", peephole_pattern_name(i), codegen->peephole->hits[i]);
+      }
+    }
+    printf("Compilation successful\n");
+  }
 }
 
-bool compiler_compile_string(const char* source, const char* source_name, 
-                             const char* output_file, CompilerOptions options) {
-  if (!source || !source_name || !output_file) {
-    snprintf(error_message, sizeof(error_message), "Invalid arguments to compiler_compile_string");
+/*
+ * Parse and generate one top-level declaration at a time. Tokens are lexed
+ * on demand, AST nodes go to an arena of their own, and each function body
+ * is released as soon as its code has been written to the output, so no
+ * more than one function body and its code are held at a time. What still
+ * grows with the program is the source text and per-declaration state: the
+ * declarations themselves, symbols, literals and debug entries. The
+ * function cache and threads need the whole program, so -cache-dir and -j
+ * do not apply.
+ */
+static bool compile_streamed(CompilerContext* context, const char* source, size_t length,
+                             const char* source_name, const char* output_file,
+                             CompilerOptions options) {
+  Arena* arena = context->arena;
+  CompilerError* error = &context->error;
+  
+  CompilerStats stats;
+  if (options.print_stats) {
+    stats_init(&stats);
+  }
+  
+  Profile* profile;
+  if (!open_profile(context, options, &profile)) {
+    return false;
+  }
+  
+  Lexer* lexer = lexer_create_with_length(source, length, source_name, context->strings, arena);
+  if (!lexer) {
+    compiler_set_error(error, "Failed to initialize lexer");
+    return false;
+  }
+  
+  Arena* nodes = arena_create(ARENA_INITIAL_SIZE);
+  if (!nodes) {
+    compiler_set_error(error, "Memory allocation failed");
+    return false;
+  }
+  arena_add_cleanup(arena, destroy_node_arena, nodes);
+  
+  // The parser's own tables stay in the context arena
+  Parser* parser = parser_create(lexer, arena);
+  if (!parser) {
+    compiler_set_error(error, "Failed to initialize parser");
+    return false;
+  }
+  parser->arena = nodes;
+  
+  FILE* output = fopen(output_file, "wb");
+  if (!output) {
+    compiler_set_error(error, "Could not open output file '%s'", output_file);
+    return false;
+  }
+  
+  CodeGenerator* codegen = create_codegen(context, parser->program, output, options,
+                                          &stats);
+  if (!codegen) {
+    compiler_set_error(error, "Failed to initialize code generator");
+    fclose(output);
+    remove(output_file);
     return false;
   }
+  codegen->profile = profile;
+  
+  if (options.print_ast) {
+    printf("AST dump:\n");
+  }
+  
+  bool success = codegen_begin(codegen);
+  for (int index = 0; success; index++) {
+    if (options.print_stats) {
+      stats_phase_begin(&stats, nodes);
+    }
+    Decl* decl = parser_next_declaration(parser);
+    if (options.print_stats) {
+      stats_phase_end(&stats, PHASE_PARSE, nodes);
+    }
+    
+    const char* parse_err = parser_error(parser);
+    if (parse_err) {
+      compiler_set_error(error, "Parse error: %s", parse_err);
+      fclose(output);
+      remove(output_file);
+      return false;
+    }
+    if (!decl) break;
+    
+    if (options.print_stats) {
+      stats_count_declaration(&stats, parser->program, decl);
+    }
+    if (options.print_ast) {
+      print_declaration(index, decl);
+    }
+    
+    // Counters are numbered on the unfolded tree, the same at every -O level
+    if (profile) {
+      profile_number_counters(parser->program, decl);
+    }
+    
+    if (options.optimization_level >= 1) {
+      if (options.print_stats) {
+        stats_phase_begin(&stats, nodes);
+      }
+      fold_declaration(parser->program, decl);
+      if (options.print_stats) {
+        stats_phase_end(&stats, PHASE_FOLD, nodes);
+      }
+    }
+    
+    if (options.print_stats) {
+      stats_phase_begin(&stats, arena);
+    }
+    success = codegen_stream_declaration(codegen, decl);
+    if (options.print_stats) {
+      stats_phase_end(&stats, PHASE_CODEGEN, arena);
+    }
+    
+    // Small functions stay, to be inlined into later callers
+    if (!codegen_inlines(codegen, decl)) {
+      parser_release_body(parser, decl);
+    }
+  }
   
-  Arena* arena = arena_create(ARENA_INITIAL_SIZE);
-  if (!arena) {
-    snprintf(error_message, sizeof(error_message), "Memory allocation failed");
+  if (success) {
+    if (options.print_stats) {
+      stats_phase_begin(&stats, arena);
+    }
+    success = codegen_finish(codegen);
+    if (options.print_stats) {
+      stats_phase_end(&stats, PHASE_CODEGEN, arena);
+    }
+  }
+  
+  fclose(output);
+  
+  // Code was written out as it went, so leave no partial file behind
+  if (!success) {
+    compiler_set_error(error, "Code generation failed: %s", 
+             codegen->has_error ? codegen->error_message : "Unknown error");
+    remove(output_file);
     return false;
   }
   
+  finish_compilation(context, codegen, source_name, options, &stats);
+  return true;
+}
+
+// Compile source that stays valid until the context's next compilation
+static bool compile_source(CompilerContext* context, const char* source, size_t length,
+                           const char* source_name, const char* output_file,
+                           CompilerOptions options) {
+  Arena* arena = context->arena;
+  CompilerError* error = &context->error;
+  
   if (options.verbose) {
     printf("Compiling '%s' to '%s'\n", source_name, output_file);
   }
   
+  if (options.stream) {
+    return compile_streamed(context, source, length, source_name, output_file, options);
+  }
+  
+  CompilerStats stats;
+  if (options.print_stats) {
+    stats_init(&stats);
+    stats_phase_begin(&stats, arena);
+  }
+  
   // Initialize lexer
-  Lexer* lexer = lexer_create(source, source_name, arena);
+  Lexer* lexer = lexer_create_with_length(source, length, source_name, context->strings, arena);
   if (!lexer) {
-    snprintf(error_message, sizeof(error_message), "Failed to initialize lexer");
-    arena_destroy(arena);
+    compiler_set_error(error, "Failed to initialize lexer");
     return false;
   }
   
+  // Lex the whole file up front; the parser and -tokens share the array
+  TokenArray* tokens = lexer_tokenize(lexer);
+  
+  if (options.print_stats) {
+    stats_phase_end(&stats, PHASE_LEX, arena);
+    stats.token_count = tokens->count;
+  }
+  
   // Print tokens if requested
   if (options.print_tokens) {
     printf("Tokens:\n");
-    Token token;
-    do {
-      token = lexer_next_token(lexer);
-      printf("Token: %d\n", token.type);
-    } while (token.type != TOKEN_EOF);
-    
-    // Reset lexer
-    lexer = lexer_create(source, source_name, arena);
+    for (int i = 0; i < tokens->count; i++) {
+      printf("Token: %d\n", tokens->types[i]);
+    }
   }
   
   // Initialize parser
-  Parser* parser = parser_create(lexer, arena);
+  if (options.print_stats) {
+    stats_phase_begin(&stats, arena);
+  }
+  Parser* parser = parser_create_with_tokens(lexer, tokens, arena);
   if (!parser) {
-    snprintf(error_message, sizeof(error_message), "Failed to initialize parser");
-    arena_destroy(arena);
+    compiler_set_error(error, "Failed to initialize parser");
     return false;
   }
   
@@ -142,43 +483,83 @@ bool compiler_compile_string(const char* source, const char* source_name,
   if (!program) {
     const char* err = parser_error(parser);
     if (err) {
-      snprintf(error_message, sizeof(error_message), "Parse error: %s", err);
+      compiler_set_error(error, "Parse error: %s", err);
     } else {
-      snprintf(error_message, sizeof(error_message), "Parse error: Unknown error");
+      compiler_set_error(error, "Parse error: Unknown error");
     }
-    arena_destroy(arena);
     return false;
   }
   
   // Check for parser errors
   const char* parse_err = parser_error(parser);
   if (parse_err) {
-    snprintf(error_message, sizeof(error_message), "Parse error: %s", parse_err);
-    arena_destroy(arena);
+    compiler_set_error(error, "Parse error: %s", parse_err);
     return false;
   }
   
+  if (options.print_stats) {
+    stats_phase_end(&stats, PHASE_PARSE, arena);
+    stats_count_ast(&stats, program);
+  }
+  
   // Print AST if requested
   if (options.print_ast) {
     print_ast(program);
   }
   
+  Profile* profile;
+  if (!open_profile(context, options, &profile)) {
+    return false;
+  }
+  
+  // Cache keys hash the tokens of each declaration, so take them before
+  // folding rewrites the tree
+  uint64_t* cache_keys = NULL;
+  if (options.cache_dir) {
+    cache_keys = fcache_program_keys(program, tokens, compiler_options_hash(options, profile),
+                                     options.emit_debug_info, arena);
+  }
+  
+  // Counters are numbered on the unfolded tree, the same at every -O level
+  if (profile) {
+    for (int i = 0; i < program->count; i++) {
+      profile_number_counters(program, program->declarations[i]);
+    }
+  }
+  
+  // Simplify constant expressions and dead branches
+  if (options.optimization_level >= 1) {
+    if (options.print_stats) {
+      stats_phase_begin(&stats, arena);
+    }
+    fold_program(program);
+    if (options.print_stats) {
+      stats_phase_end(&stats, PHASE_FOLD, arena);
+    }
+  }
+  
   // Open output file
   FILE* output = fopen(output_file, "wb");
   if (!output) {
-    snprintf(error_message, sizeof(error_message), "Could not open output file '%s'", output_file);
-    arena_destroy(arena);
+    compiler_set_error(error, "Could not open output file '%s'", output_file);
     return false;
   }
   
   // Generate code
-  CodeGenerator* codegen = codegen_create(program, output, arena);
+  if (options.print_stats) {
+    stats_phase_begin(&stats, arena);
+  }
+  CodeGenerator* codegen = create_codegen(context, program, output, options, &stats);
   if (!codegen) {
-    snprintf(error_message, sizeof(error_message), "Failed to initialize code generator");
+    compiler_set_error(error, "Failed to initialize code generator");
     fclose(output);
-    arena_destroy(arena);
     return false;
   }
+  if (options.cache_dir) {
+    codegen->cache = fcache_open(options.cache_dir, source_name, context->strings, arena);
+    codegen->cache_keys = cache_keys;
+  }
+  codegen->profile = profile;
   
   bool codegen_success = codegen_generate(codegen);
   
@@ -186,42 +567,141 @@ bool compiler_compile_string(const char* source, const char* source_name,
   fclose(output);
   
   if (!codegen_success) {
-    snprintf(error_message, sizeof(error_message), "Code generation failed: %s", 
+    compiler_set_error(error, "Code generation failed: %s", 
              codegen->has_error ? codegen->error_message : "Unknown error");
-    arena_destroy(arena);
     return false;
   }
   
-  // Free memory
-  arena_destroy(arena);
+  if (options.print_stats) {
+    stats_phase_end(&stats, PHASE_CODEGEN, arena);
+  }
   
-  if (options.verbose) {
-    printf("Compilation successful\n");
+  finish_compilation(context, codegen, source_name, options, &stats);
+  return true;
+}
+
+CompilerContext* compiler_context_create(size_t retain_limit) {
+  CompilerContext* context = malloc(sizeof(CompilerContext));
+  if (!context) return NULL;
+  
+  context->arena = arena_create(ARENA_INITIAL_SIZE);
+  if (!context->arena) {
+    free(context);
+    return NULL;
+  }
+  arena_set_retain_limit(context->arena, retain_limit ? retain_limit : COMPILER_CONTEXT_RETAIN_LIMIT);
+  
+  context->strings = NULL;
+  context->symbols = NULL;
+  context->error.has_error = false;
+  context->error.message[0] = '\0';
+  context->compilation_count = 0;
+  return context;
+}
+
+void compiler_context_destroy(CompilerContext* context) {
+  if (!context) return;
+  
+  arena_destroy(context->arena);
+  free(context);
+}
+
+// Recycle the previous compilation's memory and set up fresh tables
+static bool compiler_context_begin(CompilerContext* context) {
+  if (context->compilation_count++ > 0) {
+    arena_reset(context->arena);
+  }
+  
+  context->error.has_error = false;
+  context->error.message[0] = '\0';
+  
+  context->strings = intern_pool_create(context->arena);
+  context->symbols = symbol_table_create(context->arena);
+  if (!context->strings || !context->symbols) {
+    compiler_set_error(&context->error, "Memory allocation failed");
+    return false;
   }
   
   return true;
 }
 
-bool compiler_compile_file(CompilerOptions options) {
+bool compiler_context_compile_string(CompilerContext* context, const char* source,
+                                     const char* source_name, const char* output_file,
+                                     CompilerOptions options) {
+  if (!compiler_context_begin(context)) return false;
+  
+  if (!source || !source_name || !output_file) {
+    compiler_set_error(&context->error, "Invalid arguments to compiler_compile_string");
+    return false;
+  }
+  
+  return compile_source(context, source, strlen(source), source_name, output_file, options);
+}
+
+bool compiler_context_compile_file(CompilerContext* context, CompilerOptions options) {
+  if (!compiler_context_begin(context)) return false;
+  
   if (!options.input_file) {
-    snprintf(error_message, sizeof(error_message), "No input file specified");
+    compiler_set_error(&context->error, "No input file specified");
     return false;
   }
   
-  char* source = read_file(options.input_file);
+  // The source (mapped or read) lives until the arena is reset or destroyed
+  size_t length = 0;
+  const char* source = load_source(options.input_file, &length, context->arena, &context->error);
   if (!source) {
     return false; // Error message set by read_file
   }
   
-  bool result = compiler_compile_string(source, options.input_file, 
-                                      options.output_file, options);
+  return compile_source(context, source, length, options.input_file, options.output_file,
+                        options);
+}
+
+const char* compiler_context_error(CompilerContext* context) {
+  return context->error.has_error ? context->error.message : NULL;
+}
+
+bool compiler_compile_string_r(const char* source, const char* source_name,
+                               const char* output_file, CompilerOptions options,
+                               CompilerError* error) {
+  CompilerContext* context = compiler_context_create(0);
+  if (!context) {
+    compiler_set_error(error, "Memory allocation failed");
+    return false;
+  }
+  
+  bool result = compiler_context_compile_string(context, source, source_name, output_file, options);
+  *error = context->error;
+  
+  compiler_context_destroy(context);
+  return result;
+}
+
+bool compiler_compile_file_r(CompilerOptions options, CompilerError* error) {
+  CompilerContext* context = compiler_context_create(0);
+  if (!context) {
+    compiler_set_error(error, "Memory allocation failed");
+    return false;
+  }
+  
+  bool result = compiler_context_compile_file(context, options);
+  *error = context->error;
   
-  free(source);
+  compiler_context_destroy(context);
   return result;
 }
 
+bool compiler_compile_string(const char* source, const char* source_name, 
+                             const char* output_file, CompilerOptions options) {
+  return compiler_compile_string_r(source, source_name, output_file, options, &last_error);
+}
+
+bool compiler_compile_file(CompilerOptions options) {
+  return compiler_compile_file_r(options, &last_error);
+}
+
 const char* compiler_error() {
-  return error_message[0] ? error_message : NULL;
+  return last_error.has_error ? last_error.message : NULL;
 }
 
 void compiler_print_version() {
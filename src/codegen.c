@@ -5,23 +5,56 @@
 
 #include "../include/codegen.h"
 #include "../include/arena.h"
+#include "../include/intern.h"
+#include "../include/cof.h"
+#include "../include/peephole.h"
+#include "../include/fcache.h"
+#include "../include/parallel.h"
+#include "../include/inline.h"
+#include "../include/loop.h"
+#include "../include/profile.h"
 #include <string.h>
 #include <stdlib.h>
 
 /* Symbol table implementation */
 
 #define SYMBOL_TABLE_INITIAL_SIZE 64
+#define CODEGEN_BUFFER_INITIAL_SIZE (64 * 1024) // 64KB
+#define CODEGEN_TEMP_INITIAL_CAPACITY 64
 
-static unsigned int hash_string(const char* str) {
-  unsigned int hash = 5381;
-  int c;
-  
-  while ((c = *str++)) {
-    hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
-  }
-  
-  return hash;
-}
+// Temporary variable states, indexed by var ID
+#define TEMP_NONE 0 // Not a temporary (named local, parameter, or never allocated)
+#define TEMP_LIVE 1 // Temporary holding a value that is still needed
+#define TEMP_FREE 2 // Temporary available for reuse
+
+/**
+ * @brief Function body being inlined at a call site
+ */
+typedef struct InlineFrame {
+  Decl* decl;
+  int value;                 // Var ID of the returned value, -1 until the return statement
+  struct InlineFrame* outer; // The body this call appears in, or NULL for the function itself
+} InlineFrame;
+
+/**
+ * @brief Value a loop keeps in a temporary from its preheader on
+ */
+typedef struct LoopValue {
+  Expr* expr;      // Subexpression it stands for, or NULL
+  int var;
+  bool owned;      // Held by this loop rather than shared with an enclosing one
+  bool constant;   // Holds value, so any use of that integer constant can share it
+  long long value;
+} LoopValue;
+
+/**
+ * @brief Strength-reduced product, advanced with its induction variable
+ */
+typedef struct LoopStep {
+  Stmt* stmt; // The step of the induction variable
+  int var;    // Product
+  int delta;  // Var ID of the amount added to the product after the step
+} LoopStep;
 
 SymbolTable* symbol_table_create(struct Arena* arena) {
   SymbolTable* table = arena_alloc(arena, sizeof(SymbolTable));
@@ -29,83 +62,196 @@ SymbolTable* symbol_table_create(struct Arena* arena) {
   table->buckets = arena_calloc(arena, sizeof(SymbolEntry*) * table->bucket_count);
   table->size = 0;
   table->current_scope = 0;
+  table->lookup_floor = 0;
+  table->scope_stack = NULL;
+  table->free_entries = NULL;
   table->arena = arena;
   return table;
 }
 
+/**
+ * Double the bucket count once the load factor passes 3/4.
+ * Each old chain splits into exactly two new chains, and both halves keep
+ * their original order so inner scopes still shadow outer ones.
+ */
+static void symbol_table_grow(SymbolTable* table) {
+  int old_count = table->bucket_count;
+  int new_count = old_count * 2;
+  SymbolEntry** new_buckets = arena_calloc(table->arena, sizeof(SymbolEntry*) * new_count);
+  if (!new_buckets) return; // Keep the old table; lookups stay correct, just slower
+  
+  for (int i = 0; i < old_count; i++) {
+    SymbolEntry** low_tail = &new_buckets[i];
+    SymbolEntry** high_tail = &new_buckets[i + old_count];
+    
+    for (SymbolEntry* entry = table->buckets[i]; entry; ) {
+      SymbolEntry* next = entry->next;
+      entry->next = NULL;
+      
+      if (entry->hash & old_count) {
+        *high_tail = entry;
+        high_tail = &entry->next;
+      } else {
+        *low_tail = entry;
+        low_tail = &entry->next;
+      }
+      
+      entry = next;
+    }
+  }
+  
+  table->buckets = new_buckets;
+  table->bucket_count = new_count;
+}
+
 void symbol_table_enter_scope(SymbolTable* table) {
   table->current_scope++;
 }
 
 void symbol_table_exit_scope(SymbolTable* table) {
-  // We don't actually remove symbols; we just check scopes during lookup
-  if (table->current_scope > 0) {
-    table->current_scope--;
+  if (table->current_scope == 0) return;
+  
+  // Pop every entry of the innermost scope; each is the head of its bucket
+  while (table->scope_stack && table->scope_stack->symbol.scope_level == table->current_scope) {
+    SymbolEntry* entry = table->scope_stack;
+    table->scope_stack = entry->scope_next;
+    
+    SymbolEntry** link = &table->buckets[entry->hash & (table->bucket_count - 1)];
+    while (*link != entry) {
+      link = &(*link)->next;
+    }
+    *link = entry->next;
+    
+    entry->next = table->free_entries;
+    table->free_entries = entry;
+    table->size--;
   }
+  
+  table->current_scope--;
 }
 
 Symbol* symbol_table_add(SymbolTable* table, const char* name, Type* type, bool is_global, int var_id) {
-  unsigned int hash = hash_string(name) % table->bucket_count;
+  unsigned int hash = intern_hash(name);
+  SymbolEntry** bucket = &table->buckets[hash & (table->bucket_count - 1)];
   
-  // Check if symbol already exists in current scope
-  SymbolEntry* entry = table->buckets[hash];
-  while (entry) {
-    if (strcmp(entry->symbol.name, name) == 0 && entry->symbol.scope_level == table->current_scope) {
+  // Symbols of the current scope sit at the front of the chain
+  for (SymbolEntry* entry = *bucket; entry && entry->symbol.scope_level == table->current_scope; entry = entry->next) {
+    if (entry->symbol.name == name) {
       return NULL; // Symbol already exists in current scope
     }
-    entry = entry->next;
   }
   
-  // Create new entry
-  SymbolEntry* new_entry = arena_alloc(table->arena, sizeof(SymbolEntry));
-  new_entry->symbol.name = arena_strdup(table->arena, name);
+  // Create new entry, recycling one from an exited scope if possible
+  SymbolEntry* new_entry = table->free_entries;
+  if (new_entry) {
+    table->free_entries = new_entry->next;
+  } else {
+    new_entry = arena_alloc(table->arena, sizeof(SymbolEntry));
+  }
+  
+  new_entry->symbol.name = name;
   new_entry->symbol.type = type;
   new_entry->symbol.scope_level = table->current_scope;
   new_entry->symbol.is_global = is_global;
   new_entry->symbol.var_id = var_id;
-  
-  // Add to bucket
-  new_entry->next = table->buckets[hash];
-  table->buckets[hash] = new_entry;
+  new_entry->symbol.symbol_index = -1;
+  new_entry->hash = hash;
+  
+  // Add to bucket and scope stack
+  new_entry->next = *bucket;
+  *bucket = new_entry;
+  new_entry->scope_next = table->scope_stack;
+  table->scope_stack = new_entry;
   table->size++;
   
+  if (table->size > table->bucket_count - table->bucket_count / 4) {
+    symbol_table_grow(table);
+  }
+  
   return &new_entry->symbol;
 }
 
 Symbol* symbol_table_lookup(SymbolTable* table, const char* name) {
-  unsigned int hash = hash_string(name) % table->bucket_count;
+  unsigned int hash = intern_hash(name);
   
-  // Find the symbol in the most recent scope
-  SymbolEntry* entry = table->buckets[hash];
-  Symbol* best_match = NULL;
-  
-  while (entry) {
-    if (strcmp(entry->symbol.name, name) == 0) {
-      // If we haven't found a match yet, or this one is in a more recent scope
-      if (!best_match || entry->symbol.scope_level > best_match->scope_level) {
-        best_match = &entry->symbol;
-      }
+  // The first match is the one from the innermost visible scope
+  for (SymbolEntry* entry = table->buckets[hash & (table->bucket_count - 1)]; entry; entry = entry->next) {
+    if (entry->symbol.name == name &&
+        (entry->symbol.scope_level >= table->lookup_floor || entry->symbol.scope_level == 0)) {
+      return &entry->symbol;
     }
-    entry = entry->next;
   }
   
-  return best_match;
+  return NULL;
 }
 
 /* COIL Code Generator implementation */
 
 CodeGenerator* codegen_create(Program* program, FILE* output, struct Arena* arena) {
+  return codegen_create_with_symbols(program, output, symbol_table_create(arena), arena);
+}
+
+CodeGenerator* codegen_create_with_symbols(Program* program, FILE* output, SymbolTable* symbols,
+                                           struct Arena* arena) {
   CodeGenerator* gen = arena_alloc(arena, sizeof(CodeGenerator));
   gen->program = program;
-  gen->symbols = symbol_table_create(arena);
+  gen->symbols = symbols;
   gen->arena = arena;
   gen->output = output;
+  gen->buffer = coil_buffer_create(arena, CODEGEN_BUFFER_INITIAL_SIZE);
   gen->var_counter = 0;
   gen->label_counter = 0;
+  gen->label_offsets = NULL;
+  gen->label_capacity = 0;
+  gen->label_base = 0;
+  gen->fixups = NULL;
+  gen->fixup_count = 0;
+  gen->fixup_capacity = 0;
   gen->current_scope = 0;
+  gen->current_function = NULL;
   gen->current_function_return_type = NULL;
-  gen->string_literals = NULL;
-  gen->string_count = 0;
+  gen->optimization_level = 0;
+  gen->emit_debug_info = false;
+  gen->compact_operands = false;
+  gen->code_start = 0;
+  gen->header_offset = 0;
+  gen->flushed = 0;
+  gen->free_temps = NULL;
+  gen->free_temp_count = 0;
+  gen->free_temp_capacity = 0;
+  gen->temp_states = NULL;
+  gen->temp_state_capacity = 0;
+  gen->temp_base = 0;
+  gen->literals = literal_pool_create(arena);
+  gen->globals = NULL;
+  gen->global_count = 0;
+  gen->global_capacity = 0;
+  gen->debug_entries = NULL;
+  gen->debug_count = 0;
+  gen->debug_capacity = 0;
+  gen->peephole = NULL;
+  gen->opcode_counts = NULL;
+  gen->cache = NULL;
+  gen->cache_keys = NULL;
+  gen->cache_key = 0;
+  gen->literal_uses = NULL;
+  gen->literal_use_count = 0;
+  gen->literal_use_capacity = 0;
+  gen->captured = NULL;
+  gen->jobs = 1;
+  gen->inline_frames = NULL;
+  gen->loop_values = NULL;
+  gen->loop_value_count = 0;
+  gen->loop_value_capacity = 0;
+  gen->loop_steps = NULL;
+  gen->loop_step_count = 0;
+  gen->loop_step_capacity = 0;
+  gen->loop_zero = -1;
+  gen->loop_addresses = NULL;
+  gen->loop_function = NULL;
+  gen->profile = NULL;
+  gen->profile_counts = NULL;
+  gen->profile_base = -1;
   gen->has_error = false;
   gen->error_message = NULL;
   return gen;
@@ -156,72 +302,577 @@ uint8_t codegen_map_type(Type* type) {
 }
 
 void codegen_emit_instruction(CodeGenerator* gen, uint8_t opcode, uint8_t qualifier, uint8_t operand_count) {
-  fputc(opcode, gen->output);
-  fputc(qualifier, gen->output);
-  fputc(operand_count, gen->output);
+  if (gen->peephole && gen->peephole->active) {
+    peephole_add_instruction(gen->peephole, gen->buffer->size, opcode, qualifier, operand_count);
+  }
+  if (gen->opcode_counts) {
+    gen->opcode_counts[opcode]++;
+  }
+  
+  uint8_t header[3] = { opcode, qualifier, operand_count };
+  coil_buffer_write(gen->buffer, header, sizeof(header));
+}
+
+// Integer operand data of 1, 2, 4 or 8 bytes, widened to 64 bits
+static int64_t operand_integer(const void* data, size_t size, bool is_signed) {
+  switch (size) {
+    case 1: { uint8_t v; memcpy(&v, data, 1); return is_signed ? (int64_t)(int8_t)v : (int64_t)v; }
+    case 2: { uint16_t v; memcpy(&v, data, 2); return is_signed ? (int64_t)(int16_t)v : (int64_t)v; }
+    case 4: { uint32_t v; memcpy(&v, data, 4); return is_signed ? (int64_t)(int32_t)v : (int64_t)v; }
+    default: { int64_t v; memcpy(&v, data, 8); return v; }
+  }
+}
+
+// Operand data, LEB128-encoded for integers when compact_operands is set
+static void codegen_write_operand_data(CodeGenerator* gen, uint8_t qualifier, uint8_t type,
+                                       const void* data, size_t size) {
+  if (!data || size == 0) return;
+  
+  if (gen->compact_operands && (size == 1 || size == 2 || size == 4 || size == 8)) {
+    switch (qualifier) {
+      case OPQUAL_VAR:
+      case OPQUAL_SYM:
+      case OPQUAL_STR:
+        coil_buffer_write_uleb128(gen->buffer, (uint64_t)operand_integer(data, size, false));
+        return;
+        
+      case OPQUAL_IMM:
+        if (type == 0x00) { // COIL_TYPE_INT
+          coil_buffer_write_sleb128(gen->buffer, operand_integer(data, size, true));
+          return;
+        }
+        if (type == 0x01) { // COIL_TYPE_UINT
+          coil_buffer_write_uleb128(gen->buffer, (uint64_t)operand_integer(data, size, false));
+          return;
+        }
+        break;
+        
+      default:
+        break;
+    }
+  }
+  
+  coil_buffer_write(gen->buffer, data, size);
 }
 
 void codegen_emit_operand(CodeGenerator* gen, uint8_t qualifier, uint8_t type, const void* data, size_t size) {
-  fputc(qualifier, gen->output);
-  fputc(type, gen->output);
+  uint8_t header[2] = { qualifier, type };
+  coil_buffer_write(gen->buffer, header, sizeof(header));
+  
+  size_t data_offset = gen->buffer->size;
+  codegen_write_operand_data(gen, qualifier, type, data, size);
   
-  if (data && size > 0) {
-    fwrite(data, 1, size, gen->output);
+  if (gen->peephole && gen->peephole->active) {
+    peephole_add_operand(gen->peephole, qualifier, type, data_offset,
+                         gen->buffer->size - data_offset, -1);
   }
 }
 
 int codegen_new_label(CodeGenerator* gen) {
+  int index = gen->label_counter - gen->label_base;
+  if (index == gen->label_capacity) {
+    gen->label_offsets = arena_grow_array(arena_scratch(gen->arena), gen->label_offsets,
+                                          &gen->label_capacity, sizeof(uint32_t));
+  }
+  gen->label_offsets[index] = CODEGEN_LABEL_UNBOUND;
   return gen->label_counter++;
 }
 
-void codegen_emit_label(CodeGenerator* gen, int label_id) {
-  // Emit a symbol directive for the label
-  uint8_t directive_opcode = 0xD3; // DIR_OPCODE_SYMBOL
-  uint8_t qualifier = 0x01; // SYMBOL_LOCAL
+void codegen_emit_label_operand(CodeGenerator* gen, int label_id) {
+  uint8_t header[2] = { OPQUAL_LBL, 0x00 };
+  coil_buffer_write(gen->buffer, header, sizeof(header));
+  
+  // Backward branches know their target already; the rest are patched later.
+  // The peephole optimizer moves code, so while it records every branch is.
+  bool recording = gen->peephole && gen->peephole->active;
+  uint32_t target = gen->label_offsets[label_id - gen->label_base];
+  int fixup = -1;
+  if (target == CODEGEN_LABEL_UNBOUND || recording) {
+    if (gen->fixup_count == gen->fixup_capacity) {
+      gen->fixups = arena_grow_array(arena_scratch(gen->arena), gen->fixups,
+                                     &gen->fixup_capacity, sizeof(LabelFixup));
+    }
+    fixup = gen->fixup_count++;
+    gen->fixups[fixup].offset = gen->buffer->size;
+    gen->fixups[fixup].label = label_id;
+  }
+  
+  if (recording) {
+    peephole_add_operand(gen->peephole, OPQUAL_LBL, 0x00, gen->buffer->size, sizeof(target), fixup);
+  }
+  coil_buffer_write(gen->buffer, &target, sizeof(target));
+}
+
+/**
+ * Patch every pending branch with its label's offset and start a new set
+ * of labels. Labels never cross function boundaries, so this runs when a
+ * function starts and ends (and once more for file-scope code), and the
+ * label state lives in the scratch arena like the temporaries'.
+ */
+static void codegen_resolve_labels(CodeGenerator* gen) {
+  for (int i = 0; i < gen->fixup_count; i++) {
+    LabelFixup* fixup = &gen->fixups[i];
+    if (fixup->label < 0) continue; // Branch removed by the peephole optimizer
+    
+    uint32_t target = gen->label_offsets[fixup->label - gen->label_base];
+    
+    if (target == CODEGEN_LABEL_UNBOUND) {
+      gen->has_error = true;
+      gen->error_message = arena_strdup(gen->arena, "Branch to a label that was never emitted");
+      break;
+    }
+    coil_buffer_patch(gen->buffer, fixup->offset, &target, sizeof(target));
+  }
+  
+  gen->label_offsets = NULL;
+  gen->label_capacity = 0;
+  gen->label_base = gen->label_counter;
+  gen->fixups = NULL;
+  gen->fixup_count = 0;
+  gen->fixup_capacity = 0;
+}
+
+static void codegen_set_temp_state(CodeGenerator* gen, int var_id, uint8_t state) {
+  int index = var_id - gen->temp_base;
+  if (index >= gen->temp_state_capacity) {
+    int new_capacity = gen->temp_state_capacity ? gen->temp_state_capacity : CODEGEN_TEMP_INITIAL_CAPACITY;
+    while (new_capacity <= index) {
+      new_capacity *= 2;
+    }
+    
+    uint8_t* new_states = arena_calloc(arena_scratch(gen->arena), new_capacity);
+    if (gen->temp_states) {
+      memcpy(new_states, gen->temp_states, gen->temp_state_capacity);
+    }
+    gen->temp_states = new_states;
+    gen->temp_state_capacity = new_capacity;
+  }
+  
+  gen->temp_states[index] = state;
+}
+
+int codegen_new_temp(CodeGenerator* gen) {
+  // Reuse the most recently released temporary; it is likely still hot in the VM
+  if (gen->free_temp_count > 0) {
+    int var_id = gen->free_temps[--gen->free_temp_count];
+    gen->temp_states[var_id - gen->temp_base] = TEMP_LIVE;
+    return var_id;
+  }
+  
+  int var_id = gen->var_counter++;
+  if (gen->optimization_level >= 1) {
+    codegen_set_temp_state(gen, var_id, TEMP_LIVE);
+  }
+  return var_id;
+}
+
+void codegen_release_temp(CodeGenerator* gen, int var_id) {
+  if (gen->optimization_level < 1) return;
   
-  char label_name[32];
-  sprintf(label_name, "L%d", label_id);
-  uint16_t name_len = strlen(label_name) + 1;
-  uint16_t length = name_len;
+  // Only live temporaries can be recycled; named variables and errors (-1) are ignored
+  int index = var_id - gen->temp_base;
+  if (index < 0 || index >= gen->temp_state_capacity || gen->temp_states[index] != TEMP_LIVE) {
+    return;
+  }
   
-  fputc(directive_opcode, gen->output);
-  fputc(qualifier, gen->output);
-  fwrite(&length, sizeof(length), 1, gen->output);
+  if (gen->free_temp_count == gen->free_temp_capacity) {
+    gen->free_temps = arena_grow_array(arena_scratch(gen->arena), gen->free_temps,
+                                       &gen->free_temp_capacity, sizeof(int));
+  }
   
-  fputc(name_len - 1, gen->output); // Emit name length
-  fwrite(label_name, 1, name_len - 1, gen->output); // Emit name without null terminator
+  gen->temp_states[index] = TEMP_FREE;
+  gen->free_temps[gen->free_temp_count++] = var_id;
+}
+
+/**
+ * Forget all recycled temporaries so the next function starts with a clean pool
+ * 
+ * The per-function arrays live in the scratch arena and are released in bulk
+ * by the rewind at the end of codegen_function_declaration; state is indexed
+ * from temp_base so it only covers the variables of the current function.
+ */
+static void codegen_reset_temps(CodeGenerator* gen) {
+  gen->free_temps = NULL;
+  gen->free_temp_count = 0;
+  gen->free_temp_capacity = 0;
+  gen->temp_states = NULL;
+  gen->temp_state_capacity = 0;
+  gen->temp_base = gen->var_counter;
+}
+
+void codegen_emit_label(CodeGenerator* gen, int label_id) {
+  gen->label_offsets[label_id - gen->label_base] = codegen_code_offset(gen, gen->buffer->size);
 }
 
 int codegen_add_string_literal(CodeGenerator* gen, const char* str) {
-  // Check if string already exists
-  for (int i = 0; i < gen->string_count; i++) {
-    if (strcmp(gen->string_literals[i], str) == 0) {
-      return i;
+  int id = literal_pool_add(gen->literals, str);
+  
+  // The function cache replays the additions to number literals the same way
+  if (gen->cache_key && id >= 0) {
+    if (gen->literal_use_count == gen->literal_use_capacity) {
+      gen->literal_uses = arena_grow_array(arena_scratch(gen->arena), gen->literal_uses,
+                                           &gen->literal_use_capacity, sizeof(int));
+    }
+    gen->literal_uses[gen->literal_use_count++] = id;
+  }
+  return id;
+}
+
+// Literal pool as the read-only data section (layout in literal_pool_write)
+static void codegen_emit_rodata(CodeGenerator* gen) {
+  if (gen->literals->count == 0) return;
+  
+  literal_pool_layout(gen->literals);
+  literal_pool_write(gen->literals, gen->buffer);
+}
+
+/* Global symbols */
+
+static uint8_t codegen_symbol_flags(Decl* decl) {
+  uint8_t flags = 0;
+  
+  if (decl->type == DECL_FUNC) {
+    flags |= SYMBOL_FLAG_FUNCTION;
+    if (decl->as.func.body) flags |= SYMBOL_FLAG_DEFINED;
+  } else if (!decl->is_extern) {
+    flags |= SYMBOL_FLAG_DEFINED;
+  }
+  
+  if (decl->is_static) flags |= SYMBOL_FLAG_STATIC;
+  return flags;
+}
+
+// Definition to inline calls from, or NULL
+static Decl* codegen_inline_decl(CodeGenerator* gen, Decl* decl) {
+  if (gen->optimization_level < 2 || decl->type != DECL_FUNC) return NULL;
+  
+  // Instrumented code counts each call as an entry of the callee
+  if (gen->profile && gen->profile->generate) return NULL;
+  
+  int max_nodes = INLINE_MAX_NODES;
+  const uint64_t* counts = gen->profile && decl->as.func.body ?
+                           profile_counts(gen->profile, decl) : NULL;
+  if (counts) {
+    if (counts[0] == 0) return NULL; // Never called: copies would only grow the callers
+    if (profile_is_hot(gen->profile, counts[0])) max_nodes = INLINE_HOT_MAX_NODES;
+  }
+  return inline_candidate(gen->program, decl, max_nodes) ? decl : NULL;
+}
+
+/**
+ * Add a global to the symbol table and give it the next symbol index. A
+ * redeclaration in the same scope (prototype, then definition) keeps the
+ * existing index and only adds its flags.
+ */
+static Symbol* codegen_declare_global(CodeGenerator* gen, Decl* decl) {
+  Symbol* symbol = symbol_table_add(gen->symbols, decl->name, decl->declared_type, true, -1);
+  if (!symbol) {
+    symbol = symbol_table_lookup(gen->symbols, decl->name);
+    if (symbol && symbol->is_global && symbol->symbol_index >= 0) {
+      GlobalSymbol* global = &gen->globals[symbol->symbol_index];
+      global->flags |= codegen_symbol_flags(decl);
+      if (!global->inline_decl) {
+        global->inline_decl = codegen_inline_decl(gen, decl);
+      }
     }
+    return symbol;
+  }
+  
+  if (gen->global_count == gen->global_capacity) {
+    gen->globals = arena_grow_array(gen->arena, gen->globals, &gen->global_capacity, sizeof(GlobalSymbol));
+  }
+  
+  Type* type = decl->declared_type;
+  if (decl->type == DECL_FUNC) {
+    type = type->as.function.return_type;
+  }
+  
+  GlobalSymbol* global = &gen->globals[gen->global_count];
+  global->name = decl->name;
+  global->flags = codegen_symbol_flags(decl);
+  global->type = codegen_map_type(type);
+  global->inline_decl = codegen_inline_decl(gen, decl);
+  global->code_offset = SYMBOL_NO_CODE;
+  global->profile_base = -1;
+  
+  symbol->symbol_index = gen->global_count++;
+  return symbol;
+}
+
+/*
+ * With -fprofile-generate, number the counters of a function definition
+ * right after it. They are static globals like any other, so worker
+ * threads declare them with the same indexes and the function cache
+ * relocates them by name.
+ */
+static void codegen_declare_counters(CodeGenerator* gen, Decl* decl, Symbol* symbol) {
+  if (!gen->profile || !gen->profile->generate || decl->type != DECL_FUNC || !decl->as.func.body) return;
+  if (!symbol || !symbol->is_global || symbol->symbol_index < 0) return;
+  
+  int function_index = symbol->symbol_index;
+  if (gen->globals[function_index].profile_base >= 0) return;
+  
+  const char** names = profile_counter_names(gen->profile, decl);
+  if (!names) {
+    gen->has_error = true;
+    gen->error_message = arena_strdup(gen->arena, "Failed to allocate profile counters");
+    return;
   }
   
-  // Add new string
-  if (gen->string_literals == NULL) {
-    gen->string_literals = arena_alloc(gen->arena, sizeof(char*) * 16);
-  } else if (gen->string_count % 16 == 0) {
-    char** new_array = arena_alloc(gen->arena, sizeof(char*) * (gen->string_count + 16));
-    memcpy(new_array, gen->string_literals, sizeof(char*) * gen->string_count);
-    gen->string_literals = new_array;
+  int base = gen->global_count;
+  int count = profile_counter_count(decl);
+  for (int i = 0; i < count; i++) {
+    // Counter names cannot clash with C identifiers, and each is declared once
+    Symbol* counter = symbol_table_add(gen->symbols, names[i], NULL, true, -1);
+    if (!counter) {
+      gen->has_error = true;
+      gen->error_message = arena_strdup(gen->arena, "Profile counter declared twice");
+      return;
+    }
+    
+    if (gen->global_count == gen->global_capacity) {
+      gen->globals = arena_grow_array(gen->arena, gen->globals, &gen->global_capacity, sizeof(GlobalSymbol));
+    }
+    
+    GlobalSymbol* global = &gen->globals[gen->global_count];
+    global->name = names[i];
+    global->flags = SYMBOL_FLAG_DEFINED | SYMBOL_FLAG_STATIC;
+    global->type = 0x01; // COIL_TYPE_UINT with width 64
+    global->inline_decl = NULL;
+    global->code_offset = SYMBOL_NO_CODE;
+    global->profile_base = -1;
+    counter->symbol_index = gen->global_count++;
   }
   
-  gen->string_literals[gen->string_count] = arena_strdup(gen->arena, str);
-  return gen->string_count++;
+  gen->globals[function_index].profile_base = base;
+}
+
+void codegen_emit_symbol_operand(CodeGenerator* gen, Symbol* symbol) {
+  uint32_t index = (uint32_t)symbol->symbol_index;
+  codegen_emit_operand(gen, OPQUAL_SYM, 0x00, &index, sizeof(index));
+}
+
+/*
+ * Symbol section: uint32 count, then per symbol index: uint8 flags
+ * (SYMBOL_FLAG_*), uint8 COIL type, uint16 name length, uint32 code offset
+ * (SYMBOL_NO_CODE unless it is a function defined here), name bytes. The
+ * loader resolves each entry once; OPQUAL_SYM operands carry the index.
+ * Functions need not appear in the code section in declaration order.
+ */
+static void codegen_emit_symtab(CodeGenerator* gen) {
+  if (gen->global_count == 0) return;
+  
+  uint32_t count = (uint32_t)gen->global_count;
+  coil_buffer_write(gen->buffer, &count, sizeof(count));
+  for (int i = 0; i < gen->global_count; i++) {
+    GlobalSymbol* global = &gen->globals[i];
+    uint16_t name_len = (uint16_t)intern_length(global->name);
+    
+    coil_buffer_write_byte(gen->buffer, global->flags);
+    coil_buffer_write_byte(gen->buffer, global->type);
+    coil_buffer_write(gen->buffer, &name_len, sizeof(name_len));
+    coil_buffer_write(gen->buffer, &global->code_offset, sizeof(global->code_offset));
+    coil_buffer_write(gen->buffer, global->name, name_len);
+  }
 }
 
 /* Expression code generation */
 
+// Children are references into the program's node pools
+static inline Expr* expr_at(CodeGenerator* gen, ExprRef ref) {
+  return ast_expr(gen->program, ref);
+}
+
+static inline Stmt* stmt_at(CodeGenerator* gen, StmtRef ref) {
+  return ast_stmt(gen->program, ref);
+}
+
+static bool is_comparison_operator(TokenType op) {
+  switch (op) {
+    case TOKEN_EQUAL_EQUAL:
+    case TOKEN_EXCLAIM_EQUAL:
+    case TOKEN_LESS:
+    case TOKEN_LESS_EQUAL:
+    case TOKEN_GREATER:
+    case TOKEN_GREATER_EQUAL:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/**
+ * Map a comparison operator to the branch qualifier taken when it holds
+ */
+static uint8_t comparison_branch(TokenType op) {
+  switch (op) {
+    case TOKEN_EQUAL_EQUAL:   return BR_EQ;
+    case TOKEN_EXCLAIM_EQUAL: return BR_NE;
+    case TOKEN_LESS:          return BR_LT;
+    case TOKEN_LESS_EQUAL:    return BR_LE;
+    case TOKEN_GREATER:       return BR_GT;
+    case TOKEN_GREATER_EQUAL: return BR_GE;
+    default:                  return BR_ALWAYS;
+  }
+}
+
+/**
+ * Get the branch qualifier for the opposite outcome of a comparison
+ */
+static uint8_t invert_branch(uint8_t qualifier) {
+  switch (qualifier) {
+    case BR_EQ: return BR_NE;
+    case BR_NE: return BR_EQ;
+    case BR_LT: return BR_GE;
+    case BR_LE: return BR_GT;
+    case BR_GT: return BR_LE;
+    case BR_GE: return BR_LT;
+    default:    return qualifier;
+  }
+}
+
+static void codegen_emit_branch(CodeGenerator* gen, uint8_t qualifier, int label) {
+  codegen_emit_instruction(gen, qualifier == BR_ALWAYS ? OP_BR : OP_BRC, qualifier, 1);
+  codegen_emit_label_operand(gen, label);
+}
+
+/**
+ * Branch on the flags set by the preceding CMP.
+ * Either label may be -1, meaning that outcome falls through.
+ */
+static void codegen_emit_condition_branch(CodeGenerator* gen, uint8_t qualifier, int true_label, int false_label) {
+  if (true_label >= 0) {
+    codegen_emit_branch(gen, qualifier, true_label);
+    if (false_label >= 0) {
+      codegen_emit_branch(gen, BR_ALWAYS, false_label);
+    }
+  } else if (false_label >= 0) {
+    codegen_emit_branch(gen, invert_branch(qualifier), false_label);
+  }
+}
+
+void codegen_condition(CodeGenerator* gen, Expr* expr, int true_label, int false_label) {
+  if (!expr) return;
+  
+  if (expr->type == EXPR_BINARY) {
+    TokenType op = expr->as.binary.operator;
+    
+    // Comparisons branch directly on the CMP flags
+    if (is_comparison_operator(op)) {
+      int left_var = codegen_expression(gen, expr_at(gen, expr->as.binary.left));
+      int right_var = codegen_expression(gen, expr_at(gen, expr->as.binary.right));
+      
+      codegen_emit_instruction(gen, OP_CMP, 0x00, 2);
+      codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &left_var, sizeof(left_var));
+      codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &right_var, sizeof(right_var));
+      codegen_release_temp(gen, left_var);
+      codegen_release_temp(gen, right_var);
+      
+      codegen_emit_condition_branch(gen, comparison_branch(op), true_label, false_label);
+      return;
+    }
+    
+    // a && b: a false skips b entirely
+    if (op == TOKEN_AMPERSAND_AMPERSAND) {
+      int skip_label = false_label >= 0 ? false_label : codegen_new_label(gen);
+      codegen_condition(gen, expr_at(gen, expr->as.binary.left), -1, skip_label);
+      codegen_condition(gen, expr_at(gen, expr->as.binary.right), true_label, false_label);
+      if (false_label < 0) {
+        codegen_emit_label(gen, skip_label);
+      }
+      return;
+    }
+    
+    // a || b: a true skips b entirely
+    if (op == TOKEN_PIPE_PIPE) {
+      int skip_label = true_label >= 0 ? true_label : codegen_new_label(gen);
+      codegen_condition(gen, expr_at(gen, expr->as.binary.left), skip_label, -1);
+      codegen_condition(gen, expr_at(gen, expr->as.binary.right), true_label, false_label);
+      if (true_label < 0) {
+        codegen_emit_label(gen, skip_label);
+      }
+      return;
+    }
+  }
+  
+  // !a just swaps the targets
+  if (expr->type == EXPR_UNARY && expr->as.unary.operator == TOKEN_EXCLAIM) {
+    codegen_condition(gen, expr_at(gen, expr->as.unary.operand), false_label, true_label);
+    return;
+  }
+  
+  // Constant conditions become an unconditional jump (or nothing)
+  if (expr->type == EXPR_INTEGER_LITERAL || expr->type == EXPR_CHAR_LITERAL) {
+    bool truth = expr->type == EXPR_INTEGER_LITERAL ? expr->as.int_literal.value != 0
+                                                     : expr->as.char_literal.value != 0;
+    int target = truth ? true_label : false_label;
+    if (target >= 0) {
+      codegen_emit_branch(gen, BR_ALWAYS, target);
+    }
+    return;
+  }
+  
+  // Anything else: compare the value against zero, which loops materialize once
+  int cond_var = codegen_expression(gen, expr);
+  
+  int zero_var = gen->loop_zero;
+  if (zero_var < 0) {
+    zero_var = codegen_new_temp(gen);
+    codegen_emit_instruction(gen, OP_MOVI, 0x00, 2);
+    codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &zero_var, sizeof(zero_var));
+    int zero = 0;
+    codegen_emit_operand(gen, OPQUAL_IMM, 0x00, &zero, sizeof(zero));
+  }
+  
+  codegen_emit_instruction(gen, OP_CMP, 0x00, 2);
+  codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &cond_var, sizeof(cond_var));
+  codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &zero_var, sizeof(zero_var));
+  codegen_release_temp(gen, cond_var);
+  codegen_release_temp(gen, zero_var);
+  
+  codegen_emit_condition_branch(gen, BR_NE, true_label, false_label);
+}
+
+/*
+ * a && b or a || b as a value: the branches of codegen_condition, which
+ * evaluates each operand at most once, set the result to 0 or 1.
+ */
+static int codegen_logical_expression(CodeGenerator* gen, Expr* expr) {
+  int result_var = codegen_new_temp(gen);
+  int false_label = codegen_new_label(gen);
+  int end_label = codegen_new_label(gen);
+  
+  codegen_condition(gen, expr, -1, false_label);
+  
+  int one = 1;
+  codegen_emit_instruction(gen, OP_MOVI, 0x00, 2);
+  codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &result_var, sizeof(result_var));
+  codegen_emit_operand(gen, OPQUAL_IMM, 0x00, &one, sizeof(one));
+  codegen_emit_branch(gen, BR_ALWAYS, end_label);
+  
+  codegen_emit_label(gen, false_label);
+  int zero = 0;
+  codegen_emit_instruction(gen, OP_MOVI, 0x00, 2);
+  codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &result_var, sizeof(result_var));
+  codegen_emit_operand(gen, OPQUAL_IMM, 0x00, &zero, sizeof(zero));
+  
+  codegen_emit_label(gen, end_label);
+  return result_var;
+}
+
 int codegen_binary_expression(CodeGenerator* gen, Expr* expr) {
+  // Logical operators short-circuit, so their operands are not generated here
+  if (expr->as.binary.operator == TOKEN_AMPERSAND_AMPERSAND ||
+      expr->as.binary.operator == TOKEN_PIPE_PIPE) {
+    return codegen_logical_expression(gen, expr);
+  }
+  
   // Generate code for the left and right operands
-  int left_var = codegen_expression(gen, expr->as.binary.left);
-  int right_var = codegen_expression(gen, expr->as.binary.right);
+  int left_var = codegen_expression(gen, expr_at(gen, expr->as.binary.left));
+  int right_var = codegen_expression(gen, expr_at(gen, expr->as.binary.right));
   
   // Create a result variable
-  int result_var = gen->var_counter++;
+  int result_var = codegen_new_temp(gen);
   
   // Map the operator to a COIL opcode
   CoilOpcode opcode;
@@ -269,10 +920,12 @@ int codegen_binary_expression(CodeGenerator* gen, Expr* expr) {
       codegen_emit_instruction(gen, OP_CMP, 0x00, 2);
       codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &left_var, sizeof(left_var));
       codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &right_var, sizeof(right_var));
+      codegen_release_temp(gen, left_var);
+      codegen_release_temp(gen, right_var);
       
       // Create a temporary for the result
-      int zero_var = gen->var_counter++;
-      int one_var = gen->var_counter++;
+      int zero_var = codegen_new_temp(gen);
+      int one_var = codegen_new_temp(gen);
       
       // Create the constants 0 and 1
       codegen_emit_instruction(gen, OP_MOVI, 0x00, 2);
@@ -290,33 +943,10 @@ int codegen_binary_expression(CodeGenerator* gen, Expr* expr) {
       int end_label = codegen_new_label(gen);
       
       // Branch to false_label if comparison fails
-      uint8_t branch_qualifier;
-      switch (expr->as.binary.operator) {
-        case TOKEN_EQUAL_EQUAL:
-          branch_qualifier = BR_NE; // Jump if NOT equal
-          break;
-        case TOKEN_EXCLAIM_EQUAL:
-          branch_qualifier = BR_EQ; // Jump if equal
-          break;
-        case TOKEN_LESS:
-          branch_qualifier = BR_GE; // Jump if NOT less than
-          break;
-        case TOKEN_LESS_EQUAL:
-          branch_qualifier = BR_GT; // Jump if NOT less than or equal
-          break;
-        case TOKEN_GREATER:
-          branch_qualifier = BR_LE; // Jump if NOT greater than
-          break;
-        case TOKEN_GREATER_EQUAL:
-          branch_qualifier = BR_LT; // Jump if NOT greater than or equal
-          break;
-        default:
-          branch_qualifier = BR_ALWAYS;
-          break;
-      }
+      uint8_t branch_qualifier = invert_branch(comparison_branch(expr->as.binary.operator));
       
       codegen_emit_instruction(gen, OP_BRC, branch_qualifier, 1);
-      codegen_emit_operand(gen, OPQUAL_LBL, 0x00, &false_label, sizeof(false_label));
+      codegen_emit_label_operand(gen, false_label);
       
       // True case: result = 1
       codegen_emit_instruction(gen, OP_MOV, 0x00, 2);
@@ -325,7 +955,7 @@ int codegen_binary_expression(CodeGenerator* gen, Expr* expr) {
       
       // Jump to end
       codegen_emit_instruction(gen, OP_BR, 0x00, 1);
-      codegen_emit_operand(gen, OPQUAL_LBL, 0x00, &end_label, sizeof(end_label));
+      codegen_emit_label_operand(gen, end_label);
       
       // False label
       codegen_emit_label(gen, false_label);
@@ -338,6 +968,8 @@ int codegen_binary_expression(CodeGenerator* gen, Expr* expr) {
       // End label
       codegen_emit_label(gen, end_label);
       
+      codegen_release_temp(gen, zero_var);
+      codegen_release_temp(gen, one_var);
       return result_var;
     default:
       // Unsupported operator, emit an error
@@ -354,15 +986,19 @@ int codegen_binary_expression(CodeGenerator* gen, Expr* expr) {
   codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &left_var, sizeof(left_var));
   codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &right_var, sizeof(right_var));
   
+  codegen_release_temp(gen, left_var);
+  codegen_release_temp(gen, right_var);
   return result_var;
 }
 
 int codegen_unary_expression(CodeGenerator* gen, Expr* expr) {
+  Expr* operand = expr_at(gen, expr->as.unary.operand);
+  
   // Generate code for the operand
-  int operand_var = codegen_expression(gen, expr->as.unary.operand);
+  int operand_var = codegen_expression(gen, operand);
   
   // Create a result variable
-  int result_var = gen->var_counter++;
+  int result_var = codegen_new_temp(gen);
   
   // Map the operator to a COIL opcode
   CoilOpcode opcode;
@@ -378,7 +1014,7 @@ int codegen_unary_expression(CodeGenerator* gen, Expr* expr) {
     case TOKEN_EXCLAIM:
       // For logical NOT, we need to compare with zero
       // Create a zero constant
-      int zero_var = gen->var_counter++;
+      int zero_var = codegen_new_temp(gen);
       codegen_emit_instruction(gen, OP_MOVI, 0x00, 2);
       codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &zero_var, sizeof(zero_var));
       int zero = 0;
@@ -388,9 +1024,10 @@ int codegen_unary_expression(CodeGenerator* gen, Expr* expr) {
       codegen_emit_instruction(gen, OP_CMP, 0x00, 2);
       codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &operand_var, sizeof(operand_var));
       codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &zero_var, sizeof(zero_var));
+      codegen_release_temp(gen, operand_var);
       
       // Create a one constant
-      int one_var = gen->var_counter++;
+      int one_var = codegen_new_temp(gen);
       codegen_emit_instruction(gen, OP_MOVI, 0x00, 2);
       codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &one_var, sizeof(one_var));
       int one = 1;
@@ -402,7 +1039,7 @@ int codegen_unary_expression(CodeGenerator* gen, Expr* expr) {
       
       // Branch if not equal to zero
       codegen_emit_instruction(gen, OP_BRC, BR_NE, 1);
-      codegen_emit_operand(gen, OPQUAL_LBL, 0x00, &false_label, sizeof(false_label));
+      codegen_emit_label_operand(gen, false_label);
       
       // True case (operand is zero): result = 1
       codegen_emit_instruction(gen, OP_MOV, 0x00, 2);
@@ -411,7 +1048,7 @@ int codegen_unary_expression(CodeGenerator* gen, Expr* expr) {
       
       // Jump to end
       codegen_emit_instruction(gen, OP_BR, 0x00, 1);
-      codegen_emit_operand(gen, OPQUAL_LBL, 0x00, &end_label, sizeof(end_label));
+      codegen_emit_label_operand(gen, end_label);
       
       // False label
       codegen_emit_label(gen, false_label);
@@ -424,6 +1061,8 @@ int codegen_unary_expression(CodeGenerator* gen, Expr* expr) {
       // End label
       codegen_emit_label(gen, end_label);
       
+      codegen_release_temp(gen, zero_var);
+      codegen_release_temp(gen, one_var);
       return result_var;
     
     case TOKEN_PLUS_PLUS:
@@ -438,13 +1077,13 @@ int codegen_unary_expression(CodeGenerator* gen, Expr* expr) {
         codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &operand_var, sizeof(operand_var));
         
         // For variables, we need to update the actual variable
-        if (expr->as.unary.operand->type == EXPR_IDENTIFIER) {
-          Symbol* symbol = symbol_table_lookup(gen->symbols, expr->as.unary.operand->as.identifier.name);
+        if (operand->type == EXPR_IDENTIFIER) {
+          Symbol* symbol = symbol_table_lookup(gen->symbols, operand->as.identifier.name);
           if (symbol) {
             if (symbol->is_global) {
               // Global variable update
               codegen_emit_instruction(gen, OP_VARSET, 0x00, 2);
-              codegen_emit_operand(gen, OPQUAL_STR, 0x00, symbol->name, strlen(symbol->name) + 1);
+              codegen_emit_symbol_operand(gen, symbol);
               codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &operand_var, sizeof(operand_var));
             } else {
               // Local variable update
@@ -461,13 +1100,13 @@ int codegen_unary_expression(CodeGenerator* gen, Expr* expr) {
         codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &operand_var, sizeof(operand_var));
         
         // Update the actual variable
-        if (expr->as.unary.operand->type == EXPR_IDENTIFIER) {
-          Symbol* symbol = symbol_table_lookup(gen->symbols, expr->as.unary.operand->as.identifier.name);
+        if (operand->type == EXPR_IDENTIFIER) {
+          Symbol* symbol = symbol_table_lookup(gen->symbols, operand->as.identifier.name);
           if (symbol) {
             if (symbol->is_global) {
               // Global variable update
               codegen_emit_instruction(gen, OP_VARSET, 0x00, 2);
-              codegen_emit_operand(gen, OPQUAL_STR, 0x00, symbol->name, strlen(symbol->name) + 1);
+              codegen_emit_symbol_operand(gen, symbol);
               codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &operand_var, sizeof(operand_var));
             } else {
               // Local variable update
@@ -484,6 +1123,7 @@ int codegen_unary_expression(CodeGenerator* gen, Expr* expr) {
         codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &result_var, sizeof(result_var));
         codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &operand_var, sizeof(operand_var));
       }
+      codegen_release_temp(gen, operand_var);
       return result_var;
     
     case TOKEN_MINUS_MINUS:
@@ -499,13 +1139,13 @@ int codegen_unary_expression(CodeGenerator* gen, Expr* expr) {
         codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &operand_var, sizeof(operand_var));
         
         // Update variable
-        if (expr->as.unary.operand->type == EXPR_IDENTIFIER) {
+        if (operand->type == EXPR_IDENTIFIER) {
           // Similar to ++ case
-          Symbol* symbol = symbol_table_lookup(gen->symbols, expr->as.unary.operand->as.identifier.name);
+          Symbol* symbol = symbol_table_lookup(gen->symbols, operand->as.identifier.name);
           if (symbol) {
             if (symbol->is_global) {
               codegen_emit_instruction(gen, OP_VARSET, 0x00, 2);
-              codegen_emit_operand(gen, OPQUAL_STR, 0x00, symbol->name, strlen(symbol->name) + 1);
+              codegen_emit_symbol_operand(gen, symbol);
               codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &operand_var, sizeof(operand_var));
             } else {
               codegen_emit_instruction(gen, OP_VARSET, 0x00, 2);
@@ -521,13 +1161,13 @@ int codegen_unary_expression(CodeGenerator* gen, Expr* expr) {
         codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &operand_var, sizeof(operand_var));
         
         // Update variable
-        if (expr->as.unary.operand->type == EXPR_IDENTIFIER) {
+        if (operand->type == EXPR_IDENTIFIER) {
           // Similar to ++ case
-          Symbol* symbol = symbol_table_lookup(gen->symbols, expr->as.unary.operand->as.identifier.name);
+          Symbol* symbol = symbol_table_lookup(gen->symbols, operand->as.identifier.name);
           if (symbol) {
             if (symbol->is_global) {
               codegen_emit_instruction(gen, OP_VARSET, 0x00, 2);
-              codegen_emit_operand(gen, OPQUAL_STR, 0x00, symbol->name, strlen(symbol->name) + 1);
+              codegen_emit_symbol_operand(gen, symbol);
               codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &operand_var, sizeof(operand_var));
             } else {
               codegen_emit_instruction(gen, OP_VARSET, 0x00, 2);
@@ -542,24 +1182,26 @@ int codegen_unary_expression(CodeGenerator* gen, Expr* expr) {
         codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &result_var, sizeof(result_var));
         codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &operand_var, sizeof(operand_var));
       }
+      codegen_release_temp(gen, operand_var);
       return result_var;
       
     case TOKEN_AMPERSAND:
       // Address-of operator
-      if (expr->as.unary.operand->type == EXPR_IDENTIFIER) {
-        Symbol* symbol = symbol_table_lookup(gen->symbols, expr->as.unary.operand->as.identifier.name);
+      if (operand->type == EXPR_IDENTIFIER) {
+        Symbol* symbol = symbol_table_lookup(gen->symbols, operand->as.identifier.name);
         if (symbol) {
           // Get variable reference
           codegen_emit_instruction(gen, OP_VARREF, 0x00, 2);
           codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &result_var, sizeof(result_var));
           
           if (symbol->is_global) {
-            codegen_emit_operand(gen, OPQUAL_STR, 0x00, symbol->name, strlen(symbol->name) + 1);
+            codegen_emit_symbol_operand(gen, symbol);
           } else {
             int var_id = symbol->var_id;
             codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &var_id, sizeof(var_id));
           }
           
+          codegen_release_temp(gen, operand_var);
           return result_var;
         }
       }
@@ -574,6 +1216,7 @@ int codegen_unary_expression(CodeGenerator* gen, Expr* expr) {
       codegen_emit_instruction(gen, OP_LOAD, 0x00, 2);
       codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &result_var, sizeof(result_var));
       codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &operand_var, sizeof(operand_var));
+      codegen_release_temp(gen, operand_var);
       return result_var;
       
     default:
@@ -588,12 +1231,13 @@ int codegen_unary_expression(CodeGenerator* gen, Expr* expr) {
   codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &result_var, sizeof(result_var));
   codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &operand_var, sizeof(operand_var));
   
+  codegen_release_temp(gen, operand_var);
   return result_var;
 }
 
 int codegen_literal_expression(CodeGenerator* gen, Expr* expr) {
   // Create a result variable
-  int result_var = gen->var_counter++;
+  int result_var = codegen_new_temp(gen);
   
   switch (expr->type) {
     case EXPR_INTEGER_LITERAL: {
@@ -651,7 +1295,7 @@ int codegen_identifier_expression(CodeGenerator* gen, Expr* expr) {
   }
   
   // Create a result variable
-  int result_var = gen->var_counter++;
+  int result_var = codegen_new_temp(gen);
   
   // Get variable value
   codegen_emit_instruction(gen, OP_VARGET, 0x00, 2);
@@ -659,7 +1303,7 @@ int codegen_identifier_expression(CodeGenerator* gen, Expr* expr) {
   
   if (symbol->is_global) {
     // Global variable
-    codegen_emit_operand(gen, OPQUAL_STR, 0x00, symbol->name, strlen(symbol->name) + 1);
+    codegen_emit_symbol_operand(gen, symbol);
   } else {
     // Local variable
     int var_id = symbol->var_id;
@@ -670,12 +1314,14 @@ int codegen_identifier_expression(CodeGenerator* gen, Expr* expr) {
 }
 
 int codegen_assign_expression(CodeGenerator* gen, Expr* expr) {
+  Expr* target = expr_at(gen, expr->as.assign.target);
+  
   // Generate code for the right-hand side
-  int value_var = codegen_expression(gen, expr->as.assign.value);
+  int value_var = codegen_expression(gen, expr_at(gen, expr->as.assign.value));
   
   // Check if left-hand side is an identifier
-  if (expr->as.assign.target->type == EXPR_IDENTIFIER) {
-    Symbol* symbol = symbol_table_lookup(gen->symbols, expr->as.assign.target->as.identifier.name);
+  if (target->type == EXPR_IDENTIFIER) {
+    Symbol* symbol = symbol_table_lookup(gen->symbols, target->as.identifier.name);
     if (!symbol) {
       gen->has_error = true;
       gen->error_message = arena_strdup(gen->arena, "Undefined variable in assignment");
@@ -685,12 +1331,12 @@ int codegen_assign_expression(CodeGenerator* gen, Expr* expr) {
     // Handle compound assignment operators
     if (expr->as.assign.operator != TOKEN_EQUAL) {
       // Get the current value of the variable
-      int current_var = gen->var_counter++;
+      int current_var = codegen_new_temp(gen);
       codegen_emit_instruction(gen, OP_VARGET, 0x00, 2);
       codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &current_var, sizeof(current_var));
       
       if (symbol->is_global) {
-        codegen_emit_operand(gen, OPQUAL_STR, 0x00, symbol->name, strlen(symbol->name) + 1);
+        codegen_emit_symbol_operand(gen, symbol);
       } else {
         int var_id = symbol->var_id;
         codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &var_id, sizeof(var_id));
@@ -723,6 +1369,12 @@ int codegen_assign_expression(CodeGenerator* gen, Expr* expr) {
         case TOKEN_CARET_EQUAL:
           opcode = OP_XOR;
           break;
+        case TOKEN_LESS_LESS_EQUAL:
+          opcode = OP_SHL;
+          break;
+        case TOKEN_GREATER_GREATER_EQUAL:
+          opcode = OP_SHR;
+          break;
         // More compound operators would go here
         default:
           gen->has_error = true;
@@ -730,11 +1382,13 @@ int codegen_assign_expression(CodeGenerator* gen, Expr* expr) {
           return -1;
       }
       
-      int result_var = gen->var_counter++;
+      int result_var = codegen_new_temp(gen);
       codegen_emit_instruction(gen, opcode, 0x00, 3);
       codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &result_var, sizeof(result_var));
       codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &current_var, sizeof(current_var));
       codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &value_var, sizeof(value_var));
+      codegen_release_temp(gen, current_var);
+      codegen_release_temp(gen, value_var);
       
       // Update value_var to the result
       value_var = result_var;
@@ -744,7 +1398,7 @@ int codegen_assign_expression(CodeGenerator* gen, Expr* expr) {
     codegen_emit_instruction(gen, OP_VARSET, 0x00, 2);
     
     if (symbol->is_global) {
-      codegen_emit_operand(gen, OPQUAL_STR, 0x00, symbol->name, strlen(symbol->name) + 1);
+      codegen_emit_symbol_operand(gen, symbol);
     } else {
       int var_id = symbol->var_id;
       codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &var_id, sizeof(var_id));
@@ -753,52 +1407,30 @@ int codegen_assign_expression(CodeGenerator* gen, Expr* expr) {
     codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &value_var, sizeof(value_var));
     
     return value_var;
-  } else if (expr->as.assign.target->type == EXPR_UNARY && 
-             expr->as.assign.target->as.unary.operator == TOKEN_STAR) {
+  } else if (target->type == EXPR_UNARY && 
+             target->as.unary.operator == TOKEN_STAR) {
     // Pointer assignment: *ptr = value
-    int ptr_var = codegen_expression(gen, expr->as.assign.target->as.unary.operand);
+    int ptr_var = codegen_expression(gen, expr_at(gen, target->as.unary.operand));
     
     // Store to memory
     codegen_emit_instruction(gen, OP_STORE, 0x00, 2);
     codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &ptr_var, sizeof(ptr_var));
     codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &value_var, sizeof(value_var));
+    codegen_release_temp(gen, ptr_var);
     
     return value_var;
-  } else if (expr->as.assign.target->type == EXPR_INDEX) {
+  } else if (target->type == EXPR_INDEX) {
     // Array assignment: arr[index] = value
-    int array_var = codegen_expression(gen, expr->as.assign.target->as.index.array);
-    int index_var = codegen_expression(gen, expr->as.assign.target->as.index.index);
+    int array_var = codegen_expression(gen, expr_at(gen, target->as.index.array));
+    int index_var = codegen_expression(gen, expr_at(gen, target->as.index.index));
     
     // Calculate the address: arr + index * element_size
-    int element_size = 4; // Default to 4 bytes (int)
-    if (expr->as.assign.target->result_type && 
-        expr->as.assign.target->result_type->kind == TYPE_POINTER &&
-        expr->as.assign.target->result_type->as.pointer.element_type) {
-      // Calculate size based on element type
-      switch (expr->as.assign.target->result_type->as.pointer.element_type->kind) {
-        case TYPE_CHAR:
-          element_size = 1;
-          break;
-        case TYPE_SHORT:
-          element_size = 2;
-          break;
-        case TYPE_INT:
-          element_size = 4;
-          break;
-        case TYPE_LONG:
-        case TYPE_DOUBLE:
-          element_size = 8;
-          break;
-        default:
-          element_size = 4;
-          break;
-      }
-    }
+    int element_size = 4; // Expressions carry no types yet, so assume int
     
     // Multiply index by element size
-    int scaled_index_var = gen->var_counter++;
+    int scaled_index_var = codegen_new_temp(gen);
     if (element_size > 1) {
-      int size_var = gen->var_counter++;
+      int size_var = codegen_new_temp(gen);
       codegen_emit_instruction(gen, OP_MOVI, 0x00, 2);
       codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &size_var, sizeof(size_var));
       codegen_emit_operand(gen, OPQUAL_IMM, 0x00, &element_size, sizeof(element_size));
@@ -807,6 +1439,7 @@ int codegen_assign_expression(CodeGenerator* gen, Expr* expr) {
       codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &scaled_index_var, sizeof(scaled_index_var));
       codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &index_var, sizeof(index_var));
       codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &size_var, sizeof(size_var));
+      codegen_release_temp(gen, size_var);
     } else {
       // No scaling needed for char arrays
       codegen_emit_instruction(gen, OP_MOV, 0x00, 2);
@@ -815,16 +1448,20 @@ int codegen_assign_expression(CodeGenerator* gen, Expr* expr) {
     }
     
     // Calculate address: array + scaled_index
-    int addr_var = gen->var_counter++;
+    int addr_var = codegen_new_temp(gen);
     codegen_emit_instruction(gen, OP_ADD, 0x00, 3);
     codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &addr_var, sizeof(addr_var));
     codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &array_var, sizeof(array_var));
     codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &scaled_index_var, sizeof(scaled_index_var));
+    codegen_release_temp(gen, array_var);
+    codegen_release_temp(gen, index_var);
+    codegen_release_temp(gen, scaled_index_var);
     
     // Store value to calculated address
     codegen_emit_instruction(gen, OP_STORE, 0x00, 2);
     codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &addr_var, sizeof(addr_var));
     codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &value_var, sizeof(value_var));
+    codegen_release_temp(gen, addr_var);
     
     return value_var;
   } else {
@@ -834,31 +1471,145 @@ int codegen_assign_expression(CodeGenerator* gen, Expr* expr) {
   }
 }
 
-int codegen_call_expression(CodeGenerator* gen, Expr* expr) {
-  // Create variables for arguments
-  int* arg_vars = arena_alloc(gen->arena, sizeof(int) * expr->as.call.arg_count);
+// Function whose body replaces this call, or NULL for a real CALL
+static Decl* codegen_inline_target(CodeGenerator* gen, Expr* expr) {
+  if (gen->optimization_level < 2) return NULL;
   
-  // Generate code for each argument
-  for (int i = 0; i < expr->as.call.arg_count; i++) {
-    arg_vars[i] = codegen_expression(gen, expr->as.call.arguments[i]);
-  }
+  Expr* function = expr_at(gen, expr->as.call.function);
+  if (function->type != EXPR_IDENTIFIER) return NULL;
   
-  // Generate code for the function pointer
-  int func_var = codegen_expression(gen, expr->as.call.function);
+  Symbol* symbol = symbol_table_lookup(gen->symbols, function->as.identifier.name);
+  if (!symbol || !symbol->is_global || symbol->symbol_index < 0) return NULL;
   
-  // Emit parameter setup
-  for (int i = 0; i < expr->as.call.arg_count; i++) {
-    codegen_emit_instruction(gen, OP_PARAM, i, 1);
-    codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &arg_vars[i], sizeof(arg_vars[i]));
+  // The body is gone once a streamed compilation has released it
+  Decl* decl = gen->globals[symbol->symbol_index].inline_decl;
+  if (!decl || !decl->as.func.body ||
+      decl->declared_type->as.function.param_count != expr->as.call.arg_count) {
+    return NULL;
   }
   
-  // Create a result variable
-  int result_var = gen->var_counter++;
+  // Bounded nesting, and no function inside its own inlined body
+  int depth = 0;
+  for (InlineFrame* frame = gen->inline_frames; frame; frame = frame->outer) {
+    if (frame->decl == decl || ++depth >= INLINE_MAX_DEPTH) return NULL;
+  }
+  return decl;
+}
+
+// Whether a block declares locals directly, so needs its own variable scope
+static bool block_declares(CodeGenerator* gen, Stmt* block) {
+  for (int i = 0; i < block->as.block.count; i++) {
+    if (stmt_at(gen, block->as.block.statements[i])->type == STMT_DECL) return true;
+  }
+  return false;
+}
+
+/*
+ * Generate the body of decl in place of a call. Each argument is moved
+ * into a variable of its parameter's type, as the callee's prologue would
+ * with PARAM, so there is no CALL, and the value of the final return
+ * statement is the result. Names in the body are looked up past the
+ * caller's scopes, directly at file scope, as they would be in the
+ * function itself.
+ */
+static int codegen_inline_call(CodeGenerator* gen, Decl* decl, int* arg_vars) {
+  Type* type = decl->declared_type;
+  Stmt* body = stmt_at(gen, decl->as.func.body);
+  int param_count = type->as.function.param_count;
+  
+  InlineFrame frame;
+  frame.decl = decl;
+  frame.value = -1;
+  frame.outer = gen->inline_frames;
+  gen->inline_frames = &frame;
+  
+  // The parameters need a variable scope, and so does a body that declares locals
+  bool scoped = param_count > 0 || block_declares(gen, body);
+  if (scoped) {
+    codegen_emit_instruction(gen, OP_VARSC, 0x00, 0);
+  }
+  
+  // Converting to the parameter type also keeps the body from aliasing the argument
+  int* param_vars = arena_alloc(arena_scratch(gen->arena), sizeof(int) * (param_count > 0 ? param_count : 1));
+  for (int i = 0; i < param_count; i++) {
+    param_vars[i] = gen->var_counter++;
+    uint8_t coil_type = codegen_map_type(type->as.function.param_types[i]);
+    
+    codegen_emit_instruction(gen, OP_VARCR, 0x00, 2);
+    codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &param_vars[i], sizeof(param_vars[i]));
+    codegen_emit_operand(gen, OPQUAL_IMM, coil_type, NULL, 0);
+    
+    codegen_emit_instruction(gen, OP_MOV, 0x00, 2);
+    codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &param_vars[i], sizeof(param_vars[i]));
+    codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &arg_vars[i], sizeof(arg_vars[i]));
+    codegen_release_temp(gen, arg_vars[i]);
+  }
+  
+  symbol_table_enter_scope(gen->symbols);
+  int lookup_floor = gen->symbols->lookup_floor;
+  gen->symbols->lookup_floor = gen->symbols->current_scope;
+  
+  if (decl->as.func.param_names) {
+    for (int i = 0; i < param_count; i++) {
+      if (decl->as.func.param_names[i]) {
+        symbol_table_add(gen->symbols, decl->as.func.param_names[i],
+                         type->as.function.param_types[i], false, param_vars[i]);
+      }
+    }
+  }
+  
+  for (int i = 0; i < body->as.block.count; i++) {
+    codegen_statement(gen, stmt_at(gen, body->as.block.statements[i]));
+  }
+  
+  gen->symbols->lookup_floor = lookup_floor;
+  symbol_table_exit_scope(gen->symbols);
+  gen->inline_frames = frame.outer;
+  
+  if (scoped) {
+    codegen_emit_instruction(gen, OP_VAREND, 0x00, 0);
+  }
+  
+  // Falling off the end of a void function leaves an unused result
+  return frame.value >= 0 ? frame.value : codegen_new_temp(gen);
+}
+
+int codegen_call_expression(CodeGenerator* gen, Expr* expr) {
+  // Create variables for arguments
+  int* arg_vars = arena_alloc(arena_scratch(gen->arena), sizeof(int) * expr->as.call.arg_count);
+  
+  // Generate code for each argument
+  for (int i = 0; i < expr->as.call.arg_count; i++) {
+    arg_vars[i] = codegen_expression(gen, expr_at(gen, expr->as.call.arguments[i]));
+  }
+  
+  Decl* inlined = codegen_inline_target(gen, expr);
+  if (inlined) {
+    return codegen_inline_call(gen, inlined, arg_vars);
+  }
+  
+  // Generate code for the function pointer
+  int func_var = codegen_expression(gen, expr_at(gen, expr->as.call.function));
+  
+  // Emit parameter setup
+  for (int i = 0; i < expr->as.call.arg_count; i++) {
+    codegen_emit_instruction(gen, OP_PARAM, i, 1);
+    codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &arg_vars[i], sizeof(arg_vars[i]));
+  }
+  
+  // Create a result variable
+  int result_var = codegen_new_temp(gen);
   
   // Emit function call
   codegen_emit_instruction(gen, OP_CALL, 0x00, 1);
   codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &func_var, sizeof(func_var));
   
+  // Arguments and the callee are dead once the call has been made
+  for (int i = 0; i < expr->as.call.arg_count; i++) {
+    codegen_release_temp(gen, arg_vars[i]);
+  }
+  codegen_release_temp(gen, func_var);
+  
   // Get function result
   codegen_emit_instruction(gen, OP_RESULT, 0x00, 1);
   codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &result_var, sizeof(result_var));
@@ -866,9 +1617,193 @@ int codegen_call_expression(CodeGenerator* gen, Expr* expr) {
   return result_var;
 }
 
+/* Loop optimizations */
+
+static LoopNameKind codegen_resolve_loop_name(void* context, const char* name) {
+  CodeGenerator* gen = context;
+  Symbol* symbol = symbol_table_lookup(gen->symbols, name);
+  if (!symbol || symbol->is_global || symbol->scope_level == 0) return LOOP_NAME_SHARED;
+  
+  // Narrower integers wrap, and their products would not
+  if (symbol->type && (symbol->type->kind == TYPE_INT || symbol->type->kind == TYPE_LONG)) {
+    return LOOP_NAME_INTEGER;
+  }
+  return LOOP_NAME_LOCAL;
+}
+
+static int codegen_loop_value(CodeGenerator* gen, Expr* expr) {
+  for (int i = 0; i < gen->loop_value_count; i++) {
+    if (gen->loop_values[i].expr == expr) return gen->loop_values[i].var;
+  }
+  return -1;
+}
+
+static LoopValue* codegen_add_loop_value(CodeGenerator* gen, Expr* expr, int var, bool owned) {
+  if (gen->loop_value_count == gen->loop_value_capacity) {
+    LoopValue* values = arena_grow_array(arena_scratch(gen->arena), gen->loop_values,
+                                         &gen->loop_value_capacity, sizeof(LoopValue));
+    if (!values) return NULL;
+    gen->loop_values = values;
+  }
+  
+  LoopValue* value = &gen->loop_values[gen->loop_value_count++];
+  value->expr = expr;
+  value->var = var;
+  value->owned = owned;
+  value->constant = false;
+  value->value = 0;
+  return value;
+}
+
+/*
+ * A held temporary is marked as no temporary at all, so the releases of
+ * the expressions that use it leave it alone until the loop ends.
+ */
+static int codegen_hold_value(CodeGenerator* gen, Expr* expr) {
+  int var = codegen_expression(gen, expr);
+  int index = var - gen->temp_base;
+  if (var < 0 || index >= gen->temp_state_capacity || gen->temp_states[index] != TEMP_LIVE) {
+    return -1;
+  }
+  
+  gen->temp_states[index] = TEMP_NONE;
+  codegen_add_loop_value(gen, expr, var, true);
+  return var;
+}
+
+// An integer constant held by this loop or an enclosing one
+static int codegen_loop_constant(CodeGenerator* gen, long long value) {
+  for (int i = 0; i < gen->loop_value_count; i++) {
+    if (gen->loop_values[i].constant && gen->loop_values[i].value == value) {
+      return gen->loop_values[i].var;
+    }
+  }
+  
+  int var = codegen_new_temp(gen);
+  codegen_emit_instruction(gen, OP_MOVI, 0x00, 2);
+  codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &var, sizeof(var));
+  codegen_emit_operand(gen, OPQUAL_IMM, 0x00, &value, sizeof(value));
+  codegen_set_temp_state(gen, var, TEMP_NONE);
+  
+  LoopValue* entry = codegen_add_loop_value(gen, NULL, var, true);
+  if (entry) {
+    entry->constant = true;
+    entry->value = value;
+  }
+  return var;
+}
+
+/**
+ * Compute what the loop plan found invariant, and the initial value of
+ * every strength-reduced product, ahead of the loop.
+ */
+static void codegen_loop_preheader(CodeGenerator* gen, Stmt* stmt) {
+  Arena* scratch = arena_scratch(gen->arena);
+  Decl* function = gen->inline_frames ? gen->inline_frames->decl : gen->current_function;
+  if (!function || !function->as.func.body) return;
+  
+  // Collected once for all the loops of a function
+  if (gen->loop_function != function) {
+    gen->loop_addresses = arena_alloc(scratch, sizeof(LoopNames));
+    if (!gen->loop_addresses) return;
+    loop_address_taken(gen->program, stmt_at(gen, function->as.func.body), scratch,
+                       gen->loop_addresses);
+    gen->loop_function = function;
+  }
+  
+  LoopPlan plan;
+  loop_plan(gen->program, stmt, gen->loop_addresses, codegen_resolve_loop_name, gen, scratch,
+            &plan);
+  
+  for (int i = 0; i < plan.invariant_count; i++) {
+    Expr* expr = plan.invariants[i];
+    if (codegen_loop_value(gen, expr) >= 0) continue; // An enclosing loop holds it already
+    
+    if (plan.invariant_firsts[i] != i) {
+      // A repeat shares the variable of the first occurrence
+      int var = codegen_loop_value(gen, plan.invariants[plan.invariant_firsts[i]]);
+      if (var >= 0) codegen_add_loop_value(gen, expr, var, false);
+    } else if (expr->type == EXPR_INTEGER_LITERAL) {
+      codegen_add_loop_value(gen, expr, codegen_loop_constant(gen, expr->as.int_literal.value), false);
+    } else {
+      codegen_hold_value(gen, expr);
+    }
+  }
+  
+  for (int i = 0; i < plan.reduction_count; i++) {
+    LoopReduction* reduction = &plan.reductions[i];
+    if (reduction->first != i) {
+      // Advanced by the step of the first occurrence
+      int var = codegen_loop_value(gen, plan.reductions[reduction->first].product);
+      if (var >= 0) codegen_add_loop_value(gen, reduction->product, var, false);
+      continue;
+    }
+    
+    int var = codegen_hold_value(gen, reduction->product);
+    if (var < 0) continue;
+    
+    if (gen->loop_step_count == gen->loop_step_capacity) {
+      LoopStep* steps = arena_grow_array(arena_scratch(gen->arena), gen->loop_steps,
+                                         &gen->loop_step_capacity, sizeof(LoopStep));
+      if (!steps) break;
+      gen->loop_steps = steps;
+    }
+    
+    LoopStep* step = &gen->loop_steps[gen->loop_step_count++];
+    step->stmt = reduction->step;
+    step->var = var;
+    step->delta = codegen_loop_constant(gen, reduction->delta);
+  }
+  
+  if (plan.compares_zero && gen->loop_zero < 0) {
+    int zero_var = codegen_new_temp(gen);
+    codegen_emit_instruction(gen, OP_MOVI, 0x00, 2);
+    codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &zero_var, sizeof(zero_var));
+    int zero = 0;
+    codegen_emit_operand(gen, OPQUAL_IMM, 0x00, &zero, sizeof(zero));
+    codegen_set_temp_state(gen, zero_var, TEMP_NONE);
+    
+    codegen_add_loop_value(gen, NULL, zero_var, true);
+    gen->loop_zero = zero_var;
+  }
+}
+
+// Advance the products of the induction variable this statement steps
+static void codegen_loop_step(CodeGenerator* gen, Stmt* stmt) {
+  for (int i = 0; i < gen->loop_step_count; i++) {
+    LoopStep* step = &gen->loop_steps[i];
+    if (step->stmt != stmt) continue;
+    
+    codegen_emit_instruction(gen, OP_ADD, 0x00, 3);
+    codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &step->var, sizeof(step->var));
+    codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &step->var, sizeof(step->var));
+    codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &step->delta, sizeof(step->delta));
+  }
+}
+
+// Drop what a loop held, returning its temporaries to the pool
+static void codegen_end_loop(CodeGenerator* gen, int value_base, int step_base, int loop_zero) {
+  for (int i = value_base; i < gen->loop_value_count; i++) {
+    if (gen->loop_values[i].owned) {
+      codegen_set_temp_state(gen, gen->loop_values[i].var, TEMP_LIVE);
+      codegen_release_temp(gen, gen->loop_values[i].var);
+    }
+  }
+  
+  gen->loop_value_count = value_base;
+  gen->loop_step_count = step_base;
+  gen->loop_zero = loop_zero;
+}
+
 int codegen_expression(CodeGenerator* gen, Expr* expr) {
   if (!expr) return -1;
   
+  // Computed before the loop
+  if (gen->loop_value_count > 0) {
+    int var = codegen_loop_value(gen, expr);
+    if (var >= 0) return var;
+  }
+  
   switch (expr->type) {
     case EXPR_BINARY:
       return codegen_binary_expression(gen, expr);
@@ -903,73 +1838,183 @@ int codegen_expression(CodeGenerator* gen, Expr* expr) {
 /* Statement code generation */
 
 void codegen_expression_statement(CodeGenerator* gen, Stmt* stmt) {
-  codegen_expression(gen, stmt->as.expr.expr);
+  int result_var = codegen_expression(gen, expr_at(gen, stmt->as.expr.expr));
+  codegen_release_temp(gen, result_var);
+  
+  if (gen->loop_step_count > 0) {
+    codegen_loop_step(gen, stmt);
+  }
 }
 
 void codegen_block_statement(CodeGenerator* gen, Stmt* stmt) {
   // Enter a new scope
   symbol_table_enter_scope(gen->symbols);
   
-  // Emit variable scope creation
-  codegen_emit_instruction(gen, OP_VARSC, 0x00, 0);
+  // Emit variable scope creation; from -O2 on, only for a block that declares locals
+  bool scoped = gen->optimization_level < 2 || block_declares(gen, stmt);
+  if (scoped) {
+    codegen_emit_instruction(gen, OP_VARSC, 0x00, 0);
+  }
   
   // Generate code for each statement in the block
   for (int i = 0; i < stmt->as.block.count; i++) {
-    codegen_statement(gen, stmt->as.block.statements[i]);
+    codegen_statement(gen, stmt_at(gen, stmt->as.block.statements[i]));
   }
   
   // Emit variable scope end
-  codegen_emit_instruction(gen, OP_VAREND, 0x00, 0);
+  if (scoped) {
+    codegen_emit_instruction(gen, OP_VAREND, 0x00, 0);
+  }
   
   // Exit the scope
   symbol_table_exit_scope(gen->symbols);
 }
 
+/* Profile-guided optimization */
+
+/*
+ * A counter of the current function as profile_number_counters numbered it,
+ * or -1 when not profiling. Inlined bodies have none: their points belong to
+ * another function.
+ */
+static int codegen_counter(CodeGenerator* gen, int counter) {
+  if (!gen->profile || gen->inline_frames) return -1;
+  return counter;
+}
+
+// With -fprofile-generate, add one to a counter of the current function
+static void codegen_count(CodeGenerator* gen, int counter) {
+  if (counter < 0 || gen->profile_base < 0) return;
+  
+  uint32_t index = (uint32_t)(gen->profile_base + counter);
+  int value = codegen_new_temp(gen);
+  codegen_emit_instruction(gen, OP_VARGET, 0x00, 2);
+  codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &value, sizeof(value));
+  codegen_emit_operand(gen, OPQUAL_SYM, 0x00, &index, sizeof(index));
+  
+  codegen_emit_instruction(gen, OP_INC, 0x00, 1);
+  codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &value, sizeof(value));
+  
+  codegen_emit_instruction(gen, OP_VARSET, 0x00, 2);
+  codegen_emit_operand(gen, OPQUAL_SYM, 0x00, &index, sizeof(index));
+  codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &value, sizeof(value));
+  codegen_release_temp(gen, value);
+}
+
+// With -fprofile-use, the recorded count of a counter of the current function
+static uint64_t codegen_profile_count(CodeGenerator* gen, int counter) {
+  return counter >= 0 && gen->profile_counts ? gen->profile_counts[counter] : 0;
+}
+
+/*
+ * An if/else whose else branch the profile shows ran more often than its
+ * then branch: the else branch becomes the fall-through.
+ * 
+ *   BRC <condition> then; <else>; BR end; then: <then>; end:
+ */
+static void codegen_inverted_if(CodeGenerator* gen, Stmt* stmt) {
+  int then_label = codegen_new_label(gen);
+  int end_label = codegen_new_label(gen);
+  
+  codegen_condition(gen, expr_at(gen, stmt->as.if_stmt.condition), then_label, -1);
+  codegen_statement(gen, stmt_at(gen, stmt->as.if_stmt.else_branch));
+  codegen_emit_branch(gen, BR_ALWAYS, end_label);
+  
+  codegen_emit_label(gen, then_label);
+  codegen_statement(gen, stmt_at(gen, stmt->as.if_stmt.then_branch));
+  codegen_emit_label(gen, end_label);
+}
+
 void codegen_if_statement(CodeGenerator* gen, Stmt* stmt) {
-  // Generate code for the condition
-  int cond_var = codegen_expression(gen, stmt->as.if_stmt.condition);
+  // The then and else edges, counted even when there is no else branch
+  int counter = codegen_counter(gen, stmt->as.if_stmt.profile_counter);
+  bool count_else = counter >= 0 && gen->profile_base >= 0;
+  
+  if (stmt->as.if_stmt.else_branch && counter >= 0 &&
+      codegen_profile_count(gen, counter + 1) > codegen_profile_count(gen, counter)) {
+    codegen_inverted_if(gen, stmt);
+    return;
+  }
   
   // Create labels for branches
   int false_label = codegen_new_label(gen);
   int end_label = codegen_new_label(gen);
   
-  // Compare condition with zero
-  int zero_var = gen->var_counter++;
-  codegen_emit_instruction(gen, OP_MOVI, 0x00, 2);
-  codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &zero_var, sizeof(zero_var));
-  int zero = 0;
-  codegen_emit_operand(gen, OPQUAL_IMM, 0x00, &zero, sizeof(zero));
-  
-  codegen_emit_instruction(gen, OP_CMP, 0x00, 2);
-  codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &cond_var, sizeof(cond_var));
-  codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &zero_var, sizeof(zero_var));
-  
-  // Branch if condition is false
-  codegen_emit_instruction(gen, OP_BRC, BR_EQ, 1);
-  codegen_emit_operand(gen, OPQUAL_LBL, 0x00, &false_label, sizeof(false_label));
+  // Branch to false_label if the condition fails, fall through otherwise
+  codegen_condition(gen, expr_at(gen, stmt->as.if_stmt.condition), -1, false_label);
   
   // Generate code for 'then' branch
-  codegen_statement(gen, stmt->as.if_stmt.then_branch);
+  codegen_count(gen, counter);
+  codegen_statement(gen, stmt_at(gen, stmt->as.if_stmt.then_branch));
   
-  // Jump to end if there's an 'else' branch
-  if (stmt->as.if_stmt.else_branch) {
+  // Jump to end if there's an 'else' branch (or an else edge to count)
+  if (stmt->as.if_stmt.else_branch || count_else) {
     codegen_emit_instruction(gen, OP_BR, 0x00, 1);
-    codegen_emit_operand(gen, OPQUAL_LBL, 0x00, &end_label, sizeof(end_label));
+    codegen_emit_label_operand(gen, end_label);
   }
   
   // False label
   codegen_emit_label(gen, false_label);
+  if (count_else) {
+    codegen_count(gen, counter + 1);
+  }
   
   // Generate code for 'else' branch if it exists
-  if (stmt->as.if_stmt.else_branch) {
-    codegen_statement(gen, stmt->as.if_stmt.else_branch);
+  if (stmt->as.if_stmt.else_branch || count_else) {
+    codegen_statement(gen, stmt_at(gen, stmt->as.if_stmt.else_branch));
     
     // End label
     codegen_emit_label(gen, end_label);
   }
 }
 
+/**
+ * Loops at -O2 and above: invariant values are computed in a preheader,
+ * and the test sits after the body, so an iteration runs one conditional
+ * branch and no jump back. Below -O2, loops the profile shows iterating
+ * get the same layout, without the preheader.
+ * 
+ *   preheader; BR test; body: <body>; test: BRC <condition> body
+ */
+static void codegen_rotated_while(CodeGenerator* gen, Stmt* stmt, int counter) {
+  int value_base = gen->loop_value_count;
+  int step_base = gen->loop_step_count;
+  int loop_zero = gen->loop_zero;
+  if (gen->optimization_level >= 2) {
+    codegen_loop_preheader(gen, stmt);
+  }
+  
+  int body_label = codegen_new_label(gen);
+  int test_label = codegen_new_label(gen);
+  
+  // An always-true loop has nothing to test on entry
+  Expr* condition = expr_at(gen, stmt->as.while_stmt.condition);
+  bool always = (condition->type == EXPR_INTEGER_LITERAL && condition->as.int_literal.value != 0) ||
+                (condition->type == EXPR_CHAR_LITERAL && condition->as.char_literal.value != 0);
+  if (!always) {
+    codegen_emit_branch(gen, BR_ALWAYS, test_label);
+  }
+  
+  codegen_emit_label(gen, body_label);
+  codegen_count(gen, counter);
+  // Nothing if folding removed the body
+  codegen_statement(gen, stmt_at(gen, stmt->as.while_stmt.body));
+  
+  codegen_emit_label(gen, test_label);
+  codegen_condition(gen, condition, body_label, -1);
+  
+  codegen_end_loop(gen, value_base, step_base, loop_zero);
+}
+
 void codegen_while_statement(CodeGenerator* gen, Stmt* stmt) {
+  // Counts iterations
+  int counter = codegen_counter(gen, stmt->as.while_stmt.profile_counter);
+  
+  if (gen->optimization_level >= 2 || codegen_profile_count(gen, counter) > 0) {
+    codegen_rotated_while(gen, stmt, counter);
+    return;
+  }
+  
   // Create labels
   int start_label = codegen_new_label(gen);
   int end_label = codegen_new_label(gen);
@@ -977,43 +2022,38 @@ void codegen_while_statement(CodeGenerator* gen, Stmt* stmt) {
   // Start label
   codegen_emit_label(gen, start_label);
   
-  // Generate code for condition
-  int cond_var = codegen_expression(gen, stmt->as.while_stmt.condition);
-  
-  // Compare condition with zero
-  int zero_var = gen->var_counter++;
-  codegen_emit_instruction(gen, OP_MOVI, 0x00, 2);
-  codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &zero_var, sizeof(zero_var));
-  int zero = 0;
-  codegen_emit_operand(gen, OPQUAL_IMM, 0x00, &zero, sizeof(zero));
-  
-  codegen_emit_instruction(gen, OP_CMP, 0x00, 2);
-  codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &cond_var, sizeof(cond_var));
-  codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &zero_var, sizeof(zero_var));
-  
   // Branch to end if condition is false
-  codegen_emit_instruction(gen, OP_BRC, BR_EQ, 1);
-  codegen_emit_operand(gen, OPQUAL_LBL, 0x00, &end_label, sizeof(end_label));
+  codegen_condition(gen, expr_at(gen, stmt->as.while_stmt.condition), -1, end_label);
   
   // Generate code for loop body
-  codegen_statement(gen, stmt->as.while_stmt.body);
+  codegen_count(gen, counter);
+  codegen_statement(gen, stmt_at(gen, stmt->as.while_stmt.body));
   
   // Jump back to start
   codegen_emit_instruction(gen, OP_BR, 0x00, 1);
-  codegen_emit_operand(gen, OPQUAL_LBL, 0x00, &start_label, sizeof(start_label));
+  codegen_emit_label_operand(gen, start_label);
   
   // End label
   codegen_emit_label(gen, end_label);
 }
 
 void codegen_return_statement(CodeGenerator* gen, Stmt* stmt) {
+  // An inlined body returns only from its last statement: the value is the call's result
+  if (gen->inline_frames) {
+    if (stmt->as.return_stmt.value) {
+      gen->inline_frames->value = codegen_expression(gen, expr_at(gen, stmt->as.return_stmt.value));
+    }
+    return;
+  }
+  
   if (stmt->as.return_stmt.value) {
     // Generate code for return value
-    int value_var = codegen_expression(gen, stmt->as.return_stmt.value);
+    int value_var = codegen_expression(gen, expr_at(gen, stmt->as.return_stmt.value));
     
     // Set function result
     codegen_emit_instruction(gen, OP_RESULT, 0x00, 1);
     codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &value_var, sizeof(value_var));
+    codegen_release_temp(gen, value_var);
   }
   
   // Return from function
@@ -1024,9 +2064,47 @@ void codegen_declaration_statement(CodeGenerator* gen, Stmt* stmt) {
   codegen_declaration(gen, stmt->as.decl_stmt.decl);
 }
 
+/**
+ * Add a debug entry. One at the same code offset as the last replaces it,
+ * so a statement that emits nothing before its first child (such as a
+ * block) is superseded by the child.
+ */
+static void codegen_debug_entry(CodeGenerator* gen, uint32_t code_offset, uint32_t source_offset) {
+  if (gen->debug_count > 0 && gen->debug_entries[gen->debug_count - 1].code_offset == code_offset) {
+    gen->debug_entries[gen->debug_count - 1].source_offset = source_offset;
+    return;
+  }
+  
+  if (gen->debug_count == gen->debug_capacity) {
+    gen->debug_entries = arena_grow_array(gen->arena, gen->debug_entries, &gen->debug_capacity,
+                                          sizeof(DebugEntry));
+  }
+  gen->debug_entries[gen->debug_count].code_offset = code_offset;
+  gen->debug_entries[gen->debug_count].source_offset = source_offset;
+  gen->debug_count++;
+}
+
+// Note where a statement's code starts
+static void codegen_debug_statement(CodeGenerator* gen, Stmt* stmt) {
+  codegen_debug_entry(gen, codegen_code_offset(gen, gen->buffer->size), stmt->location.offset);
+}
+
+// Debug section: uint32 count, then DebugEntry pairs in code order
+static void codegen_emit_debug(CodeGenerator* gen) {
+  if (!gen->emit_debug_info) return;
+  
+  uint32_t count = (uint32_t)gen->debug_count;
+  coil_buffer_write(gen->buffer, &count, sizeof(count));
+  coil_buffer_write(gen->buffer, gen->debug_entries, sizeof(DebugEntry) * gen->debug_count);
+}
+
 void codegen_statement(CodeGenerator* gen, Stmt* stmt) {
   if (!stmt) return;
   
+  if (gen->emit_debug_info) {
+    codegen_debug_statement(gen, stmt);
+  }
+  
   switch (stmt->type) {
     case STMT_EXPR:
       codegen_expression_statement(gen, stmt);
@@ -1068,8 +2146,8 @@ void codegen_variable_declaration(CodeGenerator* gen, Decl* decl) {
   uint8_t coil_type = codegen_map_type(decl->declared_type);
   
   if (decl->is_static || decl->is_extern) {
-    // Global variable - add to symbol table
-    symbol_table_add(gen->symbols, decl->name, decl->declared_type, true, -1);
+    // Global variable - add to symbol table (file-scope ones are already numbered)
+    codegen_declare_global(gen, decl);
     
     // No code generation for extern
     if (decl->is_extern) return;
@@ -1090,33 +2168,377 @@ void codegen_variable_declaration(CodeGenerator* gen, Decl* decl) {
     
     // Initialize if there's an initializer
     if (decl->as.var.initializer) {
-      int init_var = codegen_expression(gen, decl->as.var.initializer);
+      int init_var = codegen_expression(gen, expr_at(gen, decl->as.var.initializer));
       
       codegen_emit_instruction(gen, OP_VARSET, 0x00, 2);
       codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &var_id, sizeof(var_id));
       codegen_emit_operand(gen, OPQUAL_VAR, 0x00, &init_var, sizeof(init_var));
+      codegen_release_temp(gen, init_var);
+    }
+  }
+}
+
+/* Function cache */
+
+// Relocation kind of an operand, or -1 if its data is position independent
+static int codegen_reloc_kind(const PeepholeOperand* operand) {
+  if (operand->size == 0) return -1;
+  
+  switch (operand->qualifier) {
+    case OPQUAL_VAR: return FCACHE_RELOC_VAR;
+    case OPQUAL_SYM: return FCACHE_RELOC_SYMBOL;
+    case OPQUAL_STR: return FCACHE_RELOC_STRING;
+    case OPQUAL_LBL: return FCACHE_RELOC_LABEL;
+    default: return -1;
+  }
+}
+
+// Operand data of a relocation in the current encoding
+static uint64_t codegen_reloc_value(CodeGenerator* gen, int kind, const uint8_t* data, size_t size) {
+  if (gen->compact_operands && kind != FCACHE_RELOC_LABEL) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+      value |= (uint64_t)(data[i] & 0x7F) << (7 * i);
+    }
+    return value;
+  }
+  return (uint64_t)operand_integer(data, size, false);
+}
+
+static size_t uleb128_size(uint64_t value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    size++;
+  }
+  return size;
+}
+
+/**
+ * Copy the function just generated, starting at buffer offset start, into
+ * a position-independent fragment for the function cache or the parallel
+ * merge. Its instruction list is still in the peephole recorder, so every
+ * operand that refers to something outside the function can be turned
+ * into a relocation. Anything unexpected (a static local adding a global,
+ * a variable of file-scope code) returns NULL.
+ */
+static CachedFunction* codegen_capture_function(CodeGenerator* gen, Decl* decl, size_t start,
+                                                int var_base, int global_count, int debug_base) {
+  Peephole* peephole = gen->peephole;
+  if (gen->has_error || gen->buffer->has_error || gen->global_count != global_count) return NULL;
+  
+  Arena* scratch = arena_scratch(gen->arena);
+  ArenaMark mark = arena_mark(scratch);
+  const uint8_t* code = gen->buffer->data + start;
+  uint32_t code_size = (uint32_t)(gen->buffer->size - start);
+  uint32_t function_offset = codegen_code_offset(gen, start);
+  
+  // Distinct literals in the order they were first added
+  int* literal_ranks = arena_alloc(scratch, sizeof(int) * (gen->literals->count + 1));
+  for (int i = 0; i < gen->literals->count; i++) {
+    literal_ranks[i] = -1;
+  }
+  int literal_count = 0;
+  for (int i = 0; i < gen->literal_use_count; i++) {
+    int id = gen->literal_uses[i];
+    if (literal_ranks[id] < 0) {
+      literal_ranks[id] = literal_count++;
+    }
+  }
+  
+  // Count and check the relocations before copying anything
+  int instr_count = 0;
+  int reloc_count = 0;
+  int symbol_count = 0;
+  bool cacheable = true;
+  for (int i = 0; i < peephole->count && cacheable; i++) {
+    PeepholeInstr* instr = &peephole->instrs[i];
+    if (instr->deleted) continue;
+    instr_count++;
+    
+    for (int k = 0; k < instr->operand_count && cacheable; k++) {
+      PeepholeOperand* operand = &peephole->operands[instr->first_operand + k];
+      int kind = codegen_reloc_kind(operand);
+      if (kind < 0) continue;
+      
+      bool fits = gen->compact_operands && kind != FCACHE_RELOC_LABEL ? operand->size <= 5 :
+                  operand->size == 4 || (operand->size == 8 && kind != FCACHE_RELOC_LABEL);
+      uint64_t value = codegen_reloc_value(gen, kind, gen->buffer->data + operand->data_offset,
+                                           operand->size);
+      switch (kind) {
+        case FCACHE_RELOC_VAR:
+          fits = fits && value >= (uint64_t)var_base && value < (uint64_t)gen->var_counter;
+          break;
+        case FCACHE_RELOC_SYMBOL:
+          fits = fits && value < (uint64_t)gen->global_count;
+          symbol_count++;
+          break;
+        case FCACHE_RELOC_STRING:
+          fits = fits && value < (uint64_t)gen->literals->count && literal_ranks[value] >= 0;
+          break;
+        default:
+          fits = fits && value >= function_offset && value - function_offset <= code_size;
+          break;
+      }
+      cacheable = fits;
+      reloc_count++;
+    }
+  }
+  if (!cacheable) {
+    arena_rewind(scratch, mark);
+    return NULL;
+  }
+  
+  Arena* arena = gen->arena;
+  CachedFunction* cached = arena_calloc(arena, sizeof(CachedFunction));
+  cached->key = gen->cache_key;
+  cached->code_size = code_size;
+  cached->code = arena_alloc(arena, code_size ? code_size : 1);
+  memcpy(cached->code, code, code_size);
+  cached->relocs = arena_alloc(arena, sizeof(FcacheReloc) * (reloc_count + 1));
+  cached->instrs = arena_alloc(arena, sizeof(uint32_t) * (instr_count + 1));
+  cached->symbols = arena_alloc(arena, sizeof(char*) * (symbol_count + 1));
+  cached->literals = arena_alloc(arena, sizeof(char*) * (literal_count + 1));
+  cached->var_count = gen->var_counter - var_base;
+  
+  for (int i = 0; i < peephole->count; i++) {
+    PeepholeInstr* instr = &peephole->instrs[i];
+    if (instr->deleted) continue;
+    cached->instrs[cached->instr_count++] = (uint32_t)(instr->new_offset - start);
+    
+    for (int k = 0; k < instr->operand_count; k++) {
+      PeepholeOperand* operand = &peephole->operands[instr->first_operand + k];
+      int kind = codegen_reloc_kind(operand);
+      if (kind < 0) continue;
+      
+      uint64_t value = codegen_reloc_value(gen, kind, gen->buffer->data + operand->data_offset,
+                                           operand->size);
+      FcacheReloc* reloc = &cached->relocs[cached->reloc_count++];
+      reloc->offset = (uint32_t)(operand->data_offset - start);
+      reloc->kind = (uint8_t)kind;
+      reloc->size = operand->size;
+      
+      switch (kind) {
+        case FCACHE_RELOC_VAR:
+          reloc->value = (uint32_t)(value - var_base);
+          break;
+        case FCACHE_RELOC_SYMBOL:
+          reloc->value = (uint32_t)cached->symbol_count;
+          cached->symbols[cached->symbol_count++] = gen->globals[value].name;
+          break;
+        case FCACHE_RELOC_STRING:
+          reloc->value = (uint32_t)literal_ranks[value];
+          break;
+        default:
+          reloc->value = (uint32_t)(value - function_offset);
+          break;
+      }
+    }
+  }
+  
+  for (int i = 0; i < gen->literals->count; i++) {
+    if (literal_ranks[i] >= 0) {
+      cached->literals[literal_ranks[i]] = gen->literals->entries[i]->chars;
+    }
+  }
+  cached->literal_count = literal_count;
+  
+  cached->debug_count = gen->debug_count - debug_base;
+  cached->debug = arena_alloc(arena, sizeof(FcacheDebugEntry) * (cached->debug_count + 1));
+  for (int i = 0; i < cached->debug_count; i++) {
+    DebugEntry* entry = &gen->debug_entries[debug_base + i];
+    cached->debug[i].code_offset = entry->code_offset - function_offset;
+    cached->debug[i].source_offset = (int32_t)(entry->source_offset - decl->location.offset);
+  }
+  
+  arena_rewind(scratch, mark);
+  return cached;
+}
+
+// New position of a cached code offset: moved by every relocation before it
+static uint32_t codegen_splice_offset(const CachedFunction* cached, const int32_t* shifts,
+                                      uint32_t function_offset, uint32_t offset) {
+  int low = 0;
+  int high = cached->reloc_count;
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    if (cached->relocs[mid].offset < offset) {
+      low = mid + 1;
+    } else {
+      high = mid;
     }
   }
+  return (uint32_t)((int64_t)function_offset + offset + shifts[low]);
+}
+
+/**
+ * Emit a cached function in place of generating it, relocating its
+ * operands to this compilation's variables, symbols, literals and code
+ * offsets. Returns false, having emitted nothing, if a symbol it refers to
+ * is missing; the caller then generates the function as usual.
+ */
+static bool codegen_splice_function(CodeGenerator* gen, Decl* decl, CachedFunction* cached) {
+  Symbol* function = codegen_declare_global(gen, decl);
+  codegen_resolve_labels(gen); // Branches of preceding file-scope code
+  if (gen->has_error) return false;
+  
+  Arena* scratch = arena_scratch(gen->arena);
+  ArenaMark mark = arena_mark(scratch);
+  uint32_t* symbol_indexes = arena_alloc(scratch, sizeof(uint32_t) * (cached->symbol_count + 1));
+  for (int i = 0; i < cached->symbol_count; i++) {
+    Symbol* symbol = symbol_table_lookup(gen->symbols, cached->symbols[i]);
+    if (!symbol || !symbol->is_global || symbol->symbol_index < 0) {
+      arena_rewind(scratch, mark);
+      return false;
+    }
+    symbol_indexes[i] = (uint32_t)symbol->symbol_index;
+  }
+  
+  // Room for the code with every relocation at its largest (a 5-byte ULEB128)
+  if (!coil_buffer_reserve(gen->buffer, cached->code_size + (size_t)cached->reloc_count * 5)) {
+    arena_rewind(scratch, mark);
+    return false;
+  }
+  
+  int* literal_ids = arena_alloc(scratch, sizeof(int) * (cached->literal_count + 1));
+  for (int i = 0; i < cached->literal_count; i++) {
+    literal_ids[i] = literal_pool_add(gen->literals, cached->literals[i]);
+  }
+  
+  // New operand values, and how much each relocation moves the code after it
+  uint64_t* values = arena_alloc(scratch, sizeof(uint64_t) * (cached->reloc_count + 1));
+  uint8_t* sizes = arena_alloc(scratch, cached->reloc_count + 1);
+  int32_t* shifts = arena_alloc(scratch, sizeof(int32_t) * (cached->reloc_count + 1));
+  shifts[0] = 0;
+  for (int i = 0; i < cached->reloc_count; i++) {
+    FcacheReloc* reloc = &cached->relocs[i];
+    switch (reloc->kind) {
+      case FCACHE_RELOC_VAR: values[i] = (uint64_t)gen->var_counter + reloc->value; break;
+      case FCACHE_RELOC_SYMBOL: values[i] = symbol_indexes[reloc->value]; break;
+      case FCACHE_RELOC_STRING: values[i] = (uint64_t)literal_ids[reloc->value]; break;
+      default: values[i] = 0; break; // Needs the shifts; written below
+    }
+    
+    sizes[i] = reloc->size;
+    if (gen->compact_operands && reloc->kind != FCACHE_RELOC_LABEL) {
+      sizes[i] = (uint8_t)uleb128_size(values[i]);
+    }
+    shifts[i + 1] = shifts[i] + sizes[i] - reloc->size;
+  }
+  
+  uint32_t function_offset = codegen_code_offset(gen, gen->buffer->size);
+  if (function && function->is_global && function->symbol_index >= 0) {
+    gen->globals[function->symbol_index].code_offset = function_offset;
+  }
+  
+  // Copy the code between relocations straight into the reserved buffer space
+  uint8_t* out = gen->buffer->data + gen->buffer->size;
+  uint32_t position = 0;
+  for (int i = 0; i < cached->reloc_count; i++) {
+    FcacheReloc* reloc = &cached->relocs[i];
+    memcpy(out, cached->code + position, reloc->offset - position);
+    out += reloc->offset - position;
+    position = reloc->offset + reloc->size;
+    
+    if (reloc->kind == FCACHE_RELOC_LABEL) {
+      uint32_t target = codegen_splice_offset(cached, shifts, function_offset, reloc->value);
+      memcpy(out, &target, sizeof(target));
+      out += sizeof(target);
+    } else if (gen->compact_operands) {
+      uint64_t value = values[i];
+      do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        *out++ = value ? byte | 0x80 : byte;
+      } while (value);
+    } else if (reloc->size == 4) {
+      uint32_t value = (uint32_t)values[i];
+      memcpy(out, &value, sizeof(value));
+      out += sizeof(value);
+    } else {
+      memcpy(out, &values[i], sizeof(values[i]));
+      out += sizeof(values[i]);
+    }
+  }
+  memcpy(out, cached->code + position, cached->code_size - position);
+  gen->buffer->size = (size_t)(out - gen->buffer->data) + (cached->code_size - position);
+  
+  if (gen->opcode_counts) {
+    for (int i = 0; i < cached->instr_count; i++) {
+      gen->opcode_counts[cached->code[cached->instrs[i]]]++;
+    }
+  }
+  
+  for (int i = 0; i < cached->debug_count; i++) {
+    FcacheDebugEntry* entry = &cached->debug[i];
+    codegen_debug_entry(gen, codegen_splice_offset(cached, shifts, function_offset, entry->code_offset),
+                        (uint32_t)((int32_t)decl->location.offset + entry->source_offset));
+  }
+  
+  gen->var_counter += cached->var_count;
+  codegen_reset_temps(gen);
+  arena_rewind(scratch, mark);
+  return true;
 }
 
 void codegen_function_declaration(CodeGenerator* gen, Decl* decl) {
   // Skip if just a prototype
   if (!decl->as.func.body) return;
   
-  // Add to symbol table
-  symbol_table_add(gen->symbols, decl->name, decl->declared_type, true, -1);
+  // Add to symbol table (normally already numbered by codegen_generate)
+  Symbol* function = codegen_declare_global(gen, decl);
+  GlobalSymbol* global = function && function->is_global && function->symbol_index >= 0 ?
+                         &gen->globals[function->symbol_index] : NULL;
   
   // Emit function symbol directive
   // TODO: Emit appropriate directives for function symbol
   
   // Save current function return type
+  Decl* prev_function = gen->current_function;
   Type* prev_return_type = gen->current_function_return_type;
+  gen->current_function = decl;
   gen->current_function_return_type = decl->declared_type->as.function.return_type;
   
   // Enter function scope
   symbol_table_enter_scope(gen->symbols);
   
+  // Temporaries are recycled within a single function only
+  Arena* scratch = arena_scratch(gen->arena);
+  ArenaMark scratch_mark = arena_mark(scratch);
+  codegen_reset_temps(gen);
+  codegen_resolve_labels(gen);
+  if (gen->peephole) {
+    peephole_begin(gen->peephole, gen->buffer->size);
+  }
+  
+  // State the function cache relocates against
+  size_t function_start = gen->buffer->size;
+  int var_base = gen->var_counter;
+  int global_count = gen->global_count;
+  int debug_base = gen->debug_count;
+  gen->literal_uses = NULL;
+  gen->literal_use_count = 0;
+  gen->literal_use_capacity = 0;
+  gen->captured = NULL;
+  gen->loop_values = NULL;
+  gen->loop_value_capacity = 0;
+  gen->loop_steps = NULL;
+  gen->loop_step_capacity = 0;
+  gen->loop_addresses = NULL;
+  gen->loop_function = NULL;
+  
+  // Counters of instrumented code, or the counts that guide optimized code
+  gen->profile_base = global && gen->profile && gen->profile->generate ? global->profile_base : -1;
+  gen->profile_counts = NULL;
+  if (gen->profile && !gen->profile->generate && gen->optimization_level >= 1) {
+    gen->profile_counts = profile_counts(gen->profile, decl);
+  }
+  int entry_counter = codegen_counter(gen, 0);
+  
   // Emit function prologue
+  if (global) {
+    global->code_offset = codegen_code_offset(gen, function_start);
+  }
   codegen_emit_instruction(gen, OP_ENTER, 0x00, 0);
   
   // Create variable scope for parameters
@@ -1145,7 +2567,8 @@ void codegen_function_declaration(CodeGenerator* gen, Decl* decl) {
   }
   
   // Generate code for function body
-  codegen_statement(gen, decl->as.func.body);
+  codegen_count(gen, entry_counter);
+  codegen_statement(gen, stmt_at(gen, decl->as.func.body));
   
   // End parameter scope
   codegen_emit_instruction(gen, OP_VAREND, 0x00, 0);
@@ -1158,8 +2581,21 @@ void codegen_function_declaration(CodeGenerator* gen, Decl* decl) {
   
   // Exit function scope
   symbol_table_exit_scope(gen->symbols);
+  codegen_reset_temps(gen);
+  if (gen->peephole) {
+    peephole_run(gen->peephole, gen);
+  }
+  codegen_resolve_labels(gen);
+  if (gen->cache_key && gen->peephole) {
+    gen->captured = codegen_capture_function(gen, decl, function_start, var_base, global_count,
+                                             debug_base);
+  }
+  arena_rewind(scratch, scratch_mark);
+  gen->profile_counts = NULL;
+  gen->profile_base = -1;
   
   // Restore previous function return type
+  gen->current_function = prev_function;
   gen->current_function_return_type = prev_return_type;
 }
 
@@ -1175,6 +2611,10 @@ void codegen_declaration(CodeGenerator* gen, Decl* decl) {
       codegen_function_declaration(gen, decl);
       break;
       
+    case DECL_TYPEDEF:
+      // Resolved by the parser, nothing to emit
+      break;
+      
     // More declaration types would be handled here
       
     default:
@@ -1184,21 +2624,302 @@ void codegen_declaration(CodeGenerator* gen, Decl* decl) {
   }
 }
 
-bool codegen_generate(CodeGenerator* gen) {
-  // Emit COF header
-  // TODO: Implement proper COF header generation
+/*
+ * Sections start on COF_SECTION_ALIGNMENT boundaries; emit() writes the
+ * section contents at the end of the buffer.
+ */
+static void codegen_emit_section(CodeGenerator* gen, CofSection* section, uint32_t type,
+                                 uint32_t flags, void (*emit)(CodeGenerator* gen)) {
+  while ((gen->flushed + gen->buffer->size) % COF_SECTION_ALIGNMENT != 0) {
+    coil_buffer_write_byte(gen->buffer, 0);
+  }
+  
+  size_t start = gen->flushed + gen->buffer->size;
+  emit(gen);
+  
+  section->type = type;
+  section->flags = flags;
+  section->offset = (uint32_t)start;
+  section->size = (uint32_t)(gen->flushed + gen->buffer->size - start);
+}
+
+// Write out the buffer and empty it; nothing may refer to its positions afterwards
+static bool codegen_flush(CodeGenerator* gen) {
+  if (!coil_buffer_flush(gen->buffer, gen->output)) {
+    gen->has_error = true;
+    gen->error_message = arena_strdup(gen->arena, "Failed to write output");
+    return false;
+  }
+  
+  gen->flushed += gen->buffer->size;
+  gen->buffer->size = 0;
+  return true;
+}
+
+// File-scope declarations that name a global symbol
+static bool codegen_is_global(Decl* decl) {
+  return decl->type == DECL_FUNC ||
+         (decl->type == DECL_VAR && (decl->is_static || decl->is_extern));
+}
+
+/*
+ * Number every global up front, so uses that precede the definition (and
+ * calls to functions that only have a prototype) get the same symbol index
+ */
+void codegen_declare_globals(CodeGenerator* gen) {
+  for (int i = 0; i < gen->program->count; i++) {
+    Decl* decl = gen->program->declarations[i];
+    if (codegen_is_global(decl)) {
+      codegen_declare_counters(gen, decl, codegen_declare_global(gen, decl));
+    }
+  }
+}
+
+bool codegen_begin(CodeGenerator* gen) {
+  if (!gen->buffer) {
+    gen->has_error = true;
+    gen->error_message = arena_strdup(gen->arena, "Failed to allocate output buffer");
+    return false;
+  }
+  
+  // Reserve the COF header and section table; codegen_finish fills them in
+  CofHeader header;
+  CofSection sections[COF_SECTION_COUNT];
+  memset(&header, 0, sizeof(header));
+  memset(sections, 0, sizeof(sections));
+  
+  gen->header_offset = gen->buffer->size;
+  coil_buffer_write(gen->buffer, &header, sizeof(header));
+  coil_buffer_write(gen->buffer, sections, sizeof(sections));
+  gen->code_start = gen->buffer->size; // Aligned: the header and each entry are 16 bytes
   
   // Global scope
   gen->current_scope = 0;
   
-  // Generate code for each declaration
+  // The function cache needs the recorded instructions even without -O2
+  if ((gen->optimization_level >= 2 || gen->cache) && !gen->peephole) {
+    gen->peephole = peephole_create(gen->arena);
+    gen->peephole->optimize = gen->optimization_level >= 2;
+  }
+  
+  return true;
+}
+
+bool codegen_stream_declaration(CodeGenerator* gen, Decl* decl) {
+  // Numbered as they come, which matches codegen_declare_globals as long
+  // as nothing is used before its declaration
+  if (decl && codegen_is_global(decl)) {
+    codegen_declare_counters(gen, decl, codegen_declare_global(gen, decl));
+  }
+  
+  codegen_declaration(gen, decl);
+  
+  // Branches in file-scope code end with their declaration, so once they
+  // are patched its code can go out and the buffer never holds more than
+  // one declaration
+  codegen_resolve_labels(gen);
+  if (gen->has_error) {
+    return false;
+  }
+  return codegen_flush(gen);
+}
+
+bool codegen_inlines(CodeGenerator* gen, Decl* decl) {
+  if (!decl || decl->type != DECL_FUNC) return false;
+  
+  Symbol* symbol = symbol_table_lookup(gen->symbols, decl->name);
+  return symbol && symbol->is_global && symbol->symbol_index >= 0 &&
+         gen->globals[symbol->symbol_index].inline_decl == decl;
+}
+
+/*
+ * A function's code includes the bodies it inlines, which its own cache key
+ * does not cover. Fold the keys of every inlinable function into all keys,
+ * so editing one invalidates each function that might have inlined it.
+ */
+static void codegen_cover_inlined_keys(CodeGenerator* gen) {
+  uint64_t hash = FCACHE_HASH_SEED;
+  bool any = false;
+  for (int i = 0; i < gen->program->count; i++) {
+    if (gen->cache_keys[i] && codegen_inlines(gen, gen->program->declarations[i])) {
+      hash = fcache_hash(hash, &gen->cache_keys[i], sizeof(gen->cache_keys[i]));
+      any = true;
+    }
+  }
+  if (!any) return;
+  
   for (int i = 0; i < gen->program->count; i++) {
-    codegen_declaration(gen, gen->program->declarations[i]);
+    if (gen->cache_keys[i]) {
+      uint64_t key = fcache_hash(gen->cache_keys[i], &hash, sizeof(hash));
+      gen->cache_keys[i] = key ? key : 1; // 0 means "not cached"
+    }
+  }
+}
+
+/**
+ * @brief Function definition and how often the profile says it was entered
+ */
+typedef struct {
+  int index; // In the program
+  uint64_t entry;
+} CodegenHotness;
+
+// Most entered first, ties in declaration order
+static int codegen_compare_hotness(const void* a, const void* b) {
+  const CodegenHotness* left = a;
+  const CodegenHotness* right = b;
+  if (left->entry != right->entry) return left->entry > right->entry ? -1 : 1;
+  return left->index - right->index;
+}
+
+/*
+ * Order in which to generate the declarations. With -fprofile-use, the
+ * function definitions take the places of one another from the most to the
+ * least entered, so the hot code sits together; everything else stays in
+ * place. Returns NULL for declaration order. A streamed compilation never
+ * holds the whole program, so it always keeps declaration order.
+ */
+static int* codegen_declaration_order(CodeGenerator* gen) {
+  if (!gen->profile || gen->profile->generate || gen->optimization_level < 1) return NULL;
+  
+  Program* program = gen->program;
+  Arena* scratch = arena_scratch(gen->arena);
+  ArenaMark mark = arena_mark(scratch);
+  int* order = arena_alloc(gen->arena, sizeof(int) * (program->count + 1));
+  CodegenHotness* functions = arena_alloc(scratch, sizeof(CodegenHotness) * (program->count + 1));
+  if (!order || !functions) {
+    arena_rewind(scratch, mark);
+    return NULL;
+  }
+  
+  int function_count = 0;
+  for (int i = 0; i < program->count; i++) {
+    order[i] = i;
+    Decl* decl = program->declarations[i];
+    if (!decl || decl->type != DECL_FUNC || !decl->as.func.body) continue;
+    
+    const uint64_t* counts = profile_counts(gen->profile, decl);
+    functions[function_count].index = i;
+    functions[function_count].entry = counts ? counts[0] : 0;
+    function_count++;
+  }
+  qsort(functions, function_count, sizeof(CodegenHotness), codegen_compare_hotness);
+  
+  // Refill the slots of the function definitions, in declaration order
+  int next = 0;
+  for (int i = 0; i < program->count; i++) {
+    Decl* decl = program->declarations[i];
+    if (decl && decl->type == DECL_FUNC && decl->as.func.body) {
+      order[i] = functions[next++].index;
+    }
+  }
+  
+  arena_rewind(scratch, mark);
+  return order;
+}
+
+bool codegen_generate(CodeGenerator* gen) {
+  if (!codegen_begin(gen)) {
+    return false;
+  }
+  
+  codegen_declare_globals(gen);
+  if (gen->cache && gen->cache_keys && gen->optimization_level >= 2) {
+    codegen_cover_inlined_keys(gen);
+  }
+  if (gen->has_error) {
+    return false;
+  }
+  
+  // Function bodies generated on worker threads, merged in order below
+  CachedFunction** prepared = gen->jobs > 1 ? parallel_generate_functions(gen) : NULL;
+  int* order = codegen_declaration_order(gen);
+  
+  // Generate code for each declaration, or copy it from the function cache
+  // or a worker
+  for (int k = 0; k < gen->program->count; k++) {
+    int i = order ? order[k] : k;
+    Decl* decl = gen->program->declarations[i];
+    uint64_t key = gen->cache && gen->cache_keys ? gen->cache_keys[i] : 0;
+    CachedFunction* cached = key ? fcache_lookup(gen->cache, key) : NULL;
+    CachedFunction* fragment = !cached && prepared ? prepared[i] : NULL;
+    
+    if (cached && codegen_splice_function(gen, decl, cached)) {
+      gen->cache->hits++;
+    } else if (fragment && codegen_splice_function(gen, decl, fragment)) {
+      if (key) {
+        fragment->key = key;
+        fcache_insert(gen->cache, fragment);
+      }
+    } else {
+      gen->cache_key = key;
+      codegen_declaration(gen, decl);
+      if (key && gen->captured) {
+        fcache_insert(gen->cache, gen->captured);
+      }
+      gen->cache_key = 0;
+    }
     
     if (gen->has_error) {
       return false;
     }
   }
   
+  return codegen_finish(gen);
+}
+
+bool codegen_finish(CodeGenerator* gen) {
+  // Branches in file-scope code (initializers)
+  codegen_resolve_labels(gen);
+  if (gen->has_error) {
+    return false;
+  }
+  
+  CofHeader header;
+  CofSection sections[COF_SECTION_COUNT];
+  memset(&header, 0, sizeof(header));
+  memset(sections, 0, sizeof(sections));
+  
+  CofSection* code = &sections[COF_SECTION_CODE - 1];
+  code->type = COF_SECTION_CODE;
+  code->flags = COF_SECTION_READ | COF_SECTION_EXEC;
+  code->offset = (uint32_t)gen->code_start;
+  code->size = (uint32_t)(gen->flushed + gen->buffer->size - gen->code_start);
+  
+  codegen_emit_section(gen, &sections[COF_SECTION_RODATA - 1], COF_SECTION_RODATA,
+                       COF_SECTION_READ, codegen_emit_rodata);
+  codegen_emit_section(gen, &sections[COF_SECTION_SYMTAB - 1], COF_SECTION_SYMTAB,
+                       COF_SECTION_READ, codegen_emit_symtab);
+  codegen_emit_section(gen, &sections[COF_SECTION_DEBUG - 1], COF_SECTION_DEBUG,
+                       COF_SECTION_READ, codegen_emit_debug);
+  
+  header.magic[0] = COF_MAGIC0;
+  header.magic[1] = COF_MAGIC1;
+  header.magic[2] = COF_MAGIC2;
+  header.magic[3] = COF_MAGIC3;
+  header.version = COF_VERSION;
+  header.flags = gen->compact_operands ? COF_FLAG_VARINT_OPERANDS : 0;
+  header.section_count = COF_SECTION_COUNT;
+  header.section_table_offset = (uint32_t)(gen->header_offset + sizeof(header));
+  
+  if (gen->flushed == 0) {
+    // Write everything out in one go
+    coil_buffer_patch(gen->buffer, gen->header_offset, &header, sizeof(header));
+    coil_buffer_patch(gen->buffer, gen->header_offset + sizeof(header), sections, sizeof(sections));
+    return codegen_flush(gen);
+  }
+  
+  // The placeholder header went out with the first declaration
+  if (!codegen_flush(gen)) {
+    return false;
+  }
+  if (fseek(gen->output, (long)gen->header_offset, SEEK_SET) != 0 ||
+      fwrite(&header, sizeof(header), 1, gen->output) != 1 ||
+      fwrite(sections, sizeof(sections), 1, gen->output) != 1) {
+    gen->has_error = true;
+    gen->error_message = arena_strdup(gen->arena, "Failed to write output");
+    return false;
+  }
+  
   return true;
-}
\ No newline at end of file
+}
@@ -0,0 +1,150 @@
+/**
+ * @file driver.c
+ * @brief Parallel multi-file compilation driver implementation
+ */
+
+#define _POSIX_C_SOURCE 200809L // pthreads
+
+#include "../include/driver.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief One translation unit and its result
+ */
+typedef struct {
+  const char* input_file;
+  char* output_file;
+  bool success;
+  CompilerError error;
+} DriverJob;
+
+/**
+ * @brief State shared by all workers
+ */
+typedef struct {
+  DriverJob* jobs;
+  int job_count;
+  int next_job; // Protected by lock
+  pthread_mutex_t lock;
+  CompilerOptions options;
+} DriverQueue;
+
+static char* output_name_for(const char* input_file) {
+  size_t length = strlen(input_file);
+  if (length > 2 && strcmp(input_file + length - 2, ".c") == 0) {
+    length -= 2;
+  }
+  
+  char* output = malloc(length + 5);
+  if (!output) return NULL;
+  
+  memcpy(output, input_file, length);
+  memcpy(output + length, ".cof", 5);
+  return output;
+}
+
+static DriverJob* driver_take_job(DriverQueue* queue) {
+  DriverJob* job = NULL;
+  
+  pthread_mutex_lock(&queue->lock);
+  if (queue->next_job < queue->job_count) {
+    job = &queue->jobs[queue->next_job++];
+  }
+  pthread_mutex_unlock(&queue->lock);
+  
+  return job;
+}
+
+static void* driver_worker(void* data) {
+  DriverQueue* queue = data;
+  CompilerContext* context = compiler_context_create(0);
+  
+  DriverJob* job;
+  while ((job = driver_take_job(queue)) != NULL) {
+    if (!context || !job->output_file) {
+      job->success = false;
+      job->error.has_error = true;
+      snprintf(job->error.message, sizeof(job->error.message), "Memory allocation failed");
+      continue;
+    }
+    
+    CompilerOptions options = queue->options;
+    options.input_file = job->input_file;
+    options.output_file = job->output_file;
+    options.jobs = 1; // The threads are already busy with one file each
+    
+    // The context recycles its arena between files
+    job->success = compiler_context_compile_file(context, options);
+    job->error = context->error;
+  }
+  
+  compiler_context_destroy(context);
+  return NULL;
+}
+
+bool driver_compile_files(CompilerOptions options, const char** input_files, int input_count) {
+  if (input_count <= 0) return true;
+  
+  DriverQueue queue;
+  queue.jobs = calloc(input_count, sizeof(DriverJob));
+  if (!queue.jobs) {
+    fprintf(stderr, "Compilation failed: Memory allocation failed\n");
+    return false;
+  }
+  queue.job_count = input_count;
+  queue.next_job = 0;
+  queue.options = options;
+  pthread_mutex_init(&queue.lock, NULL);
+  
+  for (int i = 0; i < input_count; i++) {
+    queue.jobs[i].input_file = input_files[i];
+    queue.jobs[i].output_file = output_name_for(input_files[i]);
+  }
+  
+  int worker_count = options.jobs < 1 ? 1 : options.jobs;
+  if (worker_count > input_count) {
+    worker_count = input_count;
+  }
+  
+  // The calling thread is one of the workers
+  pthread_t* threads = malloc(sizeof(pthread_t) * worker_count);
+  int started = 0;
+  if (threads) {
+    for (int i = 1; i < worker_count; i++) {
+      if (pthread_create(&threads[started], NULL, driver_worker, &queue) != 0) {
+        break; // Fewer workers is still correct
+      }
+      started++;
+    }
+  }
+  
+  driver_worker(&queue);
+  
+  for (int i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  pthread_mutex_destroy(&queue.lock);
+  
+  // Report in input order so output does not depend on scheduling
+  bool all_succeeded = true;
+  for (int i = 0; i < input_count; i++) {
+    DriverJob* job = &queue.jobs[i];
+    
+    if (!job->success) {
+      all_succeeded = false;
+      printf("Compilation of '%s' failed: %s\n", job->input_file,
+             job->error.has_error ? job->error.message : "Unknown error");
+    } else if (options.verbose) {
+      printf("Successfully compiled '%s' to '%s'\n", job->input_file, job->output_file);
+    }
+    
+    free(job->output_file);
+  }
+  
+  free(queue.jobs);
+  return all_succeeded;
+}
@@ -0,0 +1,555 @@
+/**
+ * @file fcache.c
+ * @brief On-disk cache of generated function code for incremental rebuilds
+ */
+
+#define _POSIX_C_SOURCE 200809L // mkdir
+
+#include "../include/fcache.h"
+#include "../include/buffer.h"
+#include "../include/intern.h"
+#include "../include/arena.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#include <sys/types.h>
+#define FCACHE_HAVE_MKDIR 1
+#endif
+
+#define FCACHE_INITIAL_CAPACITY 64
+#define FCACHE_FILE_BUFFER_SIZE (64 * 1024)
+
+static const uint8_t fcache_magic[4] = { 'C', 'F', 'C', 'H' };
+
+/*
+ * Cache file layout, in host byte order: magic, uint32 version, uint32
+ * entry count, uint64 checksum of the rest, then per entry: uint64 key; the code size, relocation,
+ * instruction, debug, literal and symbol counts and var count; the code;
+ * relocations (offset from the end of the previous one, byte kind | size
+ * << 4, value); instruction offsets and debug entries as deltas, source
+ * offsets zigzag-encoded; literals and symbol names as length plus bytes.
+ * Every number after the entry count is ULEB128, which keeps the file
+ * close to the size of the code it holds.
+ */
+
+uint64_t fcache_hash(uint64_t hash, const void* data, size_t size) {
+  const uint8_t* bytes = data;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL; // FNV-1a 64-bit prime
+  }
+  return hash;
+}
+
+/*
+ * Checksum of the entries, so a damaged file is rejected instead of
+ * spliced: FNV-style mixing over 8-byte words, which keeps it cheap next to
+ * reading the file.
+ */
+static uint64_t fcache_checksum(const uint8_t* data, size_t size) {
+  uint64_t hash = FCACHE_HASH_SEED;
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    hash = (hash ^ word) * 0x100000001b3ULL;
+    hash ^= hash >> 29;
+  }
+  return fcache_hash(hash, data + i, size - i);
+}
+
+/* Table */
+
+static void fcache_table_put(FunctionCache* cache, CachedFunction* function) {
+  unsigned mask = (unsigned)cache->table_capacity - 1;
+  unsigned index = (unsigned)(function->key ^ (function->key >> 32)) & mask;
+  
+  while (cache->table[index]) {
+    if (cache->table[index]->key == function->key) {
+      cache->table[index] = function; // Newer code for the same key
+      return;
+    }
+    index = (index + 1) & mask;
+  }
+  
+  cache->table[index] = function;
+  cache->count++;
+}
+
+static void fcache_table_grow(FunctionCache* cache) {
+  CachedFunction** old_table = cache->table;
+  int old_capacity = cache->table_capacity;
+  
+  cache->table_capacity = old_capacity ? old_capacity * 2 : FCACHE_INITIAL_CAPACITY;
+  cache->table = arena_calloc(cache->arena, sizeof(CachedFunction*) * cache->table_capacity);
+  cache->count = 0;
+  
+  for (int i = 0; i < old_capacity; i++) {
+    if (old_table[i]) {
+      fcache_table_put(cache, old_table[i]);
+    }
+  }
+}
+
+CachedFunction* fcache_lookup(FunctionCache* cache, uint64_t key) {
+  if (cache->count == 0) return NULL;
+  
+  unsigned mask = (unsigned)cache->table_capacity - 1;
+  unsigned index = (unsigned)(key ^ (key >> 32)) & mask;
+  
+  while (cache->table[index]) {
+    CachedFunction* function = cache->table[index];
+    if (function->key == key) {
+      function->used = true;
+      return function;
+    }
+    index = (index + 1) & mask;
+  }
+  return NULL;
+}
+
+void fcache_insert(FunctionCache* cache, CachedFunction* function) {
+  // Keep the load factor at or below one half
+  if ((cache->count + 1) * 2 > cache->table_capacity) {
+    fcache_table_grow(cache);
+  }
+  
+  function->used = true;
+  fcache_table_put(cache, function);
+  cache->stored++;
+}
+
+/* Loading */
+
+typedef struct {
+  const uint8_t* data;
+  size_t size;
+  size_t position;
+  bool ok;
+} FcacheReader;
+
+static const uint8_t* read_bytes(FcacheReader* reader, size_t size) {
+  if (!reader->ok || size > reader->size - reader->position) {
+    reader->ok = false;
+    return NULL;
+  }
+  
+  const uint8_t* bytes = reader->data + reader->position;
+  reader->position += size;
+  return bytes;
+}
+
+static uint32_t read_u32(FcacheReader* reader) {
+  uint32_t value = 0;
+  const uint8_t* bytes = read_bytes(reader, sizeof(value));
+  if (bytes) memcpy(&value, bytes, sizeof(value));
+  return value;
+}
+
+static uint32_t read_uleb(FcacheReader* reader) {
+  uint64_t value = 0;
+  for (int shift = 0; reader->ok && shift < 35; shift += 7) {
+    const uint8_t* byte = read_bytes(reader, 1);
+    if (!byte) break;
+    value |= (uint64_t)(*byte & 0x7F) << shift;
+    if (!(*byte & 0x80)) {
+      if (value > UINT32_MAX) break;
+      return (uint32_t)value;
+    }
+  }
+  reader->ok = false;
+  return 0;
+}
+
+// Zigzag-encoded signed value
+static int32_t read_sleb(FcacheReader* reader) {
+  uint32_t value = read_uleb(reader);
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+// Array of count items in aligned arena memory; false if the file is too short for it
+static void* alloc_items(FcacheReader* reader, Arena* arena, uint32_t count, size_t item_size) {
+  if (count == 0 || !reader->ok) return NULL;
+  if (count > reader->size - reader->position) { // Every item takes at least one byte
+    reader->ok = false;
+    return NULL;
+  }
+  
+  void* items = arena_alloc(arena, (size_t)count * item_size);
+  if (!items) reader->ok = false;
+  return items;
+}
+
+static const char** read_strings(FcacheReader* reader, FunctionCache* cache, uint32_t count,
+                                 bool intern) {
+  const char** strings = alloc_items(reader, cache->arena, count, sizeof(char*));
+  
+  for (uint32_t i = 0; i < count && reader->ok; i++) {
+    uint32_t length = read_uleb(reader);
+    const uint8_t* bytes = read_bytes(reader, length);
+    if (!bytes) break;
+    
+    if (intern) {
+      strings[i] = intern_string(cache->strings, (const char*)bytes, length);
+    } else {
+      char* copy = arena_alloc_aligned(cache->arena, length + 1, 1);
+      memcpy(copy, bytes, length);
+      copy[length] = '\0';
+      strings[i] = copy;
+    }
+  }
+  return strings;
+}
+
+static CachedFunction* read_function(FcacheReader* reader, FunctionCache* cache) {
+  CachedFunction* function = arena_calloc(cache->arena, sizeof(CachedFunction));
+  const uint8_t* key = read_bytes(reader, sizeof(function->key));
+  if (!key) return NULL;
+  memcpy(&function->key, key, sizeof(function->key));
+  
+  function->code_size = read_uleb(reader);
+  uint32_t reloc_count = read_uleb(reader);
+  uint32_t instr_count = read_uleb(reader);
+  uint32_t debug_count = read_uleb(reader);
+  uint32_t literal_count = read_uleb(reader);
+  uint32_t symbol_count = read_uleb(reader);
+  function->var_count = (int)read_uleb(reader);
+  
+  // The code stays in the loaded file; nothing writes to it
+  function->code = (uint8_t*)read_bytes(reader, function->code_size);
+  
+  function->relocs = alloc_items(reader, cache->arena, reloc_count, sizeof(FcacheReloc));
+  uint64_t end = 0;
+  for (uint32_t i = 0; i < reloc_count && reader->ok; i++) {
+    FcacheReloc* reloc = &function->relocs[i];
+    uint64_t offset = end + read_uleb(reader);
+    const uint8_t* kind_size = read_bytes(reader, 1);
+    if (!kind_size) break;
+    reloc->offset = (uint32_t)offset;
+    reloc->kind = *kind_size & 0x0F;
+    reloc->size = *kind_size >> 4;
+    reloc->value = read_uleb(reader);
+    end = offset + reloc->size;
+    
+    // Relocations must lie inside the code, and indexes inside their lists
+    bool valid = end <= function->code_size;
+    switch (reloc->kind) {
+      case FCACHE_RELOC_VAR: valid = valid && reloc->value < (uint32_t)function->var_count; break;
+      case FCACHE_RELOC_SYMBOL: valid = valid && reloc->value < symbol_count; break;
+      case FCACHE_RELOC_STRING: valid = valid && reloc->value < literal_count; break;
+      case FCACHE_RELOC_LABEL: valid = valid && reloc->value <= function->code_size && reloc->size == 4; break;
+      default: valid = false; break;
+    }
+    if (!valid) reader->ok = false;
+  }
+  function->reloc_count = (int)reloc_count;
+  
+  function->instrs = alloc_items(reader, cache->arena, instr_count, sizeof(uint32_t));
+  uint64_t offset = 0;
+  for (uint32_t i = 0; i < instr_count && reader->ok; i++) {
+    offset += read_uleb(reader);
+    if (offset >= function->code_size) reader->ok = false;
+    function->instrs[i] = (uint32_t)offset;
+  }
+  function->instr_count = (int)instr_count;
+  
+  function->debug = alloc_items(reader, cache->arena, debug_count, sizeof(FcacheDebugEntry));
+  offset = 0;
+  for (uint32_t i = 0; i < debug_count && reader->ok; i++) {
+    offset += read_uleb(reader);
+    if (offset > function->code_size) reader->ok = false;
+    function->debug[i].code_offset = (uint32_t)offset;
+    function->debug[i].source_offset = read_sleb(reader);
+  }
+  function->debug_count = (int)debug_count;
+  
+  function->literals = read_strings(reader, cache, literal_count, false);
+  function->literal_count = (int)literal_count;
+  function->symbols = read_strings(reader, cache, symbol_count, true);
+  function->symbol_count = (int)symbol_count;
+  
+  return reader->ok ? function : NULL;
+}
+
+// Read every entry of a cache file; all or nothing
+static void fcache_load(FunctionCache* cache) {
+  FILE* file = fopen(cache->path, "rb");
+  if (!file) return;
+  
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  if (size <= 0) {
+    fclose(file);
+    return;
+  }
+  
+  // Cached code points into the file data, so it is read into the cache's arena
+  ArenaMark mark = arena_mark(cache->arena);
+  uint8_t* data = arena_alloc(cache->arena, (size_t)size);
+  size_t bytes_read = data ? fread(data, 1, (size_t)size, file) : 0;
+  fclose(file);
+  
+  FcacheReader reader = { data, bytes_read, 0, bytes_read == (size_t)size };
+  const uint8_t* magic = read_bytes(&reader, sizeof(fcache_magic));
+  uint32_t version = read_u32(&reader);
+  uint32_t count = read_u32(&reader);
+  uint64_t checksum = 0;
+  const uint8_t* checksum_bytes = read_bytes(&reader, sizeof(checksum));
+  if (checksum_bytes) memcpy(&checksum, checksum_bytes, sizeof(checksum));
+  
+  if (!reader.ok || memcmp(magic, fcache_magic, sizeof(fcache_magic)) != 0 ||
+      version != FCACHE_VERSION ||
+      checksum != fcache_checksum(data + reader.position, reader.size - reader.position)) {
+    arena_rewind(cache->arena, mark);
+    return;
+  }
+  
+  Arena* scratch = arena_scratch(cache->arena);
+  ArenaMark scratch_mark = arena_mark(scratch);
+  CachedFunction** functions = alloc_items(&reader, scratch, count, sizeof(CachedFunction*));
+  uint32_t read = 0;
+  while (read < count && reader.ok) {
+    CachedFunction* function = read_function(&reader, cache);
+    if (!function) break;
+    functions[read++] = function;
+  }
+  
+  if (read == count && reader.ok) {
+    for (uint32_t i = 0; i < count; i++) {
+      if ((cache->count + 1) * 2 > cache->table_capacity) {
+        fcache_table_grow(cache);
+      }
+      fcache_table_put(cache, functions[i]);
+    }
+    arena_rewind(scratch, scratch_mark);
+  } else {
+    arena_rewind(scratch, scratch_mark);
+    arena_rewind(cache->arena, mark); // Corrupt file: start over empty
+  }
+}
+
+FunctionCache* fcache_open(const char* cache_dir, const char* source_name,
+                           struct InternPool* strings, struct Arena* arena) {
+  FunctionCache* cache = arena_calloc(arena, sizeof(FunctionCache));
+  cache->strings = strings;
+  cache->arena = arena;
+
+#ifdef FCACHE_HAVE_MKDIR
+  mkdir(cache_dir, 0777); // Fails harmlessly if it exists
+#endif
+  
+  // One file per source: its base name plus a hash of the full path
+  const char* base = strrchr(source_name, '/');
+  base = base ? base + 1 : source_name;
+  uint64_t path_hash = fcache_hash(FCACHE_HASH_SEED, source_name, strlen(source_name));
+  
+  size_t length = strlen(cache_dir) + strlen(base) + 32;
+  char* path = arena_alloc_aligned(arena, length, 1);
+  snprintf(path, length, "%s/%s-%016llx.fcache", cache_dir, base, (unsigned long long)path_hash);
+  cache->path = path;
+  
+  fcache_load(cache);
+  return cache;
+}
+
+/* Saving */
+
+static void write_u32(CoilBuffer* buffer, uint32_t value) {
+  coil_buffer_write(buffer, &value, sizeof(value));
+}
+
+static void write_string(CoilBuffer* buffer, const char* str, size_t length) {
+  coil_buffer_write_uleb128(buffer, length);
+  coil_buffer_write(buffer, str, length);
+}
+
+static void write_function(CoilBuffer* buffer, const CachedFunction* function) {
+  coil_buffer_write(buffer, &function->key, sizeof(function->key));
+  coil_buffer_write_uleb128(buffer, function->code_size);
+  coil_buffer_write_uleb128(buffer, (uint64_t)function->reloc_count);
+  coil_buffer_write_uleb128(buffer, (uint64_t)function->instr_count);
+  coil_buffer_write_uleb128(buffer, (uint64_t)function->debug_count);
+  coil_buffer_write_uleb128(buffer, (uint64_t)function->literal_count);
+  coil_buffer_write_uleb128(buffer, (uint64_t)function->symbol_count);
+  coil_buffer_write_uleb128(buffer, (uint64_t)function->var_count);
+  coil_buffer_write(buffer, function->code, function->code_size);
+  
+  uint32_t end = 0;
+  for (int i = 0; i < function->reloc_count; i++) {
+    const FcacheReloc* reloc = &function->relocs[i];
+    coil_buffer_write_uleb128(buffer, reloc->offset - end);
+    coil_buffer_write_byte(buffer, (uint8_t)(reloc->kind | reloc->size << 4));
+    coil_buffer_write_uleb128(buffer, reloc->value);
+    end = reloc->offset + reloc->size;
+  }
+  
+  uint32_t offset = 0;
+  for (int i = 0; i < function->instr_count; i++) {
+    coil_buffer_write_uleb128(buffer, function->instrs[i] - offset);
+    offset = function->instrs[i];
+  }
+  
+  offset = 0;
+  for (int i = 0; i < function->debug_count; i++) {
+    const FcacheDebugEntry* entry = &function->debug[i];
+    coil_buffer_write_uleb128(buffer, entry->code_offset - offset);
+    coil_buffer_write_uleb128(buffer, ((uint32_t)entry->source_offset << 1) ^
+                                      (uint32_t)(entry->source_offset >> 31));
+    offset = entry->code_offset;
+  }
+  
+  for (int i = 0; i < function->literal_count; i++) {
+    write_string(buffer, function->literals[i], strlen(function->literals[i]));
+  }
+  for (int i = 0; i < function->symbol_count; i++) {
+    write_string(buffer, function->symbols[i], intern_length(function->symbols[i]));
+  }
+}
+
+bool fcache_save(FunctionCache* cache) {
+  uint32_t count = 0;
+  for (int i = 0; i < cache->table_capacity; i++) {
+    if (cache->table[i] && cache->table[i]->used) count++;
+  }
+  
+  // Nothing added and nothing dropped: the file is already up to date
+  if (cache->stored == 0 && (int)count == cache->count) return true;
+  
+  Arena* scratch = arena_scratch(cache->arena);
+  ArenaMark mark = arena_mark(scratch);
+  CoilBuffer* buffer = coil_buffer_create(scratch, FCACHE_FILE_BUFFER_SIZE);
+  if (!buffer) return false;
+  
+  uint64_t checksum = 0;
+  coil_buffer_write(buffer, fcache_magic, sizeof(fcache_magic));
+  write_u32(buffer, FCACHE_VERSION);
+  write_u32(buffer, count);
+  size_t checksum_offset = buffer->size;
+  coil_buffer_write(buffer, &checksum, sizeof(checksum));
+  for (int i = 0; i < cache->table_capacity; i++) {
+    if (cache->table[i] && cache->table[i]->used) {
+      write_function(buffer, cache->table[i]);
+    }
+  }
+  
+  size_t body = checksum_offset + sizeof(checksum);
+  checksum = fcache_checksum(buffer->data + body, buffer->size - body);
+  coil_buffer_patch(buffer, checksum_offset, &checksum, sizeof(checksum));
+  
+  // Write a temporary file and rename it over the old one, so a failed or
+  // concurrent build never leaves a half-written cache behind
+  size_t length = strlen(cache->path) + 5;
+  char* temp_path = arena_alloc_aligned(scratch, length, 1);
+  snprintf(temp_path, length, "%s.tmp", cache->path);
+  
+  bool ok = false;
+  FILE* file = fopen(temp_path, "wb");
+  if (file) {
+    ok = coil_buffer_flush(buffer, file);
+    ok = fclose(file) == 0 && ok;
+    ok = ok && rename(temp_path, cache->path) == 0;
+    if (!ok) remove(temp_path);
+  }
+  
+  arena_rewind(scratch, mark);
+  return ok;
+}
+
+/* Keys */
+
+static uint64_t hash_tokens(uint64_t hash, const TokenArray* tokens, int start, int end,
+                            int origin, bool hash_offsets) {
+  for (int i = start; i < end; i++) {
+    uint8_t type = tokens->types[i];
+    const TokenValue* value = &tokens->values[i];
+    hash = fcache_hash(hash, &type, sizeof(type));
+    
+    switch (type) {
+      case TOKEN_IDENTIFIER: {
+        uint32_t length = (uint32_t)intern_length(value->identifier);
+        hash = fcache_hash(hash, &length, sizeof(length));
+        hash = fcache_hash(hash, value->identifier, length);
+        break;
+      }
+      
+      case TOKEN_INTEGER_LITERAL:
+        hash = fcache_hash(hash, &value->int_value, sizeof(value->int_value));
+        break;
+      
+      case TOKEN_FLOAT_LITERAL:
+        hash = fcache_hash(hash, &value->float_value, sizeof(value->float_value));
+        break;
+      
+      case TOKEN_STRING_LITERAL: {
+        uint32_t length = value->string_value ? (uint32_t)strlen(value->string_value) : 0;
+        hash = fcache_hash(hash, &length, sizeof(length));
+        hash = fcache_hash(hash, value->string_value, length);
+        break;
+      }
+      
+      case TOKEN_CHAR_LITERAL:
+        hash = fcache_hash(hash, &value->char_value, sizeof(value->char_value));
+        break;
+      
+      default:
+        break;
+    }
+    
+    if (hash_offsets) {
+      uint32_t offset = tokens->offsets[i] - tokens->offsets[origin];
+      hash = fcache_hash(hash, &offset, sizeof(offset));
+    }
+  }
+  return hash;
+}
+
+// Index of the token at a source offset within [start, end), or end
+static int token_at(const TokenArray* tokens, int start, int end, uint32_t offset) {
+  int low = start;
+  int high = end;
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    if (tokens->offsets[mid] < offset) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+static bool is_function_definition(const Decl* decl) {
+  return decl && decl->type == DECL_FUNC && decl->as.func.body;
+}
+
+uint64_t* fcache_program_keys(Program* program, const TokenArray* tokens, uint64_t options_hash,
+                              bool hash_offsets, struct Arena* arena) {
+  if (!program->token_starts || program->count == 0) return NULL;
+  
+  // The environment: every token outside function bodies
+  uint64_t environment = options_hash;
+  for (int i = 0; i < program->count; i++) {
+    Decl* decl = program->declarations[i];
+    int start = program->token_starts[i];
+    int end = program->token_starts[i + 1];
+    
+    if (is_function_definition(decl)) {
+      end = token_at(tokens, start, end, ast_stmt(program, decl->as.func.body)->location.offset);
+    }
+    environment = hash_tokens(environment, tokens, start, end, start, hash_offsets);
+  }
+  
+  uint64_t* keys = arena_calloc(arena, sizeof(uint64_t) * program->count);
+  for (int i = 0; i < program->count; i++) {
+    if (!is_function_definition(program->declarations[i])) continue;
+    
+    int start = program->token_starts[i];
+    uint64_t key = hash_tokens(environment, tokens, start, program->token_starts[i + 1], start,
+                               hash_offsets);
+    keys[i] = key ? key : 1; // 0 means "not cached"
+  }
+  return keys;
+}
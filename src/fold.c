@@ -0,0 +1,437 @@
+/**
+ * @file fold.c
+ * @brief Constant folding and algebraic simplification over the AST
+ */
+
+#include "../include/fold.h"
+#include <stdlib.h>
+#include <limits.h>
+
+/* Literal helpers */
+
+static bool is_int_constant(Expr* expr) {
+  return expr->type == EXPR_INTEGER_LITERAL || expr->type == EXPR_CHAR_LITERAL;
+}
+
+static bool is_constant(Expr* expr) {
+  return is_int_constant(expr) || expr->type == EXPR_FLOAT_LITERAL;
+}
+
+static long long int_value(Expr* expr) {
+  if (expr->type == EXPR_CHAR_LITERAL) {
+    return expr->as.char_literal.value;
+  }
+  return expr->as.int_literal.value;
+}
+
+static double float_value(Expr* expr) {
+  if (expr->type == EXPR_FLOAT_LITERAL) {
+    return expr->as.float_literal.value;
+  }
+  return (double)int_value(expr);
+}
+
+static bool is_int_value(Expr* expr, long long value) {
+  return is_int_constant(expr) && int_value(expr) == value;
+}
+
+/**
+ * Evaluate a constant's truth value
+ */
+static bool constant_truth(Expr* expr) {
+  if (expr->type == EXPR_FLOAT_LITERAL) {
+    return expr->as.float_literal.value != 0.0;
+  }
+  return int_value(expr) != 0;
+}
+
+/**
+ * Turn an existing node into an integer literal, keeping its location and
+ * its reference
+ */
+static Expr* make_int(Expr* expr, long long value) {
+  expr->type = EXPR_INTEGER_LITERAL;
+  expr->as.int_literal.value = value;
+  return expr;
+}
+
+static Expr* make_float(Expr* expr, double value) {
+  expr->type = EXPR_FLOAT_LITERAL;
+  expr->as.float_literal.value = value;
+  return expr;
+}
+
+/**
+ * Check whether evaluating an expression can have side effects
+ * (assignments, calls, increments, or memory accesses that may fault)
+ */
+static bool is_pure(Program* program, Expr* expr) {
+  switch (expr->type) {
+    case EXPR_INTEGER_LITERAL:
+    case EXPR_FLOAT_LITERAL:
+    case EXPR_CHAR_LITERAL:
+    case EXPR_STRING_LITERAL:
+    case EXPR_IDENTIFIER:
+    case EXPR_SIZEOF:
+      return true;
+      
+    case EXPR_BINARY:
+      return is_pure(program, ast_expr(program, expr->as.binary.left)) &&
+             is_pure(program, ast_expr(program, expr->as.binary.right));
+      
+    case EXPR_UNARY:
+      switch (expr->as.unary.operator) {
+        case TOKEN_PLUS_PLUS:
+        case TOKEN_MINUS_MINUS:
+        case TOKEN_STAR:
+          return false;
+        default:
+          return is_pure(program, ast_expr(program, expr->as.unary.operand));
+      }
+      
+    default:
+      return false;
+  }
+}
+
+/* Expression folding */
+
+static Expr* fold_binary_constants(Expr* expr, Expr* left, Expr* right) {
+  TokenType op = expr->as.binary.operator;
+  
+  // Floating point arithmetic and comparisons
+  if (left->type == EXPR_FLOAT_LITERAL || right->type == EXPR_FLOAT_LITERAL) {
+    double a = float_value(left);
+    double b = float_value(right);
+    
+    switch (op) {
+      case TOKEN_PLUS:          return make_float(expr, a + b);
+      case TOKEN_MINUS:         return make_float(expr, a - b);
+      case TOKEN_STAR:          return make_float(expr, a * b);
+      case TOKEN_SLASH:         return make_float(expr, a / b);
+      case TOKEN_EQUAL_EQUAL:   return make_int(expr, a == b);
+      case TOKEN_EXCLAIM_EQUAL: return make_int(expr, a != b);
+      case TOKEN_LESS:          return make_int(expr, a < b);
+      case TOKEN_LESS_EQUAL:    return make_int(expr, a <= b);
+      case TOKEN_GREATER:       return make_int(expr, a > b);
+      case TOKEN_GREATER_EQUAL: return make_int(expr, a >= b);
+      case TOKEN_AMPERSAND_AMPERSAND: return make_int(expr, a != 0.0 && b != 0.0);
+      case TOKEN_PIPE_PIPE:     return make_int(expr, a != 0.0 || b != 0.0);
+      default:                  return expr;
+    }
+  }
+  
+  // Integer arithmetic is done on unsigned values so overflow wraps instead of being undefined
+  long long a = int_value(left);
+  long long b = int_value(right);
+  unsigned long long ua = (unsigned long long)a;
+  unsigned long long ub = (unsigned long long)b;
+  
+  switch (op) {
+    case TOKEN_PLUS:          return make_int(expr, (long long)(ua + ub));
+    case TOKEN_MINUS:         return make_int(expr, (long long)(ua - ub));
+    case TOKEN_STAR:          return make_int(expr, (long long)(ua * ub));
+    case TOKEN_SLASH:
+      // Leave division by zero and overflow for the runtime to report
+      if (b == 0 || (a == LLONG_MIN && b == -1)) return expr;
+      return make_int(expr, a / b);
+    case TOKEN_PERCENT:
+      if (b == 0 || (a == LLONG_MIN && b == -1)) return expr;
+      return make_int(expr, a % b);
+    case TOKEN_AMPERSAND:     return make_int(expr, a & b);
+    case TOKEN_PIPE:          return make_int(expr, a | b);
+    case TOKEN_CARET:         return make_int(expr, a ^ b);
+    case TOKEN_LESS_LESS:
+      if (b < 0 || b >= 64) return expr;
+      return make_int(expr, (long long)(ua << b));
+    case TOKEN_GREATER_GREATER:
+      if (b < 0 || b >= 64) return expr;
+      return make_int(expr, (long long)(ua >> b)); // Matches the logical SHR emitted by codegen
+    case TOKEN_EQUAL_EQUAL:   return make_int(expr, a == b);
+    case TOKEN_EXCLAIM_EQUAL: return make_int(expr, a != b);
+    case TOKEN_LESS:          return make_int(expr, a < b);
+    case TOKEN_LESS_EQUAL:    return make_int(expr, a <= b);
+    case TOKEN_GREATER:       return make_int(expr, a > b);
+    case TOKEN_GREATER_EQUAL: return make_int(expr, a >= b);
+    case TOKEN_AMPERSAND_AMPERSAND: return make_int(expr, a && b);
+    case TOKEN_PIPE_PIPE:     return make_int(expr, a || b);
+    default:                  return expr;
+  }
+}
+
+/**
+ * Apply algebraic identities where exactly one side is an integer constant
+ */
+static ExprRef simplify_binary(Program* program, ExprRef ref) {
+  Expr* expr = ast_expr(program, ref);
+  ExprRef left_ref = expr->as.binary.left;
+  ExprRef right_ref = expr->as.binary.right;
+  Expr* left = ast_expr(program, left_ref);
+  Expr* right = ast_expr(program, right_ref);
+  
+  switch (expr->as.binary.operator) {
+    case TOKEN_PLUS:
+    case TOKEN_PIPE:
+    case TOKEN_CARET:
+      // x + 0, 0 + x, x | 0, x ^ 0
+      if (is_int_value(right, 0)) return left_ref;
+      if (is_int_value(left, 0)) return right_ref;
+      break;
+      
+    case TOKEN_MINUS:
+    case TOKEN_LESS_LESS:
+    case TOKEN_GREATER_GREATER:
+      // x - 0, x << 0, x >> 0
+      if (is_int_value(right, 0)) return left_ref;
+      break;
+      
+    case TOKEN_STAR:
+      // x * 1, 1 * x
+      if (is_int_value(right, 1)) return left_ref;
+      if (is_int_value(left, 1)) return right_ref;
+      // x * 0 only when x can be dropped without losing side effects
+      if ((is_int_value(right, 0) && is_pure(program, left)) ||
+          (is_int_value(left, 0) && is_pure(program, right))) {
+        make_int(expr, 0);
+      }
+      break;
+      
+    case TOKEN_SLASH:
+      // x / 1
+      if (is_int_value(right, 1)) return left_ref;
+      break;
+      
+    case TOKEN_AMPERSAND:
+      if ((is_int_value(right, 0) && is_pure(program, left)) ||
+          (is_int_value(left, 0) && is_pure(program, right))) {
+        make_int(expr, 0);
+      }
+      break;
+      
+    case TOKEN_AMPERSAND_AMPERSAND:
+      // The right operand is never evaluated when the left is false
+      if (is_constant(left) && !constant_truth(left)) make_int(expr, 0);
+      break;
+      
+    case TOKEN_PIPE_PIPE:
+      // The right operand is never evaluated when the left is true
+      if (is_constant(left) && constant_truth(left)) make_int(expr, 1);
+      break;
+      
+    default:
+      break;
+  }
+  
+  return ref;
+}
+
+static ExprRef fold_binary(Program* program, ExprRef ref) {
+  Expr* expr = ast_expr(program, ref);
+  expr->as.binary.left = fold_expression(program, expr->as.binary.left);
+  expr->as.binary.right = fold_expression(program, expr->as.binary.right);
+  Expr* left = ast_expr(program, expr->as.binary.left);
+  Expr* right = ast_expr(program, expr->as.binary.right);
+  
+  if (!left || !right) return ref;
+  
+  if (is_constant(left) && is_constant(right)) {
+    fold_binary_constants(expr, left, right); // Rewrites the node in place
+    return ref;
+  }
+  
+  return simplify_binary(program, ref);
+}
+
+static ExprRef fold_unary(Program* program, ExprRef ref) {
+  Expr* expr = ast_expr(program, ref);
+  expr->as.unary.operand = fold_expression(program, expr->as.unary.operand);
+  Expr* operand = ast_expr(program, expr->as.unary.operand);
+  
+  if (!operand) return ref;
+  
+  // Unary plus is a no-op
+  if (expr->as.unary.operator == TOKEN_PLUS) {
+    return expr->as.unary.operand;
+  }
+  
+  if (!is_constant(operand)) return ref;
+  
+  if (operand->type == EXPR_FLOAT_LITERAL) {
+    double value = operand->as.float_literal.value;
+    switch (expr->as.unary.operator) {
+      case TOKEN_MINUS:   make_float(expr, -value); break;
+      case TOKEN_EXCLAIM: make_int(expr, value == 0.0); break;
+      default:            break;
+    }
+    return ref;
+  }
+  
+  long long value = int_value(operand);
+  switch (expr->as.unary.operator) {
+    case TOKEN_MINUS:   make_int(expr, (long long)(0ULL - (unsigned long long)value)); break;
+    case TOKEN_TILDE:   make_int(expr, ~value); break;
+    case TOKEN_EXCLAIM: make_int(expr, !value); break;
+    default:            break;
+  }
+  return ref;
+}
+
+ExprRef fold_expression(Program* program, ExprRef ref) {
+  Expr* expr = ast_expr(program, ref);
+  if (!expr) return AST_NONE;
+  
+  switch (expr->type) {
+    case EXPR_BINARY:
+      return fold_binary(program, ref);
+      
+    case EXPR_UNARY:
+      return fold_unary(program, ref);
+      
+    case EXPR_CALL:
+      for (int i = 0; i < expr->as.call.arg_count; i++) {
+        expr->as.call.arguments[i] = fold_expression(program, expr->as.call.arguments[i]);
+      }
+      return ref;
+      
+    case EXPR_INDEX:
+      expr->as.index.array = fold_expression(program, expr->as.index.array);
+      expr->as.index.index = fold_expression(program, expr->as.index.index);
+      return ref;
+      
+    case EXPR_FIELD:
+      expr->as.field.object = fold_expression(program, expr->as.field.object);
+      return ref;
+      
+    case EXPR_ASSIGN:
+      expr->as.assign.value = fold_expression(program, expr->as.assign.value);
+      return ref;
+      
+    case EXPR_CONDITIONAL: {
+      expr->as.conditional.condition = fold_expression(program, expr->as.conditional.condition);
+      expr->as.conditional.true_expr = fold_expression(program, expr->as.conditional.true_expr);
+      expr->as.conditional.false_expr = fold_expression(program, expr->as.conditional.false_expr);
+      
+      Expr* condition = ast_expr(program, expr->as.conditional.condition);
+      if (condition && is_constant(condition)) {
+        return constant_truth(condition) ? expr->as.conditional.true_expr
+                                         : expr->as.conditional.false_expr;
+      }
+      return ref;
+    }
+      
+    case EXPR_CAST:
+      expr->as.cast.expr = fold_expression(program, expr->as.cast.expr);
+      return ref;
+      
+    default:
+      return ref;
+  }
+}
+
+/* Statement folding */
+
+static StmtRef fold_block(Program* program, StmtRef ref) {
+  Stmt* stmt = ast_stmt(program, ref);
+  
+  // Fold in place, compacting away statements that disappeared
+  int count = 0;
+  for (int i = 0; i < stmt->as.block.count; i++) {
+    StmtRef folded = fold_statement(program, stmt->as.block.statements[i]);
+    if (folded) {
+      stmt->as.block.statements[count++] = folded;
+    }
+  }
+  stmt->as.block.count = count;
+  return ref;
+}
+
+StmtRef fold_statement(Program* program, StmtRef ref) {
+  Stmt* stmt = ast_stmt(program, ref);
+  if (!stmt) return AST_NONE;
+  
+  switch (stmt->type) {
+    case STMT_EXPR:
+      stmt->as.expr.expr = fold_expression(program, stmt->as.expr.expr);
+      return ref;
+      
+    case STMT_BLOCK:
+      return fold_block(program, ref);
+      
+    case STMT_IF: {
+      stmt->as.if_stmt.condition = fold_expression(program, stmt->as.if_stmt.condition);
+      stmt->as.if_stmt.then_branch = fold_statement(program, stmt->as.if_stmt.then_branch);
+      stmt->as.if_stmt.else_branch = fold_statement(program, stmt->as.if_stmt.else_branch);
+      
+      // Keep only the branch that can run
+      Expr* condition = ast_expr(program, stmt->as.if_stmt.condition);
+      if (condition && is_constant(condition)) {
+        return constant_truth(condition) ? stmt->as.if_stmt.then_branch
+                                         : stmt->as.if_stmt.else_branch;
+      }
+      return ref;
+    }
+      
+    case STMT_WHILE: {
+      stmt->as.while_stmt.condition = fold_expression(program, stmt->as.while_stmt.condition);
+      Expr* condition = ast_expr(program, stmt->as.while_stmt.condition);
+      
+      // A loop whose condition is false from the start never runs
+      if (condition && is_constant(condition) && !constant_truth(condition)) {
+        return AST_NONE;
+      }
+      
+      stmt->as.while_stmt.body = fold_statement(program, stmt->as.while_stmt.body);
+      return ref;
+    }
+      
+    case STMT_DO_WHILE:
+      stmt->as.do_while_stmt.body = fold_statement(program, stmt->as.do_while_stmt.body);
+      stmt->as.do_while_stmt.condition = fold_expression(program, stmt->as.do_while_stmt.condition);
+      return ref;
+      
+    case STMT_FOR:
+      stmt->as.for_stmt.init = fold_statement(program, stmt->as.for_stmt.init);
+      stmt->as.for_stmt.condition = fold_expression(program, stmt->as.for_stmt.condition);
+      stmt->as.for_stmt.update = fold_expression(program, stmt->as.for_stmt.update);
+      stmt->as.for_stmt.body = fold_statement(program, stmt->as.for_stmt.body);
+      return ref;
+      
+    case STMT_SWITCH:
+      stmt->as.switch_stmt.condition = fold_expression(program, stmt->as.switch_stmt.condition);
+      return ref;
+      
+    case STMT_RETURN:
+      stmt->as.return_stmt.value = fold_expression(program, stmt->as.return_stmt.value);
+      return ref;
+      
+    case STMT_LABEL:
+      stmt->as.label_stmt.statement = fold_statement(program, stmt->as.label_stmt.statement);
+      return ref;
+      
+    case STMT_DECL:
+      if (stmt->as.decl_stmt.decl && stmt->as.decl_stmt.decl->type == DECL_VAR) {
+        Decl* decl = stmt->as.decl_stmt.decl;
+        decl->as.var.initializer = fold_expression(program, decl->as.var.initializer);
+      }
+      return ref;
+      
+    default:
+      return ref;
+  }
+}
+
+void fold_declaration(Program* program, Decl* decl) {
+  if (!decl) return;
+  
+  if (decl->type == DECL_VAR) {
+    decl->as.var.initializer = fold_expression(program, decl->as.var.initializer);
+  } else if (decl->type == DECL_FUNC && decl->as.func.body) {
+    decl->as.func.body = fold_statement(program, decl->as.func.body);
+  }
+}
+
+void fold_program(Program* program) {
+  for (int i = 0; i < program->count; i++) {
+    fold_declaration(program, program->declarations[i]);
+  }
+}
@@ -0,0 +1,179 @@
+/**
+ * @file inline.c
+ * @brief Selection of the functions codegen inlines at their call sites
+ */
+
+#include "../include/inline.h"
+
+/**
+ * @brief Walk state of inline_candidate
+ */
+typedef struct {
+  Program* program;
+  Decl* decl;
+  int nodes; // Visited so far; the walk gives up past max_nodes
+  int max_nodes;
+  bool ok;
+} InlineCheck;
+
+static void check_expr(InlineCheck* check, ExprRef ref);
+static void check_stmt(InlineCheck* check, StmtRef ref, bool last);
+
+static bool is_parameter(InlineCheck* check, ExprRef ref) {
+  Expr* expr = ast_expr(check->program, ref);
+  if (!expr || expr->type != EXPR_IDENTIFIER || !check->decl->as.func.param_names) return false;
+  
+  Type* type = check->decl->declared_type;
+  for (int i = 0; i < type->as.function.param_count; i++) {
+    if (check->decl->as.func.param_names[i] == expr->as.identifier.name) return true;
+  }
+  return false;
+}
+
+// Count a node, and stop the walk once the body is too big
+static bool visit(InlineCheck* check) {
+  if (!check->ok) return false;
+  if (++check->nodes > check->max_nodes) {
+    check->ok = false;
+    return false;
+  }
+  return true;
+}
+
+static void check_expr(InlineCheck* check, ExprRef ref) {
+  Expr* expr = ast_expr(check->program, ref);
+  if (!expr || !visit(check)) return;
+  
+  switch (expr->type) {
+    case EXPR_BINARY:
+      check_expr(check, expr->as.binary.left);
+      check_expr(check, expr->as.binary.right);
+      break;
+    
+    case EXPR_UNARY: {
+      TokenType op = expr->as.unary.operator;
+      if ((op == TOKEN_PLUS_PLUS || op == TOKEN_MINUS_MINUS || op == TOKEN_AMPERSAND) &&
+          is_parameter(check, expr->as.unary.operand)) {
+        check->ok = false;
+        return;
+      }
+      check_expr(check, expr->as.unary.operand);
+      break;
+    }
+    
+    case EXPR_CALL: {
+      Expr* function = ast_expr(check->program, expr->as.call.function);
+      if (function->type == EXPR_IDENTIFIER && function->as.identifier.name == check->decl->name) {
+        check->ok = false; // Recursive
+        return;
+      }
+      check_expr(check, expr->as.call.function);
+      for (int i = 0; i < expr->as.call.arg_count; i++) {
+        check_expr(check, expr->as.call.arguments[i]);
+      }
+      break;
+    }
+    
+    case EXPR_INDEX:
+      check_expr(check, expr->as.index.array);
+      check_expr(check, expr->as.index.index);
+      break;
+    
+    case EXPR_FIELD:
+      check_expr(check, expr->as.field.object);
+      break;
+    
+    case EXPR_ASSIGN:
+      if (is_parameter(check, expr->as.assign.target)) {
+        check->ok = false;
+        return;
+      }
+      check_expr(check, expr->as.assign.target);
+      check_expr(check, expr->as.assign.value);
+      break;
+    
+    case EXPR_CONDITIONAL:
+      check_expr(check, expr->as.conditional.condition);
+      check_expr(check, expr->as.conditional.true_expr);
+      check_expr(check, expr->as.conditional.false_expr);
+      break;
+    
+    case EXPR_CAST:
+      check_expr(check, expr->as.cast.expr);
+      break;
+    
+    default:
+      break;
+  }
+}
+
+// last: the final statement of the body's top-level block, the only place a return may be
+static void check_stmt(InlineCheck* check, StmtRef ref, bool last) {
+  Stmt* stmt = ast_stmt(check->program, ref);
+  if (!stmt || !visit(check)) return;
+  
+  switch (stmt->type) {
+    case STMT_EXPR:
+      check_expr(check, stmt->as.expr.expr);
+      break;
+    
+    case STMT_BLOCK:
+      for (int i = 0; i < stmt->as.block.count; i++) {
+        check_stmt(check, stmt->as.block.statements[i], false);
+      }
+      break;
+    
+    case STMT_IF:
+      check_expr(check, stmt->as.if_stmt.condition);
+      check_stmt(check, stmt->as.if_stmt.then_branch, false);
+      check_stmt(check, stmt->as.if_stmt.else_branch, false);
+      break;
+    
+    case STMT_WHILE:
+      check_expr(check, stmt->as.while_stmt.condition);
+      check_stmt(check, stmt->as.while_stmt.body, false);
+      break;
+    
+    case STMT_RETURN:
+      if (!last) {
+        check->ok = false;
+        return;
+      }
+      check_expr(check, stmt->as.return_stmt.value);
+      break;
+    
+    case STMT_DECL: {
+      Decl* decl = stmt->as.decl_stmt.decl;
+      if (!decl || decl->type != DECL_VAR || decl->is_static || decl->is_extern) {
+        check->ok = false;
+        return;
+      }
+      check_expr(check, decl->as.var.initializer);
+      break;
+    }
+    
+    default:
+      check->ok = false;
+      break;
+  }
+}
+
+bool inline_candidate(Program* program, Decl* decl, int max_nodes) {
+  if (!decl || decl->type != DECL_FUNC || !decl->as.func.body) return false;
+  if (decl->declared_type->as.function.is_variadic) return false;
+  
+  Stmt* body = ast_stmt(program, decl->as.func.body);
+  if (body->type != STMT_BLOCK) return false;
+  
+  InlineCheck check;
+  check.program = program;
+  check.decl = decl;
+  check.nodes = 0;
+  check.max_nodes = max_nodes;
+  check.ok = true;
+  
+  for (int i = 0; i < body->as.block.count && check.ok; i++) {
+    check_stmt(&check, body->as.block.statements[i], i == body->as.block.count - 1);
+  }
+  return check.ok;
+}
@@ -0,0 +1,92 @@
+/**
+ * @file intern.c
+ * @brief Implementation of the string interning pool
+ */
+
+#include "../include/intern.h"
+#include "../include/arena.h"
+#include <string.h>
+#include <stddef.h>
+
+#define INTERN_POOL_INITIAL_SIZE 256
+
+static InternEntry* intern_entry(const char* str) {
+  return (InternEntry*)(str - offsetof(InternEntry, chars));
+}
+
+unsigned int intern_hash_bytes(const char* str, size_t length) {
+  // FNV-1a
+  unsigned int hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (unsigned char)str[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+unsigned int intern_hash(const char* str) {
+  return intern_entry(str)->hash;
+}
+
+size_t intern_length(const char* str) {
+  return intern_entry(str)->length;
+}
+
+InternPool* intern_pool_create(struct Arena* arena) {
+  InternPool* pool = arena_alloc(arena, sizeof(InternPool));
+  pool->bucket_count = INTERN_POOL_INITIAL_SIZE;
+  pool->buckets = arena_calloc(arena, sizeof(InternEntry*) * pool->bucket_count);
+  pool->count = 0;
+  pool->arena = arena;
+  return pool;
+}
+
+static void intern_pool_grow(InternPool* pool) {
+  int new_count = pool->bucket_count * 2;
+  InternEntry** new_buckets = arena_calloc(pool->arena, sizeof(InternEntry*) * new_count);
+  if (!new_buckets) return;
+  
+  for (int i = 0; i < pool->bucket_count; i++) {
+    InternEntry* entry = pool->buckets[i];
+    while (entry) {
+      InternEntry* next = entry->next;
+      unsigned int index = entry->hash & (new_count - 1);
+      entry->next = new_buckets[index];
+      new_buckets[index] = entry;
+      entry = next;
+    }
+  }
+  
+  pool->buckets = new_buckets;
+  pool->bucket_count = new_count;
+}
+
+const char* intern_string(InternPool* pool, const char* str, size_t length) {
+  unsigned int hash = intern_hash_bytes(str, length);
+  InternEntry** bucket = &pool->buckets[hash & (pool->bucket_count - 1)];
+  
+  for (InternEntry* entry = *bucket; entry; entry = entry->next) {
+    if (entry->hash == hash && entry->length == length &&
+        memcmp(entry->chars, str, length) == 0) {
+      return entry->chars;
+    }
+  }
+  
+  // First time this spelling is seen: store it once
+  InternEntry* entry = arena_alloc(pool->arena, sizeof(InternEntry) + length + 1);
+  if (!entry) return NULL;
+  
+  entry->hash = hash;
+  entry->length = (unsigned int)length;
+  memcpy(entry->chars, str, length);
+  entry->chars[length] = '\0';
+  entry->next = *bucket;
+  *bucket = entry;
+  pool->count++;
+  
+  if (pool->count > pool->bucket_count) {
+    intern_pool_grow(pool);
+  }
+  
+  return entry->chars;
+}
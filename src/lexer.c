@@ -5,105 +5,150 @@
 
 #include "../include/lexer.h"
 #include "../include/arena.h"
+#include "../include/intern.h"
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
 
+// Character classes for table-driven scanning
+#define CHAR_ALPHA  0x01 // Letters and '_'
+#define CHAR_DIGIT  0x02
+#define CHAR_HEX    0x04
+#define CHAR_OCTAL  0x08
+#define CHAR_SPACE  0x10 // ' ', '\t', '\r', '\n'
+
+static const unsigned char char_class[256] = {
+  ['\t'] = CHAR_SPACE, ['\n'] = CHAR_SPACE, ['\r'] = CHAR_SPACE, [' '] = CHAR_SPACE,
+  ['0'] = CHAR_DIGIT | CHAR_HEX | CHAR_OCTAL, ['1'] = CHAR_DIGIT | CHAR_HEX | CHAR_OCTAL,
+  ['2'] = CHAR_DIGIT | CHAR_HEX | CHAR_OCTAL, ['3'] = CHAR_DIGIT | CHAR_HEX | CHAR_OCTAL,
+  ['4'] = CHAR_DIGIT | CHAR_HEX | CHAR_OCTAL, ['5'] = CHAR_DIGIT | CHAR_HEX | CHAR_OCTAL,
+  ['6'] = CHAR_DIGIT | CHAR_HEX | CHAR_OCTAL, ['7'] = CHAR_DIGIT | CHAR_HEX | CHAR_OCTAL,
+  ['8'] = CHAR_DIGIT | CHAR_HEX, ['9'] = CHAR_DIGIT | CHAR_HEX,
+  ['A'] = CHAR_ALPHA | CHAR_HEX, ['B'] = CHAR_ALPHA | CHAR_HEX, ['C'] = CHAR_ALPHA | CHAR_HEX,
+  ['D'] = CHAR_ALPHA | CHAR_HEX, ['E'] = CHAR_ALPHA | CHAR_HEX, ['F'] = CHAR_ALPHA | CHAR_HEX,
+  ['G'] = CHAR_ALPHA, ['H'] = CHAR_ALPHA, ['I'] = CHAR_ALPHA, ['J'] = CHAR_ALPHA,
+  ['K'] = CHAR_ALPHA, ['L'] = CHAR_ALPHA, ['M'] = CHAR_ALPHA, ['N'] = CHAR_ALPHA,
+  ['O'] = CHAR_ALPHA, ['P'] = CHAR_ALPHA, ['Q'] = CHAR_ALPHA, ['R'] = CHAR_ALPHA,
+  ['S'] = CHAR_ALPHA, ['T'] = CHAR_ALPHA, ['U'] = CHAR_ALPHA, ['V'] = CHAR_ALPHA,
+  ['W'] = CHAR_ALPHA, ['X'] = CHAR_ALPHA, ['Y'] = CHAR_ALPHA, ['Z'] = CHAR_ALPHA,
+  ['_'] = CHAR_ALPHA,
+  ['a'] = CHAR_ALPHA | CHAR_HEX, ['b'] = CHAR_ALPHA | CHAR_HEX, ['c'] = CHAR_ALPHA | CHAR_HEX,
+  ['d'] = CHAR_ALPHA | CHAR_HEX, ['e'] = CHAR_ALPHA | CHAR_HEX, ['f'] = CHAR_ALPHA | CHAR_HEX,
+  ['g'] = CHAR_ALPHA, ['h'] = CHAR_ALPHA, ['i'] = CHAR_ALPHA, ['j'] = CHAR_ALPHA,
+  ['k'] = CHAR_ALPHA, ['l'] = CHAR_ALPHA, ['m'] = CHAR_ALPHA, ['n'] = CHAR_ALPHA,
+  ['o'] = CHAR_ALPHA, ['p'] = CHAR_ALPHA, ['q'] = CHAR_ALPHA, ['r'] = CHAR_ALPHA,
+  ['s'] = CHAR_ALPHA, ['t'] = CHAR_ALPHA, ['u'] = CHAR_ALPHA, ['v'] = CHAR_ALPHA,
+  ['w'] = CHAR_ALPHA, ['x'] = CHAR_ALPHA, ['y'] = CHAR_ALPHA, ['z'] = CHAR_ALPHA,
+};
+
 // Helper functions for character checking
 static inline bool is_alpha(char c) {
-  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+  return char_class[(unsigned char)c] & CHAR_ALPHA;
 }
 
 static inline bool is_digit(char c) {
-  return c >= '0' && c <= '9';
+  return char_class[(unsigned char)c] & CHAR_DIGIT;
 }
 
 static inline bool is_alnum(char c) {
-  return is_alpha(c) || is_digit(c);
+  return char_class[(unsigned char)c] & (CHAR_ALPHA | CHAR_DIGIT);
 }
 
 static inline bool is_hex_digit(char c) {
-  return is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+  return char_class[(unsigned char)c] & CHAR_HEX;
 }
 
 static inline bool is_octal_digit(char c) {
-  return c >= '0' && c <= '7';
+  return char_class[(unsigned char)c] & CHAR_OCTAL;
 }
 
 static inline bool is_whitespace(char c) {
-  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
-}
-
-// Keyword table
-typedef struct {
-  const char* keyword;
-  TokenType type;
-} Keyword;
-
-static const Keyword keywords[] = {
-  {"auto", TOKEN_AUTO},
-  {"break", TOKEN_BREAK},
-  {"case", TOKEN_CASE},
-  {"char", TOKEN_CHAR},
-  {"const", TOKEN_CONST},
-  {"continue", TOKEN_CONTINUE},
-  {"default", TOKEN_DEFAULT},
-  {"do", TOKEN_DO},
-  {"double", TOKEN_DOUBLE},
-  {"else", TOKEN_ELSE},
-  {"enum", TOKEN_ENUM},
-  {"extern", TOKEN_EXTERN},
-  {"float", TOKEN_FLOAT},
-  {"for", TOKEN_FOR},
-  {"goto", TOKEN_GOTO},
-  {"if", TOKEN_IF},
-  {"int", TOKEN_INT},
-  {"long", TOKEN_LONG},
-  {"register", TOKEN_REGISTER},
-  {"return", TOKEN_RETURN},
-  {"short", TOKEN_SHORT},
-  {"signed", TOKEN_SIGNED},
-  {"sizeof", TOKEN_SIZEOF},
-  {"static", TOKEN_STATIC},
-  {"struct", TOKEN_STRUCT},
-  {"switch", TOKEN_SWITCH},
-  {"typedef", TOKEN_TYPEDEF},
-  {"union", TOKEN_UNION},
-  {"unsigned", TOKEN_UNSIGNED},
-  {"void", TOKEN_VOID},
-  {"volatile", TOKEN_VOLATILE},
-  {"while", TOKEN_WHILE},
-  {NULL, TOKEN_EOF}
-};
+  return char_class[(unsigned char)c] & CHAR_SPACE;
+}
 
-// Helper functions for lexer
-static char lexer_peek(Lexer* lexer) {
-  if (lexer->position >= lexer->source_length) {
-    return '\0';
+/*
+ * Bulk scanners. The source is always NUL-terminated and the sentinel is
+ * never part of any class, so every scan stops at the end of input without a
+ * bounds check. The SSE2 paths only load full 16-byte blocks that lie before
+ * the sentinel and finish with the scalar loop.
+ */
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define LEXER_SIMD_WIDTH 16
+
+static inline unsigned int simd_whitespace_mask(const char* p) {
+  __m128i v = _mm_loadu_si128((const __m128i*)p);
+  __m128i space = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                               _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+  __m128i line = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                              _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+  return (unsigned int)_mm_movemask_epi8(_mm_or_si128(space, line));
+}
+
+static inline unsigned int simd_identifier_mask(const char* p) {
+  __m128i v = _mm_loadu_si128((const __m128i*)p);
+  __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+  __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+  __m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+  return (unsigned int)_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit), under));
+}
+#endif
+
+static inline const char* scan_whitespace(const char* p, const char* end) {
+#ifdef LEXER_SIMD_WIDTH
+  // Most runs are a single space; only go wide for longer ones (indentation)
+  if (is_whitespace(p[0]) && is_whitespace(p[1])) {
+    while (end - p >= LEXER_SIMD_WIDTH) {
+      unsigned int mask = simd_whitespace_mask(p);
+      if (mask != 0xFFFF) {
+        return p + __builtin_ctz(~mask);
+      }
+      p += LEXER_SIMD_WIDTH;
+    }
   }
+#else
+  (void)end;
+#endif
+  while (is_whitespace(*p)) p++;
+  return p;
+}
+
+static inline const char* scan_identifier(const char* p, const char* end) {
+#ifdef LEXER_SIMD_WIDTH
+  while (end - p >= LEXER_SIMD_WIDTH) {
+    unsigned int mask = simd_identifier_mask(p);
+    if (mask != 0xFFFF) {
+      return p + __builtin_ctz(~mask);
+    }
+    p += LEXER_SIMD_WIDTH;
+  }
+#else
+  (void)end;
+#endif
+  while (is_alnum(*p)) p++;
+  return p;
+}
+
+// Helper functions for lexer
+static inline char lexer_peek(Lexer* lexer) {
   return lexer->source[lexer->position];
 }
 
-static char lexer_peek_next(Lexer* lexer) {
-  if (lexer->position + 1 >= lexer->source_length) {
+static inline char lexer_peek_next(Lexer* lexer) {
+  if (lexer->source[lexer->position] == '\0') {
     return '\0';
   }
   return lexer->source[lexer->position + 1];
 }
 
-static char lexer_advance(Lexer* lexer) {
-  char c = lexer_peek(lexer);
-  if (c == '\0') return c;
-  
-  lexer->position++;
-  
-  if (c == '\n') {
-    lexer->line++;
-    lexer->column = 0;
-  } else {
-    lexer->column++;
+static inline char lexer_advance(Lexer* lexer) {
+  char c = lexer->source[lexer->position];
+  if (c != '\0') {
+    lexer->position++;
   }
-  
   return c;
 }
 
@@ -112,63 +157,51 @@ static bool lexer_match(Lexer* lexer, char expected) {
     return false;
   }
   
-  lexer_advance(lexer);
+  lexer->position++;
   return true;
 }
 
 static void lexer_skip_whitespace(Lexer* lexer) {
-  for (;;) {
-    char c = lexer_peek(lexer);
-    
-    if (c == ' ' || c == '\r' || c == '\t') {
-      lexer_advance(lexer);
-    } else if (c == '\n') {
-      lexer_advance(lexer);
-    } else {
-      break;
-    }
-  }
+  const char* p = lexer->source + lexer->position;
+  lexer->position = scan_whitespace(p, lexer->source + lexer->source_length) - lexer->source;
 }
 
 static void lexer_skip_comment(Lexer* lexer) {
-  // Line comment
-  if (lexer_peek(lexer) == '/' && lexer_peek_next(lexer) == '/') {
-    lexer_advance(lexer); // Skip '/'
-    lexer_advance(lexer); // Skip '/'
-    
-    // Read until end of line or end of file
-    while (lexer_peek(lexer) != '\n' && lexer_peek(lexer) != '\0') {
-      lexer_advance(lexer);
-    }
+  const char* p = lexer->source + lexer->position + 2; // Skip the opening "//" or "/*"
+  const char* end = lexer->source + lexer->source_length;
+  
+  // Line comment: stop at the newline (or end of file)
+  if (lexer->source[lexer->position + 1] == '/') {
+    const char* newline = memchr(p, '\n', end - p);
+    lexer->position = (newline ? newline : end) - lexer->source;
+    return;
   }
-  // Block comment
-  else if (lexer_peek(lexer) == '/' && lexer_peek_next(lexer) == '*') {
-    lexer_advance(lexer); // Skip '/'
-    lexer_advance(lexer); // Skip '*'
-    
-    // Read until */ or end of file
-    while (!(lexer_peek(lexer) == '*' && lexer_peek_next(lexer) == '/') &&
-           lexer_peek(lexer) != '\0') {
-      lexer_advance(lexer);
+  
+  // Block comment: jump from '*' to '*' until one is followed by '/'
+  for (;;) {
+    const char* star = memchr(p, '*', end - p);
+    if (!star) {
+      lexer->position = lexer->source_length; // Unterminated, consume the rest
+      return;
     }
-    
-    if (lexer_peek(lexer) != '\0') {
-      lexer_advance(lexer); // Skip '*'
-      lexer_advance(lexer); // Skip '/'
+    if (star[1] == '/') {
+      lexer->position = star + 2 - lexer->source;
+      return;
     }
+    p = star + 1;
   }
 }
 
 static Token lexer_make_token(Lexer* lexer, TokenType type) {
   Token token;
   token.type = type;
-  token.location.file = lexer->filename;
-  token.location.line = lexer->line;
-  token.location.column = lexer->column;
+  token.location.file_id = lexer->file_id;
+  token.location.offset = (uint32_t)lexer->token_start; // Line resolved on demand
   
   // For now, we don't store the lexeme directly
   token.lexeme = NULL;
   token.length = 0;
+  token.value.int_value = 0;
   
   return token;
 }
@@ -181,12 +214,98 @@ static Token lexer_error_token(Lexer* lexer, const char* message) {
   return token;
 }
 
+// Match the remainder of a single keyword candidate
+static inline TokenType check_keyword_rest(const char* identifier, int length,
+                                           int start, const char* rest, int rest_length,
+                                           TokenType type) {
+  if (length == start + rest_length && memcmp(identifier + start, rest, rest_length) == 0) {
+    return type;
+  }
+  return TOKEN_IDENTIFIER;
+}
+
+/*
+ * Keyword recognition switches on the first character (and the second where
+ * several keywords share one), so each identifier costs at most a couple of
+ * branches and one short memcmp.
+ */
 static TokenType check_keyword(const char* identifier, int length) {
-  for (int i = 0; keywords[i].keyword != NULL; i++) {
-    if (strncmp(keywords[i].keyword, identifier, length) == 0 &&
-        keywords[i].keyword[length] == '\0') {
-      return keywords[i].type;
-    }
+  if (length < 2 || length > 8) {
+    return TOKEN_IDENTIFIER; // Keywords are 2 to 8 characters long
+  }
+  
+  switch (identifier[0]) {
+    case 'a': return check_keyword_rest(identifier, length, 1, "uto", 3, TOKEN_AUTO);
+    case 'b': return check_keyword_rest(identifier, length, 1, "reak", 4, TOKEN_BREAK);
+    case 'c':
+      switch (identifier[1]) {
+        case 'a': return check_keyword_rest(identifier, length, 2, "se", 2, TOKEN_CASE);
+        case 'h': return check_keyword_rest(identifier, length, 2, "ar", 2, TOKEN_CHAR);
+        case 'o':
+          if (length == 5) return check_keyword_rest(identifier, length, 2, "nst", 3, TOKEN_CONST);
+          return check_keyword_rest(identifier, length, 2, "ntinue", 6, TOKEN_CONTINUE);
+      }
+      break;
+    case 'd':
+      if (length == 2) return check_keyword_rest(identifier, length, 1, "o", 1, TOKEN_DO);
+      switch (identifier[1]) {
+        case 'e': return check_keyword_rest(identifier, length, 2, "fault", 5, TOKEN_DEFAULT);
+        case 'o': return check_keyword_rest(identifier, length, 2, "uble", 4, TOKEN_DOUBLE);
+      }
+      break;
+    case 'e':
+      switch (identifier[1]) {
+        case 'l': return check_keyword_rest(identifier, length, 2, "se", 2, TOKEN_ELSE);
+        case 'n': return check_keyword_rest(identifier, length, 2, "um", 2, TOKEN_ENUM);
+        case 'x': return check_keyword_rest(identifier, length, 2, "tern", 4, TOKEN_EXTERN);
+      }
+      break;
+    case 'f':
+      switch (identifier[1]) {
+        case 'l': return check_keyword_rest(identifier, length, 2, "oat", 3, TOKEN_FLOAT);
+        case 'o': return check_keyword_rest(identifier, length, 2, "r", 1, TOKEN_FOR);
+      }
+      break;
+    case 'g': return check_keyword_rest(identifier, length, 1, "oto", 3, TOKEN_GOTO);
+    case 'i':
+      switch (identifier[1]) {
+        case 'f': return check_keyword_rest(identifier, length, 2, "", 0, TOKEN_IF);
+        case 'n': return check_keyword_rest(identifier, length, 2, "t", 1, TOKEN_INT);
+      }
+      break;
+    case 'l': return check_keyword_rest(identifier, length, 1, "ong", 3, TOKEN_LONG);
+    case 'r':
+      if (identifier[1] != 'e') break;
+      switch (identifier[2]) {
+        case 'g': return check_keyword_rest(identifier, length, 3, "ister", 5, TOKEN_REGISTER);
+        case 't': return check_keyword_rest(identifier, length, 3, "urn", 3, TOKEN_RETURN);
+      }
+      break;
+    case 's':
+      switch (identifier[1]) {
+        case 'h': return check_keyword_rest(identifier, length, 2, "ort", 3, TOKEN_SHORT);
+        case 'i':
+          if (length == 6 && identifier[2] == 'g') return check_keyword_rest(identifier, length, 3, "ned", 3, TOKEN_SIGNED);
+          return check_keyword_rest(identifier, length, 2, "zeof", 4, TOKEN_SIZEOF);
+        case 't':
+          if (length == 6 && identifier[2] == 'a') return check_keyword_rest(identifier, length, 3, "tic", 3, TOKEN_STATIC);
+          return check_keyword_rest(identifier, length, 2, "ruct", 4, TOKEN_STRUCT);
+        case 'w': return check_keyword_rest(identifier, length, 2, "itch", 4, TOKEN_SWITCH);
+      }
+      break;
+    case 't': return check_keyword_rest(identifier, length, 1, "ypedef", 6, TOKEN_TYPEDEF);
+    case 'u':
+      if (identifier[1] != 'n') break;
+      switch (identifier[2]) {
+        case 'i': return check_keyword_rest(identifier, length, 3, "on", 2, TOKEN_UNION);
+        case 's': return check_keyword_rest(identifier, length, 3, "igned", 5, TOKEN_UNSIGNED);
+      }
+      break;
+    case 'v':
+      if (identifier[1] != 'o') break;
+      if (length == 4) return check_keyword_rest(identifier, length, 2, "id", 2, TOKEN_VOID);
+      return check_keyword_rest(identifier, length, 2, "latile", 6, TOKEN_VOLATILE);
+    case 'w': return check_keyword_rest(identifier, length, 1, "hile", 4, TOKEN_WHILE);
   }
   
   return TOKEN_IDENTIFIER;
@@ -195,9 +314,8 @@ static TokenType check_keyword(const char* identifier, int length) {
 static Token lexer_identifier(Lexer* lexer) {
   size_t start = lexer->position - 1; // We've already consumed the first character
   
-  while (is_alnum(lexer_peek(lexer))) {
-    lexer_advance(lexer);
-  }
+  const char* end = scan_identifier(lexer->source + lexer->position, lexer->source + lexer->source_length);
+  lexer->position = end - lexer->source;
   
   // Determine if it's a keyword or identifier
   size_t length = lexer->position - start;
@@ -207,6 +325,10 @@ static Token lexer_identifier(Lexer* lexer) {
   token.lexeme = lexer->source + start;
   token.length = length;
   
+  if (type == TOKEN_IDENTIFIER) {
+    token.value.identifier = intern_string(lexer->strings, token.lexeme, length);
+  }
+  
   return token;
 }
 
@@ -448,25 +570,35 @@ static Token lexer_char(Lexer* lexer) {
   return token;
 }
 
+static Token lexer_scan_token(Lexer* lexer);
+
 Lexer* lexer_create(const char* source, const char* filename, struct Arena* arena) {
+  return lexer_create_with_length(source, strlen(source), filename, NULL, arena);
+}
+
+Lexer* lexer_create_with_length(const char* source, size_t length, const char* filename,
+                                struct InternPool* strings, struct Arena* arena) {
   Lexer* lexer = arena_alloc(arena, sizeof(Lexer));
   lexer->source = source;
   lexer->filename = filename;
-  lexer->source_length = strlen(source);
+  lexer->file_id = SOURCE_FILE_MAIN;
+  lexer->source_length = length;
   lexer->position = 0;
-  lexer->line = 1;
-  lexer->column = 0;
+  lexer->token_start = 0;
+  lexer->line_offsets = NULL;
+  lexer->line_count = 0;
   lexer->arena = arena;
+  lexer->strings = strings ? strings : intern_pool_create(arena);
   lexer->has_error = false;
   lexer->error_message = NULL;
   
   // Pre-load the first token
-  lexer->current = lexer_next_token(lexer);
+  lexer->current = lexer_scan_token(lexer);
   
   return lexer;
 }
 
-Token lexer_next_token(Lexer* lexer) {
+static Token lexer_scan_token(Lexer* lexer) {
   // Skip whitespace and comments
   for (;;) {
     lexer_skip_whitespace(lexer);
@@ -478,6 +610,8 @@ Token lexer_next_token(Lexer* lexer) {
     }
   }
   
+  lexer->token_start = lexer->position;
+  
   // Check for end of file
   if (lexer_peek(lexer) == '\0') {
     return lexer_make_token(lexer, TOKEN_EOF);
@@ -588,10 +722,114 @@ Token lexer_next_token(Lexer* lexer) {
   return lexer_error_token(lexer, "Unexpected character");
 }
 
+Token lexer_next_token(Lexer* lexer) {
+  lexer->current = lexer_scan_token(lexer);
+  return lexer->current;
+}
+
 Token lexer_peek_token(Lexer* lexer) {
   return lexer->current;
 }
 
+Token lexer_peek_ahead(Lexer* lexer, int distance) {
+  if (distance <= 0 || lexer->current.type == TOKEN_EOF) {
+    return lexer->current;
+  }
+  
+  // Scan ahead, then rewind; interning the same names again is harmless
+  size_t position = lexer->position;
+  size_t token_start = lexer->token_start;
+  bool has_error = lexer->has_error;
+  char* error_message = lexer->error_message;
+  
+  Token token = lexer->current;
+  for (int i = 0; i < distance && token.type != TOKEN_EOF; i++) {
+    token = lexer_scan_token(lexer);
+  }
+  
+  lexer->position = position;
+  lexer->token_start = token_start;
+  lexer->has_error = has_error;
+  lexer->error_message = error_message;
+  
+  return token;
+}
+
+#define TOKEN_ARRAY_INITIAL_CAPACITY 1024
+#define TOKEN_ARRAY_ALIGNMENT 64 // Cache line, so columns can be scanned with vector loads
+
+static void token_array_grow(TokenArray* tokens, struct Arena* arena) {
+  int capacity = tokens->capacity * 2;
+  
+  uint8_t* types = arena_alloc_aligned(arena, sizeof(uint8_t) * capacity, TOKEN_ARRAY_ALIGNMENT);
+  uint32_t* offsets = arena_alloc_aligned(arena, sizeof(uint32_t) * capacity, TOKEN_ARRAY_ALIGNMENT);
+  uint32_t* lengths = arena_alloc_aligned(arena, sizeof(uint32_t) * capacity, TOKEN_ARRAY_ALIGNMENT);
+  TokenValue* values = arena_alloc_aligned(arena, sizeof(TokenValue) * capacity, TOKEN_ARRAY_ALIGNMENT);
+  
+  memcpy(types, tokens->types, sizeof(uint8_t) * tokens->count);
+  memcpy(offsets, tokens->offsets, sizeof(uint32_t) * tokens->count);
+  memcpy(lengths, tokens->lengths, sizeof(uint32_t) * tokens->count);
+  memcpy(values, tokens->values, sizeof(TokenValue) * tokens->count);
+  
+  tokens->types = types;
+  tokens->offsets = offsets;
+  tokens->lengths = lengths;
+  tokens->values = values;
+  tokens->capacity = capacity;
+}
+
+TokenArray* lexer_tokenize(Lexer* lexer) {
+  TokenArray* tokens = arena_alloc(lexer->arena, sizeof(TokenArray));
+  
+  // Roughly one token per five bytes of typical C, so most files never grow
+  int capacity = TOKEN_ARRAY_INITIAL_CAPACITY;
+  while ((size_t)capacity * 5 < lexer->source_length) {
+    capacity *= 2;
+  }
+  
+  tokens->types = arena_alloc_aligned(lexer->arena, sizeof(uint8_t) * capacity, TOKEN_ARRAY_ALIGNMENT);
+  tokens->offsets = arena_alloc_aligned(lexer->arena, sizeof(uint32_t) * capacity, TOKEN_ARRAY_ALIGNMENT);
+  tokens->lengths = arena_alloc_aligned(lexer->arena, sizeof(uint32_t) * capacity, TOKEN_ARRAY_ALIGNMENT);
+  tokens->values = arena_alloc_aligned(lexer->arena, sizeof(TokenValue) * capacity, TOKEN_ARRAY_ALIGNMENT);
+  tokens->count = 0;
+  tokens->capacity = capacity;
+  tokens->source = lexer->source;
+  tokens->file_id = lexer->file_id;
+  
+  Token token = lexer->current;
+  for (;;) {
+    if (tokens->count == tokens->capacity) {
+      token_array_grow(tokens, lexer->arena);
+    }
+    
+    int index = tokens->count++;
+    tokens->types[index] = (uint8_t)token.type;
+    tokens->offsets[index] = token.location.offset;
+    tokens->lengths[index] = (uint32_t)token.length;
+    tokens->values[index] = token.value;
+    
+    if (token.type == TOKEN_EOF) break;
+    token = lexer_next_token(lexer);
+  }
+  
+  return tokens;
+}
+
+Token token_array_get(const TokenArray* tokens, int index) {
+  if (index >= tokens->count) {
+    index = tokens->count - 1;
+  }
+  
+  Token token;
+  token.type = (TokenType)tokens->types[index];
+  token.length = (int)tokens->lengths[index];
+  token.lexeme = token.length ? tokens->source + tokens->offsets[index] : NULL;
+  token.location.file_id = tokens->file_id;
+  token.location.offset = tokens->offsets[index];
+  token.value = tokens->values[index];
+  return token;
+}
+
 bool lexer_check(Lexer* lexer, TokenType type) {
   return lexer->current.type == type;
 }
@@ -618,12 +856,54 @@ bool lexer_consume(Lexer* lexer, TokenType type) {
 
 SourceLocation lexer_location(Lexer* lexer) {
   SourceLocation location;
-  location.file = lexer->filename;
-  location.line = lexer->line;
-  location.column = lexer->column;
+  location.file_id = lexer->file_id;
+  location.offset = (uint32_t)lexer->position;
   return location;
 }
 
+// Record the offset at which every line starts (built on first use)
+static void lexer_build_line_index(Lexer* lexer) {
+  size_t count = 1;
+  const char* end = lexer->source + lexer->source_length;
+  for (const char* p = lexer->source; (p = memchr(p, '\n', end - p)); p++) {
+    count++;
+  }
+  
+  lexer->line_offsets = arena_alloc(lexer->arena, sizeof(size_t) * count);
+  lexer->line_offsets[0] = 0;
+  lexer->line_count = 1;
+  for (const char* p = lexer->source; (p = memchr(p, '\n', end - p)); p++) {
+    lexer->line_offsets[lexer->line_count++] = p + 1 - lexer->source;
+  }
+}
+
+ResolvedLocation lexer_resolve_location(Lexer* lexer, SourceLocation location) {
+  // Only one file per lexer for now; its ID is what the tokens carry
+  ResolvedLocation resolved;
+  resolved.file = lexer->filename;
+  resolved.offset = location.offset;
+  
+  if (!lexer->line_offsets) {
+    lexer_build_line_index(lexer);
+  }
+  
+  // Find the last line starting at or before the offset
+  size_t low = 0;
+  size_t high = lexer->line_count;
+  while (high - low > 1) {
+    size_t mid = low + (high - low) / 2;
+    if (lexer->line_offsets[mid] <= location.offset) {
+      low = mid;
+    } else {
+      high = mid;
+    }
+  }
+  
+  resolved.line = (int)low + 1;
+  resolved.column = (int)(location.offset - lexer->line_offsets[low]) + 1;
+  return resolved;
+}
+
 const char* lexer_error(Lexer* lexer) {
   if (lexer->has_error) {
     return lexer->error_message;
@@ -0,0 +1,151 @@
+/**
+ * @file literal.c
+ * @brief Implementation of the string literal pool
+ */
+
+#include "../include/literal.h"
+#include "../include/intern.h"
+#include "../include/arena.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define LITERAL_POOL_INITIAL_SIZE 64
+
+LiteralPool* literal_pool_create(struct Arena* arena) {
+  LiteralPool* pool = arena_alloc(arena, sizeof(LiteralPool));
+  pool->bucket_count = LITERAL_POOL_INITIAL_SIZE;
+  pool->buckets = arena_calloc(arena, sizeof(LiteralEntry*) * pool->bucket_count);
+  pool->entries = NULL;
+  pool->count = 0;
+  pool->capacity = 0;
+  pool->data_size = 0;
+  pool->arena = arena;
+  return pool;
+}
+
+static void literal_pool_grow(LiteralPool* pool) {
+  int new_count = pool->bucket_count * 2;
+  LiteralEntry** new_buckets = arena_calloc(pool->arena, sizeof(LiteralEntry*) * new_count);
+  if (!new_buckets) return;
+  
+  for (int i = 0; i < pool->count; i++) {
+    LiteralEntry* entry = pool->entries[i];
+    unsigned int index = entry->hash & (new_count - 1);
+    entry->next = new_buckets[index];
+    new_buckets[index] = entry;
+  }
+  
+  pool->buckets = new_buckets;
+  pool->bucket_count = new_count;
+}
+
+int literal_pool_add(LiteralPool* pool, const char* str) {
+  size_t length = strlen(str);
+  unsigned int hash = intern_hash_bytes(str, length);
+  
+  for (LiteralEntry* entry = pool->buckets[hash & (pool->bucket_count - 1)]; entry; entry = entry->next) {
+    if (entry->hash == hash && entry->length == length &&
+        memcmp(entry->chars, str, length) == 0) {
+      return entry->id;
+    }
+  }
+  
+  // New literal
+  LiteralEntry* entry = arena_alloc(pool->arena, sizeof(LiteralEntry));
+  if (!entry) return -1;
+  
+  if (pool->count == pool->capacity) {
+    pool->entries = arena_grow_array(pool->arena, pool->entries, &pool->capacity, sizeof(LiteralEntry*));
+    if (!pool->entries) return -1;
+  }
+  
+  entry->chars = str;
+  entry->length = (uint32_t)length;
+  entry->hash = hash;
+  entry->id = pool->count;
+  entry->offset = 0;
+  
+  unsigned int index = hash & (pool->bucket_count - 1);
+  entry->next = pool->buckets[index];
+  pool->buckets[index] = entry;
+  pool->entries[pool->count++] = entry;
+  
+  if (pool->count > pool->bucket_count) {
+    literal_pool_grow(pool);
+  }
+  
+  return entry->id;
+}
+
+// Order literals by their reversed bytes, so a suffix sorts right before its longer forms
+static int compare_reversed(const void* a, const void* b) {
+  const LiteralEntry* x = *(const LiteralEntry* const*)a;
+  const LiteralEntry* y = *(const LiteralEntry* const*)b;
+  
+  uint32_t i = x->length;
+  uint32_t j = y->length;
+  while (i > 0 && j > 0) {
+    unsigned char cx = (unsigned char)x->chars[--i];
+    unsigned char cy = (unsigned char)y->chars[--j];
+    if (cx != cy) return cx < cy ? -1 : 1;
+  }
+  
+  if (x->length != y->length) return x->length < y->length ? -1 : 1;
+  return 0;
+}
+
+static bool is_suffix_of(const LiteralEntry* suffix, const LiteralEntry* entry) {
+  return suffix->length <= entry->length &&
+         memcmp(entry->chars + entry->length - suffix->length, suffix->chars, suffix->length) == 0;
+}
+
+size_t literal_pool_layout(LiteralPool* pool) {
+  pool->data_size = 0;
+  
+  if (pool->count > 0) {
+    Arena* scratch = arena_scratch(pool->arena);
+    ArenaMark mark = arena_mark(scratch);
+    
+    LiteralEntry** sorted = arena_alloc(scratch, sizeof(LiteralEntry*) * pool->count);
+    memcpy(sorted, pool->entries, sizeof(LiteralEntry*) * pool->count);
+    qsort(sorted, pool->count, sizeof(LiteralEntry*), compare_reversed);
+    
+    // Walking backwards, each literal is either a suffix of the one sorted
+    // after it (already placed, possibly itself shared) or gets new storage
+    for (int i = pool->count - 1; i >= 0; i--) {
+      LiteralEntry* entry = sorted[i];
+      LiteralEntry* longer = i + 1 < pool->count ? sorted[i + 1] : NULL;
+      
+      if (longer && is_suffix_of(entry, longer)) {
+        entry->offset = longer->offset + longer->length - entry->length;
+      } else {
+        entry->offset = pool->data_size;
+        pool->data_size += entry->length + 1;
+      }
+    }
+    
+    arena_rewind(scratch, mark);
+  }
+  
+  return sizeof(uint32_t) * (2 + (size_t)pool->count) + pool->data_size;
+}
+
+void literal_pool_write(LiteralPool* pool, CoilBuffer* buffer) {
+  uint32_t count = (uint32_t)pool->count;
+  coil_buffer_write(buffer, &count, sizeof(count));
+  
+  for (int i = 0; i < pool->count; i++) {
+    coil_buffer_write(buffer, &pool->entries[i]->offset, sizeof(uint32_t));
+  }
+  
+  coil_buffer_write(buffer, &pool->data_size, sizeof(pool->data_size));
+  
+  // Fill the data area in place; shared literals simply rewrite the same bytes
+  if (!coil_buffer_reserve(buffer, pool->data_size)) return;
+  uint8_t* data = buffer->data + buffer->size;
+  for (int i = 0; i < pool->count; i++) {
+    LiteralEntry* entry = pool->entries[i];
+    memcpy(data + entry->offset, entry->chars, entry->length + 1);
+  }
+  buffer->size += pool->data_size;
+}
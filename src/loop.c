@@ -0,0 +1,614 @@
+/**
+ * @file loop.c
+ * @brief Analysis of while loops for the loop optimizations of codegen
+ */
+
+#include "../include/loop.h"
+#include "../include/arena.h"
+
+/**
+ * @brief Entry of LoopNames
+ */
+struct LoopName {
+  const char* name;
+  int count;
+};
+
+/**
+ * @brief Induction variable found by loop_plan
+ */
+typedef struct {
+  const char* name;
+  Stmt* step;
+  long long amount; // Added to the variable at each step
+} Induction;
+
+/**
+ * @brief Walk state of loop_plan and loop_address_taken
+ */
+typedef struct {
+  const Program* program;
+  LoopNameFn resolve;
+  void* context;
+  Arena* arena;
+  bool record_writes;                  // Off while loop_address_taken scans a function
+  LoopNames written;                   // Assigned, stepped or declared in the loop
+  LoopNames address_taken;             // What loop_address_taken collects
+  const LoopNames* function_addresses; // Its result for the loop's function
+  Induction* inductions;
+  int induction_count;
+  int induction_capacity;
+  LoopPlan* plan;
+} LoopScan;
+
+static void add_name(LoopScan* scan, LoopNames* set, const char* name) {
+  for (int i = 0; i < set->count; i++) {
+    if (set->items[i].name == name) {
+      set->items[i].count++;
+      return;
+    }
+  }
+  
+  if (set->count == set->capacity) {
+    set->items = arena_grow_array(scan->arena, set->items, &set->capacity, sizeof(*set->items));
+    if (!set->items) {
+      set->count = set->capacity = 0;
+      return;
+    }
+  }
+  set->items[set->count].name = name;
+  set->items[set->count++].count = 1;
+}
+
+static int name_count(const LoopNames* set, const char* name) {
+  for (int i = 0; i < set->count; i++) {
+    if (set->items[i].name == name) return set->items[i].count;
+  }
+  return 0;
+}
+
+// Children are references into the program's node pools
+static inline Expr* expr_at(LoopScan* scan, ExprRef ref) {
+  return ast_expr(scan->program, ref);
+}
+
+static inline Stmt* stmt_at(LoopScan* scan, StmtRef ref) {
+  return ast_stmt(scan->program, ref);
+}
+
+static void note_expr(LoopScan* scan, Expr* expr);
+static void note_stmt(LoopScan* scan, Stmt* stmt);
+
+static void note_write(LoopScan* scan, Expr* target) {
+  if (scan->record_writes && target && target->type == EXPR_IDENTIFIER) {
+    add_name(scan, &scan->written, target->as.identifier.name);
+  }
+}
+
+// Record the writes and address-of operations under an expression
+static void note_expr(LoopScan* scan, Expr* expr) {
+  if (!expr) return;
+  
+  switch (expr->type) {
+    case EXPR_BINARY:
+      note_expr(scan, expr_at(scan, expr->as.binary.left));
+      note_expr(scan, expr_at(scan, expr->as.binary.right));
+      break;
+    
+    case EXPR_UNARY: {
+      TokenType op = expr->as.unary.operator;
+      Expr* operand = expr_at(scan, expr->as.unary.operand);
+      if (op == TOKEN_PLUS_PLUS || op == TOKEN_MINUS_MINUS) {
+        note_write(scan, operand);
+      } else if (op == TOKEN_AMPERSAND && operand && operand->type == EXPR_IDENTIFIER) {
+        add_name(scan, &scan->address_taken, operand->as.identifier.name);
+      }
+      note_expr(scan, operand);
+      break;
+    }
+    
+    case EXPR_CALL:
+      note_expr(scan, expr_at(scan, expr->as.call.function));
+      for (int i = 0; i < expr->as.call.arg_count; i++) {
+        note_expr(scan, expr_at(scan, expr->as.call.arguments[i]));
+      }
+      break;
+    
+    case EXPR_INDEX:
+      note_expr(scan, expr_at(scan, expr->as.index.array));
+      note_expr(scan, expr_at(scan, expr->as.index.index));
+      break;
+    
+    case EXPR_FIELD:
+      note_expr(scan, expr_at(scan, expr->as.field.object));
+      break;
+    
+    case EXPR_ASSIGN:
+      note_write(scan, expr_at(scan, expr->as.assign.target));
+      note_expr(scan, expr_at(scan, expr->as.assign.target));
+      note_expr(scan, expr_at(scan, expr->as.assign.value));
+      break;
+    
+    case EXPR_CONDITIONAL:
+      note_expr(scan, expr_at(scan, expr->as.conditional.condition));
+      note_expr(scan, expr_at(scan, expr->as.conditional.true_expr));
+      note_expr(scan, expr_at(scan, expr->as.conditional.false_expr));
+      break;
+    
+    case EXPR_CAST:
+      note_expr(scan, expr_at(scan, expr->as.cast.expr));
+      break;
+    
+    default:
+      break;
+  }
+}
+
+static void note_stmt(LoopScan* scan, Stmt* stmt) {
+  if (!stmt) return;
+  
+  switch (stmt->type) {
+    case STMT_EXPR:
+      note_expr(scan, expr_at(scan, stmt->as.expr.expr));
+      break;
+    
+    case STMT_BLOCK:
+      for (int i = 0; i < stmt->as.block.count; i++) {
+        note_stmt(scan, stmt_at(scan, stmt->as.block.statements[i]));
+      }
+      break;
+    
+    case STMT_IF:
+      note_expr(scan, expr_at(scan, stmt->as.if_stmt.condition));
+      note_stmt(scan, stmt_at(scan, stmt->as.if_stmt.then_branch));
+      note_stmt(scan, stmt_at(scan, stmt->as.if_stmt.else_branch));
+      break;
+    
+    case STMT_SWITCH:
+      note_expr(scan, expr_at(scan, stmt->as.switch_stmt.condition));
+      for (int i = 0; i < stmt->as.switch_stmt.case_count; i++) {
+        note_stmt(scan, stmt_at(scan, stmt->as.switch_stmt.cases[i]));
+      }
+      note_stmt(scan, stmt_at(scan, stmt->as.switch_stmt.default_case));
+      break;
+    
+    case STMT_WHILE:
+      note_expr(scan, expr_at(scan, stmt->as.while_stmt.condition));
+      note_stmt(scan, stmt_at(scan, stmt->as.while_stmt.body));
+      break;
+    
+    case STMT_DO_WHILE:
+      note_stmt(scan, stmt_at(scan, stmt->as.do_while_stmt.body));
+      note_expr(scan, expr_at(scan, stmt->as.do_while_stmt.condition));
+      break;
+    
+    case STMT_FOR:
+      note_stmt(scan, stmt_at(scan, stmt->as.for_stmt.init));
+      note_expr(scan, expr_at(scan, stmt->as.for_stmt.condition));
+      note_expr(scan, expr_at(scan, stmt->as.for_stmt.update));
+      note_stmt(scan, stmt_at(scan, stmt->as.for_stmt.body));
+      break;
+    
+    case STMT_LABEL:
+      note_stmt(scan, stmt_at(scan, stmt->as.label_stmt.statement));
+      break;
+    
+    case STMT_RETURN:
+      note_expr(scan, expr_at(scan, stmt->as.return_stmt.value));
+      break;
+    
+    case STMT_DECL: {
+      // A local declared in the loop starts over on every iteration
+      Decl* decl = stmt->as.decl_stmt.decl;
+      if (decl && decl->type == DECL_VAR) {
+        if (scan->record_writes) {
+          add_name(scan, &scan->written, decl->name);
+        }
+        note_expr(scan, expr_at(scan, decl->as.var.initializer));
+      }
+      break;
+    }
+    
+    default:
+      break;
+  }
+}
+
+static bool is_comparison(TokenType op) {
+  return op == TOKEN_EQUAL_EQUAL || op == TOKEN_EXCLAIM_EQUAL ||
+         op == TOKEN_LESS || op == TOKEN_LESS_EQUAL ||
+         op == TOKEN_GREATER || op == TOKEN_GREATER_EQUAL;
+}
+
+static bool is_constant(Expr* expr) {
+  return expr->type == EXPR_INTEGER_LITERAL || expr->type == EXPR_CHAR_LITERAL;
+}
+
+static long long constant_value(Expr* expr) {
+  return expr->type == EXPR_INTEGER_LITERAL ? expr->as.int_literal.value : expr->as.char_literal.value;
+}
+
+// Mirrors codegen_condition: whether it ends up comparing a value against zero
+static bool tests_zero(LoopScan* scan, Expr* expr) {
+  if (!expr) return false;
+  
+  if (expr->type == EXPR_BINARY) {
+    TokenType op = expr->as.binary.operator;
+    if (is_comparison(op)) return false;
+    if (op == TOKEN_AMPERSAND_AMPERSAND || op == TOKEN_PIPE_PIPE) {
+      return tests_zero(scan, expr_at(scan, expr->as.binary.left)) ||
+             tests_zero(scan, expr_at(scan, expr->as.binary.right));
+    }
+  }
+  if (expr->type == EXPR_UNARY && expr->as.unary.operator == TOKEN_EXCLAIM) {
+    return tests_zero(scan, expr_at(scan, expr->as.unary.operand));
+  }
+  return !is_constant(expr);
+}
+
+// A local the loop cannot change, directly or through a pointer
+static bool is_stable(LoopScan* scan, const char* name) {
+  return scan->resolve(scan->context, name) != LOOP_NAME_SHARED &&
+         name_count(scan->function_addresses, name) == 0 &&
+         name_count(&scan->written, name) == 0;
+}
+
+static bool is_invariant(LoopScan* scan, Expr* expr) {
+  switch (expr->type) {
+    case EXPR_INTEGER_LITERAL:
+    case EXPR_CHAR_LITERAL:
+      return true;
+    
+    case EXPR_IDENTIFIER:
+      return is_stable(scan, expr->as.identifier.name);
+    
+    case EXPR_BINARY:
+      // Division could trap in a loop that never runs, so it stays put
+      switch (expr->as.binary.operator) {
+        case TOKEN_PLUS:
+        case TOKEN_MINUS:
+        case TOKEN_STAR:
+        case TOKEN_AMPERSAND:
+        case TOKEN_PIPE:
+        case TOKEN_CARET:
+        case TOKEN_LESS_LESS:
+        case TOKEN_GREATER_GREATER:
+          return is_invariant(scan, expr_at(scan, expr->as.binary.left)) &&
+                 is_invariant(scan, expr_at(scan, expr->as.binary.right));
+        default:
+          return false;
+      }
+    
+    case EXPR_UNARY:
+      return (expr->as.unary.operator == TOKEN_MINUS || expr->as.unary.operator == TOKEN_TILDE) &&
+             is_invariant(scan, expr_at(scan, expr->as.unary.operand));
+    
+    default:
+      return false;
+  }
+}
+
+static Induction* find_induction(LoopScan* scan, Expr* expr) {
+  if (!expr || expr->type != EXPR_IDENTIFIER) return NULL;
+  
+  for (int i = 0; i < scan->induction_count; i++) {
+    if (scan->inductions[i].name == expr->as.identifier.name) return &scan->inductions[i];
+  }
+  return NULL;
+}
+
+// i++, ++i, i--, --i, i += k, i -= k, i = i + k, i = k + i or i = i - k
+static Expr* step_target(LoopScan* scan, Expr* expr, long long* amount) {
+  if (expr->type == EXPR_UNARY) {
+    TokenType op = expr->as.unary.operator;
+    if (op != TOKEN_PLUS_PLUS && op != TOKEN_MINUS_MINUS) return NULL;
+    *amount = op == TOKEN_PLUS_PLUS ? 1 : -1;
+    return expr_at(scan, expr->as.unary.operand);
+  }
+  if (expr->type != EXPR_ASSIGN) return NULL;
+  
+  Expr* target = expr_at(scan, expr->as.assign.target);
+  Expr* value = expr_at(scan, expr->as.assign.value);
+  TokenType op = expr->as.assign.operator;
+  if (target->type != EXPR_IDENTIFIER) return NULL;
+  
+  if ((op == TOKEN_PLUS_EQUAL || op == TOKEN_MINUS_EQUAL) && is_constant(value)) {
+    *amount = op == TOKEN_PLUS_EQUAL ? constant_value(value) : -constant_value(value);
+    return target;
+  }
+  if (op != TOKEN_EQUAL || value->type != EXPR_BINARY) return NULL;
+  
+  Expr* left = expr_at(scan, value->as.binary.left);
+  Expr* right = expr_at(scan, value->as.binary.right);
+  bool left_is_target = left->type == EXPR_IDENTIFIER && left->as.identifier.name == target->as.identifier.name;
+  bool right_is_target = right->type == EXPR_IDENTIFIER && right->as.identifier.name == target->as.identifier.name;
+  
+  if (value->as.binary.operator == TOKEN_PLUS) {
+    if (left_is_target && is_constant(right)) {
+      *amount = constant_value(right);
+      return target;
+    }
+    if (right_is_target && is_constant(left)) {
+      *amount = constant_value(left);
+      return target;
+    }
+  } else if (value->as.binary.operator == TOKEN_MINUS && left_is_target && is_constant(right)) {
+    *amount = -constant_value(right);
+    return target;
+  }
+  return NULL;
+}
+
+/*
+ * Only a step at the top level of the body runs exactly once per
+ * iteration, and it must be the variable's only write in the loop.
+ */
+static void find_inductions(LoopScan* scan, StmtRef body) {
+  Stmt* block = stmt_at(scan, body);
+  if (!block) return; // Folded away: an empty loop steps nothing
+  
+  StmtRef* statements = &body;
+  int count = 1;
+  if (block->type == STMT_BLOCK) {
+    statements = block->as.block.statements;
+    count = block->as.block.count;
+  }
+  
+  for (int i = 0; i < count; i++) {
+    Stmt* stmt = stmt_at(scan, statements[i]);
+    if (!stmt || stmt->type != STMT_EXPR || !stmt->as.expr.expr) continue;
+    
+    long long amount;
+    Expr* target = step_target(scan, expr_at(scan, stmt->as.expr.expr), &amount);
+    if (!target || target->type != EXPR_IDENTIFIER) continue;
+    
+    const char* name = target->as.identifier.name;
+    if (scan->resolve(scan->context, name) != LOOP_NAME_INTEGER ||
+        name_count(scan->function_addresses, name) != 0 ||
+        name_count(&scan->written, name) != 1) {
+      continue;
+    }
+    
+    if (scan->induction_count == scan->induction_capacity) {
+      scan->inductions = arena_grow_array(scan->arena, scan->inductions, &scan->induction_capacity,
+                                          sizeof(Induction));
+      if (!scan->inductions) {
+        scan->induction_count = scan->induction_capacity = 0;
+        return;
+      }
+    }
+    Induction* induction = &scan->inductions[scan->induction_count++];
+    induction->name = name;
+    induction->step = stmt;
+    induction->amount = amount;
+  }
+}
+
+// Whether two invariant or product expressions always have the same value
+static bool same_value(LoopScan* scan, Expr* a, Expr* b) {
+  if (a->type != b->type) return false;
+  
+  switch (a->type) {
+    case EXPR_INTEGER_LITERAL:
+      return a->as.int_literal.value == b->as.int_literal.value;
+    case EXPR_CHAR_LITERAL:
+      return a->as.char_literal.value == b->as.char_literal.value;
+    case EXPR_IDENTIFIER:
+      return a->as.identifier.name == b->as.identifier.name;
+    case EXPR_BINARY:
+      return a->as.binary.operator == b->as.binary.operator &&
+             same_value(scan, expr_at(scan, a->as.binary.left), expr_at(scan, b->as.binary.left)) &&
+             same_value(scan, expr_at(scan, a->as.binary.right), expr_at(scan, b->as.binary.right));
+    case EXPR_UNARY:
+      return a->as.unary.operator == b->as.unary.operator &&
+             same_value(scan, expr_at(scan, a->as.unary.operand), expr_at(scan, b->as.unary.operand));
+    default:
+      return false;
+  }
+}
+
+static bool has_room(LoopScan* scan) {
+  return scan->plan->invariant_count + scan->plan->reduction_count < LOOP_MAX_VALUES;
+}
+
+// i * k or k * i, with i an induction variable and k a constant
+static bool record_reduction(LoopScan* scan, Expr* expr) {
+  if (expr->type != EXPR_BINARY || expr->as.binary.operator != TOKEN_STAR || !has_room(scan)) {
+    return false;
+  }
+  
+  Expr* left = expr_at(scan, expr->as.binary.left);
+  Expr* right = expr_at(scan, expr->as.binary.right);
+  Induction* induction = find_induction(scan, left);
+  Expr* factor = right;
+  if (!induction) {
+    induction = find_induction(scan, right);
+    factor = left;
+  }
+  if (!induction || !is_constant(factor)) return false;
+  
+  int index = scan->plan->reduction_count++;
+  LoopReduction* reduction = &scan->plan->reductions[index];
+  reduction->product = expr;
+  reduction->step = induction->step;
+  reduction->delta = induction->amount * constant_value(factor);
+  reduction->first = index;
+  for (int i = 0; i < index; i++) {
+    if (same_value(scan, scan->plan->reductions[i].product, expr)) {
+      reduction->first = i;
+      break;
+    }
+  }
+  return true;
+}
+
+// Bare locals are left alone: a VARGET is as cheap as keeping them in a temporary
+static bool record_invariant(LoopScan* scan, Expr* expr) {
+  if (expr->type == EXPR_IDENTIFIER || !has_room(scan) || !is_invariant(scan, expr)) return false;
+  
+  int index = scan->plan->invariant_count++;
+  scan->plan->invariants[index] = expr;
+  scan->plan->invariant_firsts[index] = index;
+  for (int i = 0; i < index; i++) {
+    if (same_value(scan, scan->plan->invariants[i], expr)) {
+      scan->plan->invariant_firsts[index] = i;
+      break;
+    }
+  }
+  return true;
+}
+
+static void find_values(LoopScan* scan, Expr* expr);
+
+// Operands of a condition, which codegen_condition branches on rather than computing
+static void find_condition(LoopScan* scan, Expr* expr) {
+  if (!expr) return;
+  
+  if (expr->type == EXPR_BINARY) {
+    TokenType op = expr->as.binary.operator;
+    if (is_comparison(op)) {
+      find_values(scan, expr_at(scan, expr->as.binary.left));
+      find_values(scan, expr_at(scan, expr->as.binary.right));
+      return;
+    }
+    if (op == TOKEN_AMPERSAND_AMPERSAND || op == TOKEN_PIPE_PIPE) {
+      find_condition(scan, expr_at(scan, expr->as.binary.left));
+      find_condition(scan, expr_at(scan, expr->as.binary.right));
+      return;
+    }
+  }
+  if (expr->type == EXPR_UNARY && expr->as.unary.operator == TOKEN_EXCLAIM) {
+    find_condition(scan, expr_at(scan, expr->as.unary.operand));
+    return;
+  }
+  if (is_constant(expr)) return;
+  
+  find_values(scan, expr);
+}
+
+static void find_values(LoopScan* scan, Expr* expr) {
+  if (!expr || record_reduction(scan, expr) || record_invariant(scan, expr)) return;
+  
+  switch (expr->type) {
+    case EXPR_BINARY:
+      if (expr->as.binary.operator == TOKEN_AMPERSAND_AMPERSAND ||
+          expr->as.binary.operator == TOKEN_PIPE_PIPE) {
+        scan->plan->compares_zero |= tests_zero(scan, expr);
+        find_condition(scan, expr);
+        break;
+      }
+      find_values(scan, expr_at(scan, expr->as.binary.left));
+      find_values(scan, expr_at(scan, expr->as.binary.right));
+      break;
+    
+    case EXPR_UNARY: {
+      // The operand of ++, -- and & is a place, not a value
+      TokenType op = expr->as.unary.operator;
+      if (op != TOKEN_PLUS_PLUS && op != TOKEN_MINUS_MINUS && op != TOKEN_AMPERSAND) {
+        find_values(scan, expr_at(scan, expr->as.unary.operand));
+      }
+      break;
+    }
+    
+    case EXPR_CALL:
+      for (int i = 0; i < expr->as.call.arg_count; i++) {
+        find_values(scan, expr_at(scan, expr->as.call.arguments[i]));
+      }
+      break;
+    
+    case EXPR_ASSIGN: {
+      Expr* target = expr_at(scan, expr->as.assign.target);
+      find_values(scan, expr_at(scan, expr->as.assign.value));
+      if (target->type == EXPR_UNARY && target->as.unary.operator == TOKEN_STAR) {
+        find_values(scan, expr_at(scan, target->as.unary.operand));
+      } else if (target->type == EXPR_INDEX) {
+        find_values(scan, expr_at(scan, target->as.index.array));
+        find_values(scan, expr_at(scan, target->as.index.index));
+      }
+      break;
+    }
+    
+    default:
+      break;
+  }
+}
+
+static void find_statement_values(LoopScan* scan, Stmt* stmt) {
+  if (!stmt) return;
+  
+  switch (stmt->type) {
+    case STMT_EXPR:
+      find_values(scan, expr_at(scan, stmt->as.expr.expr));
+      break;
+    
+    case STMT_BLOCK:
+      for (int i = 0; i < stmt->as.block.count; i++) {
+        find_statement_values(scan, stmt_at(scan, stmt->as.block.statements[i]));
+      }
+      break;
+    
+    case STMT_IF:
+      scan->plan->compares_zero |= tests_zero(scan, expr_at(scan, stmt->as.if_stmt.condition));
+      find_condition(scan, expr_at(scan, stmt->as.if_stmt.condition));
+      find_statement_values(scan, stmt_at(scan, stmt->as.if_stmt.then_branch));
+      find_statement_values(scan, stmt_at(scan, stmt->as.if_stmt.else_branch));
+      break;
+    
+    case STMT_WHILE:
+      scan->plan->compares_zero |= tests_zero(scan, expr_at(scan, stmt->as.while_stmt.condition));
+      find_condition(scan, expr_at(scan, stmt->as.while_stmt.condition));
+      find_statement_values(scan, stmt_at(scan, stmt->as.while_stmt.body));
+      break;
+    
+    case STMT_RETURN:
+      find_values(scan, expr_at(scan, stmt->as.return_stmt.value));
+      break;
+    
+    case STMT_DECL: {
+      Decl* decl = stmt->as.decl_stmt.decl;
+      if (decl && decl->type == DECL_VAR && !decl->is_static && !decl->is_extern) {
+        find_values(scan, expr_at(scan, decl->as.var.initializer));
+      }
+      break;
+    }
+    
+    default:
+      break;
+  }
+}
+
+void loop_address_taken(const Program* program, Stmt* function_body, struct Arena* arena,
+                        LoopNames* names) {
+  LoopScan scan = {0};
+  scan.program = program;
+  scan.arena = arena;
+  scan.record_writes = false;
+  note_stmt(&scan, function_body);
+  *names = scan.address_taken;
+}
+
+void loop_plan(const Program* program, Stmt* loop, const LoopNames* address_taken,
+               LoopNameFn resolve, void* context, struct Arena* arena, LoopPlan* plan) {
+  plan->invariants = arena_alloc(arena, sizeof(Expr*) * LOOP_MAX_VALUES);
+  plan->invariant_firsts = arena_alloc(arena, sizeof(int) * LOOP_MAX_VALUES);
+  plan->reductions = arena_alloc(arena, sizeof(LoopReduction) * LOOP_MAX_VALUES);
+  plan->invariant_count = 0;
+  plan->reduction_count = 0;
+  plan->compares_zero = false;
+  if (!plan->invariants || !plan->invariant_firsts || !plan->reductions) return;
+  
+  LoopScan scan = {0};
+  scan.program = program;
+  scan.resolve = resolve;
+  scan.context = context;
+  scan.arena = arena;
+  scan.plan = plan;
+  scan.function_addresses = address_taken;
+  scan.record_writes = true;
+  note_stmt(&scan, loop);
+  
+  // The body may be NULL once folding has removed it; only the condition is left then
+  // The body may be AST_NONE once folding has removed it; only the condition is left then
+  find_inductions(&scan, loop->as.while_stmt.body);
+  find_statement_values(&scan, loop);
+}
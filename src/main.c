@@ -4,19 +4,29 @@
  */
 
 #include "../include/colc.h"
+#include "../include/driver.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 static void print_usage() {
-  printf("Usage: colc [options] input_file\n");
+  printf("Usage: colc [options] input_file...\n");
   printf("Options:\n");
   printf("  -o <file>   Set output file (default: output.cof)\n");
   printf("  -O<level>   Set optimization level (0-3, default: 1)\n");
+  printf("  -j <n>      Compile on n threads (input files, or the functions of one file)\n");
   printf("  -v          Enable verbose output\n");
   printf("  -ast        Print AST\n");
   printf("  -tokens     Print tokens\n");
   printf("  -g          Generate debug information\n");
+  printf("  -varint     Encode operands as LEB128 for smaller output\n");
+  printf("  -stats      Report time and memory per phase on stderr (also -time-report)\n");
+  printf("  -stats-json Report the same statistics as JSON\n");
+  printf("  -cache-dir <dir> Reuse the code of unchanged functions cached in dir\n");
+  printf("  -stream     Compile and write out each declaration as soon as it is parsed\n");
+  printf("              (functions stay in source order, even with -fprofile-use)\n");
+  printf("  -fprofile-generate Count function entries and branches at run time\n");
+  printf("  -fprofile-use=<file> Optimize for the counts an instrumented run dumped to file\n");
   printf("  -h, --help  Show this help message\n");
   printf("  --version   Show version information\n");
 }
@@ -28,11 +38,28 @@ int main(int argc, char* argv[]) {
   }
   
   CompilerOptions options = compiler_default_options();
+  bool output_given = false;
+  
+  // Input files point into argv
+  const char** input_files = malloc(sizeof(char*) * argc);
+  int input_count = 0;
+  if (!input_files) {
+    printf("Out of memory\n");
+    return 1;
+  }
   
   // Parse command line arguments
   for (int i = 1; i < argc; i++) {
     if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
       options.output_file = argv[++i];
+      output_given = true;
+    } else if (strncmp(argv[i], "-j", 2) == 0) {
+      const char* count = argv[i][2] ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "");
+      options.jobs = atoi(count);
+      if (options.jobs < 1) {
+        printf("Invalid job count: %s\n", count);
+        return 1;
+      }
     } else if (strncmp(argv[i], "-O", 2) == 0) {
       options.optimization_level = atoi(argv[i] + 2);
       if (options.optimization_level < 0 || options.optimization_level > 3) {
@@ -47,6 +74,21 @@ int main(int argc, char* argv[]) {
       options.print_tokens = true;
     } else if (strcmp(argv[i], "-g") == 0) {
       options.emit_debug_info = true;
+    } else if (strcmp(argv[i], "-varint") == 0) {
+      options.compact_operands = true;
+    } else if (strcmp(argv[i], "-stats") == 0 || strcmp(argv[i], "-time-report") == 0) {
+      options.print_stats = true;
+    } else if (strcmp(argv[i], "-stats-json") == 0) {
+      options.print_stats = true;
+      options.stats_json = true;
+    } else if (strcmp(argv[i], "-cache-dir") == 0 && i + 1 < argc) {
+      options.cache_dir = argv[++i];
+    } else if (strcmp(argv[i], "-stream") == 0) {
+      options.stream = true;
+    } else if (strcmp(argv[i], "-fprofile-generate") == 0) {
+      options.profile_generate = true;
+    } else if (strncmp(argv[i], "-fprofile-use=", 14) == 0 && argv[i][14]) {
+      options.profile_use = argv[i] + 14;
     } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
       print_usage();
       return 0;
@@ -58,17 +100,37 @@ int main(int argc, char* argv[]) {
       print_usage();
       return 1;
     } else {
-      options.input_file = argv[i];
+      input_files[input_count++] = argv[i];
     }
   }
   
+  if (options.profile_generate && options.profile_use) {
+    printf("Cannot use -fprofile-generate with -fprofile-use\n");
+    return 1;
+  }
+  
   // Check if input file is specified
-  if (!options.input_file) {
+  if (input_count == 0) {
     printf("No input file specified\n");
     print_usage();
     return 1;
   }
   
+  // Several translation units: each gets its own output next to the input
+  if (input_count > 1) {
+    if (output_given) {
+      printf("Cannot use -o with multiple input files\n");
+      return 1;
+    }
+    
+    bool all_succeeded = driver_compile_files(options, input_files, input_count);
+    free(input_files);
+    return all_succeeded ? 0 : 1;
+  }
+  
+  options.input_file = input_files[0];
+  free(input_files);
+  
   // Compile file
   bool success = compiler_compile_file(options);
   
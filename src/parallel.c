@@ -0,0 +1,179 @@
+/**
+ * @file parallel.c
+ * @brief Code generation of function bodies on worker threads
+ */
+
+#define _POSIX_C_SOURCE 200809L // pthreads
+
+#include "../include/parallel.h"
+#include "../include/peephole.h"
+#include "../include/arena.h"
+#include <pthread.h>
+#include <string.h>
+
+#define PARALLEL_ARENA_SIZE (1024 * 1024) // 1MB
+#define PARALLEL_MIN_FUNCTIONS 2          // Fewer are not worth a thread
+
+/**
+ * @brief Function definitions to generate, shared by all workers
+ */
+typedef struct {
+  CodeGenerator* gen;
+  CachedFunction** fragments; // Per declaration, filled by whichever worker generated it
+  int* tasks;                 // Declaration indexes, in order
+  int task_count;
+  int next_task;              // Protected by lock
+  pthread_mutex_t lock;
+} ParallelQueue;
+
+/**
+ * @brief One worker thread
+ */
+typedef struct {
+  ParallelQueue* queue;
+  struct Arena* arena;              // Holds its generator and the fragments it captures
+  int hits[PEEPHOLE_PATTERN_COUNT]; // Peephole rewrites in the captured functions
+} ParallelWorker;
+
+static void parallel_destroy_arena(void* data) {
+  arena_destroy(data);
+}
+
+static int parallel_take_task(ParallelQueue* queue) {
+  int task = -1;
+  
+  pthread_mutex_lock(&queue->lock);
+  if (queue->next_task < queue->task_count) {
+    task = queue->tasks[queue->next_task++];
+  }
+  pthread_mutex_unlock(&queue->lock);
+  
+  return task;
+}
+
+/*
+ * A generator of the worker's own. Declaring the globals again gives them
+ * the same indexes as in gen, so its symbol table is a private copy of the
+ * global scope; nothing is shared with other threads except the program,
+ * which codegen only reads.
+ */
+static CodeGenerator* parallel_create_generator(CodeGenerator* gen, Arena* arena) {
+  SymbolTable* symbols = symbol_table_create(arena);
+  if (!symbols) return NULL;
+  
+  CodeGenerator* worker = codegen_create_with_symbols(gen->program, NULL, symbols, arena);
+  if (!worker || !worker->buffer) return NULL;
+  
+  worker->optimization_level = gen->optimization_level;
+  worker->emit_debug_info = gen->emit_debug_info;
+  worker->compact_operands = gen->compact_operands;
+  worker->profile = gen->profile; // Read only: gen has made every counter name already
+  codegen_declare_globals(worker);
+  
+  // The recorder is what makes functions capturable, even below -O2
+  worker->peephole = peephole_create(arena);
+  worker->peephole->optimize = gen->optimization_level >= 2;
+  worker->cache_key = 1; // Capture every function
+  return worker;
+}
+
+static void* parallel_worker(void* data) {
+  ParallelWorker* self = data;
+  ParallelQueue* queue = self->queue;
+  CodeGenerator* gen = parallel_create_generator(queue->gen, self->arena);
+  if (!gen) return NULL; // The other workers, or the serial path, take its share
+  
+  int task;
+  while ((task = parallel_take_task(queue)) >= 0) {
+    // Fragments are position independent, so each function starts from an empty buffer
+    gen->buffer->size = 0;
+    gen->debug_count = 0;
+    int scope = gen->symbols->current_scope;
+    int hits[PEEPHOLE_PATTERN_COUNT];
+    memcpy(hits, gen->peephole->hits, sizeof(hits));
+    
+    codegen_declaration(gen, gen->program->declarations[task]);
+    
+    if (gen->captured) {
+      queue->fragments[task] = gen->captured;
+      for (int i = 0; i < PEEPHOLE_PATTERN_COUNT; i++) {
+        self->hits[i] += gen->peephole->hits[i] - hits[i];
+      }
+    }
+    
+    // A function that failed is generated again serially, which reports the
+    // error in order; the generator itself stays usable unless it ran out of
+    // memory or lost track of its scopes
+    if (gen->buffer->has_error || gen->symbols->current_scope != scope) break;
+    gen->has_error = false;
+    gen->error_message = NULL;
+  }
+  
+  return NULL;
+}
+
+CachedFunction** parallel_generate_functions(CodeGenerator* gen) {
+  Program* program = gen->program;
+  ParallelQueue queue;
+  queue.gen = gen;
+  queue.fragments = arena_calloc(gen->arena, sizeof(CachedFunction*) * (program->count + 1));
+  queue.tasks = arena_alloc(gen->arena, sizeof(int) * (program->count + 1));
+  queue.task_count = 0;
+  queue.next_task = 0;
+  if (!queue.fragments || !queue.tasks) return NULL;
+  
+  // Function definitions the function cache does not already have
+  for (int i = 0; i < program->count; i++) {
+    Decl* decl = program->declarations[i];
+    if (!decl || decl->type != DECL_FUNC || !decl->as.func.body) continue;
+    
+    uint64_t key = gen->cache && gen->cache_keys ? gen->cache_keys[i] : 0;
+    if (key && fcache_lookup(gen->cache, key)) continue;
+    queue.tasks[queue.task_count++] = i;
+  }
+  if (queue.task_count < PARALLEL_MIN_FUNCTIONS) return NULL;
+  
+  int worker_count = gen->jobs < queue.task_count ? gen->jobs : queue.task_count;
+  ParallelWorker* workers = arena_calloc(gen->arena, sizeof(ParallelWorker) * worker_count);
+  pthread_t* threads = arena_alloc(gen->arena, sizeof(pthread_t) * worker_count);
+  if (!workers || !threads) return NULL;
+  
+  // Worker arenas live as long as gen's, since the fragments stay in them
+  for (int i = 0; i < worker_count; i++) {
+    workers[i].queue = &queue;
+    workers[i].arena = arena_create(PARALLEL_ARENA_SIZE);
+    if (workers[i].arena) {
+      arena_add_cleanup(gen->arena, parallel_destroy_arena, workers[i].arena);
+    }
+  }
+  pthread_mutex_init(&queue.lock, NULL);
+  
+  // The calling thread is the first worker
+  int started = 0;
+  for (int i = 1; i < worker_count; i++) {
+    if (!workers[i].arena) continue;
+    if (pthread_create(&threads[started], NULL, parallel_worker, &workers[i]) != 0) {
+      break; // Fewer workers is still correct
+    }
+    started++;
+  }
+  
+  if (workers[0].arena) {
+    parallel_worker(&workers[0]);
+  }
+  
+  for (int i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  pthread_mutex_destroy(&queue.lock);
+  
+  if (gen->peephole) {
+    for (int i = 0; i < worker_count; i++) {
+      for (int k = 0; k < PEEPHOLE_PATTERN_COUNT; k++) {
+        gen->peephole->hits[k] += workers[i].hits[k];
+      }
+    }
+  }
+  
+  return queue.fragments;
+}
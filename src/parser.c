@@ -5,12 +5,13 @@
 
 #include "../include/parser.h"
 #include "../include/arena.h"
+#include "../include/intern.h"
 #include <string.h>
 #include <stdlib.h>
 
 // Forward declarations for recursive parsing
-static Expr* parse_expression(Parser* parser);
-static Stmt* parse_statement(Parser* parser);
+static ExprRef parse_expression(Parser* parser);
+static StmtRef parse_statement(Parser* parser);
 static Decl* parse_declaration(Parser* parser);
 static Type* parse_type(Parser* parser);
 
@@ -21,39 +22,64 @@ static void parser_error_at(Parser* parser, Token token, const char* message) {
   parser->has_error = true;
   
   // Format error message with location
+  ResolvedLocation location = lexer_resolve_location(parser->lexer, token.location);
   char buffer[256];
   snprintf(buffer, sizeof(buffer), "Error at %s:%d:%d: %s",
-           token.location.file, token.location.line, token.location.column, message);
+           location.file, location.line, location.column, message);
   
   parser->error_message = arena_strdup(parser->arena, buffer);
 }
 
 static void parser_error_current(Parser* parser, const char* message) {
-  parser_error_at(parser, lexer_peek_token(parser->lexer), message);
+  parser_error_at(parser, parser->current, message);
 }
 
 static void parser_error_previous(Parser* parser, const char* message) {
-  Token previous = lexer_peek_token(parser->lexer); // This isn't actually the previous token, but will do for now
-  parser_error_at(parser, previous, message);
+  parser_error_at(parser, parser->previous, message);
 }
 
 // Helper functions for parsing
-static bool match(Parser* parser, TokenType type) {
-  if (lexer_check(parser->lexer, type)) {
-    lexer_next_token(parser->lexer);
-    return true;
+static inline Token peek(Parser* parser) {
+  return parser->current;
+}
+
+// Type of the token `distance` places after the current one
+static inline TokenType peek_ahead(Parser* parser, int distance) {
+  if (parser->tokens) {
+    int index = parser->position + distance;
+    if (index >= parser->tokens->count) {
+      index = parser->tokens->count - 1;
+    }
+    return (TokenType)parser->tokens->types[index];
   }
-  return false;
+  return lexer_peek_ahead(parser->lexer, distance).type;
 }
 
-static bool check(Parser* parser, TokenType type) {
-  return lexer_check(parser->lexer, type);
+static inline bool check(Parser* parser, TokenType type) {
+  return parser->current.type == type;
 }
 
 static Token advance(Parser* parser) {
-  Token current = lexer_peek_token(parser->lexer);
-  lexer_next_token(parser->lexer);
-  return current;
+  parser->previous = parser->current;
+  
+  if (parser->tokens) {
+    if (parser->position < parser->tokens->count - 1) {
+      parser->position++;
+    }
+    parser->current = token_array_get(parser->tokens, parser->position);
+  } else {
+    parser->current = lexer_next_token(parser->lexer);
+  }
+  
+  return parser->previous;
+}
+
+static bool match(Parser* parser, TokenType type) {
+  if (check(parser, type)) {
+    advance(parser);
+    return true;
+  }
+  return false;
 }
 
 static Token consume(Parser* parser, TokenType type, const char* message) {
@@ -62,19 +88,57 @@ static Token consume(Parser* parser, TokenType type, const char* message) {
   }
   
   parser_error_current(parser, message);
-  return lexer_peek_token(parser->lexer);
+  return parser->current;
+}
+
+// Interned name of an identifier token (NULL if consume() failed)
+static const char* token_name(Token token) {
+  return token.type == TOKEN_IDENTIFIER ? token.value.identifier : NULL;
+}
+
+/*
+ * Lists whose final length is unknown (block statements, parameters) are
+ * grown with arena_grow_array in the scratch arena between an arena_mark
+ * and an arena_rewind, and only the finished list is copied into the AST
+ * arena.
+ */
+static void* list_finish(Parser* parser, const void* items, int count, size_t item_size) {
+  if (count == 0) return NULL;
+  
+  void* list = arena_alloc(parser->arena, item_size * count);
+  memcpy(list, items, item_size * count);
+  return list;
+}
+
+// Nodes go into the program's pools; the pointers stay valid as pools grow.
+// Pool chunks outlive a released body, which only rewinds the pool counts.
+static inline ExprRef new_expr(Parser* parser, ExprType type, SourceLocation location) {
+  return ast_create_expr(parser->program, type, location, parser->table_arena);
+}
+
+static inline StmtRef new_stmt(Parser* parser, StmtType type, SourceLocation location) {
+  return ast_create_stmt(parser->program, type, location, parser->table_arena);
+}
+
+static inline Expr* expr_at(Parser* parser, ExprRef ref) {
+  return ast_expr(parser->program, ref);
 }
 
-// Symbol table for typedefs
+static inline Stmt* stmt_at(Parser* parser, StmtRef ref) {
+  return ast_stmt(parser->program, ref);
+}
+
+// Symbol table for typedefs (keyed by interned names)
 typedef struct TypedefEntry {
-  char* name;
+  const char* name;
+  Type* type; // The aliased type
   struct TypedefEntry* next;
 } TypedefEntry;
 
-typedef struct {
+typedef struct TypedefTable {
   TypedefEntry** entries;
   int size;
-  int capacity;
+  int capacity; // Always a power of two
   struct Arena* arena;
 } TypedefTable;
 
@@ -87,16 +151,12 @@ static TypedefTable* typedef_table_create(struct Arena* arena) {
   return table;
 }
 
-static void typedef_table_add(TypedefTable* table, const char* name) {
-  unsigned hash = 0;
-  for (const char* p = name; *p; p++) {
-    hash = hash * 31 + *p;
-  }
-  
-  unsigned index = hash % table->capacity;
+static void typedef_table_add(TypedefTable* table, const char* name, Type* type) {
+  unsigned index = intern_hash(name) & (table->capacity - 1);
   
   TypedefEntry* entry = arena_alloc(table->arena, sizeof(TypedefEntry));
-  entry->name = arena_strdup(table->arena, name);
+  entry->name = name;
+  entry->type = type;
   entry->next = table->entries[index];
   table->entries[index] = entry;
   table->size++;
@@ -108,23 +168,16 @@ static void typedef_table_add(TypedefTable* table, const char* name) {
     
     table->capacity *= 2;
     table->entries = arena_calloc(table->arena, sizeof(TypedefEntry*) * table->capacity);
-    table->size = 0;
     
     for (int i = 0; i < old_capacity; i++) {
       TypedefEntry* entry = old_entries[i];
       while (entry) {
         TypedefEntry* next = entry->next;
         
-        // Rehash and insert
-        unsigned new_hash = 0;
-        for (const char* p = entry->name; *p; p++) {
-          new_hash = new_hash * 31 + *p;
-        }
-        
-        unsigned new_index = new_hash % table->capacity;
+        // The hash is cached in the interned string, no rescan needed
+        unsigned new_index = intern_hash(entry->name) & (table->capacity - 1);
         entry->next = table->entries[new_index];
         table->entries[new_index] = entry;
-        table->size++;
         
         entry = next;
       }
@@ -132,436 +185,488 @@ static void typedef_table_add(TypedefTable* table, const char* name) {
   }
 }
 
-static bool typedef_table_contains(TypedefTable* table, const char* name) {
-  unsigned hash = 0;
-  for (const char* p = name; *p; p++) {
-    hash = hash * 31 + *p;
-  }
-  
-  unsigned index = hash % table->capacity;
+// Returns the aliased type, or NULL if the name is not a typedef
+static Type* typedef_table_lookup(TypedefTable* table, const char* name) {
+  unsigned index = intern_hash(name) & (table->capacity - 1);
   
   TypedefEntry* entry = table->entries[index];
   while (entry) {
-    if (strcmp(entry->name, name) == 0) {
-      return true;
+    if (entry->name == name) {
+      return entry->type;
     }
     entry = entry->next;
   }
   
-  return false;
+  return NULL;
 }
 
-// Parsing functions
-static Expr* parse_primary_expression(Parser* parser) {
-  Token token = lexer_peek_token(parser->lexer);
-  
-  // Integer literal
-  if (check(parser, TOKEN_INTEGER_LITERAL)) {
-    advance(parser);
-    
-    Expr* expr = ast_create_expr(EXPR_INTEGER_LITERAL, token.location, parser->arena);
-    expr->as.int_literal.value = token.value.int_value;
-    return expr;
-  }
-  
-  // Float literal
-  if (check(parser, TOKEN_FLOAT_LITERAL)) {
-    advance(parser);
-    
-    Expr* expr = ast_create_expr(EXPR_FLOAT_LITERAL, token.location, parser->arena);
-    expr->as.float_literal.value = token.value.float_value;
-    return expr;
-  }
-  
-  // String literal
-  if (check(parser, TOKEN_STRING_LITERAL)) {
-    advance(parser);
-    
-    Expr* expr = ast_create_expr(EXPR_STRING_LITERAL, token.location, parser->arena);
-    expr->as.string_literal.value = token.value.string_value;
-    return expr;
-  }
-  
-  // Character literal
-  if (check(parser, TOKEN_CHAR_LITERAL)) {
-    advance(parser);
-    
-    Expr* expr = ast_create_expr(EXPR_CHAR_LITERAL, token.location, parser->arena);
-    expr->as.char_literal.value = token.value.char_value;
-    return expr;
+/*
+ * Expressions are parsed by one precedence-climbing loop instead of a
+ * recursive function per precedence level. Operands and pending operators
+ * live on explicit stacks owned by the parser, so each operand costs a
+ * single call to parse_primary_expression and nesting (parentheses, calls,
+ * indexing, conditionals, assignment chains) is bounded by memory rather
+ * than by the C stack.
+ */
+
+// Binding strength of binary operators, loosest first
+typedef enum {
+  PREC_NONE,           // Not a binary operator
+  PREC_ASSIGNMENT,     // = += -= ... (right associative)
+  PREC_CONDITIONAL,    // ?: (right associative)
+  PREC_LOGICAL_OR,
+  PREC_LOGICAL_AND,
+  PREC_BITWISE_OR,
+  PREC_BITWISE_XOR,
+  PREC_BITWISE_AND,
+  PREC_EQUALITY,
+  PREC_RELATIONAL,
+  PREC_SHIFT,
+  PREC_ADDITIVE,
+  PREC_MULTIPLICATIVE,
+  PREC_UNARY           // Prefix operators bind tighter than any binary operator
+} Precedence;
+
+static const unsigned char binary_precedence[TOKEN_WHILE + 1] = {
+  [TOKEN_EQUAL] = PREC_ASSIGNMENT,
+  [TOKEN_PLUS_EQUAL] = PREC_ASSIGNMENT,
+  [TOKEN_MINUS_EQUAL] = PREC_ASSIGNMENT,
+  [TOKEN_STAR_EQUAL] = PREC_ASSIGNMENT,
+  [TOKEN_SLASH_EQUAL] = PREC_ASSIGNMENT,
+  [TOKEN_PERCENT_EQUAL] = PREC_ASSIGNMENT,
+  [TOKEN_AMPERSAND_EQUAL] = PREC_ASSIGNMENT,
+  [TOKEN_PIPE_EQUAL] = PREC_ASSIGNMENT,
+  [TOKEN_CARET_EQUAL] = PREC_ASSIGNMENT,
+  [TOKEN_LESS_LESS_EQUAL] = PREC_ASSIGNMENT,
+  [TOKEN_GREATER_GREATER_EQUAL] = PREC_ASSIGNMENT,
+  [TOKEN_QUESTION] = PREC_CONDITIONAL,
+  [TOKEN_PIPE_PIPE] = PREC_LOGICAL_OR,
+  [TOKEN_AMPERSAND_AMPERSAND] = PREC_LOGICAL_AND,
+  [TOKEN_PIPE] = PREC_BITWISE_OR,
+  [TOKEN_CARET] = PREC_BITWISE_XOR,
+  [TOKEN_AMPERSAND] = PREC_BITWISE_AND,
+  [TOKEN_EQUAL_EQUAL] = PREC_EQUALITY,
+  [TOKEN_EXCLAIM_EQUAL] = PREC_EQUALITY,
+  [TOKEN_LESS] = PREC_RELATIONAL,
+  [TOKEN_LESS_EQUAL] = PREC_RELATIONAL,
+  [TOKEN_GREATER] = PREC_RELATIONAL,
+  [TOKEN_GREATER_EQUAL] = PREC_RELATIONAL,
+  [TOKEN_LESS_LESS] = PREC_SHIFT,
+  [TOKEN_GREATER_GREATER] = PREC_SHIFT,
+  [TOKEN_PLUS] = PREC_ADDITIVE,
+  [TOKEN_MINUS] = PREC_ADDITIVE,
+  [TOKEN_STAR] = PREC_MULTIPLICATIVE,
+  [TOKEN_SLASH] = PREC_MULTIPLICATIVE,
+  [TOKEN_PERCENT] = PREC_MULTIPLICATIVE,
+};
+
+// What an entry on the operator stack is waiting for
+typedef enum {
+  FRAME_BINARY,   // Right operand of a binary or assignment operator
+  FRAME_PREFIX,   // Operand of a prefix operator
+  FRAME_COLON,    // False branch of a conditional; condition and true branch are stacked
+  
+  // Brackets: never reduced by an operator, only closed by their token
+  FRAME_GROUP,    // ')' of a parenthesized expression
+  FRAME_INDEX,    // ']' of an array index; the array is stacked
+  FRAME_CALL,     // ')' of a call; the function and finished arguments are stacked
+  FRAME_QUESTION  // ':' of a conditional; the condition is stacked
+} FrameKind;
+
+typedef struct {
+  unsigned char kind;       // FrameKind
+  unsigned char precedence; // PREC_NONE for brackets
+  TokenType operator;
+  SourceLocation location;
+  int operand_base;         // FRAME_CALL: operand stack index of the function
+} OperatorFrame;
+
+typedef struct ExprStack {
+  ExprRef* operands;
+  int* depths;     // Height of the tree of each operand, which later phases walk recursively
+  int operand_count;
+  int operand_capacity;
+  OperatorFrame* frames;
+  int frame_count;
+  int frame_capacity;
+} ExprStack;
+
+static void push_operand(Parser* parser, ExprRef expr) {
+  ExprStack* stack = parser->expr_stack;
+  if (stack->operand_count == stack->operand_capacity) {
+    int depth_capacity = stack->operand_capacity;
+    stack->operands = arena_grow_array(parser->table_arena, stack->operands,
+                                       &stack->operand_capacity, sizeof(ExprRef));
+    stack->depths = arena_grow_array(parser->table_arena, stack->depths,
+                                     &depth_capacity, sizeof(int));
   }
-  
-  // Identifier
-  if (check(parser, TOKEN_IDENTIFIER)) {
-    advance(parser);
-    
-    Expr* expr = ast_create_expr(EXPR_IDENTIFIER, token.location, parser->arena);
-    expr->as.identifier.name = arena_strdup(parser->arena, token.lexeme); // Careful, this might need length
-    return expr;
+  stack->depths[stack->operand_count] = 1;
+  stack->operands[stack->operand_count++] = expr;
+}
+
+/*
+ * Replace the operands from index first up to the top with expr, one level
+ * above the deepest of them. Folding, code generation and the statistics
+ * walk recurse over expressions, so a tree deeper than EXPR_MAX_DEPTH is
+ * rejected here rather than overflowing the stack of a later phase.
+ */
+static void replace_operands(Parser* parser, int first, ExprRef expr, SourceLocation location) {
+  ExprStack* stack = parser->expr_stack;
+  int depth = 0;
+  for (int i = first; i < stack->operand_count; i++) {
+    if (stack->depths[i] > depth) depth = stack->depths[i];
   }
   
-  // Parenthesized expression
-  if (match(parser, TOKEN_LEFT_PAREN)) {
-    Expr* expr = parse_expression(parser);
-    consume(parser, TOKEN_RIGHT_PAREN, "Expect ')' after expression");
-    return expr;
+  if (++depth > EXPR_MAX_DEPTH) {
+    Token token = parser->current;
+    token.location = location;
+    parser_error_at(parser, token, "Expression nested too deeply");
   }
   
-  parser_error_current(parser, "Expect expression");
-  return NULL;
+  stack->operand_count = first + 1;
+  stack->operands[first] = expr;
+  stack->depths[first] = depth;
 }
 
-static Expr* parse_unary_expression(Parser* parser) {
-  // Check for unary operators
-  if (match(parser, TOKEN_MINUS) || match(parser, TOKEN_PLUS) ||
-      match(parser, TOKEN_TILDE) || match(parser, TOKEN_EXCLAIM) ||
-      match(parser, TOKEN_AMPERSAND) || match(parser, TOKEN_STAR) ||
-      match(parser, TOKEN_PLUS_PLUS) || match(parser, TOKEN_MINUS_MINUS)) {
-    
-    Token operator = lexer_peek_token(parser->lexer);
-    TokenType op_type = operator.type;
-    
-    Expr* expr = ast_create_expr(EXPR_UNARY, operator.location, parser->arena);
-    expr->as.unary.operator = op_type;
-    expr->as.unary.operand = parse_unary_expression(parser);
-    expr->as.unary.is_postfix = false;
-    
-    return expr;
+static void push_frame(Parser* parser, FrameKind kind, Precedence precedence, Token token) {
+  ExprStack* stack = parser->expr_stack;
+  if (stack->frame_count == stack->frame_capacity) {
+    stack->frames = arena_grow_array(parser->table_arena, stack->frames,
+                                     &stack->frame_capacity, sizeof(OperatorFrame));
   }
   
-  // Parse primary expression
-  Expr* expr = parse_primary_expression(parser);
-  
-  // Check for postfix operators
-  while (match(parser, TOKEN_LEFT_BRACKET) || match(parser, TOKEN_LEFT_PAREN) ||
-         match(parser, TOKEN_DOT) || match(parser, TOKEN_ARROW) ||
-         match(parser, TOKEN_PLUS_PLUS) || match(parser, TOKEN_MINUS_MINUS)) {
-    
-    Token operator = lexer_peek_token(parser->lexer);
-    
-    if (operator.type == TOKEN_LEFT_BRACKET) {
-      // Array indexing
-      Expr* index = parse_expression(parser);
-      consume(parser, TOKEN_RIGHT_BRACKET, "Expect ']' after array index");
+  OperatorFrame* frame = &stack->frames[stack->frame_count++];
+  frame->kind = (unsigned char)kind;
+  frame->precedence = (unsigned char)precedence;
+  frame->operator = token.type;
+  frame->location = token.location;
+  frame->operand_base = stack->operand_count - 1;
+}
+
+// Pop the top operator and replace its stacked operands with the node it builds
+static void reduce_frame(Parser* parser) {
+  ExprStack* stack = parser->expr_stack;
+  OperatorFrame* frame = &stack->frames[--stack->frame_count];
+  ExprRef* top = &stack->operands[stack->operand_count - 1];
+  int first = stack->operand_count - 2; // Binary operators and assignments
+  ExprRef ref;
+  Expr* expr;
+  
+  switch (frame->kind) {
+    case FRAME_PREFIX:
+      ref = new_expr(parser, EXPR_UNARY, frame->location);
+      expr = expr_at(parser, ref);
+      expr->as.unary.operator = frame->operator;
+      expr->as.unary.operand = top[0];
+      expr->as.unary.is_postfix = false;
+      first = stack->operand_count - 1;
+      break;
       
-      Expr* new_expr = ast_create_expr(EXPR_INDEX, operator.location, parser->arena);
-      new_expr->as.index.array = expr;
-      new_expr->as.index.index = index;
-      expr = new_expr;
-    }
-    else if (operator.type == TOKEN_LEFT_PAREN) {
-      // Function call
-      Expr** arguments = NULL;
-      int arg_count = 0;
+    case FRAME_COLON:
+      ref = new_expr(parser, EXPR_CONDITIONAL, frame->location);
+      expr = expr_at(parser, ref);
+      expr->as.conditional.condition = top[-2];
+      expr->as.conditional.true_expr = top[-1];
+      expr->as.conditional.false_expr = top[0];
+      first = stack->operand_count - 3;
+      break;
       
-      if (!check(parser, TOKEN_RIGHT_PAREN)) {
-        do {
-          // Allocate space for arguments
-          if (arguments == NULL) {
-            arguments = arena_alloc(parser->arena, sizeof(Expr*) * 4);
-          } else if (arg_count % 4 == 0) {
-            Expr** new_args = arena_alloc(parser->arena, sizeof(Expr*) * (arg_count + 4));
-            memcpy(new_args, arguments, sizeof(Expr*) * arg_count);
-            arguments = new_args;
-          }
-          
-          // Parse argument
-          arguments[arg_count++] = parse_expression(parser);
-        } while (match(parser, TOKEN_COMMA));
+    default:
+      if (frame->precedence == PREC_ASSIGNMENT) {
+        ref = new_expr(parser, EXPR_ASSIGN, frame->location);
+        expr = expr_at(parser, ref);
+        expr->as.assign.target = top[-1];
+        expr->as.assign.operator = frame->operator;
+        expr->as.assign.value = top[0];
+      } else {
+        ref = new_expr(parser, EXPR_BINARY, frame->location);
+        expr = expr_at(parser, ref);
+        expr->as.binary.left = top[-1];
+        expr->as.binary.operator = frame->operator;
+        expr->as.binary.right = top[0];
       }
-      
-      consume(parser, TOKEN_RIGHT_PAREN, "Expect ')' after arguments");
-      
-      Expr* new_expr = ast_create_expr(EXPR_CALL, operator.location, parser->arena);
-      new_expr->as.call.function = expr;
-      new_expr->as.call.arguments = arguments;
-      new_expr->as.call.arg_count = arg_count;
-      expr = new_expr;
-    }
-    else if (operator.type == TOKEN_DOT || operator.type == TOKEN_ARROW) {
-      // Struct field access
-      advance(parser); // Consume . or ->
-      
-      Token field = consume(parser, TOKEN_IDENTIFIER, "Expect field name after '.' or '->'");
-      
-      Expr* new_expr = ast_create_expr(EXPR_FIELD, operator.location, parser->arena);
-      new_expr->as.field.object = expr;
-      new_expr->as.field.field = arena_strdup(parser->arena, field.lexeme); // Careful with length
-      new_expr->as.field.is_arrow = (operator.type == TOKEN_ARROW);
-      expr = new_expr;
-    }
-    else if (operator.type == TOKEN_PLUS_PLUS || operator.type == TOKEN_MINUS_MINUS) {
-      // Postfix increment/decrement
-      advance(parser); // Consume ++ or --
-      
-      Expr* new_expr = ast_create_expr(EXPR_UNARY, operator.location, parser->arena);
-      new_expr->as.unary.operator = operator.type;
-      new_expr->as.unary.operand = expr;
-      new_expr->as.unary.is_postfix = true;
-      expr = new_expr;
-    }
+      break;
   }
   
-  return expr;
+  replace_operands(parser, first, ref, frame->location);
 }
 
-static Expr* parse_multiplicative_expression(Parser* parser) {
-  Expr* expr = parse_unary_expression(parser);
-  
-  while (match(parser, TOKEN_STAR) || match(parser, TOKEN_SLASH) || match(parser, TOKEN_PERCENT)) {
-    Token operator = lexer_peek_token(parser->lexer);
-    TokenType op_type = operator.type;
-    
-    Expr* right = parse_unary_expression(parser);
-    
-    Expr* new_expr = ast_create_expr(EXPR_BINARY, operator.location, parser->arena);
-    new_expr->as.binary.left = expr;
-    new_expr->as.binary.operator = op_type;
-    new_expr->as.binary.right = right;
-    expr = new_expr;
+// Reduce operators above frame_base that bind at least as tightly as precedence
+// (brackets have PREC_NONE and stop the reduction)
+static void reduce_operators(Parser* parser, int frame_base, Precedence precedence) {
+  ExprStack* stack = parser->expr_stack;
+  while (stack->frame_count > frame_base &&
+         stack->frames[stack->frame_count - 1].precedence >= precedence) {
+    reduce_frame(parser);
   }
-  
-  return expr;
 }
 
-static Expr* parse_additive_expression(Parser* parser) {
-  Expr* expr = parse_multiplicative_expression(parser);
-  
-  while (match(parser, TOKEN_PLUS) || match(parser, TOKEN_MINUS)) {
-    Token operator = lexer_peek_token(parser->lexer);
-    TokenType op_type = operator.type;
-    
-    Expr* right = parse_multiplicative_expression(parser);
-    
-    Expr* new_expr = ast_create_expr(EXPR_BINARY, operator.location, parser->arena);
-    new_expr->as.binary.left = expr;
-    new_expr->as.binary.operator = op_type;
-    new_expr->as.binary.right = right;
-    expr = new_expr;
-  }
-  
-  return expr;
+// Replace a call's stacked function and arguments with the call node
+static void finish_call(Parser* parser) {
+  ExprStack* stack = parser->expr_stack;
+  OperatorFrame* frame = &stack->frames[--stack->frame_count];
+  int arg_count = stack->operand_count - frame->operand_base - 1;
+  
+  ExprRef ref = new_expr(parser, EXPR_CALL, frame->location);
+  Expr* expr = expr_at(parser, ref);
+  expr->as.call.function = stack->operands[frame->operand_base];
+  expr->as.call.arguments = list_finish(parser, &stack->operands[frame->operand_base + 1],
+                                        arg_count, sizeof(ExprRef));
+  expr->as.call.arg_count = arg_count;
+  
+  replace_operands(parser, frame->operand_base, ref, frame->location);
 }
 
-static Expr* parse_shift_expression(Parser* parser) {
-  Expr* expr = parse_additive_expression(parser);
+// Replace a stacked array and index with the index node
+static void finish_index(Parser* parser) {
+  ExprStack* stack = parser->expr_stack;
+  OperatorFrame* frame = &stack->frames[--stack->frame_count];
   
-  while (match(parser, TOKEN_LESS_LESS) || match(parser, TOKEN_GREATER_GREATER)) {
-    Token operator = lexer_peek_token(parser->lexer);
-    TokenType op_type = operator.type;
-    
-    Expr* right = parse_additive_expression(parser);
-    
-    Expr* new_expr = ast_create_expr(EXPR_BINARY, operator.location, parser->arena);
-    new_expr->as.binary.left = expr;
-    new_expr->as.binary.operator = op_type;
-    new_expr->as.binary.right = right;
-    expr = new_expr;
-  }
+  ExprRef ref = new_expr(parser, EXPR_INDEX, frame->location);
+  Expr* expr = expr_at(parser, ref);
+  expr->as.index.array = stack->operands[stack->operand_count - 2];
+  expr->as.index.index = stack->operands[stack->operand_count - 1];
   
-  return expr;
+  replace_operands(parser, stack->operand_count - 2, ref, frame->location);
 }
 
-static Expr* parse_relational_expression(Parser* parser) {
-  Expr* expr = parse_shift_expression(parser);
-  
-  while (match(parser, TOKEN_LESS) || match(parser, TOKEN_LESS_EQUAL) ||
-         match(parser, TOKEN_GREATER) || match(parser, TOKEN_GREATER_EQUAL)) {
-    Token operator = lexer_peek_token(parser->lexer);
-    TokenType op_type = operator.type;
-    
-    Expr* right = parse_shift_expression(parser);
-    
-    Expr* new_expr = ast_create_expr(EXPR_BINARY, operator.location, parser->arena);
-    new_expr->as.binary.left = expr;
-    new_expr->as.binary.operator = op_type;
-    new_expr->as.binary.right = right;
-    expr = new_expr;
-  }
-  
-  return expr;
+static bool is_prefix_operator(TokenType type) {
+  return type == TOKEN_MINUS || type == TOKEN_PLUS || type == TOKEN_TILDE ||
+         type == TOKEN_EXCLAIM || type == TOKEN_AMPERSAND || type == TOKEN_STAR ||
+         type == TOKEN_PLUS_PLUS || type == TOKEN_MINUS_MINUS;
 }
 
-static Expr* parse_equality_expression(Parser* parser) {
-  Expr* expr = parse_relational_expression(parser);
+// Parsing functions
+static ExprRef parse_primary_expression(Parser* parser) {
+  Token token = peek(parser);
   
-  while (match(parser, TOKEN_EQUAL_EQUAL) || match(parser, TOKEN_EXCLAIM_EQUAL)) {
-    Token operator = lexer_peek_token(parser->lexer);
-    TokenType op_type = operator.type;
-    
-    Expr* right = parse_relational_expression(parser);
+  // Integer literal
+  if (check(parser, TOKEN_INTEGER_LITERAL)) {
+    advance(parser);
     
-    Expr* new_expr = ast_create_expr(EXPR_BINARY, operator.location, parser->arena);
-    new_expr->as.binary.left = expr;
-    new_expr->as.binary.operator = op_type;
-    new_expr->as.binary.right = right;
-    expr = new_expr;
+    ExprRef ref = new_expr(parser, EXPR_INTEGER_LITERAL, token.location);
+    Expr* expr = expr_at(parser, ref);
+    expr->as.int_literal.value = token.value.int_value;
+    return ref;
   }
   
-  return expr;
-}
-
-static Expr* parse_bitwise_and_expression(Parser* parser) {
-  Expr* expr = parse_equality_expression(parser);
-  
-  while (match(parser, TOKEN_AMPERSAND)) {
-    Token operator = lexer_peek_token(parser->lexer);
-    
-    Expr* right = parse_equality_expression(parser);
+  // Float literal
+  if (check(parser, TOKEN_FLOAT_LITERAL)) {
+    advance(parser);
     
-    Expr* new_expr = ast_create_expr(EXPR_BINARY, operator.location, parser->arena);
-    new_expr->as.binary.left = expr;
-    new_expr->as.binary.operator = TOKEN_AMPERSAND;
-    new_expr->as.binary.right = right;
-    expr = new_expr;
+    ExprRef ref = new_expr(parser, EXPR_FLOAT_LITERAL, token.location);
+    Expr* expr = expr_at(parser, ref);
+    expr->as.float_literal.value = token.value.float_value;
+    return ref;
   }
   
-  return expr;
-}
-
-static Expr* parse_bitwise_xor_expression(Parser* parser) {
-  Expr* expr = parse_bitwise_and_expression(parser);
-  
-  while (match(parser, TOKEN_CARET)) {
-    Token operator = lexer_peek_token(parser->lexer);
-    
-    Expr* right = parse_bitwise_and_expression(parser);
+  // String literal
+  if (check(parser, TOKEN_STRING_LITERAL)) {
+    advance(parser);
     
-    Expr* new_expr = ast_create_expr(EXPR_BINARY, operator.location, parser->arena);
-    new_expr->as.binary.left = expr;
-    new_expr->as.binary.operator = TOKEN_CARET;
-    new_expr->as.binary.right = right;
-    expr = new_expr;
+    ExprRef ref = new_expr(parser, EXPR_STRING_LITERAL, token.location);
+    Expr* expr = expr_at(parser, ref);
+    expr->as.string_literal.value = token.value.string_value;
+    return ref;
   }
   
-  return expr;
-}
-
-static Expr* parse_bitwise_or_expression(Parser* parser) {
-  Expr* expr = parse_bitwise_xor_expression(parser);
-  
-  while (match(parser, TOKEN_PIPE)) {
-    Token operator = lexer_peek_token(parser->lexer);
-    
-    Expr* right = parse_bitwise_xor_expression(parser);
+  // Character literal
+  if (check(parser, TOKEN_CHAR_LITERAL)) {
+    advance(parser);
     
-    Expr* new_expr = ast_create_expr(EXPR_BINARY, operator.location, parser->arena);
-    new_expr->as.binary.left = expr;
-    new_expr->as.binary.operator = TOKEN_PIPE;
-    new_expr->as.binary.right = right;
-    expr = new_expr;
+    ExprRef ref = new_expr(parser, EXPR_CHAR_LITERAL, token.location);
+    Expr* expr = expr_at(parser, ref);
+    expr->as.char_literal.value = token.value.char_value;
+    return ref;
   }
   
-  return expr;
-}
-
-static Expr* parse_logical_and_expression(Parser* parser) {
-  Expr* expr = parse_bitwise_or_expression(parser);
-  
-  while (match(parser, TOKEN_AMPERSAND_AMPERSAND)) {
-    Token operator = lexer_peek_token(parser->lexer);
-    
-    Expr* right = parse_bitwise_or_expression(parser);
+  // Identifier
+  if (check(parser, TOKEN_IDENTIFIER)) {
+    advance(parser);
     
-    Expr* new_expr = ast_create_expr(EXPR_BINARY, operator.location, parser->arena);
-    new_expr->as.binary.left = expr;
-    new_expr->as.binary.operator = TOKEN_AMPERSAND_AMPERSAND;
-    new_expr->as.binary.right = right;
-    expr = new_expr;
+    ExprRef ref = new_expr(parser, EXPR_IDENTIFIER, token.location);
+    Expr* expr = expr_at(parser, ref);
+    expr->as.identifier.name = token.value.identifier;
+    return ref;
   }
   
-  return expr;
+  // Parenthesized expressions are opened by parse_expression itself
+  parser_error_current(parser, "Expect expression");
+  return AST_NONE;
 }
 
-static Expr* parse_logical_or_expression(Parser* parser) {
-  Expr* expr = parse_logical_and_expression(parser);
-  
-  while (match(parser, TOKEN_PIPE_PIPE)) {
-    Token operator = lexer_peek_token(parser->lexer);
+// Apply postfix operators to the top operand; false once the next token is not one
+static bool parse_postfix_operator(Parser* parser) {
+  ExprStack* stack = parser->expr_stack;
+  ExprRef top = stack->operands[stack->operand_count - 1];
+  
+  if (match(parser, TOKEN_DOT) || match(parser, TOKEN_ARROW)) {
+    // Struct field access
+    Token operator = parser->previous;
+    Token field = consume(parser, TOKEN_IDENTIFIER, "Expect field name after '.' or '->'");
     
-    Expr* right = parse_logical_and_expression(parser);
-    
-    Expr* new_expr = ast_create_expr(EXPR_BINARY, operator.location, parser->arena);
-    new_expr->as.binary.left = expr;
-    new_expr->as.binary.operator = TOKEN_PIPE_PIPE;
-    new_expr->as.binary.right = right;
-    expr = new_expr;
+    ExprRef ref = new_expr(parser, EXPR_FIELD, operator.location);
+    Expr* expr = expr_at(parser, ref);
+    expr->as.field.object = top;
+    expr->as.field.field = token_name(field);
+    expr->as.field.is_arrow = (operator.type == TOKEN_ARROW);
+    replace_operands(parser, stack->operand_count - 1, ref, operator.location);
+    return true;
   }
   
-  return expr;
-}
-
-static Expr* parse_conditional_expression(Parser* parser) {
-  Expr* expr = parse_logical_or_expression(parser);
-  
-  if (match(parser, TOKEN_QUESTION)) {
-    Expr* true_expr = parse_expression(parser);
-    consume(parser, TOKEN_COLON, "Expect ':' in conditional expression");
-    Expr* false_expr = parse_conditional_expression(parser);
+  if (match(parser, TOKEN_PLUS_PLUS) || match(parser, TOKEN_MINUS_MINUS)) {
+    // Postfix increment/decrement
+    Token operator = parser->previous;
     
-    Expr* new_expr = ast_create_expr(EXPR_CONDITIONAL, expr->location, parser->arena);
-    new_expr->as.conditional.condition = expr;
-    new_expr->as.conditional.true_expr = true_expr;
-    new_expr->as.conditional.false_expr = false_expr;
-    expr = new_expr;
+    ExprRef ref = new_expr(parser, EXPR_UNARY, operator.location);
+    Expr* expr = expr_at(parser, ref);
+    expr->as.unary.operator = operator.type;
+    expr->as.unary.operand = top;
+    expr->as.unary.is_postfix = true;
+    replace_operands(parser, stack->operand_count - 1, ref, operator.location);
+    return true;
   }
   
-  return expr;
+  return false;
 }
 
-static Expr* parse_assignment_expression(Parser* parser) {
-  Expr* expr = parse_conditional_expression(parser);
-  
-  if (match(parser, TOKEN_EQUAL) || match(parser, TOKEN_PLUS_EQUAL) ||
-      match(parser, TOKEN_MINUS_EQUAL) || match(parser, TOKEN_STAR_EQUAL) ||
-      match(parser, TOKEN_SLASH_EQUAL) || match(parser, TOKEN_PERCENT_EQUAL) ||
-      match(parser, TOKEN_AMPERSAND_EQUAL) || match(parser, TOKEN_PIPE_EQUAL) ||
-      match(parser, TOKEN_CARET_EQUAL) || match(parser, TOKEN_LESS_LESS_EQUAL) ||
-      match(parser, TOKEN_GREATER_GREATER_EQUAL)) {
+static ExprRef parse_expression(Parser* parser) {
+  ExprStack* stack = parser->expr_stack;
+  
+  // Entries below these belong to an enclosing parse and are left alone
+  int operand_base = stack->operand_count;
+  int frame_base = stack->frame_count;
+  
+  for (;;) {
+    // Operand position: prefix operators and opening parentheses, then a primary
+    while (is_prefix_operator(peek(parser).type) || check(parser, TOKEN_LEFT_PAREN)) {
+      Token token = advance(parser);
+      if (token.type == TOKEN_LEFT_PAREN) {
+        push_frame(parser, FRAME_GROUP, PREC_NONE, token);
+      } else {
+        push_frame(parser, FRAME_PREFIX, PREC_UNARY, token);
+      }
+    }
     
-    Token operator = lexer_peek_token(parser->lexer);
-    TokenType op_type = operator.type;
+    ExprRef primary = parse_primary_expression(parser);
+    if (!primary) break;
+    push_operand(parser, primary);
     
-    Expr* right = parse_assignment_expression(parser);
+    // Operator position: postfix operators and closing brackets until an
+    // operator or separator needs another operand
+    bool need_operand = false;
+    while (!need_operand) {
+      if (parse_postfix_operator(parser)) continue;
+      
+      Token token = peek(parser);
+      Precedence precedence = (Precedence)binary_precedence[token.type];
+      
+      if (precedence != PREC_NONE) {
+        // Right-associative operators leave operators of equal precedence stacked
+        bool right_associative = precedence <= PREC_CONDITIONAL;
+        reduce_operators(parser, frame_base, right_associative ? precedence + 1 : precedence);
+        advance(parser);
+        
+        if (token.type == TOKEN_QUESTION) {
+          push_frame(parser, FRAME_QUESTION, PREC_NONE, token);
+        } else {
+          push_frame(parser, FRAME_BINARY, precedence, token);
+        }
+        need_operand = true;
+        continue;
+      }
+      
+      if (token.type == TOKEN_LEFT_BRACKET) {
+        // Array indexing
+        push_frame(parser, FRAME_INDEX, PREC_NONE, advance(parser));
+        need_operand = true;
+        continue;
+      }
+      
+      if (token.type == TOKEN_LEFT_PAREN) {
+        // Function call
+        push_frame(parser, FRAME_CALL, PREC_NONE, advance(parser));
+        if (match(parser, TOKEN_RIGHT_PAREN)) {
+          finish_call(parser);
+        } else {
+          need_operand = true;
+        }
+        continue;
+      }
+      
+      // Anything else completes the operand of the innermost bracket
+      reduce_operators(parser, frame_base, PREC_ASSIGNMENT);
+      
+      if (stack->frame_count == frame_base) {
+        // The whole expression is done
+        return stack->operands[--stack->operand_count];
+      }
+      
+      OperatorFrame* frame = &stack->frames[stack->frame_count - 1];
+      switch (frame->kind) {
+        case FRAME_GROUP:
+          consume(parser, TOKEN_RIGHT_PAREN, "Expect ')' after expression");
+          stack->frame_count--;
+          break;
+          
+        case FRAME_INDEX:
+          consume(parser, TOKEN_RIGHT_BRACKET, "Expect ']' after array index");
+          finish_index(parser);
+          break;
+          
+        case FRAME_CALL:
+          if (match(parser, TOKEN_COMMA)) {
+            need_operand = true;
+          } else {
+            consume(parser, TOKEN_RIGHT_PAREN, "Expect ')' after arguments");
+            finish_call(parser);
+          }
+          break;
+          
+        default:
+          // FRAME_QUESTION: the true branch is complete, parse the false one
+          consume(parser, TOKEN_COLON, "Expect ':' in conditional expression");
+          frame->kind = FRAME_COLON;
+          frame->precedence = PREC_CONDITIONAL;
+          need_operand = true;
+          break;
+      }
+      
+      if (parser->has_error) break;
+    }
     
-    Expr* new_expr = ast_create_expr(EXPR_ASSIGN, operator.location, parser->arena);
-    new_expr->as.assign.target = expr;
-    new_expr->as.assign.operator = op_type;
-    new_expr->as.assign.value = right;
-    expr = new_expr;
+    if (parser->has_error) break;
   }
   
-  return expr;
-}
-
-static Expr* parse_expression(Parser* parser) {
-  return parse_assignment_expression(parser);
+  // Error: drop whatever this expression left on the stacks
+  stack->operand_count = operand_base;
+  stack->frame_count = frame_base;
+  return AST_NONE;
 }
 
 // Parse a statement
-static Stmt* parse_expression_statement(Parser* parser) {
-  Expr* expr = parse_expression(parser);
+static StmtRef parse_expression_statement(Parser* parser) {
+  Token start = peek(parser);
+  ExprRef expr = parse_expression(parser);
   consume(parser, TOKEN_SEMICOLON, "Expect ';' after expression");
   
-  Stmt* stmt = ast_create_stmt(STMT_EXPR, expr->location, parser->arena);
-  stmt->as.expr.expr = expr;
-  return stmt;
+  StmtRef ref = new_stmt(parser, STMT_EXPR, start.location);
+  stmt_at(parser, ref)->as.expr.expr = expr;
+  return ref;
 }
 
-static Stmt* parse_block_statement(Parser* parser) {
+static StmtRef parse_block_statement(Parser* parser) {
   Token start = consume(parser, TOKEN_LEFT_BRACE, "Expect '{' before block");
   
-  Stmt** statements = NULL;
+  Arena* scratch = arena_scratch(parser->arena);
+  ArenaMark mark = arena_mark(scratch);
+  StmtRef* statements = NULL;
   int count = 0;
+  int capacity = 0;
   
-  while (!check(parser, TOKEN_RIGHT_BRACE) && !check(parser, TOKEN_EOF)) {
-    // Allocate space for statements
-    if (statements == NULL) {
-      statements = arena_alloc(parser->arena, sizeof(Stmt*) * 8);
-    } else if (count % 8 == 0) {
-      Stmt** new_stmts = arena_alloc(parser->arena, sizeof(Stmt*) * (count + 8));
-      memcpy(new_stmts, statements, sizeof(Stmt*) * count);
-      statements = new_stmts;
+  while (!check(parser, TOKEN_RIGHT_BRACE) && !check(parser, TOKEN_EOF) && !parser->has_error) {
+    if (count == capacity) {
+      statements = arena_grow_array(scratch, statements, &capacity, sizeof(StmtRef));
     }
     
     // Parse statement
@@ -570,101 +675,116 @@ static Stmt* parse_block_statement(Parser* parser) {
   
   consume(parser, TOKEN_RIGHT_BRACE, "Expect '}' after block");
   
-  Stmt* stmt = ast_create_stmt(STMT_BLOCK, start.location, parser->arena);
-  stmt->as.block.statements = statements;
+  StmtRef ref = new_stmt(parser, STMT_BLOCK, start.location);
+  Stmt* stmt = stmt_at(parser, ref);
+  stmt->as.block.statements = list_finish(parser, statements, count, sizeof(StmtRef));
   stmt->as.block.count = count;
-  return stmt;
+  arena_rewind(scratch, mark);
+  return ref;
 }
 
-static Stmt* parse_if_statement(Parser* parser) {
+static StmtRef parse_if_statement(Parser* parser) {
   Token start = consume(parser, TOKEN_IF, "Expect 'if'");
   consume(parser, TOKEN_LEFT_PAREN, "Expect '(' after 'if'");
-  Expr* condition = parse_expression(parser);
+  ExprRef condition = parse_expression(parser);
   consume(parser, TOKEN_RIGHT_PAREN, "Expect ')' after condition");
   
-  Stmt* then_branch = parse_statement(parser);
-  Stmt* else_branch = NULL;
+  StmtRef then_branch = parse_statement(parser);
+  StmtRef else_branch = AST_NONE;
   
   if (match(parser, TOKEN_ELSE)) {
     else_branch = parse_statement(parser);
   }
   
-  Stmt* stmt = ast_create_stmt(STMT_IF, start.location, parser->arena);
+  StmtRef ref = new_stmt(parser, STMT_IF, start.location);
+  Stmt* stmt = stmt_at(parser, ref);
   stmt->as.if_stmt.condition = condition;
   stmt->as.if_stmt.then_branch = then_branch;
   stmt->as.if_stmt.else_branch = else_branch;
-  return stmt;
+  stmt->as.if_stmt.profile_counter = -1;
+  return ref;
 }
 
-static Stmt* parse_while_statement(Parser* parser) {
+static StmtRef parse_while_statement(Parser* parser) {
   Token start = consume(parser, TOKEN_WHILE, "Expect 'while'");
   consume(parser, TOKEN_LEFT_PAREN, "Expect '(' after 'while'");
-  Expr* condition = parse_expression(parser);
+  ExprRef condition = parse_expression(parser);
   consume(parser, TOKEN_RIGHT_PAREN, "Expect ')' after condition");
   
-  Stmt* body = parse_statement(parser);
+  StmtRef body = parse_statement(parser);
   
-  Stmt* stmt = ast_create_stmt(STMT_WHILE, start.location, parser->arena);
+  StmtRef ref = new_stmt(parser, STMT_WHILE, start.location);
+  Stmt* stmt = stmt_at(parser, ref);
   stmt->as.while_stmt.condition = condition;
   stmt->as.while_stmt.body = body;
-  return stmt;
+  stmt->as.while_stmt.profile_counter = -1;
+  return ref;
 }
 
-static Stmt* parse_return_statement(Parser* parser) {
+static StmtRef parse_return_statement(Parser* parser) {
   Token start = consume(parser, TOKEN_RETURN, "Expect 'return'");
   
-  Expr* value = NULL;
+  ExprRef value = AST_NONE;
   if (!check(parser, TOKEN_SEMICOLON)) {
     value = parse_expression(parser);
   }
   
   consume(parser, TOKEN_SEMICOLON, "Expect ';' after return value");
   
-  Stmt* stmt = ast_create_stmt(STMT_RETURN, start.location, parser->arena);
-  stmt->as.return_stmt.value = value;
-  return stmt;
+  StmtRef ref = new_stmt(parser, STMT_RETURN, start.location);
+  stmt_at(parser, ref)->as.return_stmt.value = value;
+  return ref;
 }
 
-static Stmt* parse_statement(Parser* parser) {
-  if (match(parser, TOKEN_LEFT_BRACE)) {
-    // Undo the consumption of '{'
-    lexer_peek_token(parser->lexer); // Not ideal, we need a proper way to go back
+// Does the current token start a local declaration?
+static bool is_declaration_start(Parser* parser) {
+  switch (peek(parser).type) {
+    case TOKEN_INT: case TOKEN_CHAR: case TOKEN_SHORT: case TOKEN_LONG:
+    case TOKEN_FLOAT: case TOKEN_DOUBLE: case TOKEN_VOID:
+    case TOKEN_STRUCT: case TOKEN_UNION: case TOKEN_TYPEDEF:
+    case TOKEN_STATIC: case TOKEN_EXTERN:
+      return true;
+    
+    case TOKEN_IDENTIFIER: {
+      // A typedef name starts a declaration only if a declarator follows;
+      // otherwise it is a variable shadowing the typedef ("T = 1;", "T(x);")
+      if (!typedef_table_lookup(parser->typedefs, peek(parser).value.identifier)) {
+        return false;
+      }
+      TokenType next = peek_ahead(parser, 1);
+      return next == TOKEN_IDENTIFIER || next == TOKEN_STAR ||
+             next == TOKEN_CONST || next == TOKEN_VOLATILE;
+    }
+    
+    default:
+      return false;
+  }
+}
+
+static StmtRef parse_statement(Parser* parser) {
+  if (check(parser, TOKEN_LEFT_BRACE)) {
     return parse_block_statement(parser);
   }
   
-  if (match(parser, TOKEN_IF)) {
-    // Undo the consumption of 'if'
-    lexer_peek_token(parser->lexer); // Not ideal
+  if (check(parser, TOKEN_IF)) {
     return parse_if_statement(parser);
   }
   
-  if (match(parser, TOKEN_WHILE)) {
-    // Undo the consumption of 'while'
-    lexer_peek_token(parser->lexer); // Not ideal
+  if (check(parser, TOKEN_WHILE)) {
     return parse_while_statement(parser);
   }
   
-  if (match(parser, TOKEN_RETURN)) {
-    // Undo the consumption of 'return'
-    lexer_peek_token(parser->lexer); // Not ideal
+  if (check(parser, TOKEN_RETURN)) {
     return parse_return_statement(parser);
   }
   
   // Check if it's a declaration
-  if (match(parser, TOKEN_INT) || match(parser, TOKEN_CHAR) ||
-      match(parser, TOKEN_FLOAT) || match(parser, TOKEN_DOUBLE) ||
-      match(parser, TOKEN_VOID) || match(parser, TOKEN_STRUCT) ||
-      match(parser, TOKEN_UNION) || match(parser, TOKEN_TYPEDEF) ||
-      match(parser, TOKEN_STATIC) || match(parser, TOKEN_EXTERN)) {
-    
-    // Undo the consumption
-    lexer_peek_token(parser->lexer); // Not ideal
-    
+  if (is_declaration_start(parser)) {
     Decl* decl = parse_declaration(parser);
     
-    Stmt* stmt = ast_create_stmt(STMT_DECL, decl->location, parser->arena);
-    stmt->as.decl_stmt.decl = decl;
-    return stmt;
+    StmtRef ref = new_stmt(parser, STMT_DECL, decl->location);
+    stmt_at(parser, ref)->as.decl_stmt.decl = decl;
+    return ref;
   }
   
   // Default to expression statement
@@ -673,7 +793,7 @@ static Stmt* parse_statement(Parser* parser) {
 
 // Parse a declaration
 static Type* parse_basic_type(Parser* parser) {
-  Token token = lexer_peek_token(parser->lexer);
+  Token token = peek(parser);
   SourceLocation location = token.location;
   Type* type = NULL;
   
@@ -695,6 +815,13 @@ static Type* parse_basic_type(Parser* parser) {
     type = ast_create_type(TYPE_FLOAT, location, parser->arena);
   } else if (match(parser, TOKEN_DOUBLE)) {
     type = ast_create_type(TYPE_DOUBLE, location, parser->arena);
+  } else if (check(parser, TOKEN_IDENTIFIER) &&
+             typedef_table_lookup(parser->typedefs, token.value.identifier)) {
+    advance(parser);
+    
+    // Copy so qualifiers below do not leak into the typedef itself
+    type = arena_alloc(parser->arena, sizeof(Type));
+    *type = *typedef_table_lookup(parser->typedefs, token.value.identifier);
   } else {
     parser_error_current(parser, "Expect type");
     return NULL;
@@ -714,10 +841,11 @@ static Type* parse_basic_type(Parser* parser) {
 static Type* parse_type(Parser* parser) {
   // Parse basic type or typedef name
   Type* type = parse_basic_type(parser);
+  if (!type) return NULL;
   
   // Parse derived types
   while (match(parser, TOKEN_STAR) || match(parser, TOKEN_LEFT_BRACKET)) {
-    if (lexer_peek_token(parser->lexer).type == TOKEN_STAR) {
+    if (parser->previous.type == TOKEN_STAR) {
       // Pointer type
       Type* ptr_type = ast_create_type(TYPE_POINTER, type->location, parser->arena);
       ptr_type->as.pointer.element_type = type;
@@ -732,11 +860,11 @@ static Type* parse_type(Parser* parser) {
         array_type->as.array.size = -1;
       } else {
         // Parse array size
-        Expr* size_expr = parse_expression(parser);
+        Expr* size_expr = expr_at(parser, parse_expression(parser));
         
         // In a full implementation, we would evaluate the constant expression
         // For now, we'll just assume it's a simple integer literal
-        if (size_expr->type == EXPR_INTEGER_LITERAL) {
+        if (size_expr && size_expr->type == EXPR_INTEGER_LITERAL) {
           array_type->as.array.size = (int)size_expr->as.int_literal.value;
         } else {
           array_type->as.array.size = -1; // Variable-length array
@@ -753,7 +881,7 @@ static Type* parse_type(Parser* parser) {
 }
 
 static Decl* parse_variable_declaration(Parser* parser, Type* type, const char* name, bool is_static, bool is_extern) {
-  SourceLocation location = lexer_location(parser->lexer);
+  SourceLocation location = parser->previous.location; // The declared name
   
   Decl* decl = ast_create_decl(DECL_VAR, name, location, parser->arena);
   decl->declared_type = type;
@@ -764,7 +892,7 @@ static Decl* parse_variable_declaration(Parser* parser, Type* type, const char*
   if (match(parser, TOKEN_EQUAL)) {
     decl->as.var.initializer = parse_expression(parser);
   } else {
-    decl->as.var.initializer = NULL;
+    decl->as.var.initializer = AST_NONE;
   }
   
   consume(parser, TOKEN_SEMICOLON, "Expect ';' after variable declaration");
@@ -773,7 +901,7 @@ static Decl* parse_variable_declaration(Parser* parser, Type* type, const char*
 }
 
 static Decl* parse_function_declaration(Parser* parser, Type* return_type, const char* name, bool is_static, bool is_extern) {
-  SourceLocation location = lexer_location(parser->lexer);
+  SourceLocation location = parser->previous.location; // The declared name
   
   // Create function type
   Type* func_type = ast_create_type(TYPE_FUNCTION, location, parser->arena);
@@ -786,6 +914,13 @@ static Decl* parse_function_declaration(Parser* parser, Type* return_type, const
   // Parse parameters
   consume(parser, TOKEN_LEFT_PAREN, "Expect '(' after function name");
   
+  Arena* scratch = arena_scratch(parser->arena);
+  ArenaMark mark = arena_mark(scratch);
+  Type** param_types = NULL;
+  const char** param_names = NULL;
+  int param_count = 0;
+  int param_capacity = 0;
+  
   if (!check(parser, TOKEN_RIGHT_PAREN)) {
     // At least one parameter
     do {
@@ -793,34 +928,31 @@ static Decl* parse_function_declaration(Parser* parser, Type* return_type, const
       Type* param_type = parse_type(parser);
       
       // Parse parameter name (optional)
-      char* param_name = NULL;
+      const char* param_name = NULL;
       if (check(parser, TOKEN_IDENTIFIER)) {
         Token name_token = advance(parser);
-        param_name = arena_strdup(parser->arena, name_token.lexeme); // Careful with length
+        param_name = token_name(name_token);
       }
       
-      // Add parameter to function type
-      if (func_type->as.function.param_types == NULL) {
-        func_type->as.function.param_types = arena_alloc(parser->arena, sizeof(Type*) * 4);
-        func_type->as.function.param_names = arena_alloc(parser->arena, sizeof(char*) * 4);
-      } else if (func_type->as.function.param_count % 4 == 0) {
-        Type** new_types = arena_alloc(parser->arena, sizeof(Type*) * (func_type->as.function.param_count + 4));
-        char** new_names = arena_alloc(parser->arena, sizeof(char*) * (func_type->as.function.param_count + 4));
-        
-        memcpy(new_types, func_type->as.function.param_types, sizeof(Type*) * func_type->as.function.param_count);
-        memcpy(new_names, func_type->as.function.param_names, sizeof(char*) * func_type->as.function.param_count);
-        
-        func_type->as.function.param_types = new_types;
-        func_type->as.function.param_names = new_names;
+      // Add parameter to the list
+      if (param_count == param_capacity) {
+        int capacity = param_capacity;
+        param_types = arena_grow_array(scratch, param_types, &capacity, sizeof(Type*));
+        param_names = arena_grow_array(scratch, param_names, &param_capacity, sizeof(char*));
       }
       
-      func_type->as.function.param_types[func_type->as.function.param_count] = param_type;
-      func_type->as.function.param_names[func_type->as.function.param_count] = param_name;
-      func_type->as.function.param_count++;
+      param_types[param_count] = param_type;
+      param_names[param_count] = param_name;
+      param_count++;
       
     } while (match(parser, TOKEN_COMMA));
   }
   
+  func_type->as.function.param_types = list_finish(parser, param_types, param_count, sizeof(Type*));
+  func_type->as.function.param_names = list_finish(parser, param_names, param_count, sizeof(char*));
+  func_type->as.function.param_count = param_count;
+  arena_rewind(scratch, mark);
+  
   consume(parser, TOKEN_RIGHT_PAREN, "Expect ')' after parameters");
   
   // Create function declaration
@@ -829,23 +961,50 @@ static Decl* parse_function_declaration(Parser* parser, Type* return_type, const
   decl->is_static = is_static;
   decl->is_extern = is_extern;
   decl->as.func.param_names = func_type->as.function.param_names;
+  decl->as.func.profile_counters = 0;
   
   // Parse function body if present (not just a declaration)
-  if (match(parser, TOKEN_LEFT_BRACE)) {
-    // Undo the consumption of '{'
-    lexer_peek_token(parser->lexer); // Not ideal
-    
+  if (check(parser, TOKEN_LEFT_BRACE)) {
+    // Everything the body allocates comes after this mark, for parser_release_body;
+    // a typedef inside it stays visible to the rest of the file, so it pins the body
+    parser->body_mark = arena_mark(parser->arena);
+    parser->body_expr_count = parser->program->exprs.count;
+    parser->body_stmt_count = parser->program->stmts.count;
+    int typedef_count = parser->typedefs->size;
     decl->as.func.body = parse_block_statement(parser);
+    parser->body_releasable = parser->typedefs->size == typedef_count;
   } else {
     // Function prototype
-    decl->as.func.body = NULL;
+    decl->as.func.body = AST_NONE;
     consume(parser, TOKEN_SEMICOLON, "Expect ';' after function prototype");
   }
   
   return decl;
 }
 
+static Decl* parse_typedef_declaration(Parser* parser) {
+  Type* type = parse_type(parser);
+  
+  Token name_token = consume(parser, TOKEN_IDENTIFIER, "Expect typedef name");
+  const char* name = token_name(name_token);
+  consume(parser, TOKEN_SEMICOLON, "Expect ';' after typedef");
+  
+  Decl* decl = ast_create_decl(DECL_TYPEDEF, name, name_token.location, parser->arena);
+  decl->declared_type = type;
+  
+  // Typedef names are file-scoped until the parser tracks block scopes
+  if (name && type) {
+    typedef_table_add(parser->typedefs, name, type);
+  }
+  
+  return decl;
+}
+
 static Decl* parse_declaration(Parser* parser) {
+  if (match(parser, TOKEN_TYPEDEF)) {
+    return parse_typedef_declaration(parser);
+  }
+  
   // Parse storage class if present
   bool is_static = false;
   bool is_extern = false;
@@ -861,7 +1020,7 @@ static Decl* parse_declaration(Parser* parser) {
   
   // Parse declarator
   Token name_token = consume(parser, TOKEN_IDENTIFIER, "Expect identifier name");
-  char* name = arena_strdup(parser->arena, name_token.lexeme); // Careful with length
+  const char* name = token_name(name_token);
   
   // Determine if it's a variable or function declaration
   if (check(parser, TOKEN_LEFT_PAREN)) {
@@ -873,13 +1032,31 @@ static Decl* parse_declaration(Parser* parser) {
 
 // Parse a complete program
 static Program* parse_program(Parser* parser) {
-  Program* program = ast_create_program(parser->arena);
-  
-  while (!check(parser, TOKEN_EOF)) {
+  Program* program = parser->program;
+  int* token_starts = NULL;
+  int start_capacity = 0;
+  
+  while (!check(parser, TOKEN_EOF) && !parser->has_error) {
+    if (parser->tokens) {
+      if (program->count == start_capacity) {
+        token_starts = arena_grow_array(parser->arena, token_starts, &start_capacity, sizeof(int));
+      }
+      token_starts[program->count] = parser->position;
+    }
+    
     Decl* decl = parse_declaration(parser);
     ast_add_declaration(program, decl, parser->arena);
   }
   
+  // Declaration boundaries in the token array, for the function cache
+  if (parser->tokens) {
+    if (program->count == start_capacity) {
+      token_starts = arena_grow_array(parser->arena, token_starts, &start_capacity, sizeof(int));
+    }
+    token_starts[program->count] = parser->position;
+    program->token_starts = token_starts;
+  }
+  
   return program;
 }
 
@@ -888,28 +1065,62 @@ Parser* parser_create(Lexer* lexer, struct Arena* arena) {
   Parser* parser = arena_alloc(arena, sizeof(Parser));
   parser->lexer = lexer;
   parser->arena = arena;
-  parser->program = NULL;
+  parser->table_arena = arena;
+  parser->program = ast_create_program(arena);
+  parser->tokens = NULL;
+  parser->position = 0;
+  parser->current = lexer_peek_token(lexer);
+  parser->previous = parser->current;
   parser->has_error = false;
   parser->error_message = NULL;
-  parser->typedefs = NULL; // In a full implementation, initialize the typedef table
+  parser->typedefs = typedef_table_create(arena);
+  parser->expr_stack = arena_calloc(arena, sizeof(ExprStack));
+  parser->body_releasable = false;
+  
+  return parser;
+}
+
+Parser* parser_create_with_tokens(Lexer* lexer, TokenArray* tokens, struct Arena* arena) {
+  Parser* parser = parser_create(lexer, arena);
+  parser->tokens = tokens;
+  parser->position = 0;
+  parser->current = token_array_get(tokens, 0);
+  parser->previous = parser->current;
   
   return parser;
 }
 
 Program* parser_parse_program(Parser* parser) {
-  parser->program = parse_program(parser);
-  return parser->program;
+  return parse_program(parser);
 }
 
 Decl* parser_parse_declaration(Parser* parser) {
   return parse_declaration(parser);
 }
 
-Stmt* parser_parse_statement(Parser* parser) {
+Decl* parser_next_declaration(Parser* parser) {
+  if (check(parser, TOKEN_EOF) || parser_error(parser)) return NULL;
+  
+  parser->body_releasable = false;
+  return parse_declaration(parser);
+}
+
+void parser_release_body(Parser* parser, Decl* decl) {
+  if (!decl || decl->type != DECL_FUNC || !decl->as.func.body) return;
+  if (!parser->body_releasable) return;
+  
+  decl->as.func.body = AST_NONE;
+  parser->body_releasable = false;
+  arena_rewind(parser->arena, parser->body_mark);
+  parser->program->exprs.count = parser->body_expr_count;
+  parser->program->stmts.count = parser->body_stmt_count;
+}
+
+StmtRef parser_parse_statement(Parser* parser) {
   return parse_statement(parser);
 }
 
-Expr* parser_parse_expression(Parser* parser) {
+ExprRef parser_parse_expression(Parser* parser) {
   return parse_expression(parser);
 }
 
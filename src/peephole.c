@@ -0,0 +1,435 @@
+/**
+ * @file peephole.c
+ * @brief Peephole optimizer over the COIL instructions of a function
+ */
+
+#include "../include/peephole.h"
+#include "../include/arena.h"
+#include <string.h>
+
+#define PEEPHOLE_MAX_CONSTANTS 8 // Variables tracked as holding a known MOVI value
+
+static const char* pattern_names[PEEPHOLE_PATTERN_COUNT] = {
+  "varget-after-varset",
+  "repeated-movi",
+  "branch-to-next",
+  "empty-scope"
+};
+
+// Variable known to hold the immediate of an earlier MOVI
+typedef struct {
+  PeepholeOperand dst;
+  PeepholeOperand value;
+} KnownConstant;
+
+Peephole* peephole_create(Arena* arena) {
+  Peephole* peephole = arena_calloc(arena, sizeof(Peephole));
+  peephole->arena = arena;
+  peephole->optimize = true;
+  return peephole;
+}
+
+void peephole_begin(Peephole* peephole, size_t function_start) {
+  peephole->instrs = NULL;
+  peephole->count = 0;
+  peephole->capacity = 0;
+  peephole->operands = NULL;
+  peephole->operand_count = 0;
+  peephole->operand_capacity = 0;
+  peephole->function_start = function_start;
+  peephole->active = true;
+}
+
+void peephole_add_instruction(Peephole* peephole, size_t offset, uint8_t opcode, uint8_t qualifier,
+                              uint8_t operand_count) {
+  if (peephole->count == peephole->capacity) {
+    peephole->instrs = arena_grow_array(arena_scratch(peephole->arena), peephole->instrs,
+                                        &peephole->capacity, sizeof(PeepholeInstr));
+  }
+  
+  PeepholeInstr* instr = &peephole->instrs[peephole->count++];
+  instr->offset = (uint32_t)offset;
+  instr->new_offset = (uint32_t)offset;
+  instr->opcode = opcode;
+  instr->qualifier = qualifier;
+  instr->operand_count = operand_count;
+  instr->deleted = false;
+  instr->has_label = false;
+  instr->first_operand = peephole->operand_count;
+}
+
+void peephole_add_operand(Peephole* peephole, uint8_t qualifier, uint8_t type, size_t data_offset,
+                          size_t size, int fixup) {
+  if (peephole->operand_count == peephole->operand_capacity) {
+    peephole->operands = arena_grow_array(arena_scratch(peephole->arena), peephole->operands,
+                                          &peephole->operand_capacity, sizeof(PeepholeOperand));
+  }
+  
+  PeepholeOperand* operand = &peephole->operands[peephole->operand_count++];
+  operand->qualifier = qualifier;
+  operand->type = type;
+  operand->size = (uint8_t)size;
+  operand->data_offset = (uint32_t)data_offset;
+  operand->fixup = fixup;
+}
+
+const char* peephole_pattern_name(PeepholePattern pattern) {
+  return pattern_names[pattern];
+}
+
+// Remove an instruction, keeping the -stats opcode counts in step
+static void delete_instruction(CodeGenerator* gen, PeepholeInstr* instr) {
+  instr->deleted = true;
+  if (gen->opcode_counts) {
+    gen->opcode_counts[instr->opcode]--;
+  }
+}
+
+static PeepholeOperand* operand_at(Peephole* peephole, PeepholeInstr* instr, int index) {
+  return &peephole->operands[instr->first_operand + index];
+}
+
+static bool operands_equal(CodeGenerator* gen, const PeepholeOperand* a, const PeepholeOperand* b) {
+  return a->qualifier == b->qualifier && a->type == b->type && a->size == b->size &&
+         memcmp(gen->buffer->data + a->data_offset, gen->buffer->data + b->data_offset, a->size) == 0;
+}
+
+/*
+ * Whether two operands name the same variable. Only the ID counts: a
+ * recycled temporary is written under different type bytes, and each of
+ * those writes replaces what it held.
+ */
+static bool same_variable(CodeGenerator* gen, const PeepholeOperand* a, const PeepholeOperand* b) {
+  if (a->qualifier != OPQUAL_VAR || b->qualifier != OPQUAL_VAR) return false;
+  
+  uint64_t ids[2] = { 0, 0 };
+  const PeepholeOperand* operands[2] = { a, b };
+  for (int i = 0; i < 2; i++) {
+    const uint8_t* data = gen->buffer->data + operands[i]->data_offset;
+    if (gen->compact_operands) {
+      for (int k = 0; k < operands[i]->size; k++) {
+        ids[i] |= (uint64_t)(data[k] & 0x7F) << (7 * k);
+      }
+    } else {
+      uint32_t id = 0;
+      memcpy(&id, data, operands[i]->size < sizeof(id) ? operands[i]->size : sizeof(id));
+      ids[i] = id;
+    }
+  }
+  return ids[0] == ids[1];
+}
+
+// Next instruction after index that survives, or count
+static int next_live(Peephole* peephole, int index) {
+  int next = index + 1;
+  while (next < peephole->count && peephole->instrs[next].deleted) {
+    next++;
+  }
+  return next;
+}
+
+// Whether a label is bound anywhere in (from, to]; deleted instructions pass theirs on
+static bool labelled_between(Peephole* peephole, int from, int to) {
+  for (int i = from + 1; i <= to; i++) {
+    if (peephole->instrs[i].has_label) return true;
+  }
+  return false;
+}
+
+// Index of the instruction at a buffer offset, or count for the end of the function
+static int instruction_at(Peephole* peephole, size_t offset) {
+  int low = 0;
+  int high = peephole->count;
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    if (peephole->instrs[mid].offset < offset) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+// Label bound to the instruction a branch targets, as an instruction index
+static int branch_target(Peephole* peephole, CodeGenerator* gen, PeepholeInstr* instr) {
+  if (instr->operand_count < 1) return -1;
+  
+  PeepholeOperand* operand = operand_at(peephole, instr, 0);
+  if (operand->qualifier != OPQUAL_LBL || operand->fixup < 0) return -1;
+  
+  int label = gen->fixups[operand->fixup].label;
+  if (label < gen->label_base) return -1;
+  
+  uint32_t target = gen->label_offsets[label - gen->label_base];
+  if (target == CODEGEN_LABEL_UNBOUND) return -1;
+  return instruction_at(peephole, codegen_buffer_position(gen, target));
+}
+
+// VARSC immediately followed by VAREND opens a scope nothing uses
+static bool match_empty_scope(Peephole* peephole, CodeGenerator* gen, int index) {
+  int next = next_live(peephole, index);
+  if (next >= peephole->count || peephole->instrs[next].opcode != OP_VAREND) return false;
+  if (labelled_between(peephole, index, next)) return false;
+  
+  delete_instruction(gen, &peephole->instrs[index]);
+  delete_instruction(gen, &peephole->instrs[next]);
+  return true;
+}
+
+// A branch to the instruction that follows it changes nothing
+static bool match_branch_to_next(Peephole* peephole, CodeGenerator* gen, int index) {
+  PeepholeInstr* instr = &peephole->instrs[index];
+  int target = branch_target(peephole, gen, instr);
+  if (target <= index) return false;
+  
+  for (int i = index + 1; i < target; i++) {
+    if (!peephole->instrs[i].deleted) return false;
+  }
+  
+  delete_instruction(gen, instr);
+  gen->fixups[operand_at(peephole, instr, 0)->fixup].label = -1; // Nothing left to patch
+  return true;
+}
+
+// VARSET a, x; VARGET t, a reads back x, so copy it directly (or drop the read if t is x)
+static bool match_varget_after_varset(Peephole* peephole, CodeGenerator* gen, int index) {
+  PeepholeInstr* set = &peephole->instrs[index];
+  if (set->operand_count != 2) return false;
+  
+  PeepholeOperand* value = operand_at(peephole, set, 1);
+  if (value->qualifier != OPQUAL_VAR) return false;
+  
+  int next = next_live(peephole, index);
+  if (next >= peephole->count) return false;
+  
+  PeepholeInstr* get = &peephole->instrs[next];
+  if (get->opcode != OP_VARGET || get->operand_count != 2) return false;
+  if (labelled_between(peephole, index, next)) return false;
+  if (!operands_equal(gen, operand_at(peephole, get, 1), operand_at(peephole, set, 0))) return false;
+  
+  PeepholeOperand* result = operand_at(peephole, get, 0);
+  if (operands_equal(gen, result, value)) {
+    delete_instruction(gen, get);
+  } else {
+    if (gen->opcode_counts) {
+      gen->opcode_counts[OP_VARGET]--;
+      gen->opcode_counts[OP_MOV]++;
+    }
+    get->opcode = OP_MOV;
+    *operand_at(peephole, get, 1) = *value;
+  }
+  return true;
+}
+
+// Whether an instruction may change values the constant table does not see
+static bool clobbers_constants(PeepholeInstr* instr) {
+  switch (instr->opcode) {
+    case OP_CALL:
+    case OP_STORE:
+    case OP_VARSC:
+    case OP_VAREND:
+    case OP_VARREF:
+      return true;
+    default:
+      return instr->has_label;
+  }
+}
+
+/*
+ * Drop MOVIs that load the value their destination already holds, such as
+ * the zero each comparison against zero materializes. Values survive the
+ * fall-through of a branch; tracking stops at labels (where other paths
+ * join) and at anything that could write variables behind the table's back.
+ */
+static int remove_repeated_movi(Peephole* peephole, CodeGenerator* gen) {
+  KnownConstant known[PEEPHOLE_MAX_CONSTANTS];
+  int known_count = 0;
+  int removed = 0;
+  
+  for (int i = 0; i < peephole->count; i++) {
+    PeepholeInstr* instr = &peephole->instrs[i];
+    if (instr->has_label || (!instr->deleted && clobbers_constants(instr))) {
+      known_count = 0;
+    }
+    if (instr->deleted || instr->operand_count == 0) continue;
+    
+    // Comparisons only read their operands; everything else may write the first
+    if (instr->opcode == OP_CMP) continue;
+    
+    PeepholeOperand* dst = operand_at(peephole, instr, 0);
+    if (dst->qualifier != OPQUAL_VAR) continue;
+    
+    // The table has at most one entry per variable ID
+    int found = -1;
+    for (int k = 0; k < known_count; k++) {
+      if (same_variable(gen, &known[k].dst, dst)) {
+        found = k;
+        break;
+      }
+    }
+    
+    if (instr->opcode == OP_MOVI && instr->operand_count == 2) {
+      PeepholeOperand* value = operand_at(peephole, instr, 1);
+      
+      // Repeated only if it is the same write: same destination type and same value
+      if (found >= 0 && operands_equal(gen, &known[found].dst, dst) &&
+          operands_equal(gen, &known[found].value, value)) {
+        delete_instruction(gen, instr);
+        removed++;
+        continue;
+      }
+      
+      if (found < 0) {
+        found = known_count < PEEPHOLE_MAX_CONSTANTS ? known_count++ : PEEPHOLE_MAX_CONSTANTS - 1;
+      }
+      known[found].dst = *dst;
+      known[found].value = *value;
+      continue;
+    }
+    
+    // Any other write to the variable, under whatever type, forgets its value
+    if (found >= 0) {
+      known[found] = known[--known_count];
+    }
+  }
+  
+  return removed;
+}
+
+// Mark instructions that have a label of this function bound to them
+static void mark_labels(Peephole* peephole, CodeGenerator* gen) {
+  int label_count = gen->label_counter - gen->label_base;
+  for (int i = 0; i < label_count; i++) {
+    uint32_t target = gen->label_offsets[i];
+    if (target == CODEGEN_LABEL_UNBOUND) continue;
+    
+    int index = instruction_at(peephole, codegen_buffer_position(gen, target));
+    if (index < peephole->count) {
+      peephole->instrs[index].has_label = true;
+    }
+  }
+}
+
+// New code offset for an old one, following deleted instructions to their successor
+static uint32_t remap_offset(Peephole* peephole, CodeGenerator* gen, uint32_t offset,
+                             size_t new_end) {
+  int index = instruction_at(peephole, codegen_buffer_position(gen, offset));
+  size_t position = index < peephole->count ? peephole->instrs[index].new_offset : new_end;
+  return codegen_code_offset(gen, position);
+}
+
+/*
+ * Write the surviving instructions back over the function and move
+ * everything that refers to code offsets: label bindings, branch fixups
+ * and debug entries.
+ */
+static void reencode(Peephole* peephole, CodeGenerator* gen) {
+  Arena* scratch = arena_scratch(peephole->arena);
+  size_t start = peephole->function_start;
+  size_t old_size = gen->buffer->size - start;
+  
+  // Operand data is read from a copy of the original bytes
+  uint8_t* old_code = arena_alloc(scratch, old_size);
+  memcpy(old_code, gen->buffer->data + start, old_size);
+  gen->buffer->size = start;
+  
+  for (int i = 0; i < peephole->count; i++) {
+    PeepholeInstr* instr = &peephole->instrs[i];
+    instr->new_offset = (uint32_t)gen->buffer->size;
+    if (instr->deleted) continue;
+    
+    uint8_t header[3] = { instr->opcode, instr->qualifier, instr->operand_count };
+    coil_buffer_write(gen->buffer, header, sizeof(header));
+    
+    for (int k = 0; k < instr->operand_count; k++) {
+      PeepholeOperand* operand = operand_at(peephole, instr, k);
+      uint8_t operand_header[2] = { operand->qualifier, operand->type };
+      coil_buffer_write(gen->buffer, operand_header, sizeof(operand_header));
+      
+      const uint8_t* data = old_code + (operand->data_offset - start);
+      operand->data_offset = (uint32_t)gen->buffer->size;
+      if (operand->fixup >= 0) {
+        gen->fixups[operand->fixup].offset = gen->buffer->size;
+      }
+      coil_buffer_write(gen->buffer, data, operand->size);
+    }
+  }
+  size_t new_end = gen->buffer->size;
+  
+  int label_count = gen->label_counter - gen->label_base;
+  for (int i = 0; i < label_count; i++) {
+    if (gen->label_offsets[i] != CODEGEN_LABEL_UNBOUND) {
+      gen->label_offsets[i] = remap_offset(peephole, gen, gen->label_offsets[i], new_end);
+    }
+  }
+  
+  // Entries inside the function move with their statement; one per offset survives
+  uint32_t function_offset = codegen_code_offset(gen, start);
+  int kept = 0;
+  for (int i = 0; i < gen->debug_count; i++) {
+    DebugEntry entry = gen->debug_entries[i];
+    if (entry.code_offset >= function_offset) {
+      entry.code_offset = remap_offset(peephole, gen, entry.code_offset, new_end);
+    }
+    if (kept > 0 && gen->debug_entries[kept - 1].code_offset == entry.code_offset) {
+      kept--;
+    }
+    gen->debug_entries[kept++] = entry;
+  }
+  gen->debug_count = kept;
+}
+
+void peephole_run(Peephole* peephole, CodeGenerator* gen) {
+  if (!peephole->active) return;
+  peephole->active = false;
+  if (!peephole->optimize || gen->has_error || gen->buffer->has_error || peephole->count == 0) return;
+  
+  mark_labels(peephole, gen);
+  
+  // Rewrites can expose more (an empty scope inside an empty scope), so repeat until stable
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    
+    for (int i = 0; i < peephole->count; i++) {
+      PeepholeInstr* instr = &peephole->instrs[i];
+      if (instr->deleted) continue;
+      
+      switch (instr->opcode) {
+        case OP_VARSC:
+          if (match_empty_scope(peephole, gen, i)) {
+            peephole->hits[PEEPHOLE_EMPTY_SCOPE]++;
+            changed = true;
+          }
+          break;
+          
+        case OP_BR:
+        case OP_BRC:
+          if (match_branch_to_next(peephole, gen, i)) {
+            peephole->hits[PEEPHOLE_BRANCH_TO_NEXT]++;
+            changed = true;
+          }
+          break;
+          
+        case OP_VARSET:
+          if (match_varget_after_varset(peephole, gen, i)) {
+            peephole->hits[PEEPHOLE_VARGET_AFTER_VARSET]++;
+            changed = true;
+          }
+          break;
+          
+        default:
+          break;
+      }
+    }
+    
+    int removed = remove_repeated_movi(peephole, gen);
+    if (removed > 0) {
+      peephole->hits[PEEPHOLE_REPEATED_MOVI] += removed;
+      changed = true;
+    }
+  }
+  
+  reencode(peephole, gen);
+}
@@ -0,0 +1,222 @@
+/**
+ * @file profile.c
+ * @brief Execution profiles for profile-guided optimization
+ */
+
+#include "../include/profile.h"
+#include "../include/fcache.h"
+#include "../include/intern.h"
+#include "../include/arena.h"
+#include <stdio.h>
+#include <string.h>
+
+#define PROFILE_BUCKET_COUNT 256
+#define PROFILE_MAX_INDEX (1 << 20) // Larger counter indexes are taken as garbage
+
+static Profile* profile_new(bool generate, struct InternPool* strings, Arena* arena) {
+  Profile* profile = arena_alloc(arena, sizeof(Profile));
+  if (!profile) return NULL;
+  
+  profile->generate = generate;
+  profile->bucket_count = PROFILE_BUCKET_COUNT;
+  profile->buckets = arena_calloc(arena, sizeof(ProfileFunction*) * PROFILE_BUCKET_COUNT);
+  profile->max_entry = 0;
+  profile->hash = FCACHE_HASH_SEED;
+  profile->strings = strings;
+  profile->arena = arena;
+  return profile->buckets ? profile : NULL;
+}
+
+Profile* profile_create(struct InternPool* strings, Arena* arena) {
+  return profile_new(true, strings, arena);
+}
+
+// Entry of an interned function name, added if create is set
+static ProfileFunction* profile_function(Profile* profile, const char* name, bool create) {
+  unsigned index = intern_hash(name) & (unsigned)(profile->bucket_count - 1);
+  for (ProfileFunction* function = profile->buckets[index]; function; function = function->next) {
+    if (function->name == name) return function;
+  }
+  if (!create) return NULL;
+  
+  ProfileFunction* function = arena_calloc(profile->arena, sizeof(ProfileFunction));
+  if (!function) return NULL;
+  function->name = name;
+  function->next = profile->buckets[index];
+  profile->buckets[index] = function;
+  return function;
+}
+
+// Add one "__profile.<function>.<index> <count>" line; anything else is skipped
+static void profile_read_line(Profile* profile, const char* line, const char* end) {
+  size_t prefix_length = strlen(PROFILE_PREFIX);
+  if ((size_t)(end - line) <= prefix_length || memcmp(line, PROFILE_PREFIX, prefix_length) != 0) {
+    return;
+  }
+  
+  const char* name = line + prefix_length;
+  const char* dot = name;
+  while (dot < end && *dot != '.' && *dot != ' ' && *dot != '\t') dot++;
+  if (dot == name || dot == end || *dot != '.') return;
+  
+  const char* p = dot + 1;
+  long index = 0;
+  if (p == end || *p < '0' || *p > '9') return;
+  while (p < end && *p >= '0' && *p <= '9') {
+    index = index * 10 + (*p++ - '0');
+    if (index >= PROFILE_MAX_INDEX) return;
+  }
+  
+  if (p == end || (*p != ' ' && *p != '\t')) return;
+  while (p < end && (*p == ' ' || *p == '\t')) p++;
+  if (p == end || *p < '0' || *p > '9') return;
+  uint64_t count = 0;
+  while (p < end && *p >= '0' && *p <= '9') {
+    count = count * 10 + (uint64_t)(*p++ - '0');
+  }
+  
+  const char* interned = intern_string(profile->strings, name, (size_t)(dot - name));
+  ProfileFunction* function = interned ? profile_function(profile, interned, true) : NULL;
+  if (!function) return;
+  
+  while (function->capacity <= index) {
+    int old_capacity = function->capacity;
+    function->counts = arena_grow_array(profile->arena, function->counts, &function->capacity,
+                                        sizeof(uint64_t));
+    if (!function->counts) {
+      function->capacity = 0;
+      function->count = 0;
+      return;
+    }
+    memset(function->counts + old_capacity, 0,
+           sizeof(uint64_t) * (size_t)(function->capacity - old_capacity));
+  }
+  
+  function->counts[index] += count;
+  if (function->count <= index) function->count = (int)index + 1;
+  if (index == 0 && function->counts[0] > profile->max_entry) {
+    profile->max_entry = function->counts[0];
+  }
+}
+
+Profile* profile_load(const char* path, struct InternPool* strings, Arena* arena) {
+  FILE* file = fopen(path, "rb");
+  if (!file) return NULL;
+  
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  if (size < 0) {
+    fclose(file);
+    return NULL;
+  }
+  
+  // Only needed while reading
+  Arena* scratch = arena_scratch(arena);
+  ArenaMark mark = arena_mark(scratch);
+  char* data = arena_alloc(scratch, (size_t)size + 1);
+  size_t bytes_read = data ? fread(data, 1, (size_t)size, file) : 0;
+  fclose(file);
+  
+  Profile* profile = data && bytes_read == (size_t)size ? profile_new(false, strings, arena) : NULL;
+  if (profile) {
+    profile->hash = fcache_hash(FCACHE_HASH_SEED, data, bytes_read);
+    
+    const char* end = data + bytes_read;
+    for (const char* line = data; line < end;) {
+      const char* line_end = memchr(line, '\n', (size_t)(end - line));
+      if (!line_end) line_end = end;
+      
+      const char* trimmed = line_end;
+      if (trimmed > line && trimmed[-1] == '\r') trimmed--;
+      profile_read_line(profile, line, trimmed);
+      line = line_end + 1;
+    }
+  }
+  
+  arena_rewind(scratch, mark);
+  return profile;
+}
+
+// Number the counters of stmt and what it contains from *next on
+static void number_counters(Program* program, StmtRef ref, int* next) {
+  Stmt* stmt = ast_stmt(program, ref);
+  if (!stmt) return;
+  
+  switch (stmt->type) {
+    case STMT_BLOCK:
+      for (int i = 0; i < stmt->as.block.count; i++) {
+        number_counters(program, stmt->as.block.statements[i], next);
+      }
+      break;
+    
+    case STMT_IF:
+      stmt->as.if_stmt.profile_counter = *next;
+      *next += 2;
+      number_counters(program, stmt->as.if_stmt.then_branch, next);
+      number_counters(program, stmt->as.if_stmt.else_branch, next);
+      break;
+    
+    case STMT_WHILE:
+      stmt->as.while_stmt.profile_counter = *next;
+      *next += 1;
+      number_counters(program, stmt->as.while_stmt.body, next);
+      break;
+    
+    default:
+      break;
+  }
+}
+
+void profile_number_counters(Program* program, Decl* decl) {
+  if (!decl || decl->type != DECL_FUNC || !decl->as.func.body) return;
+  
+  int next = 1; // Counter 0 is the entry
+  number_counters(program, decl->as.func.body, &next);
+  decl->as.func.profile_counters = next;
+}
+
+int profile_counter_count(Decl* decl) {
+  if (!decl || decl->type != DECL_FUNC || !decl->as.func.body) return 0;
+  return decl->as.func.profile_counters;
+}
+
+const char** profile_counter_names(Profile* profile, Decl* decl) {
+  ProfileFunction* function = profile_function(profile, decl->name, true);
+  if (!function) return NULL;
+  if (function->names) return function->names;
+  
+  int count = profile_counter_count(decl);
+  const char** names = arena_alloc(profile->arena, sizeof(const char*) * (count + 1));
+  if (!names) return NULL;
+  
+  // Room for the prefix, the function name, the dot and any index
+  size_t size = strlen(PROFILE_PREFIX) + intern_length(decl->name) + 16;
+  Arena* scratch = arena_scratch(profile->arena);
+  ArenaMark mark = arena_mark(scratch);
+  char* name = arena_alloc(scratch, size);
+  if (!name) return NULL;
+  
+  for (int i = 0; i < count && names; i++) {
+    int length = snprintf(name, size, PROFILE_PREFIX "%s.%d", decl->name, i);
+    names[i] = intern_string(profile->strings, name, (size_t)length);
+    if (!names[i]) names = NULL;
+  }
+  arena_rewind(scratch, mark);
+  if (!names) return NULL;
+  
+  function->names = names;
+  return names;
+}
+
+const uint64_t* profile_counts(Profile* profile, Decl* decl) {
+  ProfileFunction* function = profile_function(profile, decl->name, false);
+  if (!function || function->count == 0) return NULL;
+  
+  // A different length means the function changed since it was profiled
+  return function->count == profile_counter_count(decl) ? function->counts : NULL;
+}
+
+bool profile_is_hot(Profile* profile, uint64_t entry) {
+  return entry > 0 && entry >= profile->max_entry / PROFILE_HOT_SHARE;
+}
@@ -0,0 +1,467 @@
+/**
+ * @file stats.c
+ * @brief Per-phase timing and memory statistics for a compilation
+ */
+
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+
+#include "../include/stats.h"
+#include "../include/arena.h"
+#include "../include/intern.h"
+#include "../include/codegen.h"
+#include <string.h>
+#include <time.h>
+
+static const char* phase_names[PHASE_COUNT] = { "lex", "parse", "fold", "codegen" };
+
+static const char* expr_names[EXPR_CAST + 1] = {
+  "binary", "unary", "integer_literal", "float_literal", "string_literal", "char_literal",
+  "identifier", "call", "index", "field", "assign", "conditional", "sizeof", "cast"
+};
+
+static const char* stmt_names[STMT_DECL + 1] = {
+  "expr", "block", "if", "switch", "while", "do_while", "for", "goto", "continue", "break",
+  "return", "label", "decl"
+};
+
+static const char* type_names[TYPE_ENUM + 1] = {
+  "void", "bool", "char", "short", "int", "long", "float", "double", "pointer", "array",
+  "struct", "union", "function", "enum"
+};
+
+static const char* decl_names[DECL_TYPEDEF + 1] = {
+  "var", "func", "struct", "union", "enum", "typedef"
+};
+
+static const char* opcode_name(int opcode) {
+  switch (opcode) {
+    case OP_SYMB:   return "SYMB";
+    case OP_BR:     return "BR";
+    case OP_BRC:    return "BRC";
+    case OP_CALL:   return "CALL";
+    case OP_RET:    return "RET";
+    case OP_ADD:    return "ADD";
+    case OP_SUB:    return "SUB";
+    case OP_MUL:    return "MUL";
+    case OP_DIV:    return "DIV";
+    case OP_MOD:    return "MOD";
+    case OP_NEG:    return "NEG";
+    case OP_INC:    return "INC";
+    case OP_DEC:    return "DEC";
+    case OP_AND:    return "AND";
+    case OP_OR:     return "OR";
+    case OP_XOR:    return "XOR";
+    case OP_NOT:    return "NOT";
+    case OP_SHL:    return "SHL";
+    case OP_SHR:    return "SHR";
+    case OP_SAR:    return "SAR";
+    case OP_CMP:    return "CMP";
+    case OP_MOV:    return "MOV";
+    case OP_LOAD:   return "LOAD";
+    case OP_STORE:  return "STORE";
+    case OP_MOVI:   return "MOVI";
+    case OP_VARCR:  return "VARCR";
+    case OP_VARDL:  return "VARDL";
+    case OP_VARSC:  return "VARSC";
+    case OP_VAREND: return "VAREND";
+    case OP_VARGET: return "VARGET";
+    case OP_VARSET: return "VARSET";
+    case OP_VARREF: return "VARREF";
+    case OP_FTOI:   return "FTOI";
+    case OP_ITOF:   return "ITOF";
+    case OP_ENTER:  return "ENTER";
+    case OP_LEAVE:  return "LEAVE";
+    case OP_PARAM:  return "PARAM";
+    case OP_RESULT: return "RESULT";
+    default:        return NULL;
+  }
+}
+
+static double clock_seconds(clockid_t clock) {
+  struct timespec now;
+  clock_gettime(clock, &now);
+  return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+static double wall_time(void) {
+  return clock_seconds(CLOCK_MONOTONIC);
+}
+
+// CPU time of the calling thread, so parallel compilations are measured separately
+static double cpu_time(void) {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+  return clock_seconds(CLOCK_THREAD_CPUTIME_ID);
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+void stats_init(CompilerStats* stats) {
+  memset(stats, 0, sizeof(CompilerStats));
+}
+
+void stats_phase_begin(CompilerStats* stats, Arena* arena) {
+  arena_stats(arena, &stats->allocated_start, &stats->used_start);
+  stats->cpu_start = cpu_time();
+  stats->wall_start = wall_time();
+}
+
+void stats_phase_end(CompilerStats* stats, CompilerPhase phase, Arena* arena) {
+  double wall = wall_time();
+  double cpu = cpu_time();
+  size_t allocated = 0;
+  size_t used = 0;
+  arena_stats(arena, &allocated, &used);
+  
+  PhaseStats* entry = &stats->phases[phase];
+  entry->wall_seconds += wall - stats->wall_start;
+  entry->cpu_seconds += cpu - stats->cpu_start;
+  entry->arena_allocated += allocated > stats->allocated_start ? allocated - stats->allocated_start : 0;
+  entry->arena_used += used > stats->used_start ? used - stats->used_start : 0;
+}
+
+/* AST node counts */
+
+static void count_expr(CompilerStats* stats, Program* program, ExprRef ref);
+static void count_stmt(CompilerStats* stats, Program* program, StmtRef ref);
+
+static void count_type(CompilerStats* stats, Type* type) {
+  while (type) {
+    stats->type_counts[type->kind]++;
+    
+    switch (type->kind) {
+      case TYPE_POINTER:
+        type = type->as.pointer.element_type;
+        break;
+        
+      case TYPE_ARRAY:
+        type = type->as.array.element_type;
+        break;
+        
+      case TYPE_FUNCTION:
+        for (int i = 0; i < type->as.function.param_count; i++) {
+          count_type(stats, type->as.function.param_types[i]);
+        }
+        type = type->as.function.return_type;
+        break;
+        
+      default:
+        type = NULL;
+        break;
+    }
+  }
+}
+
+static void count_expr(CompilerStats* stats, Program* program, ExprRef ref) {
+  Expr* expr = ast_expr(program, ref);
+  if (!expr) return;
+  stats->expr_counts[expr->type]++;
+  
+  switch (expr->type) {
+    case EXPR_BINARY:
+      count_expr(stats, program, expr->as.binary.left);
+      count_expr(stats, program, expr->as.binary.right);
+      break;
+      
+    case EXPR_UNARY:
+      count_expr(stats, program, expr->as.unary.operand);
+      break;
+      
+    case EXPR_CALL:
+      count_expr(stats, program, expr->as.call.function);
+      for (int i = 0; i < expr->as.call.arg_count; i++) {
+        count_expr(stats, program, expr->as.call.arguments[i]);
+      }
+      break;
+      
+    case EXPR_INDEX:
+      count_expr(stats, program, expr->as.index.array);
+      count_expr(stats, program, expr->as.index.index);
+      break;
+      
+    case EXPR_FIELD:
+      count_expr(stats, program, expr->as.field.object);
+      break;
+      
+    case EXPR_ASSIGN:
+      count_expr(stats, program, expr->as.assign.target);
+      count_expr(stats, program, expr->as.assign.value);
+      break;
+      
+    case EXPR_CONDITIONAL:
+      count_expr(stats, program, expr->as.conditional.condition);
+      count_expr(stats, program, expr->as.conditional.true_expr);
+      count_expr(stats, program, expr->as.conditional.false_expr);
+      break;
+      
+    case EXPR_SIZEOF:
+      count_type(stats, expr->as.size_of.type);
+      break;
+      
+    case EXPR_CAST:
+      count_type(stats, expr->as.cast.type);
+      count_expr(stats, program, expr->as.cast.expr);
+      break;
+      
+    default:
+      break;
+  }
+}
+
+static void count_decl(CompilerStats* stats, Program* program, Decl* decl) {
+  if (!decl) return;
+  stats->decl_counts[decl->type]++;
+  count_type(stats, decl->declared_type);
+  
+  if (decl->type == DECL_VAR) {
+    count_expr(stats, program, decl->as.var.initializer);
+  } else if (decl->type == DECL_FUNC) {
+    count_stmt(stats, program, decl->as.func.body);
+  }
+}
+
+static void count_stmt(CompilerStats* stats, Program* program, StmtRef ref) {
+  Stmt* stmt = ast_stmt(program, ref);
+  if (!stmt) return;
+  stats->stmt_counts[stmt->type]++;
+  
+  switch (stmt->type) {
+    case STMT_EXPR:
+      count_expr(stats, program, stmt->as.expr.expr);
+      break;
+      
+    case STMT_BLOCK:
+      for (int i = 0; i < stmt->as.block.count; i++) {
+        count_stmt(stats, program, stmt->as.block.statements[i]);
+      }
+      break;
+      
+    case STMT_IF:
+      count_expr(stats, program, stmt->as.if_stmt.condition);
+      count_stmt(stats, program, stmt->as.if_stmt.then_branch);
+      count_stmt(stats, program, stmt->as.if_stmt.else_branch);
+      break;
+      
+    case STMT_SWITCH:
+      count_expr(stats, program, stmt->as.switch_stmt.condition);
+      for (int i = 0; i < stmt->as.switch_stmt.case_count; i++) {
+        count_stmt(stats, program, stmt->as.switch_stmt.cases[i]);
+      }
+      count_stmt(stats, program, stmt->as.switch_stmt.default_case);
+      break;
+      
+    case STMT_WHILE:
+      count_expr(stats, program, stmt->as.while_stmt.condition);
+      count_stmt(stats, program, stmt->as.while_stmt.body);
+      break;
+      
+    case STMT_DO_WHILE:
+      count_stmt(stats, program, stmt->as.do_while_stmt.body);
+      count_expr(stats, program, stmt->as.do_while_stmt.condition);
+      break;
+      
+    case STMT_FOR:
+      count_stmt(stats, program, stmt->as.for_stmt.init);
+      count_expr(stats, program, stmt->as.for_stmt.condition);
+      count_expr(stats, program, stmt->as.for_stmt.update);
+      count_stmt(stats, program, stmt->as.for_stmt.body);
+      break;
+      
+    case STMT_LABEL:
+      count_stmt(stats, program, stmt->as.label_stmt.statement);
+      break;
+      
+    case STMT_RETURN:
+      count_expr(stats, program, stmt->as.return_stmt.value);
+      break;
+      
+    case STMT_DECL:
+      count_decl(stats, program, stmt->as.decl_stmt.decl);
+      break;
+      
+    default:
+      break;
+  }
+}
+
+void stats_count_ast(CompilerStats* stats, Program* program) {
+  for (int i = 0; i < program->count; i++) {
+    count_decl(stats, program, program->declarations[i]);
+  }
+}
+
+void stats_count_declaration(CompilerStats* stats, Program* program, Decl* decl) {
+  count_decl(stats, program, decl);
+}
+
+/* Hash chain histograms */
+
+static void chain_histogram_add(int* histogram, int length) {
+  histogram[length < STATS_CHAIN_BUCKETS - 1 ? length : STATS_CHAIN_BUCKETS - 1]++;
+}
+
+void stats_count_chains(CompilerStats* stats, SymbolTable* symbols, InternPool* strings) {
+  if (symbols) {
+    for (int i = 0; i < symbols->bucket_count; i++) {
+      int length = 0;
+      for (SymbolEntry* entry = symbols->buckets[i]; entry; entry = entry->next) {
+        length++;
+      }
+      chain_histogram_add(stats->symbol_chains, length);
+    }
+  }
+  
+  if (strings) {
+    for (int i = 0; i < strings->bucket_count; i++) {
+      int length = 0;
+      for (InternEntry* entry = strings->buckets[i]; entry; entry = entry->next) {
+        length++;
+      }
+      chain_histogram_add(stats->intern_chains, length);
+    }
+  }
+}
+
+/* Reports */
+
+static void print_histogram(FILE* output, const char* label, const int* histogram) {
+  fprintf(output, "  %-16s", label);
+  for (int i = 0; i < STATS_CHAIN_BUCKETS; i++) {
+    fprintf(output, " %s%d:%d", i == STATS_CHAIN_BUCKETS - 1 ? ">=" : "", i, histogram[i]);
+  }
+  fprintf(output, "\n");
+}
+
+static void print_counts(FILE* output, const char* label, const int* counts, const char** names,
+                         int count) {
+  fprintf(output, "  %s:", label);
+  for (int i = 0; i < count; i++) {
+    if (counts[i] > 0) {
+      fprintf(output, " %s=%d", names[i], counts[i]);
+    }
+  }
+  fprintf(output, "\n");
+}
+
+void stats_print(FILE* output, const CompilerStats* stats, const char* source_name) {
+  PhaseStats total;
+  memset(&total, 0, sizeof(total));
+  
+  flockfile(output); // One report per compilation, even on several threads
+  fprintf(output, "Statistics for '%s':\n", source_name);
+  fprintf(output, "  %-10s %12s %12s %14s %14s\n", "phase", "wall (ms)", "cpu (ms)", "allocated", "used");
+  for (int i = 0; i < PHASE_COUNT; i++) {
+    const PhaseStats* phase = &stats->phases[i];
+    fprintf(output, "  %-10s %12.3f %12.3f %14zu %14zu\n", phase_names[i],
+            phase->wall_seconds * 1000.0, phase->cpu_seconds * 1000.0,
+            phase->arena_allocated, phase->arena_used);
+    total.wall_seconds += phase->wall_seconds;
+    total.cpu_seconds += phase->cpu_seconds;
+    total.arena_allocated += phase->arena_allocated;
+    total.arena_used += phase->arena_used;
+  }
+  fprintf(output, "  %-10s %12.3f %12.3f %14zu %14zu\n", "total", total.wall_seconds * 1000.0,
+          total.cpu_seconds * 1000.0, total.arena_allocated, total.arena_used);
+          
+  fprintf(output, "  tokens: %d\n", stats->token_count);
+  print_counts(output, "expressions", stats->expr_counts, expr_names, EXPR_CAST + 1);
+  print_counts(output, "statements", stats->stmt_counts, stmt_names, STMT_DECL + 1);
+  print_counts(output, "types", stats->type_counts, type_names, TYPE_ENUM + 1);
+  print_counts(output, "declarations", stats->decl_counts, decl_names, DECL_TYPEDEF + 1);
+  
+  fprintf(output, "  hash chain lengths (length:buckets):\n");
+  print_histogram(output, "symbols", stats->symbol_chains);
+  print_histogram(output, "identifiers", stats->intern_chains);
+  
+  uint32_t instructions = 0;
+  fprintf(output, "  instructions:");
+  for (int i = 0; i < STATS_OPCODE_COUNT; i++) {
+    if (stats->opcode_counts[i] == 0) continue;
+    const char* name = opcode_name(i);
+    if (name) {
+      fprintf(output, " %s=%u", name, (unsigned)stats->opcode_counts[i]);
+    } else {
+      fprintf(output, " 0x%02X=%u", i, (unsigned)stats->opcode_counts[i]);
+    }
+    instructions += stats->opcode_counts[i];
+  }
+  fprintf(output, "\n  total instructions: %u\n", (unsigned)instructions);
+  funlockfile(output);
+}
+
+static void print_json_string(FILE* output, const char* str) {
+  fputc('"', output);
+  for (const unsigned char* c = (const unsigned char*)str; *c; c++) {
+    if (*c == '"' || *c == '\\') {
+      fprintf(output, "\\%c", *c);
+    } else if (*c < 0x20) {
+      fprintf(output, "\\u%04x", *c);
+    } else {
+      fputc(*c, output);
+    }
+  }
+  fputc('"', output);
+}
+
+static void print_json_counts(FILE* output, const char* key, const int* counts, const char** names,
+                              int count) {
+  fprintf(output, "\"%s\":{", key);
+  bool first = true;
+  for (int i = 0; i < count; i++) {
+    if (counts[i] == 0) continue;
+    fprintf(output, "%s\"%s\":%d", first ? "" : ",", names[i], counts[i]);
+    first = false;
+  }
+  fprintf(output, "}");
+}
+
+static void print_json_histogram(FILE* output, const char* key, const int* histogram) {
+  fprintf(output, "\"%s\":[", key);
+  for (int i = 0; i < STATS_CHAIN_BUCKETS; i++) {
+    fprintf(output, "%s%d", i ? "," : "", histogram[i]);
+  }
+  fprintf(output, "]");
+}
+
+void stats_print_json(FILE* output, const CompilerStats* stats, const char* source_name) {
+  flockfile(output);
+  fprintf(output, "{\"source\":");
+  print_json_string(output, source_name);
+  
+  fprintf(output, ",\"phases\":{");
+  for (int i = 0; i < PHASE_COUNT; i++) {
+    const PhaseStats* phase = &stats->phases[i];
+    fprintf(output, "%s\"%s\":{\"wall_seconds\":%.9f,\"cpu_seconds\":%.9f,"
+            "\"arena_allocated\":%zu,\"arena_used\":%zu}",
+            i ? "," : "", phase_names[i], phase->wall_seconds, phase->cpu_seconds,
+            phase->arena_allocated, phase->arena_used);
+  }
+  fprintf(output, "},\"tokens\":%d,\"ast\":{", stats->token_count);
+  print_json_counts(output, "expressions", stats->expr_counts, expr_names, EXPR_CAST + 1);
+  fprintf(output, ",");
+  print_json_counts(output, "statements", stats->stmt_counts, stmt_names, STMT_DECL + 1);
+  fprintf(output, ",");
+  print_json_counts(output, "types", stats->type_counts, type_names, TYPE_ENUM + 1);
+  fprintf(output, ",");
+  print_json_counts(output, "declarations", stats->decl_counts, decl_names, DECL_TYPEDEF + 1);
+  
+  fprintf(output, "},\"hash_chains\":{");
+  print_json_histogram(output, "symbols", stats->symbol_chains);
+  fprintf(output, ",");
+  print_json_histogram(output, "identifiers", stats->intern_chains);
+  
+  fprintf(output, "},\"instructions\":{");
+  bool first = true;
+  for (int i = 0; i < STATS_OPCODE_COUNT; i++) {
+    if (stats->opcode_counts[i] == 0) continue;
+    const char* name = opcode_name(i);
+    if (name) {
+      fprintf(output, "%s\"%s\":%u", first ? "" : ",", name, (unsigned)stats->opcode_counts[i]);
+    } else {
+      fprintf(output, "%s\"0x%02X\":%u", first ? "" : ",", i, (unsigned)stats->opcode_counts[i]);
+    }
+    first = false;
+  }
+  fprintf(output, "}}\n");
+  funlockfile(output);
+}
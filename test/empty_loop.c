@@ -0,0 +1,23 @@
+/**
+ * While loops whose body constant folding removes entirely
+ */
+
+// The if folds away, leaving the loop without a body
+int spin(int x) {
+  while (x) if (0) x = 1;
+  return x;
+}
+
+// A block whose only statement folds away
+int drain(int x) {
+  while (x > 0) {
+    if (0) {
+      x = 2;
+    }
+  }
+  return x;
+}
+
+int main() {
+  return spin(0) + drain(0);
+}
@@ -0,0 +1,18 @@
+/**
+ * Inlined calls whose arguments do not have the parameter types
+ */
+
+double half(double x) {
+  return x / 2;
+}
+
+char low(char c) {
+  return c;
+}
+
+// Each inlined argument is moved into a variable of the parameter type:
+// three VARCRs in main with h, and one for the parameter of each callee
+int main() {
+  double h = half(3);
+  return low(300);
+}
@@ -0,0 +1,21 @@
+/**
+ * Loop-invariant values and a strength-reduced product, each used twice
+ */
+
+// At -O1 there are four MULs. At -O2 n * k is computed once before the
+// loop and i * 4 once for its initial value, then kept up to date by one
+// ADD after i = i + 1: two MULs and four ADDs
+int sum(int n, int k) {
+  int i = 0;
+  int s = 0;
+  while (i < n) {
+    s = s + i * 4 + n * k;
+    s = s - i * 4 - n * k;
+    i = i + 1;
+  }
+  return s;
+}
+
+int main() {
+  return sum(10, 3);
+}
@@ -0,0 +1,20 @@
+/**
+ * Profile-guided layout, with the counts in test/profile.prof
+ */
+
+// Three counters: the entry and both edges of the if. The profile shows
+// the else edge taken more often, so it becomes the fall-through and the
+// code matches test/profile_inverted.c
+int pick(int x) {
+  int r = 0;
+  if (x > 10) {
+    r = 1;
+  } else {
+    r = 2;
+  }
+  return r;
+}
+
+int main() {
+  return pick(3);
+}
@@ -0,0 +1,17 @@
+/**
+ * test/profile.c with the if/else inverted by hand
+ */
+
+int pick(int x) {
+  int r = 0;
+  if (!(x > 10)) {
+    r = 2;
+  } else {
+    r = 1;
+  }
+  return r;
+}
+
+int main() {
+  return pick(3);
+}
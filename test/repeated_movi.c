@@ -0,0 +1,17 @@
+/**
+ * Temporaries recycled under different types between equal constants
+ */
+
+// The string literal reuses the temporary that held the first 0, so
+// the second 0 must be loaded again: three MOVIs here, and three more
+// where main inlines it
+int reload() {
+  int a = 0;
+  char* s = "x";
+  int b = 0;
+  return a + b;
+}
+
+int main() {
+  return reload();
+}
@@ -0,0 +1,14 @@
+/**
+ * Compound shift assignments
+ */
+
+int shift(int a, int b) {
+  a <<= 1;
+  b >>= 2;
+  a <<= b >>= 1;
+  return a + b;
+}
+
+int main() {
+  return shift(3, 8);
+}
@@ -0,0 +1,22 @@
+/**
+ * Logical operators used as values, which must evaluate each operand once
+ */
+
+int f(int p) {
+  return p;
+}
+
+int g(int p) {
+  return p + 1;
+}
+
+// Two calls per operator: f always, g only when f does not decide
+int both(int p) {
+  int x = f(p) && g(p);
+  int y = f(p) || g(p);
+  return x + y;
+}
+
+int main() {
+  return both(0);
+}
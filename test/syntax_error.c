@@ -0,0 +1,11 @@
+/**
+ * A declaration that does not parse, after one that does
+ */
+
+int ok() {
+  return 0;
+}
+
+int broken( {
+  return 1;
+}